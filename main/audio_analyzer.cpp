@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "audio_analyzer.hpp"
+
+#include <math.h>
+#include <string.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+// 間引き後のサンプリングレートの目安 (表示する帯域の上限はこの半分)
+static constexpr const uint32_t decimated_rate_target = 12000;
+// メータの更新間隔 (BS.1770 のゲーティングブロックの間隔と同じ 100msec)
+static constexpr const uint32_t meter_period_msec = 100;
+static constexpr const size_t rms_blocks = 3;         // RMS 300msec
+static constexpr const size_t momentary_blocks = 4;   // 瞬時ラウドネス 400msec
+static constexpr const size_t short_term_blocks = 30; // 短時間ラウドネス 3秒
+
+// フルスケール (Q23) の二乗と、FFT出力 (段毎に1/2、ハン窓の係数 0.5) でのフルスケールの正弦波の二乗の log2
+static constexpr const int full_scale_log2 = 46;
+static constexpr const int fft_full_scale_log2 = 42;
+
+// FFTの回転因子 (Q30) とハン窓 (Q15)
+static int32_t fft_cos[audio_analyzer_t::fft_size / 2];
+static int32_t fft_sin[audio_analyzer_t::fft_size / 2];
+static int16_t fft_window[audio_analyzer_t::fft_size];
+
+// log2(x) を Q16 で求める (x > 0)。仮数部は 2次の補正付き直線近似
+static inline int32_t log2_q16(uint64_t x)
+{
+  int n = 63 - __builtin_clzll(x);
+  uint32_t f = (n >= 16) ? (uint32_t)(x >> (n - 16)) : (uint32_t)(x << (16 - n));
+  f &= 0xFFFF;
+  f += (uint32_t)((((uint64_t)f * (65536 - f)) >> 16) * 22486 >> 16);
+  return (n << 16) + (int32_t)f;
+}
+
+// 二乗値を dB×10 に変換する (ref_log2 を 0dB とする)
+static int16_t power_db10(uint64_t power, int ref_log2)
+{
+  if (power == 0) { return audio_analyzer_t::level_min_db10; }
+  int32_t db10 = (int32_t)((int64_t)(log2_q16(power) - (ref_log2 << 16)) * 30103 / (65536 * 1000));
+  return db10 < audio_analyzer_t::level_min_db10 ? audio_analyzer_t::level_min_db10 : db10;
+}
+
+//-------------------------------------------------------------------------
+
+void audio_analyzer_t::kfilter_t::design(double b0_, double b1_, double b2_, double a1_, double a2_)
+{
+  b0 = (int32_t)lround(b0_ * (1 << 28));
+  b1 = (int32_t)lround(b1_ * (1 << 28));
+  b2 = (int32_t)lround(b2_ * (1 << 28));
+  a1 = (int32_t)lround(a1_ * (1 << 28));
+  a2 = (int32_t)lround(a2_ * (1 << 28));
+  clear();
+}
+
+void audio_analyzer_t::kfilter_t::clear(void)
+{
+  for (int ch = 0; ch < 2; ++ch) {
+    x1[ch] = x2[ch] = y1[ch] = y2[ch] = err[ch] = 0;
+  }
+}
+
+inline int32_t audio_analyzer_t::kfilter_t::process(int ch, int32_t x)
+{
+  // ハイパスの極は 1 に近く丸め誤差が大きく増幅されるため、切り捨てた端数を次のサンプルへ持ち越す
+  int64_t acc = (int64_t)b0 * x + (int64_t)b1 * x1[ch] + (int64_t)b2 * x2[ch]
+              - (int64_t)a1 * y1[ch] - (int64_t)a2 * y2[ch] + err[ch];
+  int32_t y = (int32_t)(acc >> 28);
+  err[ch] = (int32_t)(acc & ((1 << 28) - 1));
+  x2[ch] = x1[ch];
+  x1[ch] = x;
+  y2[ch] = y1[ch];
+  y1[ch] = y;
+  return y;
+}
+
+void audio_analyzer_t::setup(uint32_t sample_rate)
+{
+  if (_sample_rate == sample_rate || sample_rate == 0) { return; }
+  _sample_rate = sample_rate;
+  _decimate = (sample_rate + decimated_rate_target / 2) / decimated_rate_target;
+  if (_decimate == 0) { _decimate = 1; }
+  _meter_period = sample_rate * meter_period_msec / 1000;
+
+  for (size_t i = 0; i < fft_size / 2; ++i) {
+    double t = 2.0 * M_PI * i / fft_size;
+    fft_cos[i] = (int32_t)lround(cos(t) * (1 << 30));
+    fft_sin[i] = (int32_t)lround(sin(t) * (1 << 30));
+  }
+  for (size_t i = 0; i < fft_size; ++i) {
+    fft_window[i] = (int16_t)lround(32767.0 * 0.5 * (1.0 - cos(2.0 * M_PI * i / fft_size)));
+  }
+
+  // 帯域の境界 (FFTの bin番号)。低域は bin 1つずつ、それ以降は対数間隔とする
+  _band_edge[0] = 1;
+  for (size_t b = 1; b <= band_count; ++b) {
+    int edge = (int)lround(pow(fft_size / 2 + 1, (double)b / band_count));
+    if (edge <= _band_edge[b - 1]) { edge = _band_edge[b - 1] + 1; }
+    if (edge > (int)(fft_size / 2 + 1)) { edge = fft_size / 2 + 1; }
+    _band_edge[b] = edge;
+  }
+
+  // BS.1770 の K特性 (ハイシェルフ + ハイパス) を任意のサンプリングレート向けに求める
+  {
+    double K = tan(M_PI * 1681.974450955533 / sample_rate);
+    double Q = 0.7071752369554196;
+    double Vh = pow(10.0, 3.999843853973347 / 20.0);
+    double Vb = pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    _kfilter[0].design((Vh + Vb * K / Q + K * K) / a0, 2.0 * (K * K - Vh) / a0, (Vh - Vb * K / Q + K * K) / a0,
+                       2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0);
+  }
+  {
+    double K = tan(M_PI * 38.13547087602444 / sample_rate);
+    double Q = 0.5003270373238773;
+    double a0 = 1.0 + K / Q + K * K;
+    _kfilter[1].design(1.0, -2.0, 1.0, 2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0);
+  }
+  reset();
+}
+
+void audio_analyzer_t::reset(void)
+{
+  memset(_capture, 0, sizeof(_capture));
+  _capture_pos = 0;
+  _capture_new = 0;
+  _decimate_sum = 0;
+  _decimate_count = 0;
+  _fft_step = 0;
+  _kfilter[0].clear();
+  _kfilter[1].clear();
+  _sum_sq = 0;
+  _sum_k = 0;
+  _peak = 0;
+  _meter_frames = 0;
+  _history_pos = 0;
+  _history_count = 0;
+  auto sequence = _result.sequence;
+  _result = result_t();
+  _result.sequence = sequence;
+}
+
+bool audio_analyzer_t::process(const int32_t* buf, size_t frames)
+{
+  if (_sample_rate == 0) { return false; }
+  bool updated = false;
+
+  for (size_t i = 0; i < frames; ++i) {
+    int32_t s[2] = { buf[i * 2] >> 8, buf[i * 2 + 1] >> 8 }; // Q23
+    for (int ch = 0; ch < 2; ++ch) {
+      uint32_t a = (uint32_t)(s[ch] < 0 ? -s[ch] : s[ch]);
+      if (_peak < a) { _peak = a; }
+      _sum_sq += (uint64_t)((int64_t)s[ch] * s[ch]);
+      int32_t k = _kfilter[1].process(ch, _kfilter[0].process(ch, s[ch]));
+      _sum_k += (uint64_t)((int64_t)k * k);
+    }
+
+    // 左右の和を単純平均で間引く
+    _decimate_sum += s[0] + s[1];
+    if (++_decimate_count >= _decimate) {
+      _capture[_capture_pos] = _decimate_sum / (int32_t)(_decimate * 2);
+      if (++_capture_pos >= fft_size) { _capture_pos = 0; }
+      ++_capture_new;
+      _decimate_sum = 0;
+      _decimate_count = 0;
+    }
+
+    if (++_meter_frames >= _meter_period) {
+      updateMeters();
+      updated = true;
+    }
+  }
+
+  // FFTは 1ブロックにつき1段のみ進める
+  if (_fft_step == 0 && _capture_new >= fft_size) {
+    _capture_new = 0;
+    _fft_step = 1;
+  }
+  if (_fft_step == 1) {
+    fftLoad();
+    ++_fft_step;
+  } else if (_fft_step >= 2 && _fft_step < 2 + fft_bits) {
+    fftStage(_fft_step - 2);
+    ++_fft_step;
+  } else if (_fft_step == 2 + fft_bits) {
+    fftBands();
+    _fft_step = 0;
+    updated = true;
+  }
+
+  if (updated) { ++_result.sequence; }
+  return updated;
+}
+
+void audio_analyzer_t::updateMeters(void)
+{
+  _ms_history[_history_pos] = _sum_sq / (_meter_frames * 2);
+  _ms_k_history[_history_pos] = _sum_k / _meter_frames;
+  if (++_history_pos >= meter_history) { _history_pos = 0; }
+  if (_history_count < meter_history) { ++_history_count; }
+
+  // 直近 count 個の平均を求める (記録が足りない場合はある分のみ)
+  auto average = [this](const uint64_t* history, size_t count) {
+    if (count > _history_count) { count = _history_count; }
+    uint64_t sum = 0;
+    size_t pos = _history_pos;
+    for (size_t i = 0; i < count; ++i) {
+      pos = (pos ? pos : meter_history) - 1;
+      sum += history[pos];
+    }
+    return sum / count;
+  };
+
+  _result.peak_db10 = power_db10((uint64_t)_peak * _peak, full_scale_log2);
+  _result.rms_db10 = power_db10(average(_ms_history, rms_blocks), full_scale_log2);
+  // ラウドネスは -0.691 を加える (BS.1770)
+  int16_t m = power_db10(average(_ms_k_history, momentary_blocks), full_scale_log2);
+  int16_t st = power_db10(average(_ms_k_history, short_term_blocks), full_scale_log2);
+  _result.momentary_lu10 = (m > level_min_db10) ? m - 7 : m;
+  _result.short_term_lu10 = (st > level_min_db10) ? st - 7 : st;
+
+  _sum_sq = 0;
+  _sum_k = 0;
+  _peak = 0;
+  _meter_frames = 0;
+}
+
+void audio_analyzer_t::fftLoad(void)
+{
+  // 古い順に窓を掛け、ビット反転の位置へ並べる
+  size_t pos = _capture_pos;
+  for (size_t n = 0; n < fft_size; ++n) {
+    size_t r = 0;
+    for (size_t b = 0; b < fft_bits; ++b) {
+      r |= ((n >> b) & 1) << (fft_bits - 1 - b);
+    }
+    _re[r] = (int32_t)(((int64_t)_capture[pos] * fft_window[n]) >> 15);
+    _im[r] = 0;
+    if (++pos >= fft_size) { pos = 0; }
+  }
+}
+
+void audio_analyzer_t::fftStage(size_t stage)
+{
+  // 基数2の時間間引き。段毎に1/2 することで桁あふれを防ぐ
+  const size_t half = 1 << stage;
+  const size_t step = fft_size / (half * 2);
+  for (size_t start = 0; start < fft_size; start += half * 2) {
+    for (size_t k = 0; k < half; ++k) {
+      size_t i = start + k;
+      size_t j = i + half;
+      int64_t wr = fft_cos[k * step];
+      int64_t wi = -fft_sin[k * step];
+      int32_t tr = (int32_t)((_re[j] * wr - _im[j] * wi) >> 30);
+      int32_t ti = (int32_t)((_re[j] * wi + _im[j] * wr) >> 30);
+      int32_t ur = _re[i];
+      int32_t ui = _im[i];
+      _re[i] = (ur + tr) >> 1;
+      _im[i] = (ui + ti) >> 1;
+      _re[j] = (ur - tr) >> 1;
+      _im[j] = (ui - ti) >> 1;
+    }
+  }
+}
+
+void audio_analyzer_t::fftBands(void)
+{
+  // 帯域内で最大の bin のレベルを帯域のレベルとする
+  for (size_t b = 0; b < band_count; ++b) {
+    uint64_t max_power = 0;
+    for (size_t k = _band_edge[b]; k < _band_edge[b + 1]; ++k) {
+      uint64_t p = (uint64_t)((int64_t)_re[k] * _re[k]) + (uint64_t)((int64_t)_im[k] * _im[k]);
+      if (max_power < p) { max_power = p; }
+    }
+    int32_t db10 = power_db10(max_power, fft_full_scale_log2);
+    int32_t v = (db10 - level_min_db10) * 255 / -level_min_db10;
+    _result.band[b] = (v < 0) ? 0 : (v > 255) ? 255 : v;
+  }
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
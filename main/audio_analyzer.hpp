@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_AUDIO_ANALYZER_HPP
+#define KANPLAY_AUDIO_ANALYZER_HPP
+
+/*
+audio_analyzer は I2Sタスクの DMAブロック毎に出力音声を解析し、スペクトルとレベルメータの値を求めます。
+ - スペクトル : 左右の和を約12kHzへ間引き、256点の固定小数点FFT (ハン窓) から対数間隔の帯域毎のレベルを求める
+ - メータ : ピーク / RMS (300msec) / ラウドネス (BS.1770 の K特性、瞬時 400msec / 短時間 3秒)
+ - 処理時間を一定に抑えるため、FFTは段毎に分割し 1ブロックにつき1段のみ進める
+ - 他のモジュールに依存しないため、ホスト上で単体で処理時間を計測できる
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class audio_analyzer_t {
+public:
+  static constexpr const size_t fft_bits = 8;
+  static constexpr const size_t fft_size = 1 << fft_bits;
+  static constexpr const size_t band_count = 32;
+  static constexpr const int16_t level_min_db10 = -900;  // 表示の下限 (-90.0dB)
+
+  // 解析結果 (GUIへの受け渡しのため 4byteの整数倍の大きさとする)
+  struct result_t {
+    uint32_t sequence = 0;        // 更新毎に増加する番号
+    int16_t peak_db10 = level_min_db10;       // 直近100msecのピーク (dBFS×10)
+    int16_t rms_db10 = level_min_db10;        // RMS 300msec (dBFS×10)
+    int16_t momentary_lu10 = level_min_db10;  // 瞬時ラウドネス 400msec (LUFS×10)
+    int16_t short_term_lu10 = level_min_db10; // 短時間ラウドネス 3秒 (LUFS×10)
+    uint8_t band[band_count] = {};            // 帯域毎のレベル (0:-90dB ～ 255:0dB)
+  };
+
+  // サンプリングレートに応じて間引き率・帯域・K特性フィルタを設定し、解析状態を初期化する
+  void setup(uint32_t sample_rate);
+  void reset(void);
+
+  // L/R交互のステレオブロックを解析する。結果が更新された場合は true を返す
+  bool process(const int32_t* buf, size_t frames);
+
+  const result_t& getResult(void) const { return _result; }
+  uint32_t getDecimatedRate(void) const { return _sample_rate / _decimate; }
+
+protected:
+  // K特性フィルタ (biquad, Direct Form I, 係数は Q2.28)
+  struct kfilter_t {
+    int32_t b0, b1, b2, a1, a2;
+    int32_t x1[2], x2[2], y1[2], y2[2], err[2];
+    void design(double b0, double b1, double b2, double a1, double a2);
+    void clear(void);
+    inline int32_t process(int ch, int32_t x);
+  };
+
+  void updateMeters(void);
+  void fftLoad(void);
+  void fftStage(size_t stage);
+  void fftBands(void);
+
+  // 間引いたモノラル信号 (Q23) のリングバッファ
+  int32_t _capture[fft_size];
+  size_t _capture_pos = 0;
+  size_t _capture_new = 0;
+  int32_t _decimate_sum = 0;
+  uint32_t _decimate = 1;
+  uint32_t _decimate_count = 0;
+
+  // FFTの作業領域と処理段 (0:待機 1:窓掛け 2～:バタフライ演算 最後:帯域レベルの算出)
+  int32_t _re[fft_size];
+  int32_t _im[fft_size];
+  size_t _fft_step = 0;
+  uint8_t _band_edge[band_count + 1];
+
+  // メータ (100msec毎に平均二乗値を記録し、区間の長さに応じて平均する)
+  static constexpr const size_t meter_history = 30;
+  kfilter_t _kfilter[2];
+  uint64_t _sum_sq = 0;
+  uint64_t _sum_k = 0;
+  uint32_t _peak = 0;
+  uint32_t _meter_frames = 0;
+  uint32_t _meter_period = 0;
+  uint64_t _ms_history[meter_history];
+  uint64_t _ms_k_history[meter_history];
+  size_t _history_pos = 0;
+  size_t _history_count = 0;
+
+  uint32_t _sample_rate = 0;
+  result_t _result;
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "audio_block_ring.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if __has_include(<esp_heap_caps.h>)
+ #include <esp_heap_caps.h>
+#endif
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+audio_block_ring_t::~audio_block_ring_t()
+{
+  int32_t* data = _data.load();
+  if (data) { free(data); }
+  if (_frames) { free(_frames); }
+  if (_sample) { free(_sample); }
+}
+
+bool audio_block_ring_t::init(size_t slots, size_t frames_max)
+{
+  if (_data.load() != nullptr || frames_max == 0) { return false; }
+  size_t n = 2;
+  while (n * 2 <= slots) { n *= 2; }
+
+  size_t data_bytes = n * frames_max * 2 * sizeof(int32_t);
+#if __has_include(<esp_heap_caps.h>)
+  // I2Sタスクが毎ブロック書き込むため内部RAMを優先し、足りない場合は PSRAM とする
+  int32_t* data = (int32_t*)heap_caps_malloc(data_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (data == nullptr) {
+    data = (int32_t*)heap_caps_malloc(data_bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  }
+#else
+  int32_t* data = (int32_t*)malloc(data_bytes);
+#endif
+  _frames = (uint32_t*)calloc(n, sizeof(uint32_t));
+  _sample = (uint64_t*)calloc(n, sizeof(uint64_t));
+  if (data == nullptr || _frames == nullptr || _sample == nullptr) {
+    if (data) { free(data); }
+    if (_frames) { free(_frames); _frames = nullptr; }
+    if (_sample) { free(_sample); _sample = nullptr; }
+    return false;
+  }
+  memset(data, 0, data_bytes);
+  _frames_max = frames_max;
+  _mask = n - 1;
+  // 他のメンバの設定が先に見えるよう、領域は最後に release で公開する
+  _data.store(data, std::memory_order_release);
+  return true;
+}
+
+int32_t* audio_block_ring_t::beginWrite(void)
+{
+  uint32_t head = _head.load(std::memory_order_relaxed);
+  // 上書きを始める前に書込み中の位置を公開する (読み手は release でこれを確認する)
+  _reserve.store(head + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return slot(head);
+}
+
+void audio_block_ring_t::commitWrite(uint32_t frames, uint64_t sample)
+{
+  uint32_t head = _head.load(std::memory_order_relaxed);
+  uint32_t index = head & _mask;
+  _frames[index] = frames < _frames_max ? frames : _frames_max;
+  _sample[index] = sample;
+  _head.store(head + 1, std::memory_order_release);
+}
+
+void audio_block_ring_t::write(const int32_t* buf, size_t frames, uint64_t sample)
+{
+  if (_data.load(std::memory_order_acquire) == nullptr) { return; }
+  if (frames > _frames_max) { frames = _frames_max; }
+  memcpy(beginWrite(), buf, frames * 2 * sizeof(int32_t));
+  commitWrite(frames, sample);
+}
+
+bool audio_block_ring_t::acquire(reader_t& reader, block_t& block) const
+{
+  if (_data.load(std::memory_order_acquire) == nullptr) { return false; }
+  uint32_t head = _head.load(std::memory_order_acquire);
+  uint32_t behind = head - reader.seq;
+  if (behind == 0) { return false; }
+  // 1周遅れた位置のスロットは書込み中の可能性があるため、最新のブロックまで読み飛ばす
+  if (behind > _mask) {
+    reader.overrun += behind - 1;
+    reader.seq = head - 1;
+  }
+  uint32_t index = reader.seq & _mask;
+  block.data = slot(reader.seq);
+  block.frames = _frames[index];
+  block.sample = _sample[index];
+  block.seq = reader.seq;
+  return true;
+}
+
+bool audio_block_ring_t::release(reader_t& reader) const
+{
+  // 参照中に書き手がこのスロットの書込みを開始していなければ有効とする
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint32_t reserve = _reserve.load(std::memory_order_relaxed);
+  bool valid = (reserve - reader.seq) <= _mask + 1;
+  if (!valid) { ++reader.overrun; }
+  ++reader.seq;
+  return valid;
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_AUDIO_BLOCK_RING_HPP
+#define KANPLAY_AUDIO_BLOCK_RING_HPP
+
+/*
+audio_block_ring は I2Sタスクが処理したDMAブロックを、複数の読み手へ共有するためのリングバッファです。
+ - 書き手は I2Sタスクのみとし、DMAブロック毎に1回書き込む。書き手は読み手を待たず、ロックも取らない
+ - 読み手はそれぞれ reader_t で読み出し位置を持ち、読み手同士は互いに影響しない (読み手の数に制限は無い)
+ - 読み手はスロットを直接参照する (コピー不要)。参照を終えたら release を呼び、参照中に上書きされていないかを確認する
+ - 読み手が遅れて上書きされたブロックは読み飛ばし、オーバーランとして数える
+ - 書き手は書込み前に書込み中の位置を公開するため、読み手は上書きの途中であることも検出できる
+ - init は書き手・読み手のタスクを開始する前に呼び出す。確保した領域は最後に公開するため、init 前の読み書きは何もしない
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class audio_block_ring_t {
+public:
+  // 読み出したブロック。data は release を呼ぶまで参照できる
+  struct block_t {
+    const int32_t* data = nullptr;  // L/R交互の32bitステレオ
+    uint32_t frames = 0;
+    uint64_t sample = 0;            // ブロックの先頭のサンプル位置 (サンプルクロック)
+    uint32_t seq = 0;               // ブロックの通し番号
+  };
+
+  // 読み手毎の読み出し位置
+  struct reader_t {
+    uint32_t seq = 0;               // 次に読み出すブロックの通し番号
+    uint32_t overrun = 0;           // 上書きにより読めなかったブロック数
+  };
+
+  ~audio_block_ring_t();
+
+  // スロットを確保する (slots は2のべき乗に切り捨てる。最低2)
+  bool init(size_t slots, size_t frames_max);
+  bool isReady(void) const { return _data.load(std::memory_order_acquire) != nullptr; }
+  size_t getSlots(void) const { return _mask + 1; }
+  size_t getFramesMax(void) const { return _frames_max; }
+
+  // 書き手 (I2Sタスク) のみが呼び出す
+  // beginWrite で得たスロットへ frames_max 以下のフレームを書き込み、commitWrite で公開する
+  int32_t* beginWrite(void);
+  void commitWrite(uint32_t frames, uint64_t sample);
+  // buf をスロットへ複写して公開する (frames_max を超える分は捨てる)
+  void write(const int32_t* buf, size_t frames, uint64_t sample);
+  // 公開したブロックの総数
+  uint32_t getWriteCount(void) const { return _head.load(std::memory_order_acquire); }
+
+  // 読み手が呼び出す (任意のタスクから呼び出せる)
+  // 以降に書き込まれるブロックから読み出すよう reader を初期化する
+  void attach(reader_t& reader) const {
+    reader.seq = _head.load(std::memory_order_acquire);
+    reader.overrun = 0;
+  }
+  // 次のブロックを得る。新しいブロックが無い場合は false
+  // 読み手が1周以上遅れている場合は最新のブロックまで読み飛ばす
+  bool acquire(reader_t& reader, block_t& block) const;
+  // acquire で得たブロックの参照を終える。参照中に上書きされた場合は false (オーバーランとして数える)
+  bool release(reader_t& reader) const;
+
+protected:
+  int32_t* slot(uint32_t seq) const { return _data.load(std::memory_order_relaxed) + (seq & _mask) * _frames_max * 2; }
+
+  std::atomic<int32_t*> _data { nullptr };  // init の最後に公開する (以下のメンバは公開前に設定する)
+  uint32_t* _frames = nullptr;
+  uint64_t* _sample = nullptr;
+  uint32_t _mask = 0;
+  size_t _frames_max = 0;
+  std::atomic<uint32_t> _head { 0 };     // 公開したブロックの数
+  std::atomic<uint32_t> _reserve { 0 };  // 書込みを開始したブロックの数 (書込み中は _head + 1)
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
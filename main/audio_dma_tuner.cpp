@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "audio_dma_tuner.hpp"
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+constexpr const uint16_t audio_dma_tuner_t::frames_table[];
+
+void audio_dma_tuner_t::setup(uint16_t frames, uint8_t desc, uint32_t sample_rate, uint32_t now_msec)
+{
+  if (sample_rate) { _sample_rate = sample_rate; }
+  _auto = (frames == 0);
+  if (_auto) {
+    frames = frames_default;
+  }
+  _index = 0;
+  while (_index + 1 < frames_table_count && frames_table[_index] < frames) { ++_index; }
+  _geometry.frames = frames_table[_index];
+  _geometry.desc = desc;
+
+  _window_start_msec = now_msec;
+  _window_worst_usec = 0;
+  _window_underrun = 0;
+  _window_late = 0;
+  _clean_windows = 0;
+  _hold_until_msec = now_msec;
+}
+
+bool audio_dma_tuner_t::reportBlock(uint32_t elapsed_usec)
+{
+  if (_window_worst_usec < elapsed_usec) { _window_worst_usec = elapsed_usec; }
+  if (elapsed_usec <= getPeriodUsec()) { return false; }
+  ++_window_late;
+  return true;
+}
+
+bool audio_dma_tuner_t::evaluate(uint32_t now_msec)
+{
+  if (now_msec - _window_start_msec < window_msec) { return false; }
+  _window_start_msec = now_msec;
+  _last_worst_usec = _window_worst_usec;
+  bool fault = (_window_underrun || _window_late);
+  _window_worst_usec = 0;
+  _window_underrun = 0;
+  _window_late = 0;
+
+  if (!_auto) { return false; }
+
+  if (fault) {
+    _clean_windows = 0;
+    _hold_until_msec = now_msec + hold_msec;
+    if (_index + 1 < frames_table_count) {
+      _geometry.frames = frames_table[++_index];
+      return true;
+    }
+    return false;
+  }
+
+  if (++_clean_windows < shrink_windows || (int32_t)(now_msec - _hold_until_msec) < 0 || _index == 0) {
+    return false;
+  }
+  // 小さいブロックでも処理時間は今の最悪値を下回るとは限らないため、今の最悪値のまま余裕を判定する
+  uint16_t candidate = frames_table[_index - 1];
+  if ((uint64_t)_last_worst_usec * margin_percent > (uint64_t)periodUsec(candidate) * 100) {
+    return false;
+  }
+  _clean_windows = 0;
+  _geometry.frames = candidate;
+  --_index;
+  return true;
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
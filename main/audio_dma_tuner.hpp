@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_AUDIO_DMA_TUNER_HPP
+#define KANPLAY_AUDIO_DMA_TUNER_HPP
+
+/*
+audio_dma_tuner は I2S の DMAブロックの大きさ (1ブロックのフレーム数と DMAディスクリプタの数) を決定します。
+ - 固定モードでは設定された大きさをそのまま使用する
+ - 自動モードでは、ブロックの処理時間の最悪値とアンダーラン・処理遅れの発生を一定期間毎に評価し、
+   問題が起きたら1段大きく、問題の無い期間が続き処理時間にも余裕があれば1段小さくする
+ - 大きくした直後は一定時間小さくしないことで、大きさが頻繁に切り替わらないようにする
+ - I2Sのドライバには依存しないため、ホスト上で判定の動作を確認できる
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class audio_dma_tuner_t {
+public:
+  struct geometry_t {
+    uint16_t frames = 0;  // 1ブロックのフレーム数 (L/R で1フレーム)
+    uint8_t desc = 0;     // DMAディスクリプタの数
+
+    bool operator==(const geometry_t& rhs) const { return frames == rhs.frames && desc == rhs.desc; }
+    bool operator!=(const geometry_t& rhs) const { return !(*this == rhs); }
+  };
+
+  // 選択できるフレーム数 (小さい順)
+  static constexpr const uint16_t frames_table[] = { 16, 24, 32, 48, 64, 96 };
+  static constexpr const size_t frames_table_count = sizeof(frames_table) / sizeof(frames_table[0]);
+  static constexpr const uint16_t frames_max = 96;
+  static constexpr const uint16_t frames_default = 48;  // 設定の初期値、および自動モードの開始時の大きさ (従来の固定値)
+
+  // frames : 0 で自動、それ以外は固定 (frames_table のうち、この値以上で最も小さい値を使用する)
+  // desc : DMAディスクリプタの数
+  void setup(uint16_t frames, uint8_t desc, uint32_t sample_rate, uint32_t now_msec);
+  const geometry_t& getGeometry(void) const { return _geometry; }
+  bool isAuto(void) const { return _auto; }
+
+  // ブロックの処理時間 (usec) を通知する。ブロックの周期を超えた場合は処理遅れとして true を返す
+  bool reportBlock(uint32_t elapsed_usec);
+  // アンダーラン (DMAキューの溢れ) の発生を通知する
+  void reportUnderrun(uint32_t count) { _window_underrun += count; }
+
+  // 評価期間毎に呼び出す。自動モードで大きさを変更する場合は true を返す
+  bool evaluate(uint32_t now_msec);
+
+  uint32_t getPeriodUsec(void) const { return periodUsec(_geometry.frames); }
+  // 直前の評価期間の処理時間の最悪値 (usec)
+  uint32_t getWorstUsec(void) const { return _last_worst_usec; }
+
+  static constexpr const uint32_t window_msec = 2000;       // 評価期間
+  static constexpr const uint32_t shrink_windows = 5;       // 小さくするのに必要な、問題の無い評価期間の連続数
+  static constexpr const uint32_t hold_msec = 60000;        // 大きくした後、小さくしない期間
+  static constexpr const uint32_t margin_percent = 150;     // 処理時間の最悪値に対して確保するブロック周期の余裕
+
+protected:
+  uint32_t periodUsec(uint16_t frames) const { return (uint32_t)((uint64_t)frames * 1000000u / _sample_rate); }
+
+  geometry_t _geometry;
+  uint32_t _sample_rate = 48000;
+  size_t _index = 0;
+  bool _auto = false;
+
+  uint32_t _window_start_msec = 0;
+  uint32_t _window_worst_usec = 0;
+  uint32_t _window_underrun = 0;
+  uint32_t _window_late = 0;
+  uint32_t _last_worst_usec = 0;
+  uint32_t _clean_windows = 0;
+  uint32_t _hold_until_msec = 0;
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
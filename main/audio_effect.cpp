@@ -0,0 +1,392 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "audio_effect.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if __has_include(<esp_heap_caps.h>)
+ #include <esp_heap_caps.h>
+#endif
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+static inline int32_t saturate32(int64_t v)
+{
+  return (int32_t)((v > INT32_MAX) ? INT32_MAX : (v < INT32_MIN) ? INT32_MIN : v);
+}
+
+static inline int16_t saturate16(int32_t v)
+{
+  return (int16_t)((v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v);
+}
+
+static inline int32_t toFixed(double v, int shift)
+{
+  return (int32_t)lround(v * (double)(1u << shift));
+}
+
+// log2(x) を Q16 で求める (x > 0)。仮数部は 2次の補正付き直線近似 (誤差 0.05dB 程度)
+static inline int32_t log2_q16(uint32_t x)
+{
+  int n = 31 - __builtin_clz(x);
+  uint32_t f = (n >= 16) ? (x >> (n - 16)) : (x << (16 - n));
+  f &= 0xFFFF;
+  f += (uint32_t)((((uint64_t)f * (65536 - f)) >> 16) * 22486 >> 16);
+  return (n << 16) + (int32_t)f;
+}
+
+// 2^(v / 65536) を Q16 で求める (v <= 0)
+static inline uint32_t exp2_q16(int32_t v)
+{
+  int32_t n = v >> 16;
+  uint32_t f = v & 0xFFFF;
+  uint32_t m = 65536 + f - (uint32_t)((((uint64_t)f * (65536 - f)) >> 16) * 22486 >> 16);
+  if (n >= 0) { return m; }
+  if (n < -17) { return 0; }
+  return m >> -n;
+}
+
+//-------------------------------------------------------------------------
+
+void audio_biquad_t::design(type_t type, float freq, float gain_db, float q, uint32_t sample_rate)
+{
+  _active = (gain_db != 0.0f && sample_rate != 0 && freq < sample_rate * 0.5f);
+  if (!_active) { return; }
+
+  double A = pow(10.0, gain_db / 40.0);
+  double w0 = 2.0 * M_PI * freq / sample_rate;
+  double cs = cos(w0);
+  double alpha = sin(w0) / (2.0 * q);
+  double sa = 2.0 * sqrt(A) * alpha;
+  double b0, b1, b2, a0, a1, a2;
+  switch (type) {
+  case low_shelf:
+    b0 =       A * ((A + 1) - (A - 1) * cs + sa);
+    b1 = 2.0 * A * ((A - 1) - (A + 1) * cs);
+    b2 =       A * ((A + 1) - (A - 1) * cs - sa);
+    a0 =            (A + 1) + (A - 1) * cs + sa;
+    a1 =    -2.0 * ((A - 1) + (A + 1) * cs);
+    a2 =            (A + 1) + (A - 1) * cs - sa;
+    break;
+
+  case high_shelf:
+    b0 =        A * ((A + 1) + (A - 1) * cs + sa);
+    b1 = -2.0 * A * ((A - 1) + (A + 1) * cs);
+    b2 =        A * ((A + 1) + (A - 1) * cs - sa);
+    a0 =             (A + 1) - (A - 1) * cs + sa;
+    a1 =      2.0 * ((A - 1) - (A + 1) * cs);
+    a2 =             (A + 1) - (A - 1) * cs - sa;
+    break;
+
+  default: // peaking
+    b0 = 1.0 + alpha * A;
+    b1 = -2.0 * cs;
+    b2 = 1.0 - alpha * A;
+    a0 = 1.0 + alpha / A;
+    a1 = -2.0 * cs;
+    a2 = 1.0 - alpha / A;
+    break;
+  }
+  _b0 = toFixed(b0 / a0, coef_shift);
+  _b1 = toFixed(b1 / a0, coef_shift);
+  _b2 = toFixed(b2 / a0, coef_shift);
+  _a1 = toFixed(a1 / a0, coef_shift);
+  _a2 = toFixed(a2 / a0, coef_shift);
+}
+
+void audio_biquad_t::reset(void)
+{
+  for (int ch = 0; ch < 2; ++ch) {
+    _x1[ch] = _x2[ch] = _y1[ch] = _y2[ch] = 0;
+  }
+}
+
+void audio_biquad_t::process(int32_t* buf, size_t frames)
+{
+  const int32_t b0 = _b0, b1 = _b1, b2 = _b2, a1 = _a1, a2 = _a2;
+  for (int ch = 0; ch < 2; ++ch) {
+    int32_t x1 = _x1[ch], x2 = _x2[ch], y1 = _y1[ch], y2 = _y2[ch];
+    int32_t* p = &buf[ch];
+    for (size_t i = 0; i < frames; ++i) {
+      int32_t x = p[i * 2];
+      int64_t acc = (int64_t)b0 * x
+                  + (int64_t)b1 * x1
+                  + (int64_t)b2 * x2
+                  - (int64_t)a1 * y1
+                  - (int64_t)a2 * y2;
+      int32_t y = saturate32(acc >> coef_shift);
+      x2 = x1; x1 = x;
+      y2 = y1; y1 = y;
+      p[i * 2] = y;
+    }
+    _x1[ch] = x1; _x2[ch] = x2; _y1[ch] = y1; _y2[ch] = y2;
+  }
+}
+
+//-------------------------------------------------------------------------
+
+void audio_compressor_t::setup(float threshold_db, float ratio, float release_msec, size_t lookahead_frames, uint32_t sample_rate)
+{
+  _active = (ratio > 1.0f && sample_rate != 0);
+  if (!_active) { return; }
+  if (threshold_db > 0.0f) { threshold_db = 0.0f; }
+  if (lookahead_frames > lookahead_max) { lookahead_frames = lookahead_max; }
+  if (_delay_frames != lookahead_frames) {
+    _delay_frames = lookahead_frames;
+    reset();
+  }
+
+  // フルスケール (2^31) を 0dB とする
+  _threshold_log2 = toFixed(31.0 + threshold_db / (20.0 * log10(2.0)), 16);
+  // 圧縮比20以上は リミッタ (∞:1) として扱う
+  _slope = (ratio >= 20.0f) ? 65536 : toFixed(1.0 - 1.0 / ratio, 16);
+  // ゲインを下げる速さは、先読み期間内にほぼ追従し終えるよう先読みの1/3を時定数とする
+  double attack_frames = (lookahead_frames > 3) ? lookahead_frames / 3.0 : 1.0;
+  _attack = toFixed(1.0 - exp(-1.0 / attack_frames), 30);
+  _release = toFixed(1.0 - exp(-1000.0 / (release_msec * sample_rate)), 30);
+}
+
+void audio_compressor_t::reset(void)
+{
+  memset(_delay, 0, sizeof(_delay));
+  _delay_pos = 0;
+  _env = 0;
+  _gain = 65536;
+}
+
+void audio_compressor_t::process(int32_t* buf, size_t frames)
+{
+  const int32_t threshold = _threshold_log2;
+  const int32_t slope = _slope;
+  uint32_t env = _env;
+  uint32_t gain = _gain;
+  size_t pos = _delay_pos;
+  for (size_t i = 0; i < frames; ++i) {
+    int32_t l = buf[i * 2    ];
+    int32_t r = buf[i * 2 + 1];
+    uint32_t al = (l < 0) ? (uint32_t)0 - (uint32_t)l : (uint32_t)l;
+    uint32_t ar = (r < 0) ? (uint32_t)0 - (uint32_t)r : (uint32_t)r;
+    uint32_t peak = al > ar ? al : ar;
+
+    // ピーク検出値は波形の山と山の間でゲインが戻らないよう、緩やかに減衰させる
+    env -= (uint32_t)(((uint64_t)env * _release) >> 30);
+    if (env < peak) { env = peak; }
+
+    // 閾値を超えた分を圧縮比に応じて下げるゲイン
+    uint32_t target = 65536;
+    if (env != 0) {
+      int32_t over = log2_q16(env) - threshold;
+      if (over > 0) {
+        target = exp2_q16(-(int32_t)(((int64_t)over * slope) >> 16));
+      }
+    }
+    // 下げる時は先読み期間内に追従し、戻す時はピーク検出値の減衰に従う
+    if (target < gain) {
+      gain -= (uint32_t)(((uint64_t)(gain - target) * _attack + (1u << 29)) >> 30);
+    } else {
+      gain = target;
+    }
+
+    // 先読み分だけ遅らせた信号にゲインを適用する
+    if (_delay_frames) {
+      int32_t* d = &_delay[pos * 2];
+      int32_t dl = d[0];
+      int32_t dr = d[1];
+      d[0] = l;
+      d[1] = r;
+      l = dl;
+      r = dr;
+      if (++pos >= _delay_frames) { pos = 0; }
+    }
+    buf[i * 2    ] = saturate32(((int64_t)l * gain) >> 16);
+    buf[i * 2 + 1] = saturate32(((int64_t)r * gain) >> 16);
+  }
+  _env = env;
+  _gain = gain;
+  _delay_pos = pos;
+}
+
+//-------------------------------------------------------------------------
+
+// Freeverb の遅延長 (44.1kHz基準) から4本・2本を選んで使用する
+static constexpr const uint16_t reverb_comb_length[] = { 1116, 1277, 1422, 1617 };
+static constexpr const uint16_t reverb_allpass_length[] = { 556, 341 };
+static constexpr const int32_t reverb_feedback = 27525; // 0.84 (Q15)
+static constexpr const int32_t reverb_damp = 6554;      // 0.2 (Q15)
+
+audio_reverb_t::~audio_reverb_t()
+{
+  if (_memory) { free(_memory); }
+}
+
+bool audio_reverb_t::init(uint32_t sample_rate)
+{
+  if (_memory != nullptr && _sample_rate == sample_rate) { return true; }
+  if (_memory != nullptr) {
+    free(_memory);
+    _memory = nullptr;
+  }
+  _sample_rate = sample_rate;
+
+  size_t total = 0;
+  uint16_t comb_size[comb_count];
+  uint16_t allpass_size[allpass_count];
+  for (size_t i = 0; i < comb_count; ++i) {
+    comb_size[i] = (uint32_t)reverb_comb_length[i] * sample_rate / 44100;
+    total += comb_size[i];
+  }
+  for (size_t i = 0; i < allpass_count; ++i) {
+    allpass_size[i] = (uint32_t)reverb_allpass_length[i] * sample_rate / 44100;
+    total += allpass_size[i];
+  }
+
+  // 遅延線は逐次アクセスのみのため、内部RAMを圧迫しないよう PSRAM を優先する
+#if __has_include(<esp_heap_caps.h>)
+  _memory = (int16_t*)heap_caps_malloc(total * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (_memory == nullptr) {
+    _memory = (int16_t*)heap_caps_malloc(total * sizeof(int16_t), MALLOC_CAP_8BIT);
+  }
+#else
+  _memory = (int16_t*)malloc(total * sizeof(int16_t));
+#endif
+  if (_memory == nullptr) { return false; }
+
+  int16_t* p = _memory;
+  for (size_t i = 0; i < comb_count; ++i) {
+    _comb[i] = { p, comb_size[i], 0 };
+    p += comb_size[i];
+  }
+  for (size_t i = 0; i < allpass_count; ++i) {
+    _allpass[i] = { p, allpass_size[i], 0 };
+    p += allpass_size[i];
+  }
+  clear();
+  return true;
+}
+
+void audio_reverb_t::clear(void)
+{
+  if (_memory == nullptr) { return; }
+  for (size_t i = 0; i < comb_count; ++i) {
+    memset(_comb[i].buf, 0, _comb[i].size * sizeof(int16_t));
+    _comb_filter[i] = 0;
+  }
+  for (size_t i = 0; i < allpass_count; ++i) {
+    memset(_allpass[i].buf, 0, _allpass[i].size * sizeof(int16_t));
+  }
+}
+
+void audio_reverb_t::process(int32_t* buf, size_t frames)
+{
+  const int32_t level = _level;
+  for (size_t i = 0; i < frames; ++i) {
+    // 左右の和の上位16bitを入力とし、コムフィルタの帰還で飽和しないよう 1/8 にする
+    int32_t input = ((buf[i * 2] >> 16) + (buf[i * 2 + 1] >> 16)) >> 3;
+
+    int32_t sum = 0;
+    for (size_t c = 0; c < comb_count; ++c) {
+      auto& d = _comb[c];
+      int32_t out = d.buf[d.pos];
+      // 帰還経路の一次ローパスで高域を早く減衰させる
+      _comb_filter[c] = (out * (32768 - reverb_damp) + _comb_filter[c] * reverb_damp) >> 15;
+      d.buf[d.pos] = saturate16(input + ((_comb_filter[c] * reverb_feedback) >> 15));
+      if (++d.pos >= d.size) { d.pos = 0; }
+      sum += out;
+    }
+
+    int32_t x = sum >> 1;
+    for (size_t a = 0; a < allpass_count; ++a) {
+      auto& d = _allpass[a];
+      int32_t out = d.buf[d.pos];
+      d.buf[d.pos] = saturate16(x + (out >> 1));
+      if (++d.pos >= d.size) { d.pos = 0; }
+      x = out - x;
+    }
+
+    int64_t wet = (((int64_t)x * level) >> 15) * 65536;
+    buf[i * 2    ] = saturate32(buf[i * 2    ] + wet);
+    buf[i * 2 + 1] = saturate32(buf[i * 2 + 1] + wet);
+  }
+}
+
+//-------------------------------------------------------------------------
+
+// EQの各バンドの中心(肩)周波数と Q
+static constexpr const float eq_low_freq = 120.0f;
+static constexpr const float eq_mid_freq = 1000.0f;
+static constexpr const float eq_high_freq = 6000.0f;
+static constexpr const float eq_shelf_q = 0.7071f;
+static constexpr const float eq_mid_q = 0.7f;
+// コンプレッサの先読み時間と、ゲインを戻す時の時定数
+static constexpr const uint32_t comp_lookahead_usec = 1000;
+static constexpr const float comp_release_msec = 100.0f;
+
+void audio_effect_chain_t::setConfig(const config_t& config)
+{
+  bool rate_changed = (_config.sample_rate != config.sample_rate);
+  _config = config;
+  const uint32_t rate = config.sample_rate;
+
+  _eq[0].design(audio_biquad_t::low_shelf,  eq_low_freq,  config.eq_low_db,  eq_shelf_q, rate);
+  _eq[1].design(audio_biquad_t::peaking,    eq_mid_freq,  config.eq_mid_db,  eq_mid_q,   rate);
+  _eq[2].design(audio_biquad_t::high_shelf, eq_high_freq, config.eq_high_db, eq_shelf_q, rate);
+
+  bool comp_was_active = _comp.isActive();
+  _comp.setup(config.comp_threshold_db, config.comp_ratio, comp_release_msec
+             , (size_t)((uint64_t)rate * comp_lookahead_usec / 1000000), rate);
+
+  bool reverb_was_active = _reverb.isActive();
+  // 遅延線はエフェクトが有効になるまで確保しない
+  uint8_t reverb_level = config.enabled ? config.reverb_level : 0;
+  if (reverb_level && !_reverb.init(rate)) { reverb_level = 0; }
+  _reverb.setLevel(reverb_level);
+
+  if (rate_changed) {
+    for (auto& eq : _eq) { eq.reset(); }
+  }
+  // 無効から有効へ切り替わった段は、以前の状態が残らないよう初期化する
+  if (!comp_was_active && _comp.isActive()) { _comp.reset(); }
+  if (!reverb_was_active && _reverb.isActive()) { _reverb.clear(); }
+  updateActive();
+}
+
+void audio_effect_chain_t::updateActive(void)
+{
+  bool active = false;
+  for (auto& eq : _eq) { active |= eq.isActive(); }
+  active |= _comp.isActive();
+  active |= _reverb.isActive();
+  _active = _config.enabled && active;
+}
+
+void audio_effect_chain_t::processInternal(int32_t* buf, size_t frames)
+{
+  for (auto& eq : _eq) {
+    if (eq.isActive()) { eq.process(buf, frames); }
+  }
+  if (_reverb.isActive() && _reverb_suspend == 0) {
+    _reverb.process(buf, frames);
+  }
+  // リミッタとして出力の最大値を抑えるため、コンプレッサは最後に置く
+  if (_comp.isActive()) {
+    _comp.process(buf, frames);
+  }
+}
+
+void audio_effect_chain_t::reportElapsed(uint32_t elapsed_usec, uint32_t budget_usec, uint32_t suspend_blocks)
+{
+  if (elapsed_usec > budget_usec) {
+    ++_overrun_count;
+    _reverb_suspend = suspend_blocks;
+  } else if (_reverb_suspend) {
+    // 再開時は途切れた残響が混ざらないよう遅延線を消去する
+    if (--_reverb_suspend == 0) { _reverb.clear(); }
+  }
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
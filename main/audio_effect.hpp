@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_AUDIO_EFFECT_HPP
+#define KANPLAY_AUDIO_EFFECT_HPP
+
+/*
+audio_effect は I2Sタスクの DMAブロック毎に適用する固定小数点のエフェクトチェインです。
+ - 3バンドEQ (ローシェルフ / ピーキング / ハイシェルフ の biquad)
+ - 先読みコンプレッサ / リミッタ (圧縮比20以上でリミッタとして動作)
+ - 軽量リバーブ (コム4本 + オールパス2本、遅延線は16bit)
+ - 係数の計算は設定変更時のみ浮動小数で行い、サンプル毎の処理は整数演算のみで行う
+ - 全て無効の場合は process の先頭で戻るため、バイパス時の負荷はほぼ無い
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+// biquad フィルタ (Direct Form I, ステレオ)
+class audio_biquad_t {
+public:
+  enum type_t : uint8_t {
+    low_shelf,
+    peaking,
+    high_shelf,
+  };
+
+  // 係数を設定する。gain_db が 0 の場合は無効となり処理を省く
+  void design(type_t type, float freq, float gain_db, float q, uint32_t sample_rate);
+  bool isActive(void) const { return _active; }
+  void reset(void);
+  void process(int32_t* buf, size_t frames);
+
+private:
+  static constexpr const int coef_shift = 28; // 係数は Q4.28 (±8 の範囲)
+  int32_t _b0 = 0, _b1 = 0, _b2 = 0, _a1 = 0, _a2 = 0;
+  int32_t _x1[2] = { 0, 0 };
+  int32_t _x2[2] = { 0, 0 };
+  int32_t _y1[2] = { 0, 0 };
+  int32_t _y2[2] = { 0, 0 };
+  bool _active = false;
+};
+
+// 先読みコンプレッサ / リミッタ (ステレオリンク)
+//  入力のピークから求めたゲインを、先読み分だけ遅らせた信号に適用する
+class audio_compressor_t {
+public:
+  static constexpr const size_t lookahead_max = 128;
+
+  // threshold_db : 閾値 (フルスケール基準、0以下)  ratio : 圧縮比 (1以下で無効)
+  void setup(float threshold_db, float ratio, float release_msec, size_t lookahead_frames, uint32_t sample_rate);
+  bool isActive(void) const { return _active; }
+  void reset(void);
+  void process(int32_t* buf, size_t frames);
+
+  // 直近のゲイン (Q16, 65536で等倍)
+  uint32_t getGain(void) const { return _gain; }
+
+private:
+  int32_t _delay[lookahead_max * 2];
+  size_t _delay_frames = 0;
+  size_t _delay_pos = 0;
+  uint32_t _env = 0;            // ピーク検出値 (絶対値。上昇は即時、下降は _release で減衰)
+  uint32_t _gain = 65536;       // 適用中のゲイン (Q16)
+  uint32_t _attack = 0;         // ゲインを下げる時の追従係数 (Q30)
+  uint32_t _release = 0;        // ピーク検出値の減衰係数 (Q30)
+  int32_t _threshold_log2 = 0;  // 閾値の log2 (Q16)
+  int32_t _slope = 0;           // 1 - 1/ratio (Q16)
+  bool _active = false;
+};
+
+// 軽量リバーブ (Schroeder型。左右の和をモノラルで処理し、両チャンネルへ加える)
+class audio_reverb_t {
+public:
+  ~audio_reverb_t();
+
+  // 遅延線を確保する。確保済みでサンプリングレートが同じ場合は何もしない
+  bool init(uint32_t sample_rate);
+  // level : 残響の量 (0-100、0で無効)
+  void setLevel(uint8_t level) { _level = (level > 100 ? 100 : level) * 32768 / 100; }
+  bool isActive(void) const { return _level != 0 && _memory != nullptr; }
+  void clear(void);
+  void process(int32_t* buf, size_t frames);
+
+private:
+  static constexpr const size_t comb_count = 4;
+  static constexpr const size_t allpass_count = 2;
+
+  struct delay_t {
+    int16_t* buf;
+    uint16_t size;
+    uint16_t pos;
+  };
+  delay_t _comb[comb_count];
+  int32_t _comb_filter[comb_count];
+  delay_t _allpass[allpass_count];
+  int16_t* _memory = nullptr;
+  uint32_t _sample_rate = 0;
+  int32_t _level = 0; // Q15
+};
+
+class audio_effect_chain_t {
+public:
+  struct config_t {
+    bool enabled = false;
+    int8_t eq_low_db = 0;
+    int8_t eq_mid_db = 0;
+    int8_t eq_high_db = 0;
+    int8_t comp_threshold_db = 0;
+    uint8_t comp_ratio = 1;
+    uint8_t reverb_level = 0;
+    uint32_t sample_rate = 48000;
+
+    bool operator==(const config_t& rhs) const {
+      return enabled == rhs.enabled
+          && eq_low_db == rhs.eq_low_db
+          && eq_mid_db == rhs.eq_mid_db
+          && eq_high_db == rhs.eq_high_db
+          && comp_threshold_db == rhs.comp_threshold_db
+          && comp_ratio == rhs.comp_ratio
+          && reverb_level == rhs.reverb_level
+          && sample_rate == rhs.sample_rate;
+    }
+    bool operator!=(const config_t& rhs) const { return !(*this == rhs); }
+  };
+
+  // 設定を反映する (係数の計算を伴うため、変更があった時のみ呼び出すこと)
+  void setConfig(const config_t& config);
+  const config_t& getConfig(void) const { return _config; }
+
+  // L/R交互のステレオブロックにエフェクトを適用する
+  void process(int32_t* buf, size_t frames) {
+    if (!_active) { return; }
+    processInternal(buf, frames);
+  }
+
+  // ブロックの処理時間を通知する。予算を超えた場合は負荷の大きいリバーブを一定期間止める
+  void reportElapsed(uint32_t elapsed_usec, uint32_t budget_usec, uint32_t suspend_blocks);
+  uint32_t getOverrunCount(void) const { return _overrun_count; }
+  bool isActive(void) const { return _active; }
+
+private:
+  void processInternal(int32_t* buf, size_t frames);
+  void updateActive(void);
+
+  config_t _config;
+  audio_biquad_t _eq[3];
+  audio_compressor_t _comp;
+  audio_reverb_t _reverb;
+  uint32_t _overrun_count = 0;
+  uint32_t _reverb_suspend = 0;
+  bool _active = false;
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
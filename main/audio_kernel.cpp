@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "audio_kernel.hpp"
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+// 分岐を含まない形で書き、Xtensa では MIN/MAX 命令に置き換わるようにしている
+static inline int32_t min32(int32_t a, int32_t b) { return a < b ? a : b; }
+static inline int32_t max32(int32_t a, int32_t b) { return a > b ? a : b; }
+
+static inline int32_t saturate32(int64_t v)
+{
+  return (int32_t)((v > INT32_MAX) ? INT32_MAX : (v < INT32_MIN) ? INT32_MIN : v);
+}
+
+audio_peak_t audio_apply_gain(int32_t* buf, size_t frames, int32_t gain_from, int32_t gain_to)
+{
+  int32_t min_level = INT32_MAX;
+  int32_t max_level = INT32_MIN;
+  if (frames == 0) { return { min_level, max_level }; }
+
+  // 音量は 16bit の小数部を持たせてフレーム毎に加算する
+  int32_t diff = (gain_to - gain_from) * 65536;
+  int32_t step = diff / (int32_t)frames;
+  // 最終フレームで gain_to に一致するよう端数を先頭側に寄せる
+  int32_t gain_acc = gain_from * 65536 + 32768 + (diff - step * (int32_t)frames);
+
+  if (max32(gain_from, gain_to) <= audio_gain_unity && min32(gain_from, gain_to) >= 0) {
+    // 等倍以下では (x >> 8) * gain が int32 に収まるため飽和処理を省く
+    if (step == 0) {
+      int32_t gain = gain_to;
+      for (size_t i = 0; i < frames; ++i) {
+        int32_t l = buf[i * 2    ];
+        int32_t r = buf[i * 2 + 1];
+        min_level = min32(min_level, min32(l, r));
+        max_level = max32(max_level, max32(l, r));
+        buf[i * 2    ] = (l >> 8) * gain;
+        buf[i * 2 + 1] = (r >> 8) * gain;
+      }
+    } else {
+      for (size_t i = 0; i < frames; ++i) {
+        gain_acc += step;
+        int32_t gain = gain_acc >> 16;
+        int32_t l = buf[i * 2    ];
+        int32_t r = buf[i * 2 + 1];
+        min_level = min32(min_level, min32(l, r));
+        max_level = max32(max_level, max32(l, r));
+        buf[i * 2    ] = (l >> 8) * gain;
+        buf[i * 2 + 1] = (r >> 8) * gain;
+      }
+    }
+  } else {
+    for (size_t i = 0; i < frames; ++i) {
+      gain_acc += step;
+      int32_t gain = gain_acc >> 16;
+      int32_t l = buf[i * 2    ];
+      int32_t r = buf[i * 2 + 1];
+      min_level = min32(min_level, min32(l, r));
+      max_level = max32(max_level, max32(l, r));
+      buf[i * 2    ] = saturate32((int64_t)(l >> 8) * gain);
+      buf[i * 2 + 1] = saturate32((int64_t)(r >> 8) * gain);
+    }
+  }
+  return { min_level, max_level };
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_AUDIO_KERNEL_HPP
+#define KANPLAY_AUDIO_KERNEL_HPP
+
+/*
+audio_kernel は I2Sタスクが DMAブロック毎に行うサンプル処理をまとめたものです。
+ - 音量の適用・飽和・ピーク検出を1回の走査で行う
+ - 音量はブロック内でフレーム毎に直線的に変化させ、ブロック境界での段差を無くす
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+struct audio_peak_t {
+  int32_t min_level;
+  int32_t max_level;
+};
+
+// 音量の等倍値
+static constexpr const int32_t audio_gain_unity = 256;
+
+// L/R交互のステレオブロックに音量を適用し、適用前のピーク値を返す
+//  - 各サンプルは8bit右シフトしてから音量を掛ける (gain = audio_gain_unity で元の値の下位8bitを落としたもの)
+//  - 音量は先頭フレームから gain_from → gain_to へ変化し、最終フレームで gain_to となる
+//  - 等倍を超える音量では int32 の範囲で飽和させる
+audio_peak_t audio_apply_gain(int32_t* buf, size_t frames, int32_t gain_from, int32_t gain_to);
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "audio_latency.hpp"
+
+#include <math.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+audio_latency_t audio_latency;
+
+void audio_latency_t::requestStart(mode_t mode, uint8_t trials)
+{
+  _trials_request.store(trials);
+  _request.store(mode == mode_click ? req_start_click : req_start_midi);
+}
+
+int32_t audio_latency_t::findOnset(const int32_t* buf, size_t frames, int32_t threshold)
+{
+  for (size_t i = 0; i < frames; ++i) {
+    int32_t m = (buf[i * 2] >> 1) + (buf[i * 2 + 1] >> 1);
+    if (m > threshold || m < -threshold) { return (int32_t)i; }
+  }
+  return -1;
+}
+
+int32_t audio_latency_t::peakLevel(const int32_t* buf, size_t frames)
+{
+  int32_t peak = 0;
+  for (size_t i = 0; i < frames; ++i) {
+    int32_t m = (buf[i * 2] >> 1) + (buf[i * 2 + 1] >> 1);
+    // -INT32_MIN は表現できないため、負の値は 1 を足してから符号を反転する
+    if (m < 0) { m = -(m + 1); }
+    if (peak < m) { peak = m; }
+  }
+  return peak;
+}
+
+void audio_latency_t::summarize(uint32_t* values, size_t count, uint32_t sample_rate, result_t& result)
+{
+  result.count = count;
+  if (count == 0 || sample_rate == 0) {
+    result.min_usec = result.median_usec = result.max_usec = result.mean_usec = result.jitter_usec = 0;
+    return;
+  }
+  // 回数が少ないため挿入ソートとする
+  for (size_t i = 1; i < count; ++i) {
+    uint32_t v = values[i];
+    size_t j = i;
+    for (; j > 0 && values[j - 1] > v; --j) { values[j] = values[j - 1]; }
+    values[j] = v;
+  }
+  auto to_usec = [sample_rate](double samples) { return (uint32_t)lround(samples * 1000000.0 / sample_rate); };
+
+  double sum = 0;
+  for (size_t i = 0; i < count; ++i) { sum += values[i]; }
+  double mean = sum / count;
+  double var = 0;
+  for (size_t i = 0; i < count; ++i) { var += (values[i] - mean) * (values[i] - mean); }
+  var /= count;
+
+  double median = (count & 1) ? values[count >> 1]
+                              : (values[(count >> 1) - 1] + (double)values[count >> 1]) * 0.5;
+  result.min_usec = to_usec(values[0]);
+  result.max_usec = to_usec(values[count - 1]);
+  result.median_usec = to_usec(median);
+  result.mean_usec = to_usec(mean);
+  result.jitter_usec = to_usec(sqrt(var));
+}
+
+void audio_latency_t::begin(mode_t mode, uint64_t block_sample)
+{
+  uint8_t trials = _trials_request.load();
+  if (trials == 0) { trials = 1; }
+  if (trials > trial_max) { trials = trial_max; }
+  _trials = trials;
+  _mode = mode;
+  _count = 0;
+  _failures = 0;
+  _phase = ph_quiet;
+  _phase_start = block_sample;
+  _noise_peak = 0;
+  _quiet_retry = 0;
+  _result = result_t();
+  _result.mode = mode;
+  _progress.store(0);
+  _state.store(lat_measuring);
+}
+
+void audio_latency_t::nextTrial(uint64_t sample, bool detected, uint32_t latency)
+{
+  if (detected && _count < trial_max) {
+    _values[_count++] = latency;
+  } else {
+    ++_failures;
+  }
+  _progress.store(_count + _failures);
+  _phase = ph_gap;
+  _phase_start = sample;
+}
+
+void audio_latency_t::finish(void)
+{
+  summarize(_values, _count, _sample_rate, _result);
+  _result.mode = _mode;
+  _result.failures = _failures;
+  // 半数以上 (最低3回) 検出できた場合のみ結果を採用する
+  uint32_t required = (_trials + 1) >> 1;
+  if (required < 3) { required = (_trials < 3) ? _trials : 3; }
+  _state.store(_count >= required ? lat_done : lat_failed);
+}
+
+audio_latency_t::event_t audio_latency_t::process(int32_t* buf, size_t frames, uint64_t block_sample, uint32_t sample_rate)
+{
+  state_t state = _state.load();
+  uint8_t progress = _progress.load();
+  event_t ev = processBlock(buf, frames, block_sample, sample_rate);
+  if (ev == ev_note_on) {
+    _probe.store(((_probe.load() >> 1) + 1) << 1 | 1);
+  } else if (ev == ev_note_off) {
+    _probe.store(_probe.load() & ~1u);
+  } else if (state == _state.load() && progress == _progress.load()) {
+    return ev;
+  }
+#if __has_include(<freertos/FreeRTOS.h>)
+  if (_notify_task != nullptr) { xTaskNotifyGive(_notify_task); }
+#endif
+  return ev;
+}
+
+audio_latency_t::event_t audio_latency_t::processBlock(int32_t* buf, size_t frames, uint64_t block_sample, uint32_t sample_rate)
+{
+  event_t ev = ev_none;
+  uint8_t request = _request.exchange(req_none);
+  switch (request) {
+  default: break;
+  case req_start_midi:
+  case req_start_click:
+    if (_note_on) {
+      _note_on = false;
+      ev = ev_note_off;
+    }
+    if (sample_rate) { _sample_rate = sample_rate; }
+    begin(request == req_start_click ? mode_click : mode_midi, block_sample);
+    break;
+  case req_cancel:
+    if (_state.load() == lat_measuring) { _state.store(lat_idle); }
+    if (_note_on) {
+      _note_on = false;
+      return ev_note_off;
+    }
+    return ev_none;
+  }
+  if (_state.load() != lat_measuring) { return ev; }
+
+  const uint64_t block_end = block_sample + frames;
+  if (_note_on && block_end >= _note_off_sample) {
+    _note_on = false;
+    ev = ev_note_off;
+  }
+
+  switch (_phase) {
+  case ph_quiet:
+    {
+      int32_t peak = peakLevel(buf, frames);
+      if (_noise_peak < peak) { _noise_peak = peak; }
+      if (_noise_peak > noise_max) {
+        // 演奏中などで無音にならない場合は区間を測り直し、続く場合はこの回を失敗とする
+        _noise_peak = 0;
+        _phase_start = block_end;
+        if (++_quiet_retry > quiet_retry_max) {
+          _quiet_retry = 0;
+          nextTrial(block_end, false, 0);
+        }
+        break;
+      }
+      if (block_end - _phase_start < msecToSamples(quiet_msec)) { break; }
+      // 同じブロックでノートオフとノートオンは返せないため、次のブロックで発音する
+      if (_mode == mode_midi && ev != ev_none) { break; }
+
+      // 無音区間のピークの4倍 (+12dB) を閾値とし、受信したブロックの末尾を起点として発音する
+      _threshold = _noise_peak * 4;
+      if (_threshold < threshold_min) { _threshold = threshold_min; }
+      _emit_sample = block_end;
+      _phase = ph_listen;
+      _phase_start = block_end;
+      if (_mode == mode_click) {
+        // 出力の先頭を立ち上がりの明確な矩形波のバースト (振幅 -6dBFS) で置き換える (入力は無音のため)
+        size_t len = frames < click_frames ? frames : click_frames;
+        for (size_t i = 0; i < len; ++i) {
+          int32_t v = (i & 4) ? -(1 << 30) : (1 << 30);
+          buf[i * 2    ] = v;
+          buf[i * 2 + 1] = v;
+        }
+      } else {
+        _note_on = true;
+        _note_off_sample = block_end + msecToSamples(note_msec);
+        ev = ev_note_on;
+      }
+    }
+    break;
+
+  case ph_listen:
+    {
+      int32_t onset = findOnset(buf, frames, _threshold);
+      if (onset >= 0) {
+        nextTrial(block_end, true, (uint32_t)(block_sample + onset - _emit_sample));
+      } else if (block_end - _phase_start >= msecToSamples(listen_msec)) {
+        nextTrial(block_end, false, 0);
+      }
+    }
+    break;
+
+  case ph_gap:
+    if (!_note_on && block_end - _phase_start >= msecToSamples(gap_msec)) {
+      if (_count + _failures >= _trials) {
+        finish();
+      } else {
+        _phase = ph_quiet;
+        _phase_start = block_end;
+        _noise_peak = 0;
+        _quiet_retry = 0;
+      }
+    }
+    break;
+  }
+  return ev;
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
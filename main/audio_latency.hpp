@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_AUDIO_LATENCY_HPP
+#define KANPLAY_AUDIO_LATENCY_HPP
+
+/*
+audio_latency は 発音の指示から I2S の入力に音が現れるまでの遅れを測定します。
+ - MIDI方式 : 内部MIDIへノートを送信し、内蔵音源の音が入力に現れるまでを測る (演奏の遅れそのもの)
+ - クリック方式 : I2Sの出力にクリック音を加え、出力から入力へ折り返した音が現れるまでを測る
+ - 測定の起点は I2Sタスクが発音を指示した時点 (受信したブロックの末尾) とし、サンプルクロックで数える
+ - 直前の無音区間のピークから閾値を決め、閾値を最初に超えたサンプルを音の立ち上がりとする
+ - 測定を繰り返し、最小・中央値・最大・平均・標準偏差を求める
+ - I2Sのドライバや MIDIの送信には依存しないため、ホスト上で合成した信号により検出と統計を確認できる
+ - I2Sタスクはノートの送信や結果の保存を行わない。発音状態 (getProbe) と測定の状態が変わると通知先のタスクを起こし、
+   通知先のタスクがノートの送信と結果の保存を行う
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+
+#if __has_include(<freertos/FreeRTOS.h>)
+ #include <freertos/FreeRTOS.h>
+ #include <freertos/task.h>
+#endif
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class audio_latency_t {
+public:
+  enum mode_t : uint8_t {
+    mode_midi = 0,
+    mode_click,
+  };
+
+  enum state_t : uint8_t {
+    lat_idle = 0,     // 未測定
+    lat_measuring,    // 測定中
+    lat_done,         // 測定完了 (結果は getResult で取得する)
+    lat_failed,       // 音を検出できなかった回数が多いため中止した
+  };
+
+  // process の戻り値。MIDI方式ではノートの送信を求める (送信は getProbe を参照するタスクが行う)
+  enum event_t : uint8_t {
+    ev_none = 0,
+    ev_note_on,
+    ev_note_off,
+  };
+
+  struct result_t {
+    mode_t mode = mode_midi;
+    uint8_t count = 0;          // 検出できた回数
+    uint8_t failures = 0;       // 検出できなかった回数
+    uint32_t min_usec = 0;
+    uint32_t median_usec = 0;
+    uint32_t max_usec = 0;
+    uint32_t mean_usec = 0;
+    uint32_t jitter_usec = 0;   // 標準偏差
+  };
+
+  static constexpr const size_t trial_max = 16;
+  static constexpr const uint32_t quiet_msec = 150;     // 閾値を決めるための無音区間
+  static constexpr const uint32_t listen_msec = 500;    // 音が現れるのを待つ最大時間
+  static constexpr const uint32_t note_msec = 50;       // MIDI方式のノートの長さ
+  static constexpr const uint32_t gap_msec = 400;       // 測定の間隔 (前の音の減衰を待つ)
+  static constexpr const uint32_t quiet_retry_max = 8;  // 無音にならない場合に区間を測り直す回数
+  static constexpr const int32_t threshold_min = 1 << 21;       // 閾値の下限 (約 -60dBFS)
+  static constexpr const int32_t noise_max = 1 << 28;           // 無音とみなすピークの上限 (約 -18dBFS)
+  static constexpr const size_t click_frames = 16;      // クリック音の長さ (最小のDMAブロック以下)
+
+  // 測定の開始・中止を要求する (任意のタスクから呼び出せる。処理は I2Sタスクが行う)
+  void requestStart(mode_t mode, uint8_t trials);
+  void requestCancel(void) { _request.store(req_cancel); }
+
+  state_t getState(void) const { return _state.load(); }
+  // 完了した測定の回数 (検出できなかった回を含む)
+  uint8_t getProgress(void) const { return _progress.load(); }
+  // lat_done / lat_failed になった後に有効 (次の測定を開始するまで書き換わらない)
+  const result_t& getResult(void) const { return _result; }
+
+  // MIDI方式のノートの発音状態 (bit0: 発音中、bit1以降: ノートオンの通し番号)
+  // 通し番号が変わっていればノートオンを、bit0 が落ちていればノートオフを送信する
+  uint32_t getProbe(void) const { return _probe.load(); }
+
+#if __has_include(<freertos/FreeRTOS.h>)
+  // 発音状態・測定の状態・進捗が変わった時に通知するタスク
+  void setNotifyTaskHandle(TaskHandle_t handle) { _notify_task = handle; }
+#endif
+
+  // I2Sタスクから呼び出す。受信したブロックを解析し、クリック方式では出力にクリック音を加える
+  // block_sample : ブロックの先頭のサンプル位置 (サンプルクロック)
+  event_t process(int32_t* buf, size_t frames, uint64_t block_sample, uint32_t sample_rate);
+
+  // L/Rの平均の絶対値が threshold を超える最初のフレームを返す (無ければ -1)
+  static int32_t findOnset(const int32_t* buf, size_t frames, int32_t threshold);
+  // ブロック内の L/Rの平均の絶対値のピーク
+  static int32_t peakLevel(const int32_t* buf, size_t frames);
+  // 測定値 (サンプル数) から統計を求める。values は並べ替えられる
+  static void summarize(uint32_t* values, size_t count, uint32_t sample_rate, result_t& result);
+
+protected:
+  enum request_t : uint8_t {
+    req_none = 0,
+    req_start_midi,
+    req_start_click,
+    req_cancel,
+  };
+  enum phase_t : uint8_t {
+    ph_quiet,
+    ph_listen,
+    ph_gap,
+  };
+
+  event_t processBlock(int32_t* buf, size_t frames, uint64_t block_sample, uint32_t sample_rate);
+  void begin(mode_t mode, uint64_t block_sample);
+  void nextTrial(uint64_t sample, bool detected, uint32_t latency);
+  void finish(void);
+  uint32_t msecToSamples(uint32_t msec) const { return (uint32_t)((uint64_t)msec * _sample_rate / 1000); }
+
+  std::atomic<uint8_t> _request { req_none };
+  std::atomic<uint8_t> _trials_request { 0 };
+  std::atomic<state_t> _state { lat_idle };
+  std::atomic<uint8_t> _progress { 0 };
+  std::atomic<uint32_t> _probe { 0 };
+#if __has_include(<freertos/FreeRTOS.h>)
+  TaskHandle_t _notify_task = nullptr;
+#endif
+
+  result_t _result;
+  uint32_t _values[trial_max];
+  uint8_t _trials = 0;
+  uint8_t _count = 0;
+  uint8_t _failures = 0;
+  mode_t _mode = mode_midi;
+  phase_t _phase = ph_quiet;
+  uint32_t _sample_rate = 48000;
+  uint64_t _phase_start = 0;
+  uint64_t _emit_sample = 0;
+  uint64_t _note_off_sample = 0;
+  bool _note_on = false;
+  int32_t _noise_peak = 0;
+  int32_t _threshold = 0;
+  uint32_t _quiet_retry = 0;
+};
+
+extern audio_latency_t audio_latency;
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
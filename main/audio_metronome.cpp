@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "audio_metronome.hpp"
+
+#include <math.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+// クリック音の周波数 (通常 / 強拍) と減衰の時定数
+static constexpr const float click_freq[2] = { 1000.0f, 2000.0f };
+static constexpr const float click_decay_msec = 5.0f;
+
+static inline int32_t saturate32(int64_t v)
+{
+  return (int32_t)((v > INT32_MAX) ? INT32_MAX : (v < INT32_MIN) ? INT32_MIN : v);
+}
+
+void audio_metronome_t::setup(uint32_t sample_rate)
+{
+  if (_sample_rate == sample_rate || sample_rate == 0) { return; }
+  _sample_rate = sample_rate;
+  _click_length = (size_t)sample_rate * click_msec / 1000;
+  if (_click_length > click_max) { _click_length = click_max; }
+
+  // 立ち上がりを明確にするため、振幅最大の位相 (cos) から始まる減衰正弦波とする
+  for (int type = 0; type < 2; ++type) {
+    for (size_t i = 0; i < _click_length; ++i) {
+      double t = (double)i / sample_rate;
+      double env = exp(-t * 1000.0 / click_decay_msec);
+      _click[type][i] = (int16_t)lround(16384.0 * env * cos(2.0 * M_PI * click_freq[type] * t));
+    }
+  }
+  reset();
+}
+
+void audio_metronome_t::reset(void)
+{
+  _voice = nullptr;
+  _has_last = false;
+}
+
+void audio_metronome_t::process(int32_t* buf, size_t frames, uint64_t block_sample, const timeline_t& timeline, const config_t& config)
+{
+  if (_has_last && timeline.session != _session) { _has_last = false; }
+  _session = timeline.session;
+
+  size_t pos = 0;
+  bool active = (timeline.period_x256 != 0) && (config.mode != mode_off) && (config.level != 0) && (_click_length != 0);
+  if (active) {
+    const uint64_t block_end = block_sample + frames;
+    const uint64_t late = (uint64_t)_sample_rate * late_tolerance_usec / 1000000u;
+    const uint32_t beats_per_bar = config.beats_per_bar ? config.beats_per_bar : 1;
+
+    // ブロック内 (遅れの許容範囲を含む) で最初の拍を求める
+    int64_t rel = (int64_t)block_sample - (int64_t)late - (int64_t)timeline.anchor_sample;
+    int64_t n = (rel <= 0) ? -((-rel * 256) / timeline.period_x256)
+                           : ((rel * 256 + timeline.period_x256 - 1) / timeline.period_x256);
+    int64_t beat = (int64_t)timeline.anchor_beat + n;
+    if (_has_last && beat <= (int64_t)_last_beat) { beat = (int64_t)_last_beat + 1; }
+    if (beat < 0) { beat = 0; }
+
+    for (;; ++beat) {
+      int64_t diff = (beat - (int64_t)timeline.anchor_beat) * timeline.period_x256;
+      int64_t click_sample = (int64_t)timeline.anchor_sample + (diff >= 0 ? (diff + 128) >> 8 : -((-diff + 128) >> 8));
+      if (click_sample >= (int64_t)block_end) { break; }
+
+      _has_last = true;
+      _last_beat = (uint32_t)beat;
+      // 許容範囲を超えて遅れた拍や、カウントインのみの設定でカウントイン以降の拍は鳴らさない
+      if (click_sample < (int64_t)block_sample - (int64_t)late) { continue; }
+      if (config.mode == mode_count_in_only && (uint32_t)beat >= timeline.count_in_beats) { continue; }
+
+      // 遅れて公開された拍はブロックの先頭で鳴らす
+      size_t offset = (click_sample > (int64_t)block_sample) ? (size_t)(click_sample - (int64_t)block_sample) : 0;
+      _last_click_sample = block_sample + offset;
+
+      // 新しいクリック音の位置までは発音中のクリック音を続ける
+      mixVoice(buf, pos, offset);
+      pos = offset;
+
+      uint32_t bar_pos = (uint32_t)beat % beats_per_bar;
+      bool accent = (config.accent_mask >> bar_pos) & 1;
+      _voice = _click[accent ? 1 : 0];
+      _voice_pos = 0;
+      _voice_gain = (config.level > 100 ? 100 : config.level) * 32768 / 100;
+    }
+  }
+
+  mixVoice(buf, pos, frames);
+}
+
+void audio_metronome_t::mixVoice(int32_t* buf, size_t pos, size_t end)
+{
+  // int16 × Q15 の積を 32bitの上位16bitへ合わせて加える
+  for (; pos < end && _voice; ++pos) {
+    int64_t v = (int64_t)_voice[_voice_pos] * _voice_gain * 2;
+    buf[pos * 2    ] = saturate32(buf[pos * 2    ] + v);
+    buf[pos * 2 + 1] = saturate32(buf[pos * 2 + 1] + v);
+    if (++_voice_pos >= _click_length) { _voice = nullptr; }
+  }
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
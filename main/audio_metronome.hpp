@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_AUDIO_METRONOME_HPP
+#define KANPLAY_AUDIO_METRONOME_HPP
+
+/*
+audio_metronome は 演奏エンジンの拍のタイミングに合わせてクリック音を I2Sの出力へ直接合成します。
+ - 演奏タスクは拍毎に「拍の通し番号・その拍のサンプル位置・拍の間隔」を timeline_t として公開する
+ - I2Sタスクは DMAブロック毎に timeline_t から次の拍のサンプル位置を求め、ブロック内の該当位置からクリック音を加える
+ - 拍の位置はサンプル単位で決まるため、MIDI送信やタスク切替えの揺らぎの影響を受けない
+ - 同じ通し番号の拍は一度しか鳴らさないため、演奏タスクが拍を公開するタイミングが前後しても二重に鳴らない
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class audio_metronome_t {
+public:
+  // 演奏タスクが公開する拍の情報
+  struct timeline_t {
+    uint64_t anchor_sample = 0;   // 基準となる拍のサンプル位置 (サンプルクロック)
+    uint32_t anchor_beat = 0;     // 基準となる拍の通し番号 (演奏開始時を0とする)
+    uint32_t period_x256 = 0;     // 拍の間隔 (サンプル数。下位8bitは小数部。0の場合は停止中)
+    uint32_t count_in_beats = 0;  // 先頭からこの数の拍はカウントイン
+    uint32_t session = 0;         // 演奏開始毎に更新する番号 (拍の通し番号が0に戻ったことを示す)
+  };
+
+  enum mode_t : uint8_t {
+    mode_off = 0,
+    mode_on,            // 常に鳴らす
+    mode_count_in_only, // カウントインのみ鳴らす
+  };
+
+  struct config_t {
+    mode_t mode = mode_off;
+    uint8_t level = 0;          // 音量 (0-100)
+    uint8_t beats_per_bar = 4;  // 1小節の拍数
+    uint8_t accent_mask = 1;    // 強拍とする小節内の拍 (bit0 が小節の頭)
+  };
+
+  // クリック音の波形を作成する (サンプリングレートの変更時に呼び出す)
+  void setup(uint32_t sample_rate);
+
+  // 演奏の停止時や再開時に、鳴らした拍の記録と発音中のクリック音を消去する
+  void reset(void);
+
+  // L/R交互のステレオブロックにクリック音を加える
+  // block_sample : ブロック先頭のサンプル位置 (サンプルクロック)
+  void process(int32_t* buf, size_t frames, uint64_t block_sample, const timeline_t& timeline, const config_t& config);
+
+  // 最後に鳴らした拍の通し番号とサンプル位置 (検証用)
+  uint32_t getLastBeat(void) const { return _last_beat; }
+  uint64_t getLastClickSample(void) const { return _last_click_sample; }
+
+  // 拍の時刻を過ぎてから公開された場合に、ブロックの先頭で遅れて鳴らす許容範囲
+  static constexpr const uint32_t late_tolerance_usec = 20000;
+
+protected:
+  void mixVoice(int32_t* buf, size_t pos, size_t end);
+
+  static constexpr const uint32_t click_msec = 30;
+  static constexpr const size_t click_max = 48000 * 2 * click_msec / 1000; // 96kHzまで
+
+  // クリック音の波形 (0:通常 1:強拍)
+  int16_t _click[2][click_max];
+  size_t _click_length = 0;
+  uint32_t _sample_rate = 0;
+
+  // 発音中のクリック音
+  const int16_t* _voice = nullptr;
+  size_t _voice_pos = 0;
+  int32_t _voice_gain = 0;
+
+  bool _has_last = false;
+  uint32_t _session = 0;
+  uint32_t _last_beat = 0;
+  uint64_t _last_click_sample = 0;
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
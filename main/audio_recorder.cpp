@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "audio_recorder.hpp"
+
+#include <string.h>
+#include <stdlib.h>
+
+#if __has_include(<esp_heap_caps.h>)
+ #include <esp_heap_caps.h>
+#endif
+#if __has_include(<esp_timer.h>)
+ #include <esp_timer.h>
+#else
+ #include <chrono>
+#endif
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+audio_recorder_t audio_recorder;
+
+static uint32_t getTimeUsec(void)
+{
+#if __has_include(<esp_timer.h>)
+  return (uint32_t)esp_timer_get_time();
+#else
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static void put16(uint8_t* dst, uint16_t value)
+{
+  dst[0] = value;
+  dst[1] = value >> 8;
+}
+
+static void put32(uint8_t* dst, uint32_t value)
+{
+  put16(dst, value);
+  put16(&dst[2], value >> 16);
+}
+
+void audio_recorder_t::makeWavHeader(uint8_t* dst, uint32_t sample_rate, uint32_t data_bytes)
+{
+  memcpy(&dst[0], "RIFF", 4);
+  put32(&dst[4], data_bytes + wav_header_bytes - 8);
+  memcpy(&dst[8], "WAVEfmt ", 8);
+  put32(&dst[16], 16);              // fmtチャンクのサイズ
+  put16(&dst[20], 1);               // リニアPCM
+  put16(&dst[22], 2);               // チャンネル数
+  put32(&dst[24], sample_rate);
+  put32(&dst[28], sample_rate * bytes_per_frame);
+  put16(&dst[32], bytes_per_frame);
+  put16(&dst[34], 16);              // 量子化ビット数
+  memcpy(&dst[36], "data", 4);
+  put32(&dst[40], data_bytes);
+}
+
+audio_recorder_t::~audio_recorder_t()
+{
+  if (_ring) { free(_ring); }
+}
+
+bool audio_recorder_t::init(size_t ring_bytes, size_t chunk_bytes)
+{
+  if (_ring != nullptr) { return true; }
+  if (chunk_bytes == 0 || chunk_bytes % bytes_per_frame) { return false; }
+  ring_bytes -= ring_bytes % chunk_bytes;
+  if (ring_bytes < chunk_bytes * 2) { return false; }
+#if __has_include(<esp_heap_caps.h>)
+  _ring = (uint8_t*)heap_caps_malloc(ring_bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+  _ring = (uint8_t*)malloc(ring_bytes);
+#endif
+  if (_ring == nullptr) { return false; }
+  _ring_bytes = ring_bytes;
+  _chunk_bytes = chunk_bytes;
+  return true;
+}
+
+bool audio_recorder_t::requestStart(storage_base_t* storage, const char* path, uint32_t sample_rate)
+{
+  if (_ring == nullptr || storage == nullptr) { return false; }
+  auto state = _state.load();
+  if (state != rec_idle && state != rec_error) { return false; }
+  _storage = storage;
+  strncpy(_path, path, sizeof(_path) - 1);
+  _path[sizeof(_path) - 1] = 0;
+  _sample_rate = sample_rate;
+  _state.store(rec_starting, std::memory_order_release);
+  return true;
+}
+
+void audio_recorder_t::requestStop(void)
+{
+  auto state = rec_recording;
+  if (!_state.compare_exchange_strong(state, rec_stopping)) {
+    // ファイル作成前であれば取り消す
+    state = rec_starting;
+    _state.compare_exchange_strong(state, rec_idle);
+  }
+}
+
+void audio_recorder_t::pushInternal(const int32_t* buf, size_t frames)
+{
+  const uint32_t length = frames * bytes_per_frame;
+  const uint32_t wpos = _write_pos.load(std::memory_order_relaxed);
+  const uint32_t fill = wpos - _read_pos.load(std::memory_order_acquire);
+  if (fill + length > _ring_bytes) {
+    _overrun_count.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // 上位16bitを取り出して格納する (WAVはリトルエンディアン)
+  size_t pos = wpos % _ring_bytes;
+  for (size_t i = 0; i < frames * 2; ++i) {
+    auto dst = (int16_t*)&_ring[pos];
+    *dst = buf[i] >> 16;
+    pos += 2;
+    if (pos >= _ring_bytes) { pos = 0; }
+  }
+  _write_pos.store(wpos + length, std::memory_order_release);
+}
+
+bool audio_recorder_t::openFile(void)
+{
+  // 録音中以外は push が書き込まないため、ここで位置を先頭に戻してチャンクの境界を揃える
+  _write_pos.store(0, std::memory_order_relaxed);
+  _read_pos.store(0, std::memory_order_release);
+  _data_bytes = 0;
+  _max_fill = 0;
+  _underrun_count = 0;
+  _overrun_count.store(0);
+
+  uint8_t header[wav_header_bytes];
+  makeWavHeader(header, _sample_rate, 0);
+  if (!_storage->beginStreamFile(_path)) { return false; }
+  if (_storage->writeStreamFile(header, sizeof(header)) != (int)sizeof(header)) {
+    _storage->endStreamFile();
+    return false;
+  }
+  return true;
+}
+
+bool audio_recorder_t::writeChunk(size_t length)
+{
+  const uint32_t rpos = _read_pos.load(std::memory_order_relaxed);
+  const uint8_t* src = &_ring[rpos % _ring_bytes];
+
+  uint32_t start = getTimeUsec();
+  int written = _storage->writeStreamFile(src, length);
+  uint32_t elapsed = getTimeUsec() - start;
+  bool result = (written == (int)length);
+
+  // 書込み時間がその音声の長さを超えた場合、リングバッファの使用量が増え続けることになる
+  if ((uint64_t)elapsed * _sample_rate > (uint64_t)(length / bytes_per_frame) * 1000000u) {
+    ++_underrun_count;
+  }
+  _read_pos.store(rpos + length, std::memory_order_release);
+  // 途中で失敗した場合も、ヘッダのデータ長は実際に書き込めたフレーム分とする
+  if (!result) { length = (written > 0) ? written - written % bytes_per_frame : 0; }
+  _data_bytes += length;
+  return result;
+}
+
+void audio_recorder_t::closeFile(bool error)
+{
+  uint8_t header[wav_header_bytes];
+  makeWavHeader(header, _sample_rate, _data_bytes);
+  bool result = _storage->rewriteStreamFile(0, header, sizeof(header));
+  result = _storage->endStreamFile() && result;
+  _state.store((error || !result) ? rec_error : rec_idle);
+}
+
+bool audio_recorder_t::process(void)
+{
+  switch (_state.load(std::memory_order_acquire)) {
+  default:
+    return false;
+
+  case rec_starting:
+    if (!openFile()) {
+      _state.store(rec_error);
+      return true;
+    }
+    {
+      // 停止要求と競合した場合は、そのまま停止処理へ進む
+      auto state = rec_starting;
+      _state.compare_exchange_strong(state, rec_recording, std::memory_order_release);
+    }
+    return true;
+
+  case rec_recording:
+  case rec_stopping:
+    break;
+  }
+
+  // 停止要求を先に読み取ってから残量を確認し、停止直前に書き込まれた分も漏らさず保存する
+  bool stopping = (_state.load(std::memory_order_acquire) == rec_stopping);
+  size_t fill = _write_pos.load(std::memory_order_acquire) - _read_pos.load(std::memory_order_relaxed);
+  if (_max_fill < fill) { _max_fill = fill; }
+
+  // WAVファイルのサイズの上限 (4GB) に達する前に停止する (リングバッファの位置も32bitで一周しない)
+  if (!stopping && (uint64_t)_data_bytes + _ring_bytes + wav_header_bytes > UINT32_MAX) {
+    requestStop();
+    return true;
+  }
+
+  if (fill >= _chunk_bytes) {
+    if (!writeChunk(_chunk_bytes)) {
+      _state.store(rec_stopping);
+      closeFile(true);
+    }
+    return true;
+  }
+  if (!stopping) { return false; }
+
+  // 残りはチャンクに満たないため、折り返しを考慮して書き込む
+  bool result = true;
+  while (fill && result) {
+    size_t pos = _read_pos.load(std::memory_order_relaxed) % _ring_bytes;
+    size_t length = _ring_bytes - pos;
+    if (length > fill) { length = fill; }
+    result = writeChunk(length);
+    fill -= length;
+  }
+  closeFile(!result);
+  return true;
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_AUDIO_RECORDER_HPP
+#define KANPLAY_AUDIO_RECORDER_HPP
+
+/*
+audio_recorder は I2Sタスクが処理したオーディオをWAVファイルとしてSDカードに保存します。
+ - I2Sタスクは push でブロックを16bitステレオに変換してリングバッファ (PSRAM) へ書き込むのみで、ファイル操作は行わない
+ - 書込みタスク (優先度は画面描画と同じ) がリングバッファからチャンク単位でファイルへ書き込む
+ - SDカードは画面とSPIバスを共有するため、spi_lock はチャンク1つの書込み毎に取得・解放し、画面描画が長く止まらないようにする
+ - リングバッファはチャンクサイズの整数倍とし、チャンクが折り返し位置を跨がないようにする
+ - リングバッファは I2Sタスク(書き手) と書込みタスク(読み手) の1対1で使用し、ロックは不要
+*/
+
+#include "file_manage.hpp"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class audio_recorder_t {
+public:
+  enum state_t : uint8_t {
+    rec_idle = 0,   // 停止中
+    rec_starting,   // 開始要求あり (書込みタスクがファイルを作成する)
+    rec_recording,  // 録音中
+    rec_stopping,   // 停止要求あり (書込みタスクが残りを書き込みファイルを閉じる)
+    rec_error,      // ファイルの作成や書込みに失敗したため停止した
+  };
+
+  ~audio_recorder_t();
+
+  // リングバッファを確保する (ring_bytes は chunk_bytes の整数倍に切り捨てる)
+  bool init(size_t ring_bytes, size_t chunk_bytes);
+
+  // 録音の開始・停止を要求する (任意のタスクから呼び出せる。ファイル操作は書込みタスクが行う)
+  bool requestStart(storage_base_t* storage, const char* path, uint32_t sample_rate);
+  void requestStop(void);
+
+  // I2Sタスクから呼び出す。L/R交互の32bitステレオを16bitに変換してリングバッファへ書き込む
+  // 空きが足りない場合はブロック全体を破棄し、オーバーランとして数える
+  void push(const int32_t* buf, size_t frames) {
+    if (_state.load(std::memory_order_acquire) != rec_recording) { return; }
+    pushInternal(buf, frames);
+  }
+
+  // 書込みタスクから呼び出す。戻り値は書込みなどの処理を行ったか否か
+  bool process(void);
+
+  state_t getState(void) const { return _state.load(); }
+  // リングバッファの空きが無くなり破棄したブロック数
+  uint32_t getOverrunCount(void) const { return _overrun_count.load(); }
+  // チャンクの書込みに、その音声の長さ以上の時間がかかった回数 (書込みが録音に追いついていない)
+  uint32_t getUnderrunCount(void) const { return _underrun_count; }
+  // リングバッファの使用量の最大値 (byte)
+  size_t getMaxFill(void) const { return _max_fill; }
+  // 書き込んだ音声データのバイト数
+  uint32_t getDataBytes(void) const { return _data_bytes; }
+  size_t getRingBytes(void) const { return _ring_bytes; }
+  size_t getChunkBytes(void) const { return _chunk_bytes; }
+
+  static constexpr const size_t wav_header_bytes = 44;
+  static constexpr const uint32_t bytes_per_frame = 4;  // 16bit ステレオ
+
+  // WAVファイルのヘッダを作成する
+  static void makeWavHeader(uint8_t* dst, uint32_t sample_rate, uint32_t data_bytes);
+
+protected:
+  void pushInternal(const int32_t* buf, size_t frames);
+  bool openFile(void);
+  bool writeChunk(size_t length);
+  void closeFile(bool error);
+
+  uint8_t* _ring = nullptr;
+  size_t _ring_bytes = 0;
+  size_t _chunk_bytes = 0;
+
+  // 書込み済み・読込み済みのバイト数 (単調増加し、差分が使用量となる)
+  std::atomic<uint32_t> _write_pos { 0 };
+  std::atomic<uint32_t> _read_pos { 0 };
+
+  std::atomic<state_t> _state { rec_idle };
+  std::atomic<uint32_t> _overrun_count { 0 };
+  uint32_t _underrun_count = 0;
+  size_t _max_fill = 0;
+
+  storage_base_t* _storage = nullptr;
+  char _path[64];
+  uint32_t _sample_rate = 0;
+  uint32_t _data_bytes = 0;
+};
+
+extern audio_recorder_t audio_recorder;
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
@@ -0,0 +1,517 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "audio_synth.hpp"
+
+#include <math.h>
+#include <string.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+static constexpr const int32_t env_full = 1 << 30;
+static constexpr const int32_t env_silent = env_full >> 12;   // これを下回ったら発音を終える (約 -72dB)
+static constexpr const uint32_t steal_release_msec = 10;      // 上限を超えたボイスを止める際のリリース時間
+static constexpr const size_t voice_limit_min = 4;            // 処理時間に応じて下げるボイス数の下限
+static constexpr const int32_t bend_range_semitone = 2;       // ピッチベンドの幅 (GMの初期値)
+
+// GMのプログラム番号を8つずつまとめたファミリ毎の音色
+const audio_synth_t::patch_t audio_synth_t::_patch_table[16] = {
+  //  wave        wave2       detune oct  A     D     S    R    cutoff vel_cutoff
+  { wave_epiano,  wave_sine,      0,  1,  2,  1800,   0, 300,  90, 120 }, // 0-7   Piano
+  { wave_sine,    wave_none,      0,  0,  1,   600,   0, 400, 255,   0 }, // 8-15  Chromatic Percussion
+  { wave_organ,   wave_none,      0,  0, 10,     1, 127,  40, 200,   0 }, // 16-23 Organ
+  { wave_saw,     wave_none,      0,  0,  2,  1500,   0, 250,  60, 100 }, // 24-31 Guitar
+  { wave_triangle,wave_sine,      0, -1,  5,  1200,  40, 120,  80,  60 }, // 32-39 Bass
+  { wave_saw,     wave_saw,       8,  0, 80,   500, 110, 300,  70,  40 }, // 40-47 Strings
+  { wave_saw,     wave_saw,     -10,  0,120,   800, 100, 500,  50,  30 }, // 48-55 Ensemble
+  { wave_brass,   wave_none,      0,  0, 30,   400,  90, 150,  80,  90 }, // 56-63 Brass
+  { wave_pulse,   wave_none,      0,  0, 25,   300, 100, 120,  90,  60 }, // 64-71 Reed
+  { wave_sine,    wave_triangle,  0,  1, 40,   300, 110, 150, 200,   0 }, // 72-79 Pipe
+  { wave_square,  wave_saw,       5,  0,  3,   800,  90, 200,  90,  80 }, // 80-87 Synth Lead
+  { wave_saw,     wave_triangle,  7,  1,250,  1000,  90, 800,  40,  20 }, // 88-95 Synth Pad
+  { wave_square,  wave_sine,     12,  1, 60,  1200,  60, 700,  60,  40 }, // 96-103 Synth Effects
+  { wave_pulse,   wave_sine,      0,  2,  2,  1200,   0, 300, 120,  80 }, // 104-111 Ethnic
+  { wave_sine,    wave_none,      0,  0,  1,   250,   0, 150, 255,   0 }, // 112-119 Percussive
+  { wave_triangle,wave_none,      0,  0, 20,   600,  60, 300, 120,   0 }, // 120-127 Sound Effects
+};
+
+// GMのドラムマップのノート番号に対するドラムの音色
+const audio_synth_t::drum_patch_t& audio_synth_t::drumPatch(uint8_t note)
+{
+  static const drum_patch_t table[] = {
+    // note drop tone noise cutoff  hp     decay
+    {  50,  25, 127,  12, 255, false,  450 }, // 0 : キック
+    {  57,  60,  60, 110, 200, false,  250 }, // 1 : スネア
+    {  76,   0,  30,  90, 255, true,    80 }, // 2 : サイドスティック・クラップ
+    {   0,  80, 110,  10, 255, false,  500 }, // 3 : タム (ノート番号で音程が変わる)
+    {   0,   0,   0, 100, 120, true,    70 }, // 4 : クローズ・ペダルハイハット
+    {   0,   0,   0, 100, 120, true,   500 }, // 5 : オープンハイハット
+    {   0,   0,   0, 110, 180, true,  1800 }, // 6 : クラッシュシンバル
+    {  88,   0,  25,  70, 160, true,  1000 }, // 7 : ライドシンバル
+    {   0,   0,  50,  50, 200, false,   90 }, // 8 : その他の打楽器
+  };
+  switch (note) {
+  case 35: case 36:                                     return table[0];
+  case 38: case 40:                                     return table[1];
+  case 37: case 39:                                     return table[2];
+  case 41: case 43: case 45: case 47: case 48: case 50: return table[3];
+  case 42: case 44:                                     return table[4];
+  case 46:                                              return table[5];
+  case 49: case 52: case 55: case 57:                   return table[6];
+  case 51: case 53: case 59:                            return table[7];
+  default:                                              return table[8];
+  }
+}
+
+static inline int32_t saturate32(int64_t v)
+{
+  return (int32_t)((v > INT32_MAX) ? INT32_MAX : (v < INT32_MIN) ? INT32_MIN : v);
+}
+
+void audio_synth_t::setup(uint32_t sample_rate)
+{
+  if (_sample_rate == sample_rate || sample_rate == 0) { return; }
+  _sample_rate = sample_rate;
+
+  // 倍音を加算して波形を作り、ピークを -6dBFS (16384) に揃える
+  // 高い音域での折返しを抑えるため、倍音は16次までとする
+  static constexpr const size_t harmonic_max = 16;
+  for (int w = 0; w < wave_max; ++w) {
+    float amp[harmonic_max + 1] = {};
+    switch (w) {
+    default: break;
+    case wave_sine:     amp[1] = 1.0f; break;
+    case wave_triangle: for (int n = 1; n <= 15; n += 2) { amp[n] = ((n >> 1) & 1 ? -1.0f : 1.0f) / (n * n); } break;
+    case wave_saw:      for (int n = 1; n <= 16; ++n) { amp[n] = 1.0f / n; } break;
+    case wave_square:   for (int n = 1; n <= 15; n += 2) { amp[n] = 1.0f / n; } break;
+    case wave_pulse:    for (int n = 1; n <= 16; ++n) { amp[n] = sinf((float)M_PI * n / 4) / n; } break;
+    case wave_organ:    amp[1] = 1.0f; amp[2] = 0.8f; amp[3] = 0.6f; amp[4] = 0.5f; amp[6] = 0.3f; amp[8] = 0.25f; break;
+    case wave_epiano:   amp[1] = 1.0f; amp[2] = 0.3f; amp[3] = 0.12f; amp[4] = 0.05f; break;
+    case wave_brass:    for (int n = 1; n <= 10; ++n) { amp[n] = 1.0f / powf((float)n, 0.7f); } break;
+    }
+    float buf[table_size];
+    float peak = 0.0f;
+    for (size_t i = 0; i < table_size; ++i) {
+      float x = 2.0f * (float)M_PI * i / table_size;
+      float v = 0.0f;
+      for (size_t n = 1; n <= harmonic_max; ++n) {
+        if (amp[n] != 0.0f) { v += amp[n] * sinf(x * n); }
+      }
+      buf[i] = v;
+      if (peak < fabsf(v)) { peak = fabsf(v); }
+    }
+    float scale = (peak > 0.0f) ? 16384.0f / peak : 0.0f;
+    for (size_t i = 0; i < table_size; ++i) {
+      _table[w][i] = (int16_t)lrintf(buf[i] * scale);
+    }
+    // 線形補間で末尾の次を参照するため、先頭を複製しておく
+    _table[w][table_size] = _table[w][0];
+  }
+
+  for (int n = 0; n < 128; ++n) {
+    double freq = 440.0 * pow(2.0, (n - 69) / 12.0);
+    _note_inc[n] = (uint32_t)(freq / sample_rate * 4294967296.0);
+  }
+  for (int p = 0; p < 128; ++p) {
+    _pan_gain[p] = (int16_t)lrint(32767.0 * cos(M_PI * 0.5 * p / 127.0));
+  }
+  reset();
+}
+
+void audio_synth_t::reset(void)
+{
+  for (auto& v : _voice) {
+    memset(&v, 0, sizeof(v));
+    v.stage = stage_off;
+  }
+  for (auto& c : _channel) {
+    c.program = 0;
+    c.volume = 100;
+    c.expression = 127;
+    c.pan = 64;
+    c.sustain = false;
+    c.bend = 0;
+    c.bend_mul = 1 << 16;
+  }
+  _age = 0;
+}
+
+int32_t audio_synth_t::decayMul(uint32_t msec) const
+{
+  // msec の間に -60dB まで減衰する係数
+  double samples = (double)(msec ? msec : 1) * _sample_rate / 1000.0;
+  return (int32_t)(exp(-6.907755 / samples) * env_full);
+}
+
+void audio_synth_t::message(uint8_t status, uint8_t data1, uint8_t data2)
+{
+  if (_sample_rate == 0) { return; }
+  uint8_t ch = status & 0x0F;
+  switch (status & 0xF0) {
+  case 0x80: noteOff(ch, data1 & 0x7F); break;
+  case 0x90:
+    if (data2) { noteOn(ch, data1 & 0x7F, data2 & 0x7F); }
+    else { noteOff(ch, data1 & 0x7F); }
+    break;
+  case 0xB0: controlChange(ch, data1 & 0x7F, data2 & 0x7F); break;
+  case 0xC0: _channel[ch].program = data1 & 0x7F; break;
+  case 0xE0: setBend(ch, (int16_t)(((data2 & 0x7F) << 7) | (data1 & 0x7F)) - 8192); break;
+  default: break;
+  }
+}
+
+void audio_synth_t::allNotesOff(void)
+{
+  for (auto& c : _channel) { c.sustain = false; }
+  for (auto& v : _voice) {
+    if (v.stage != stage_off) { releaseVoice(&v); }
+  }
+}
+
+audio_synth_t::voice_t* audio_synth_t::allocVoice(uint8_t ch, uint8_t note)
+{
+  voice_t* free_voice = nullptr;
+  voice_t* released = nullptr;
+  voice_t* oldest = nullptr;
+  for (size_t i = 0; i < _voice_limit; ++i) {
+    auto v = &_voice[i];
+    if (v->stage == stage_off) {
+      if (free_voice == nullptr) { free_voice = v; }
+      continue;
+    }
+    // 同じノートを再発音する場合は同じボイスを使う
+    if (v->channel == ch && v->note == note) { return v; }
+    if (v->stage == stage_release) {
+      if (released == nullptr || released->env > v->env) { released = v; }
+    }
+    if (oldest == nullptr || (int32_t)(v->age - oldest->age) < 0) { oldest = v; }
+  }
+  if (free_voice) { return free_voice; }
+  if (released) { return released; }
+  return oldest;
+}
+
+void audio_synth_t::noteOn(uint8_t ch, uint8_t note, uint8_t velocity)
+{
+  voice_t* v = allocVoice(ch, note);
+  if (v == nullptr) { return; }
+
+  // 再発音の場合はクリックを避けるため、位相とエンベロープを引き継ぐ
+  bool retrigger = (v->stage != stage_off);
+  v->channel = ch;
+  v->note = note;
+  v->velocity = velocity;
+  v->age = ++_age;
+  v->held = false;
+  v->drum = (ch == drum_channel);
+  if (!retrigger) {
+    v->phase = 0;
+    v->phase2 = 0;
+    v->lpf = 0;
+    v->noise_lpf = 0;
+    v->env = 0;
+  }
+
+  if (v->drum) {
+    auto& dp = drumPatch(note);
+    uint8_t tone_note = dp.note ? dp.note : (note + 6);
+    v->table = _table[wave_sine];
+    v->table2 = nullptr;
+    v->base_inc = _note_inc[tone_note & 0x7F];
+    v->inc = v->base_inc;
+    v->pitch_mul = dp.pitch_drop
+                 ? (uint32_t)(exp(-0.693147 * 1000.0 / ((double)dp.pitch_drop * _sample_rate)) * env_full)
+                 : env_full;
+    v->noise = 0x12345678u + note * 0x9E3779B9u + _age;
+    v->noise_cutoff = dp.noise_cutoff << 7;
+    v->noise_highpass = dp.noise_highpass;
+    v->tone_gain = dp.tone_level << 8;
+    v->noise_gain = dp.noise_level << 8;
+    v->cutoff = 255 << 7;
+    // 打楽器は立ち上がりを鋭くするため、アタックを省略して減衰から始める
+    v->env = env_full;
+    v->stage = stage_decay;
+    v->sustain = 0;
+    v->decay_mul = decayMul(dp.decay_msec);
+    v->release_mul = v->decay_mul;
+  } else {
+    auto& c = _channel[ch];
+    auto& p = _patch_table[(c.program >> 3) & 0x0F];
+    v->table = _table[p.wave];
+    v->table2 = (p.wave2 != wave_none) ? _table[p.wave2] : nullptr;
+    v->base_inc = _note_inc[note];
+    if (v->table2) {
+      double ratio = pow(2.0, p.octave2 + p.detune_cent / 1200.0);
+      v->base_inc2 = (uint32_t)(v->base_inc * ratio);
+    }
+    v->pitch_mul = env_full;
+    v->tone_gain = 0;
+    v->noise_gain = 0;
+    int32_t cutoff = p.cutoff + ((velocity * p.velocity_cutoff) >> 7);
+    v->cutoff = (cutoff > 255 ? 255 : cutoff) << 7;
+    uint32_t attack_samples = (uint32_t)p.attack_msec * _sample_rate / 1000;
+    v->attack_inc = env_full / (int32_t)(attack_samples ? attack_samples : 1);
+    v->sustain = (int32_t)(((int64_t)env_full * p.sustain) / 127);
+    v->decay_mul = decayMul(p.decay_msec);
+    v->release_mul = decayMul(p.release_msec);
+    v->stage = stage_attack;
+    updatePitch(v);
+  }
+  updateGain(v);
+}
+
+void audio_synth_t::noteOff(uint8_t ch, uint8_t note)
+{
+  for (auto& v : _voice) {
+    if (v.stage == stage_off || v.stage == stage_release || v.channel != ch || v.note != note) { continue; }
+    // 打楽器は自然に減衰させる
+    if (v.drum) { continue; }
+    if (_channel[ch].sustain) {
+      v.held = true;
+    } else {
+      releaseVoice(&v);
+    }
+  }
+}
+
+void audio_synth_t::releaseVoice(voice_t* v)
+{
+  v->held = false;
+  if (v->drum) { return; }
+  v->stage = stage_release;
+}
+
+void audio_synth_t::controlChange(uint8_t ch, uint8_t control, uint8_t value)
+{
+  auto& c = _channel[ch];
+  switch (control) {
+  case 7:  c.volume = value; break;
+  case 10: c.pan = value; break;
+  case 11: c.expression = value; break;
+  case 64:
+    c.sustain = (value >= 64);
+    if (!c.sustain) {
+      for (auto& v : _voice) {
+        if (v.held && v.channel == ch) { releaseVoice(&v); }
+      }
+    }
+    return;
+  case 120: // All Sound Off
+    for (auto& v : _voice) {
+      if (v.channel == ch) { v.stage = stage_off; }
+    }
+    return;
+  case 121: // Reset All Controllers
+    c.expression = 127;
+    c.sustain = false;
+    setBend(ch, 0);
+    for (auto& v : _voice) {
+      if (v.held && v.channel == ch) { releaseVoice(&v); }
+    }
+    break;
+  case 123: // All Notes Off
+    c.sustain = false;
+    for (auto& v : _voice) {
+      if (v.stage != stage_off && v.channel == ch) { releaseVoice(&v); }
+    }
+    return;
+  default: return;
+  }
+  for (auto& v : _voice) {
+    if (v.stage != stage_off && v.channel == ch) { updateGain(&v); }
+  }
+}
+
+void audio_synth_t::setBend(uint8_t ch, int16_t bend)
+{
+  auto& c = _channel[ch];
+  if (c.bend == bend) { return; }
+  c.bend = bend;
+  c.bend_mul = (uint32_t)lrint(65536.0 * pow(2.0, (double)bend * bend_range_semitone / (8192.0 * 12.0)));
+  for (auto& v : _voice) {
+    if (v.stage != stage_off && v.channel == ch && !v.drum) { updatePitch(&v); }
+  }
+}
+
+void audio_synth_t::updatePitch(voice_t* v)
+{
+  uint32_t mul = _channel[v->channel].bend_mul;
+  v->inc = (uint32_t)(((uint64_t)v->base_inc * mul) >> 16);
+  v->inc2 = (uint32_t)(((uint64_t)v->base_inc2 * mul) >> 16);
+}
+
+void audio_synth_t::updateGain(voice_t* v)
+{
+  // ベロシティは2乗、チャンネル音量とエクスプレッションは比例とする (127^4 = 260144641)
+  auto& c = _channel[v->channel];
+  uint64_t g = (uint64_t)v->velocity * v->velocity * c.volume * c.expression;
+  int32_t gain = (int32_t)((g * 32767) / 260144641u);
+  v->gain_l = (gain * _pan_gain[c.pan]) >> 15;
+  v->gain_r = (gain * _pan_gain[127 - c.pan]) >> 15;
+}
+
+size_t audio_synth_t::getActiveVoices(void) const
+{
+  size_t count = 0;
+  for (auto& v : _voice) {
+    if (v.stage != stage_off) { ++count; }
+  }
+  return count;
+}
+
+void audio_synth_t::renderVoice(voice_t* v, size_t frames)
+{
+  int32_t* mix = _mix;
+  int32_t env = v->env;
+  int32_t lpf = v->lpf;
+  uint32_t phase = v->phase;
+  const int16_t* table = v->table;
+  const int32_t cutoff = v->cutoff;
+  const int32_t gain_l = v->gain_l;
+  const int32_t gain_r = v->gain_r;
+  stage_t stage = v->stage;
+
+  for (size_t i = 0; i < frames; ++i) {
+    // エンベロープ
+    switch (stage) {
+    case stage_attack:
+      env += v->attack_inc;
+      if (env >= env_full) {
+        env = env_full;
+        stage = stage_decay;
+      }
+      break;
+    case stage_decay:
+      env = v->sustain + (int32_t)(((int64_t)(env - v->sustain) * v->decay_mul) >> 30);
+      if (env - v->sustain < env_silent) {
+        env = v->sustain;
+        stage = v->sustain ? stage_sustain : stage_off;
+      }
+      break;
+    case stage_release:
+      env = (int32_t)(((int64_t)env * v->release_mul) >> 30);
+      if (env < env_silent) { stage = stage_off; }
+      break;
+    default: break;
+    }
+    if (stage == stage_off) { env = 0; }
+
+    // 発振器 (テーブルの上位8bitを位置、続く16bitで線形補間する)
+    phase += v->inc;
+    const int16_t* t = &table[phase >> 24];
+    int32_t s = t[0] + (((t[1] - t[0]) * (int32_t)((phase >> 8) & 0xFFFF)) >> 16);
+    if (v->drum) {
+      // 正弦波の音程を下げていき、元の音程の1/4で止める
+      if (v->inc > (v->base_inc >> 2)) {
+        v->inc = (uint32_t)(((uint64_t)v->inc * v->pitch_mul) >> 30);
+      }
+      v->noise = v->noise * 1664525u + 1013904223u;
+      int32_t n = (int32_t)v->noise >> 17;
+      v->noise_lpf += ((n - v->noise_lpf) * v->noise_cutoff) >> 15;
+      n = v->noise_highpass ? (n - v->noise_lpf) : v->noise_lpf;
+      s = (s * v->tone_gain + n * v->noise_gain) >> 16;
+    } else if (v->table2) {
+      v->phase2 += v->inc2;
+      const int16_t* t2 = &v->table2[v->phase2 >> 24];
+      int32_t s2 = t2[0] + (((t2[1] - t2[0]) * (int32_t)((v->phase2 >> 8) & 0xFFFF)) >> 16);
+      s = (s + s2) >> 1;
+    }
+    lpf += ((s - lpf) * cutoff) >> 15;
+
+    int32_t out = (lpf * (env >> 15)) >> 15;
+    mix[i * 2    ] += (out * gain_l) >> 15;
+    mix[i * 2 + 1] += (out * gain_r) >> 15;
+  }
+  v->env = env;
+  v->lpf = lpf;
+  v->phase = phase;
+  v->stage = stage;
+}
+
+void audio_synth_t::render(int32_t* buf, size_t frames)
+{
+  _rendered_voices = 0;
+  _rendered_frames = frames;
+  if (frames > frames_max) { frames = frames_max; }
+
+  bool cleared = false;
+  for (auto& v : _voice) {
+    if (v.stage == stage_off) { continue; }
+    if (!cleared) {
+      cleared = true;
+      memset(_mix, 0, frames * 2 * sizeof(int32_t));
+    }
+    renderVoice(&v, frames);
+    ++_rendered_voices;
+  }
+  if (!cleared) { return; }
+
+  // 16bit相当の値を 32bitの上位へ合わせ、出力の音量を掛けて加える
+  const int32_t level = _level;
+  for (size_t i = 0; i < frames * 2; ++i) {
+    buf[i] = saturate32(buf[i] + (((int64_t)_mix[i] * level) << 8));
+  }
+}
+
+void audio_synth_t::reportElapsed(uint32_t elapsed_usec, uint32_t budget_usec)
+{
+  if (_rendered_voices == 0 || _rendered_frames == 0) { return; }
+  // 1ボイス × frames_max フレームあたりの処理時間に換算する
+  uint32_t cost = (uint32_t)((uint64_t)elapsed_usec * 1000 * frames_max / (_rendered_frames * _rendered_voices));
+  // 増加は速やかに、減少はゆっくり追従させる
+  if (_voice_cost_nsec < cost) {
+    _voice_cost_nsec += (cost - _voice_cost_nsec + 1) >> 1;
+  } else {
+    _voice_cost_nsec -= (_voice_cost_nsec - cost) >> 4;
+  }
+  if (_voice_cost_nsec == 0) { return; }
+
+  uint64_t budget_nsec = (uint64_t)budget_usec * 1000 * frames_max / _rendered_frames;
+  size_t limit = (size_t)(budget_nsec / _voice_cost_nsec);
+  if (limit < voice_limit_min) { limit = voice_limit_min; }
+  if (limit > voice_max) { limit = voice_max; }
+  if (limit < _voice_limit) {
+    // 上限を超えたボイスは短いリリースで止める
+    int32_t mul = decayMul(steal_release_msec);
+    for (size_t i = limit; i < _voice_limit; ++i) {
+      auto& v = _voice[i];
+      if (v.stage == stage_off) { continue; }
+      v.stage = stage_release;
+      v.held = false;
+      v.release_mul = mul;
+    }
+  }
+  _voice_limit = limit;
+}
+
+uint32_t audio_synth_t::benchmark(int32_t* buf, size_t frames, size_t blocks, uint32_t (*get_usec)(void))
+{
+  if (_sample_rate == 0 || frames == 0 || blocks == 0) { return 0; }
+  if (frames > frames_max) { frames = frames_max; }
+  reset();
+  _voice_limit = voice_max;
+
+  // 最も重い構成 (2系統の発振器) の音色で全ボイスを発音させる
+  for (size_t i = 0; i < voice_max; ++i) {
+    uint8_t ch = i & 7;
+    _channel[ch].program = 40;
+    noteOn(ch, 36 + i * 2, 100);
+  }
+
+  uint32_t start = get_usec();
+  for (size_t b = 0; b < blocks; ++b) {
+    memset(buf, 0, frames * 2 * sizeof(int32_t));
+    render(buf, frames);
+  }
+  uint32_t elapsed = get_usec() - start;
+  uint32_t cost = (uint32_t)((uint64_t)elapsed * 1000 / (blocks * voice_max));
+
+  memset(buf, 0, frames * 2 * sizeof(int32_t));
+  reset();
+  _voice_cost_nsec = (uint32_t)((uint64_t)cost * frames_max / frames);
+  return cost;
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_AUDIO_SYNTH_HPP
+#define KANPLAY_AUDIO_SYNTH_HPP
+
+/*
+audio_synth は midi_out_control へ出力されるものと同じ MIDIメッセージを受け取り、本体内で音を生成する簡易シンセサイザです。
+ - ボイスはウェーブテーブル発振器 (2系統まで、デチューン可) + 1次ローパス + ADSR で構成する
+ - チャンネル10 はドラムとして扱い、ピッチの下降する正弦波とノイズの組合せで発音する
+ - 音色は GMのプログラム番号を8つずつのファミリにまとめた16種類とする
+ - ボイスの割当ては 同じノートの再発音 > 空きボイス > リリース中で最も小さいもの > 最も古いもの の順とする
+ - 1ボイスあたりの処理時間を計測し、処理時間の予算に収まるようにボイス数の上限を調整する
+ - 他のモジュールに依存しないため、ホスト上で単体で描画や処理時間の計測ができる
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class audio_synth_t {
+public:
+  static constexpr const size_t voice_max = 24;
+  static constexpr const size_t channel_max = 16;
+  static constexpr const uint8_t drum_channel = 9;      // GMのチャンネル10
+  static constexpr const size_t frames_max = 96;        // 一度に描画できる最大フレーム数
+
+  // サンプリングレートに応じて音程・エンベロープの係数を設定し、全ボイスを停止する
+  void setup(uint32_t sample_rate);
+  // 全ボイスを停止し、チャンネルの状態を初期値に戻す
+  void reset(void);
+
+  // MIDIのチャンネルメッセージを処理する (ノート・コントロールチェンジ・プログラムチェンジ・ピッチベンド)
+  void message(uint8_t status, uint8_t data1, uint8_t data2);
+  // 発音中の全ボイスをリリースする (ペダルによる保持も解除する)
+  void allNotesOff(void);
+
+  // L/R交互のステレオブロックへ描画した音を加える (frames は frames_max 以下)
+  void render(int32_t* buf, size_t frames);
+
+  // 出力の音量 (0-100)
+  void setLevel(uint8_t level) { _level = (level > 100 ? 100 : level) * 256 / 100; }
+
+  // 描画の処理時間 (usec) と予算 (usec) を通知し、1ボイスあたりの処理時間からボイス数の上限を決める
+  void reportElapsed(uint32_t elapsed_usec, uint32_t budget_usec);
+  size_t getVoiceLimit(void) const { return _voice_limit; }
+  size_t getActiveVoices(void) const;
+  // 1ボイス × 1ブロック (frames_max) あたりの処理時間の推定値 (nsec)
+  uint32_t getVoiceCostNsec(void) const { return _voice_cost_nsec; }
+
+  // 全ボイスを発音させた状態で buf へ blocks 回描画し、1ボイス × 1ブロック (frames) あたりの処理時間 (nsec) を求める
+  // setup の後に呼び出すこと。終了時には全ボイスを停止し、計測値をボイス数の上限の初期値とする
+  // get_usec : 経過時間の計測に使用する関数
+  uint32_t benchmark(int32_t* buf, size_t frames, size_t blocks, uint32_t (*get_usec)(void));
+
+protected:
+  enum wave_t : uint8_t {
+    wave_none,
+    wave_sine,
+    wave_triangle,
+    wave_saw,
+    wave_square,
+    wave_pulse,
+    wave_organ,
+    wave_epiano,
+    wave_brass,
+    wave_max,
+  };
+  static constexpr const size_t table_bits = 8;
+  static constexpr const size_t table_size = 1 << table_bits;
+
+  // 音色 (時間は msec、レベルは 0-127)
+  struct patch_t {
+    wave_t wave;
+    wave_t wave2;         // 2系統目の発振器 (wave_none で無し)
+    int8_t detune_cent;   // 2系統目の発振器の音程のずれ
+    int8_t octave2;       // 2系統目の発振器のオクターブ
+    uint16_t attack_msec;
+    uint16_t decay_msec;
+    uint8_t sustain;
+    uint16_t release_msec;
+    uint8_t cutoff;       // ローパスの係数 (1-255、255でほぼ無効)
+    uint8_t velocity_cutoff; // ベロシティによるローパスの開き具合
+  };
+
+  // ドラムの音色 (tone はピッチの下降する正弦波、noise はノイズ)
+  struct drum_patch_t {
+    uint8_t note;         // 正弦波の音程 (MIDIノート番号、0は鳴らしたノート番号に従う)
+    uint8_t pitch_drop;   // 音程が半分になるまでの時間 (msec、0で一定)
+    uint8_t tone_level;
+    uint8_t noise_level;
+    uint8_t noise_cutoff; // ノイズのローパスの係数 (255でほぼ無効)
+    bool noise_highpass;  // ローパスの出力を引いて高域のみとする
+    uint16_t decay_msec;
+  };
+
+  enum stage_t : uint8_t {
+    stage_off,
+    stage_attack,
+    stage_decay,
+    stage_sustain,
+    stage_release,
+  };
+
+  struct voice_t {
+    const int16_t* table;
+    const int16_t* table2;
+    uint32_t phase;
+    uint32_t phase2;
+    uint32_t base_inc;    // ピッチベンド適用前の位相の増分
+    uint32_t base_inc2;
+    uint32_t inc;
+    uint32_t inc2;
+    uint32_t pitch_mul;   // ドラムの音程の下降 (1サンプル毎に乗じる Q30)
+    uint32_t noise;
+    int32_t lpf;          // ローパスの状態 (Q15)
+    int32_t noise_lpf;
+    int32_t cutoff;       // ローパスの係数 (Q15)
+    int32_t noise_cutoff;
+    int32_t tone_gain;    // ドラムの正弦波とノイズの量 (Q15)
+    int32_t noise_gain;
+    int32_t env;          // エンベロープ (Q30)
+    int32_t attack_inc;
+    int32_t decay_mul;    // 減衰の係数 (Q30)
+    int32_t sustain;
+    int32_t release_mul;
+    int32_t gain_l;       // ベロシティ・チャンネル音量・パンを反映した音量 (Q15)
+    int32_t gain_r;
+    uint32_t age;
+    stage_t stage;
+    uint8_t channel;
+    uint8_t note;
+    uint8_t velocity;
+    bool drum;
+    bool noise_highpass;
+    bool held;            // ノートオフ済みでサスティンペダルにより保持している
+  };
+
+  struct channel_t {
+    uint8_t program;
+    uint8_t volume;
+    uint8_t expression;
+    uint8_t pan;
+    bool sustain;
+    int16_t bend;         // -8192 ～ 8191
+    uint32_t bend_mul;    // ピッチベンドによる位相の増分の倍率 (Q16)
+  };
+
+  void noteOn(uint8_t ch, uint8_t note, uint8_t velocity);
+  void noteOff(uint8_t ch, uint8_t note);
+  void controlChange(uint8_t ch, uint8_t control, uint8_t value);
+  void setBend(uint8_t ch, int16_t bend);
+  voice_t* allocVoice(uint8_t ch, uint8_t note);
+  void updateGain(voice_t* v);
+  void updatePitch(voice_t* v);
+  void releaseVoice(voice_t* v);
+  void renderVoice(voice_t* v, size_t frames);
+  int32_t decayMul(uint32_t msec) const;
+
+  static const patch_t _patch_table[16];
+  static const drum_patch_t& drumPatch(uint8_t note);
+
+  int16_t _table[wave_max][table_size + 1];
+  int32_t _mix[frames_max * 2];
+  voice_t _voice[voice_max];
+  channel_t _channel[channel_max];
+  uint32_t _note_inc[128];
+  int16_t _pan_gain[128];       // パンの定パワー曲線 (Q15)
+  uint32_t _sample_rate = 0;
+  uint32_t _age = 0;
+  uint32_t _voice_cost_nsec = 0;
+  size_t _voice_limit = voice_max;
+  size_t _rendered_voices = 0;
+  size_t _rendered_frames = 0;
+  int32_t _level = 256;
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
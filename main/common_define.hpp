@@ -244,6 +244,7 @@ namespace def {
     NOTIFY_DELETE_CONTROL_MAPPING,
     NOTIFY_SEQ_CURSOR_MOVE,
     NOTIFY_DEVELOPER_MODE,
+    NOTIFY_SAMPLE_RATE,
     MESSAGE_NEED_RESTART,
     NOTIFY_MAX,
   };
@@ -263,6 +264,7 @@ namespace def {
     { "Delete Control Mapping", nullptr },
     { "Cursor Move"       , nullptr },
     { "Developer"         , nullptr },
+    { "Sample Rate"       , "サンプリングレート" },
     { "Please restart now", nullptr },
   }};
 
@@ -339,6 +341,14 @@ Button Index mapping
     gm_max,
   };
 
+  // 画面下部の波形モニターの表示内容
+  enum gui_wave_view_t : uint8_t {
+    wv_off = 0,   // 表示しない
+    wv_wave,      // 波形 (ブロック毎の最小値・最大値)
+    wv_spectrum,  // スペクトルとラウドネス
+    wv_max,
+  };
+
   // 演奏スタイル
   enum class perform_style_t : uint8_t {
     ps_unknown = 0,
@@ -388,6 +398,42 @@ Button Index mapping
 
     static constexpr const size_t max_note = 128;
 
+    // MIDI出力ポート (出力レイテンシ補正の対象)
+    enum output_port_t : uint8_t {
+      out_port_internal = 0, // かんぷれ内部MIDI
+      out_port_port_c,       // PortC外部MIDI
+      out_port_ble,          // BLE-MIDI
+      out_port_usb,          // USB-MIDI
+      out_port_max,
+    };
+    // MIDIルーティングのメッセージ種別 (ステータスバイト上位4bit - 8)
+    enum route_type_t : uint8_t {
+      route_note_off = 0,
+      route_note_on,
+      route_poly_pressure,
+      route_control_change,
+      route_program_change,
+      route_channel_pressure,
+      route_pitch_bend,
+      route_system,
+      route_type_max,
+    };
+    // MIDIルーティングのベロシティカーブ
+    enum velocity_curve_t : uint8_t {
+      velocity_linear = 0, // 変換なし
+      velocity_soft,       // 弱い入力でも大きく
+      velocity_hard,       // 強く弾いた時だけ大きく
+      velocity_full,       // 常に最大
+      velocity_curve_max,
+    };
+    static constexpr const uint8_t output_latency_msec_max = 200; // 出力レイテンシ設定の最大値 (msec)
+    static constexpr const uint8_t latency_probe_count = 8; // レイテンシ測定時のプローブ送信回数
+    static constexpr const uint32_t latency_probe_timeout_usec = 500000; // レイテンシ測定のプローブ応答待ち時間
+    static constexpr const size_t coalesce_threshold_bytes = 32; // 送信待ちがこの量を超えたら連続的なコントローラ値を間引く (31250bpsで約10msec)
+    static constexpr const uint32_t coalesce_threshold_usec = 10000; // 送出時間を見積もれるトランスポートでは、送信待ちの送出にかかる時間で判定する
+    static constexpr const uint32_t tx_backlog_publish_msec = 1000; // 送信待ちの最大値を runtime_info へ反映する周期
+    static constexpr const size_t coalesce_queue_size = 64; // 間引き待ちメッセージの最大数 (2の累乗であること)
+
     static constexpr const simple_text_array_t program_name_table = { 129, (const simple_text_t[]){
     // static constexpr const char* program_name_table[129] = {
     "Piano1(Ac.)",  "Piano2(Brt.)",  "Piano3(E-Grd)",  "Honky tonk",
@@ -507,6 +553,9 @@ Button Index mapping
       play_control,
       sequence_mode_set,
       sequence_step_ud,
+      looper_control,         // ルーパーの操作
+      recorder_control,       // オーディオ録音の操作
+      latency_control,        // 発音の遅れの測定
       command_max,
     };
 
@@ -638,6 +687,26 @@ Button Index mapping
       pc_reset_arpeggio,
     };
 
+    enum looper_control_t : uint8_t {
+      lc_stop = 0,
+      lc_record,    // 録音開始 / 録音中はループ確定 / 再生中は重ね録りの切替
+      lc_play,      // 再生開始 / 録音中はループ確定
+      lc_overdub,   // 重ね録りの切替
+      lc_clear,     // 録音データの消去
+    };
+
+    enum recorder_control_t : uint8_t {
+      rc_stop = 0,
+      rc_start,
+      rc_toggle,    // 停止中は開始 / 録音中は停止
+    };
+
+    enum latency_control_t : uint8_t {
+      lt_cancel = 0,
+      lt_midi,      // 内部MIDIのノートから内蔵音源の音が入力に現れるまで
+      lt_click,     // 出力したクリック音が入力へ折り返すまで (出力と入力を接続しておくこと)
+    };
+
     enum system_control_t : uint8_t {
       sc_boot = 0,
       sc_power_off,
@@ -1058,6 +1127,14 @@ Button Index mapping
       offbeat_max,
     };
 
+    // 同時発音数の上限を超えた時に停止させる音の選び方
+    enum voice_steal_policy_t : uint8_t {
+      steal_oldest = 0,   // 最も古い音
+      steal_quietest,     // 最もベロシティが小さい音
+      steal_same_pitch,   // 同じノートナンバーの音 (無ければ最も古い音)
+      steal_policy_max,
+    };
+
     enum arpeggio_style_t : uint8_t
     {
       same_time,        // 同時に鳴らす
@@ -1107,6 +1184,8 @@ Button Index mapping
     static constexpr const uint8_t task_priority_kantanplay = 2; // かんぷれの演奏指示処理はタイミングコントロールが重要なのでmidiと同格にしておく
     static constexpr const uint8_t task_priority_midi = 2;       // MIDIおよびMIDIサブタスクは指示タイミングがずれると演奏品質に問題が出るので優先度は標準より上げておく
     static constexpr const uint8_t task_priority_midi_sub = 2;
+    static constexpr const uint8_t task_priority_recorder = 1;   // 録音データの書込みはリングバッファで吸収できるため、画面描画と同格にしておく
+    static constexpr const uint8_t task_priority_audio_monitor = 2; // 出力音声の波形表示・解析はリングバッファが1周する前に読み終えるよう、画面描画より上げておく
 
     // 演奏操作に関わるタスクのみCPU1に割り当てる
     // それ以外のタスクはCPU0に割り当てる
@@ -1121,9 +1200,55 @@ Button Index mapping
     static constexpr const uint8_t task_cpu_kantanplay = 1;
     static constexpr const uint8_t task_cpu_port_a = 0;
     static constexpr const uint8_t task_cpu_port_b = 0;
+    static constexpr const uint8_t task_cpu_recorder = 0;   // SDカードへの書込みは画面描画と同じCPU0で行う
+    static constexpr const uint8_t task_cpu_audio_monitor = 0; // 波形表示・解析はI2Sタスクと並列動作可能にしておく
 
     static constexpr const uint8_t internal_firmware_version = 4;   // かんぷれハードウェア内部STM32ファームウェアバージョン
   };
+  namespace audio {
+    // サンプリングレートの選択肢 (設定値はこの順の番号とする)
+    enum sample_rate_t : uint8_t {
+      sr_48000 = 0, // 標準
+      sr_44100,
+      sr_96000,     // 高音質 (1ブロックあたりの処理時間の余裕は半分になる)
+      sr_32000,     // 低消費電力
+      sr_max,
+    };
+    static constexpr const uint32_t sample_rate_hz[sr_max] = { 48000, 44100, 96000, 32000 };
+    static constexpr const uint32_t sample_rate_reference = 48000;       // 処理時間の予算などを定めた基準のサンプリングレート
+    static constexpr const uint16_t mclk_ratio = 128;                    // ES8388 へ供給する MCLK のサンプリングレートに対する倍率
+    static constexpr const uint8_t rate_switch_ramp_msec = 20;           // レート切替え前に DACのソフトランプで減衰させる時間 ( msec )
+    static constexpr const uint8_t rate_switch_settle_msec = 40;         // レート切替え後に I2Sの再開を待ってからミュートを解除するまでの時間 ( msec )
+
+    static constexpr const int8_t effect_eq_db_max = 12;                 // EQの各バンドの最大増減量 ( dB )
+    static constexpr const int8_t effect_comp_threshold_db_max = 40;     // コンプレッサ閾値の最大値 ( フルスケールから下げる dB )
+    static constexpr const uint8_t effect_comp_ratio_max = 20;           // コンプレッサ圧縮比の最大値 ( この値でリミッタとして動作 )
+    static constexpr const uint16_t effect_budget_usec = 300;            // エフェクト処理に割り当てる1ブロックあたりの処理時間 ( usec )
+    static constexpr const uint16_t effect_suspend_blocks = 500;         // 処理時間の超過時にリバーブを停止するブロック数 ( 約0.5秒 )
+    static constexpr const uint16_t effect_load_publish_msec = 1000;     // エフェクト負荷の表示値を更新する間隔 ( msec )
+
+    static constexpr const uint8_t dma_desc_min = 2;                     // I2S DMAディスクリプタ数の最小値
+    static constexpr const uint8_t dma_desc_default = 4;                 // I2S DMAディスクリプタ数の初期値
+    static constexpr const uint8_t dma_desc_max = 8;                     // I2S DMAディスクリプタ数の最大値
+
+    static constexpr const uint16_t synth_budget_usec = 250;             // 内蔵シンセに割り当てる1ブロック ( 48フレーム ) あたりの処理時間 ( usec )
+    static constexpr const uint16_t synth_benchmark_blocks = 200;        // 起動時のベンチマークで描画するブロック数
+    static constexpr const uint8_t synth_level_default = 70;             // 内蔵シンセの音量の初期値
+
+    static constexpr const uint8_t latency_trials = 10;                  // 遅れの測定の繰返し回数
+    static constexpr const uint8_t latency_midi_channel = 9;             // 遅れの測定に使うノートのチャンネル ( ドラム )
+    static constexpr const uint8_t latency_midi_note = 37;               // 遅れの測定に使うノート ( 立ち上がりの鋭いサイドスティック )
+    static constexpr const uint8_t latency_midi_velocity = 127;
+
+    // 処理したDMAブロックを共有するリングバッファのスロット数 ( 最大のブロックで約32msec分、読み手の遅れを吸収する )
+    static constexpr const size_t block_ring_slots = 16;
+
+    // 録音のリングバッファ (PSRAM)。48kHz 16bitステレオで約2.7秒分あり、SDカードの書込みの停滞を吸収する
+    static constexpr const size_t recorder_ring_bytes = 512 * 1024;
+    // SDカードへ一度に書き込む量。spi_lock を保持するのはチャンク1つの書込みの間のみ ( 約85msec分 )
+    static constexpr const size_t recorder_chunk_bytes = 16 * 1024;
+    static constexpr const char recorder_path[] = "/recordings/";         // 録音ファイルの保存先 ( SDカード )
+  };
   namespace app {
     static constexpr const uint8_t max_slot = 8;                // 設定を保持するスロットの数
     static constexpr const uint8_t max_chord_part = 6;          // コード演奏のパート数
@@ -1144,7 +1269,15 @@ Button Index mapping
     static constexpr const int16_t swing_percent_default = 0;  //スウィング初期値
     static constexpr const int16_t swing_percent_max = 100; // スウィング最大値
 
+    static constexpr const size_t looper_max_event = 8192; // ルーパーが記録できるイベント数 (ループ1周あたり)
+    // 同時発音数の最大値。コード演奏の全パート・全ピッチ分を手動演奏とルーパー再生の2系統確保し、
+    // ノート・ドラムボタンと外部からの発音の分を加える
+    static constexpr const uint8_t max_voice = max_chord_part * max_pitch_with_drum * 2 + 32;
     static constexpr const int16_t input_tolerating_msec = 50; // 自動演奏時の遅延入力に対する許容時間 ( msec )
+    static constexpr const uint8_t quantize_window_msec_max = 100; // 手動演奏時の入力クオンタイズの最大許容幅 ( msec )
+    static constexpr const uint8_t quantize_lookahead_msec_max = 50; // 手動演奏時の入力クオンタイズの最大先読み時間 ( msec )
+    static constexpr const uint8_t metronome_beats_max = 8;     // メトロノームの1小節の最大拍数
+    static constexpr const uint8_t metronome_count_in_max = 4;  // カウントインの最大小節数
 
     static constexpr const int autorelease_msec = 5000; // コード演奏モードでの 自動ノートオフまでの時間 5秒
     static constexpr const float arpeggio_reset_timeout_beats = 4.2f;
@@ -1323,6 +1456,14 @@ Button Index mapping
       { "sharp[m7_5]"  , { "♯ [ m7-5 ]"     , nullptr              }, { command::chord_semitone, 2,                               command::chord_modifier, KANTANMusic_Modifier_m7_5 } },
       { "slot -1"      , { "Slot -1"       , "スロット -1"          }, { command::slot_select_ud  , command::slot_select_ud_t::slot_prev } },
       { "slot +1"      , { "Slot +1"       , "スロット +1"          }, { command::slot_select_ud  , command::slot_select_ud_t::slot_next } },
+      { "looper rec"   , { "Looper Rec"     , "ルーパー 録音"      }, { command::looper_control, command::looper_control_t::lc_record } },
+      { "looper play"  , { "Looper Play"    , "ルーパー 再生"      }, { command::looper_control, command::looper_control_t::lc_play } },
+      { "looper overdub",{ "Looper Overdub" , "ルーパー 重ね録り"  }, { command::looper_control, command::looper_control_t::lc_overdub } },
+      { "looper stop"  , { "Looper Stop"    , "ルーパー 停止"      }, { command::looper_control, command::looper_control_t::lc_stop } },
+      { "looper clear" , { "Looper Clear"   , "ルーパー 消去"      }, { command::looper_control, command::looper_control_t::lc_clear } },
+      { "audio rec"    , { "Audio Rec"      , "オーディオ 録音"    }, { command::recorder_control, command::recorder_control_t::rc_toggle } },
+      { "latency midi" , { "Latency MIDI"   , "遅れ測定 MIDI"      }, { command::latency_control, command::latency_control_t::lt_midi } },
+      { "latency click", { "Latency Click"  , "遅れ測定 クリック"  }, { command::latency_control, command::latency_control_t::lt_click } },
       { ""             , { "---"            , nullptr             }, {} },
       { nullptr        , nullptr                                   , {} },
     };
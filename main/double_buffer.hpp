@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_DOUBLE_BUFFER_HPP
+#define KANPLAY_DOUBLE_BUFFER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <atomic>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+// 1つのタスクが書き込み、他のタスクが読み出す値の受け渡し (書き込みは1タスクのみ)
+// 2面のバッファへ交互に書き込むため、読み出し側は書き込み中でない面を待たずに読める
+// (書き込み側より優先度の高いタスクが、書き込みの途中に割り込んで読み出しても待ち続けることがない)
+// 読み出し中に面が再び書き換えられた場合 (2回以上更新された場合) のみ読み直す
+template <typename T>
+struct double_buffer_t {
+  static_assert(sizeof(T) % sizeof(uint32_t) == 0, "T size must be a multiple of 4");
+  static constexpr const size_t words = sizeof(T) / sizeof(uint32_t);
+
+  double_buffer_t(void) {
+    uint32_t tmp[words];
+    T init {};
+    memcpy(tmp, &init, sizeof(tmp));
+    for (size_t i = 0; i < words; ++i) {
+      _buf[0][i].store(tmp[i], std::memory_order_relaxed);
+      _buf[1][i].store(tmp[i], std::memory_order_relaxed);
+    }
+  }
+
+  void publish(const T& value) {
+    uint32_t tmp[words];
+    memcpy(tmp, &value, sizeof(tmp));
+    uint32_t seq = _seq.load(std::memory_order_relaxed);
+    auto dst = _buf[((seq >> 1) + 1) & 1];
+    _seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < words; ++i) {
+      dst[i].store(tmp[i], std::memory_order_relaxed);
+    }
+    _seq.store(seq + 2, std::memory_order_release);
+  }
+
+  T get(void) const {
+    uint32_t tmp[words];
+    uint32_t seq;
+    do {
+      seq = _seq.load(std::memory_order_acquire);
+      auto src = _buf[(seq >> 1) & 1];
+      for (size_t i = 0; i < words; ++i) {
+        tmp[i] = src[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while (_seq.load(std::memory_order_relaxed) - (seq & ~1u) > 2);
+    T res;
+    memcpy(&res, tmp, sizeof(tmp));
+    return res;
+  }
+
+protected:
+  std::atomic<uint32_t> _seq { 0 };
+  std::atomic<uint32_t> _buf[2][words];
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
@@ -485,7 +485,199 @@ bool storage_sd_t::removeFile(const char* path)
 
 bool storage_sd_t::renameFile(const char* path, const char* newpath)
 {
-  return false;
+  bool res = false;
+  spi_lock();
+#if __has_include (<SdFat.h>)
+  res = SD.rename(path, newpath);
+#elif __has_include (<SD.h>)
+  res = SD.rename(path, newpath);
+#else
+  if (path[0] == '/') { ++path; }
+  if (newpath[0] == '/') { ++newpath; }
+  std::error_code ec;
+  std::filesystem::rename(path, newpath, ec);
+  res = !ec;
+#endif
+  spi_unlock();
+  return res;
+}
+
+#if __has_include(<SdFat.h>)
+static FsFile sd_write_file;
+#elif __has_include (<SD.h>)
+static fs::File sd_write_file;
+#else
+static FILE* sd_write_file = nullptr;
+#endif
+static std::string sd_write_path;
+
+static std::string makeTemporaryPath(const std::string& path)
+{
+  return path + ".part";
+}
+
+bool storage_sd_t::beginWriteFile(const char* path)
+{
+  if (!_is_begin) { return false; }
+  endWriteFile(false);
+
+  sd_write_path = path;
+  auto tmppath = makeTemporaryPath(sd_write_path);
+  bool res = false;
+  spi_lock();
+#if __has_include(<SdFat.h>)
+  sd_write_file = SD.open(tmppath.c_str(), O_CREAT | O_WRITE | O_TRUNC);
+  res = (bool)sd_write_file;
+#elif __has_include (<SD.h>)
+  sd_write_file = SD.open(tmppath.c_str(), FILE_WRITE);
+  res = (bool)sd_write_file;
+#else
+  auto p = tmppath.c_str();
+  if (p[0] == '/') { ++p; }
+  sd_write_file = fopen(p, "wb");
+  res = (sd_write_file != nullptr);
+#endif
+  spi_unlock();
+  if (!res) { sd_write_path.clear(); }
+  return res;
+}
+
+int storage_sd_t::writeFile(const uint8_t* data, size_t length)
+{
+  if (sd_write_path.empty()) { return -1; }
+  int result = -1;
+  spi_lock();
+#if __has_include(<SdFat.h>) || __has_include (<SD.h>)
+  result = sd_write_file.write(data, length);
+#else
+  result = fwrite(data, 1, length, sd_write_file);
+#endif
+  spi_unlock();
+  return result;
+}
+
+bool storage_sd_t::endWriteFile(bool commit)
+{
+  if (sd_write_path.empty()) { return false; }
+  spi_lock();
+#if __has_include(<SdFat.h>)
+  auto now = time(nullptr);
+  auto tm = gmtime(&now);
+  sd_write_file.timestamp(T_CREATE|T_WRITE, tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec);
+  sd_write_file.close();
+#elif __has_include (<SD.h>)
+  sd_write_file.close();
+#else
+  fclose(sd_write_file);
+  sd_write_file = nullptr;
+#endif
+  spi_unlock();
+
+  auto tmppath = makeTemporaryPath(sd_write_path);
+  bool res = false;
+  if (commit) {
+    // 元のファイルを削除して一時ファイルをリネームする
+    removeFile(sd_write_path.c_str());
+    res = renameFile(tmppath.c_str(), sd_write_path.c_str());
+  } else {
+    removeFile(tmppath.c_str());
+  }
+  sd_write_path.clear();
+  return res;
+}
+
+//-------------------------------------------------------------------------
+#if __has_include(<SdFat.h>)
+static FsFile sd_stream_file;
+#elif __has_include (<SD.h>)
+static fs::File sd_stream_file;
+#else
+static FILE* sd_stream_file = nullptr;
+#endif
+static bool sd_stream_opened = false;
+
+bool storage_sd_t::beginStreamFile(const char* path)
+{
+  if (!_is_begin) { return false; }
+  endStreamFile();
+
+  spi_lock();
+#if __has_include(<SdFat.h>)
+  sd_stream_file = SD.open(path, O_CREAT | O_RDWR | O_TRUNC);
+  sd_stream_opened = (bool)sd_stream_file;
+#elif __has_include (<SD.h>)
+  sd_stream_file = SD.open(path, FILE_WRITE);
+  sd_stream_opened = (bool)sd_stream_file;
+#else
+  if (path[0] == '/') { ++path; }
+  sd_stream_file = fopen(path, "w+b");
+  sd_stream_opened = (sd_stream_file != nullptr);
+#endif
+  spi_unlock();
+  return sd_stream_opened;
+}
+
+int storage_sd_t::writeStreamFile(const uint8_t* data, size_t length)
+{
+  if (!sd_stream_opened) { return -1; }
+  int result = -1;
+  spi_lock();
+#if __has_include(<SdFat.h>) || __has_include (<SD.h>)
+  result = sd_stream_file.write(data, length);
+#else
+  result = fwrite(data, 1, length, sd_stream_file);
+#endif
+  spi_unlock();
+  return result;
+}
+
+bool storage_sd_t::rewriteStreamFile(size_t offset, const uint8_t* data, size_t length)
+{
+  if (!sd_stream_opened) { return false; }
+  bool result = false;
+  spi_lock();
+#if __has_include(<SdFat.h>)
+  uint64_t end = sd_stream_file.curPosition();
+  if (sd_stream_file.seekSet(offset)) {
+    result = (sd_stream_file.write(data, length) == length);
+  }
+  sd_stream_file.seekSet(end);
+#elif __has_include (<SD.h>)
+  size_t end = sd_stream_file.position();
+  if (sd_stream_file.seek(offset)) {
+    result = (sd_stream_file.write(data, length) == length);
+  }
+  sd_stream_file.seek(end);
+#else
+  long end = ftell(sd_stream_file);
+  if (0 == fseek(sd_stream_file, offset, SEEK_SET)) {
+    result = (fwrite(data, 1, length, sd_stream_file) == length);
+  }
+  fseek(sd_stream_file, end, SEEK_SET);
+#endif
+  spi_unlock();
+  return result;
+}
+
+bool storage_sd_t::endStreamFile(void)
+{
+  if (!sd_stream_opened) { return false; }
+  sd_stream_opened = false;
+  spi_lock();
+#if __has_include(<SdFat.h>)
+  auto now = time(nullptr);
+  auto tm = gmtime(&now);
+  sd_stream_file.timestamp(T_CREATE|T_WRITE, tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec);
+  bool result = sd_stream_file.close();
+#elif __has_include (<SD.h>)
+  sd_stream_file.close();
+  bool result = true;
+#else
+  bool result = (0 == fclose(sd_stream_file));
+  sd_stream_file = nullptr;
+#endif
+  spi_unlock();
+  return result;
 }
 
 //-------------------------------------------------------------------------
@@ -1003,5 +1195,37 @@ bool file_manage_t::removeFile(def::app::data_type_t dir_type, const char* filen
   auto fullpath = dir->makeFullPath(filename);
   return storage->removeFile(fullpath.c_str());
 }
+
+bool file_manage_t::beginWriteFile(def::app::data_type_t dir_type, const char* filename)
+{
+  endWriteFile(false);
+  auto dir = getDirManage(dir_type);
+  if (dir == nullptr) { return false; }
+  auto storage = dir->getStorage();
+  if (storage == nullptr) { return false; }
+
+  if (storage->isBegin() == false) { storage->beginStorage(); }
+  auto fullpath = dir->makeFullPath(filename);
+  if (!storage->beginWriteFile(fullpath.c_str())) {
+M5_LOGE(" write open failed:%s", fullpath.c_str());
+    return false;
+  }
+  _write_storage = storage;
+  return true;
+}
+
+int file_manage_t::writeFile(const uint8_t* data, size_t length)
+{
+  if (_write_storage == nullptr) { return -1; }
+  return _write_storage->writeFile(data, length);
+}
+
+bool file_manage_t::endWriteFile(bool commit)
+{
+  if (_write_storage == nullptr) { return false; }
+  bool result = _write_storage->endWriteFile(commit);
+  _write_storage = nullptr;
+  return result;
+}
 //-------------------------------------------------------------------------
 }; // namespace kanplay_ns
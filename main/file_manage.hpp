@@ -59,6 +59,20 @@ public:
 
   // ファイルをリネームする
   virtual bool renameFile(const char* path, const char* newpath) { return false; }
+
+  // ファイルを分割して書き込む (全体をメモリに置かずに保存する場合に使用する)
+  // 書込み中は一時ファイルに保存し、endWriteFile で commit を指定した場合のみ指定のファイルを置き換える
+  virtual bool beginWriteFile(const char* path) { return false; }
+  virtual int writeFile(const uint8_t* data, size_t length) { return -1; }
+  virtual bool endWriteFile(bool commit) { return false; }
+
+  // 録音など、長時間かけて追記するファイル
+  // 分割書込みとは別のハンドルを使うため、ソングの転送と同時に使用できる
+  virtual bool beginStreamFile(const char* path) { return false; }
+  virtual int writeStreamFile(const uint8_t* data, size_t length) { return -1; }
+  // 先頭から offset の位置を書き換える (ヘッダの更新用。以降の追記は末尾から続ける)
+  virtual bool rewriteStreamFile(size_t offset, const uint8_t* data, size_t length) { return false; }
+  virtual bool endStreamFile(void) { return false; }
 };
 
 class storage_sd_t : public storage_base_t
@@ -73,6 +87,13 @@ public:
   bool makeDirectory(const char* path) override;
   bool removeFile(const char* path) override;
   bool renameFile(const char* path, const char* newpath) override;
+  bool beginWriteFile(const char* path) override;
+  int writeFile(const uint8_t* data, size_t length) override;
+  bool endWriteFile(bool commit) override;
+  bool beginStreamFile(const char* path) override;
+  int writeStreamFile(const uint8_t* data, size_t length) override;
+  bool rewriteStreamFile(size_t offset, const uint8_t* data, size_t length) override;
+  bool endStreamFile(void) override;
 };
 extern storage_sd_t storage_sd;
 
@@ -191,6 +212,14 @@ public:
 
   // ファイルを削除する
   bool removeFile(def::app::data_type_t dir_type, const char* filename);
+
+  // ファイルを分割して保存する (MIDI経由の転送など、ファイル全体を受け取る前に書き込む場合に使用する)
+  bool beginWriteFile(def::app::data_type_t dir_type, const char* filename);
+  int writeFile(const uint8_t* data, size_t length);
+  bool endWriteFile(bool commit);
+
+protected:
+  storage_base_t* _write_storage = nullptr;
 };
 
 extern file_manage_t file_manage;
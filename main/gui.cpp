@@ -3428,6 +3428,8 @@ protected:
   int _min_x;
   int _max_x;
   bool _is_visible = false;
+  bool _is_spectrum = false;
+  audio_analyzer_t::result_t _analysis;
 public:
   void update_impl(draw_param_t *param, int offset_x, int offset_y) override {
     bool visible;
@@ -3439,7 +3441,7 @@ public:
       visible = false;
       break;
     default:
-      visible = system_registry->user_setting.getGuiWaveView();
+      visible = system_registry->user_setting.getGuiWaveView() != def::wv_off;
       break;
     }
     if (_is_visible != visible) {
@@ -3458,7 +3460,19 @@ public:
 
     if (!_is_visible) { return; }
 
-    int start_pos = system_registry->raw_wave_pos - disp_width;
+    bool spectrum = system_registry->user_setting.getGuiWaveView() == def::wv_spectrum;
+    if (spectrum || _is_spectrum) {
+      // 解析結果が更新された場合のみ全体を再描画する
+      auto analysis = system_registry->audio_analysis.get();
+      if (_is_spectrum != spectrum || _analysis.sequence != analysis.sequence) {
+        _is_spectrum = spectrum;
+        _analysis = analysis;
+        param->addInvalidatedRect({offset_x, offset_y, _client_rect.w, _client_rect.h});
+      }
+      if (spectrum) { return; }
+    }
+
+    int start_pos = system_registry->raw_wave_pos.load(std::memory_order_acquire) - disp_width;
     if (start_pos < 0) {
       start_pos += system_registry->raw_wave_length;
     }
@@ -3514,6 +3528,11 @@ public:
 
     image_dark_shift(canvas, offset_x, offset_y, _client_rect.w, _client_rect.h);
 
+    if (_is_spectrum) {
+      draw_spectrum(canvas, offset_x, offset_y, clip_rect);
+      return;
+    }
+
     const int ch = _client_rect.h;
     const int clip_h = clip_rect->h;
     const int min_y = (_prev_min_y * ch) >> 8;
@@ -3560,6 +3579,50 @@ public:
       }
     }
   }
+
+protected:
+  // 帯域毎のレベルを棒グラフで、瞬時ラウドネスを横線で描画する (縦軸は -90dB ～ 0dB)
+  void draw_spectrum(M5Canvas *canvas, int32_t offset_x, int32_t offset_y, const rect_t *clip_rect) {
+    const int ch = _client_rect.h;
+    const int clip_h = clip_rect->h;
+    for (int i = 1; i < 8; ++i) {
+      int yy = (i * ch) >> 3;
+      image_color_or( canvas
+                    , offset_x
+                    , offset_y + yy
+                    , _client_rect.w, 1
+                    , 0x03F0u);
+    }
+    {
+      const int level_range = -audio_analyzer_t::level_min_db10;
+      int lu = _analysis.momentary_lu10 - audio_analyzer_t::level_min_db10;
+      if (lu > 0) {
+        int y = ch - (lu * ch / level_range);
+        if (y < 0) { y = 0; }
+        image_color_or( canvas
+                      , offset_x
+                      , offset_y + y
+                      , _client_rect.w, 1
+                      , 0xC618u);
+      }
+    }
+    const int band_width = _client_rect.w / (int)audio_analyzer_t::band_count;
+    if (band_width <= 1) { return; }
+    const int xe = clip_rect->right() - offset_x;
+    const int ye = clip_rect->bottom() - offset_y;
+    const auto wid = canvas->width();
+    auto buf = (m5gfx::swap565_t*)(canvas->getBuffer());
+    for (int x = -offset_x; x < xe; ++x, ++buf) {
+      int band = x / band_width;
+      // 帯域の間に1ドットの隙間を空ける
+      if (x < 0 || band >= (int)audio_analyzer_t::band_count || (x % band_width) == band_width - 1) { continue; }
+      int y0 = ch - ((_analysis.band[band] * ch) >> 8) + offset_y;
+      int y1 = ch + offset_y;
+      if (y0 < 0) { y0 = 0; }
+      if (y1 > clip_h) { y1 = clip_h; }
+      for (int y = y0; y < y1 && y < ye; ++y) { buf[y * wid].raw |= __builtin_bswap16(0xC600); }
+    }
+  }
 };
 ui_raw_wave_t ui_raw_wave;
 
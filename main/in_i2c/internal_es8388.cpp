@@ -163,6 +163,38 @@ void internal_es8388_t::unmute() {
   bulk_write(es8388_reg_data_set, sizeof(es8388_reg_data_set));
 }
 
+void internal_es8388_t::beginClockChange(void)
+{
+  static constexpr const uint8_t es8388_reg_data_set[] = {
+    25, 0x36, //DAC mute (ソフトランプで減衰する)
+    15, 0x34, //ADC mute
+  };
+  bulk_write(es8388_reg_data_set, sizeof(es8388_reg_data_set));
+}
+
+void internal_es8388_t::setSampleRate(uint32_t sample_rate)
+{
+  // MCLK は常にサンプリングレートの128倍とするため分周比は変えない
+  // 48kHzを超える場合は DAC側も double speed とする (ADC側は従来から double speed)
+  uint8_t dac_fs = (sample_rate > 48000) ? 0x20 : 0x00;
+  uint8_t reg_data_set[] = {
+     2, 0xF0, //CHIPPOWER: ADC/DACのステートマシンをリセット (VREFは維持してポップノイズを避ける)
+    13, 0x20, //I2S MCLK ratio (ADC側) double speed, div128
+    24, dac_fs, //I2S MCLK ratio (DAC側)
+     2, 0x00, //CHIPPOWER: power up all
+  };
+  bulk_write(reg_data_set, sizeof(reg_data_set));
+}
+
+void internal_es8388_t::endClockChange(void)
+{
+  static constexpr const uint8_t es8388_reg_data_set[] = {
+    15, 0x30, //ADC mute解除
+    25, 0x32, //DAC mute解除
+  };
+  bulk_write(es8388_reg_data_set, sizeof(es8388_reg_data_set));
+}
+
 void internal_es8388_t::setOutVolume(uint8_t volume)
 {
   if (volume > 33) {
@@ -16,6 +16,12 @@ public:
   void mute(void);
   void unmute(void);
 
+  // サンプリングレートの切替え (MCLKの変更) の前後に呼び出す
+  // begin でミュートし、MCLK を変更した後に setSampleRate で内部の状態をリセットし、end でミュートを解除する
+  void beginClockChange(void);
+  void setSampleRate(uint32_t sample_rate);
+  void endClockChange(void);
+
   // 出力ボリューム変更指示 有効レンジは 0 ~ 33 (0x21  4.5dB)
   void setOutVolume(uint8_t volume);
   uint8_t getOutVolume(void) { return _out_volume; }
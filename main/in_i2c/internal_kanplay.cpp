@@ -348,6 +348,30 @@ if (debuging_lv) {
     }
   }
 
+  { // サンプリングレートの切替え (クロックが乱れる間はコーデックをミュートする)
+    auto rate = system_registry->user_setting.getAudioSampleRate();
+    if (sample_rate != rate) {
+      uint32_t hz = def::audio::sample_rate_hz[rate];
+      internal_es8388.beginClockChange();
+      M5.delay(def::audio::rate_switch_ramp_msec);
+      if (internal_si5351.setSampleRate(hz)) {
+        sample_rate = rate;
+        internal_es8388.setSampleRate(hz);
+        // task_i2s が新しいクロックに合わせて I2S を開始し直し、各処理の係数を更新する
+        system_registry->runtime_info.setAudioClockRate(rate);
+        M5.delay(def::audio::rate_switch_settle_msec);
+        M5_LOGI("audio: sample rate %u Hz", (unsigned)hz);
+      } else {
+        // 設定できないレートは元に戻し、失敗したことを表示する
+        system_registry->user_setting.setAudioSampleRate(sample_rate);
+        auto& ri = system_registry->runtime_info;
+        ri.setAudioRateSwitchFailCount(ri.getAudioRateSwitchFailCount() + 1);
+        system_registry->popup_notify.setPopup(false, def::notify_type_t::NOTIFY_SAMPLE_RATE);
+      }
+      internal_es8388.endClockChange();
+    }
+  }
+
   {
     auto volume = system_registry->user_setting.getMasterVolume();
     volume = 13 + (volume / 5);
@@ -44,6 +44,8 @@ protected:
     internal_bmi270_t internal_bmi270;
 
     registry_t::history_code_t rgbled_history_code = 0;
+    // コーデックへ供給しているクロックのサンプリングレート (init で設定する値は 48kHz)
+    def::audio::sample_rate_t sample_rate = def::audio::sr_48000;
 };
 
 //-------------------------------------------------------------------------
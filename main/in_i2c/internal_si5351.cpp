@@ -5,6 +5,8 @@
 
 #include <M5Unified.h>
 
+#include "../common_define.hpp"
+
 namespace kanplay_ns {
 //-------------------------------------------------------------------------
 
@@ -91,18 +93,24 @@ static void setup_pll(uint8_t pll, /* PLL_A or PLL_B */
 #endif
 
 
-static void bulk_write(const uint8_t* reg_data)
+// 再試行しても書き込めなかった場合は、後続のレジスタを書き込まずに false を返す
+static bool bulk_write(const uint8_t* reg_data)
 {
   while (*reg_data) {
     uint8_t len = *reg_data++;
     int retry = 16;
-    while (!writeRegister(reg_data[0], &reg_data[1], len - 1) && --retry) { M5.delay(1); }
+    while (!writeRegister(reg_data[0], &reg_data[1], len - 1)) {
+      if (--retry == 0) { return false; }
+      M5.delay(1);
+    }
     reg_data += len;
   }
+  return true;
 }
 
 void internal_si5351_t::init(uint8_t cap, uint32_t xtal)
 {
+  _xtal_freq = xtal;
   int retry = 1024;
   while ((writeRegister8(3, 0x80) & 0x80) && --retry) { M5.delay(1); }
   if (retry == 0) {
@@ -125,13 +133,101 @@ void internal_si5351_t::init(uint8_t cap, uint32_t xtal)
     2,  3, 0x00,              // OUTPUT_ENABLE_CONTROL : enable all outputs
     0 // sentinel
   };
-  bulk_write(init_config);
+  if (!bulk_write(init_config)) {
+    M5_LOGE("Si5351 init failed");
+    return;
+  }
+  // 初期設定の MULTISYNTH1 (6.144MHz) は 48kHz 用
+  _sample_rate = def::audio::sample_rate_hz[def::audio::sr_48000];
 }
 
 void internal_si5351_t::update(int freq) {
   // writeRegister8(0x03, 0x00);  // OUTPUT_ENABLE_CONTROL : enable all outputs
 }
 
+bool internal_si5351_t::calcClock(uint32_t freq, uint32_t xtal, ratio_t& pll, ratio_t& ms)
+{
+  static constexpr const uint32_t vco_min = 600000000u;
+  static constexpr const uint32_t vco_max = 900000000u;
+  static constexpr const uint32_t denom_max = 1048575u;
+  if (freq == 0 || xtal == 0) { return false; }
+
+  uint32_t div = (vco_min + freq - 1) / freq;
+  if (div & 1) { ++div; }
+  uint64_t vco = (uint64_t)freq * div;
+  if (div < 8 || div > 2048 || vco > vco_max) { return false; }
+  ms = { div, 0, 1 };
+
+  uint32_t a = (uint32_t)(vco / xtal);
+  uint64_t b = vco - (uint64_t)a * xtal;
+  uint64_t c = xtal;
+  if (a < 15 || a > 90) { return false; }
+  // 約分しても分母が大きすぎる場合は、分母を最大値として分子を丸める
+  uint64_t x = b, y = c;
+  while (y) { uint64_t t = x % y; x = y; y = t; }
+  if (x > 1) { b /= x; c /= x; }
+  if (c > denom_max) {
+    b = (b * denom_max + c / 2) / c;
+    c = denom_max;
+  }
+  pll = { a, (uint32_t)b, (uint32_t)c };
+  return true;
+}
+
+void internal_si5351_t::encodeRatio(const ratio_t& ratio, uint8_t* dst)
+{
+  uint32_t f = (uint32_t)(((uint64_t)ratio.b << 7) / ratio.c);
+  uint32_t p1 = (ratio.a << 7) + f - 512;
+  uint32_t p2 = (ratio.b << 7) - ratio.c * f;
+  uint32_t p3 = ratio.c;
+  dst[0] = p3 >> 8;
+  dst[1] = p3;
+  dst[2] = (p1 >> 16) & 0x03;
+  dst[3] = p1 >> 8;
+  dst[4] = p1;
+  dst[5] = ((p3 >> 12) & 0xF0) | ((p2 >> 16) & 0x0F);
+  dst[6] = p2 >> 8;
+  dst[7] = p2;
+}
+
+bool internal_si5351_t::setSampleRate(uint32_t sample_rate)
+{
+  ratio_t pll, ms;
+  if (!calcClock(sample_rate * def::audio::mclk_ratio, _xtal_freq, pll, ms)) {
+    M5_LOGE("Si5351 unsupported rate: %u", (unsigned)sample_rate);
+    return false;
+  }
+  if (writeClock(pll, ms)) {
+    _sample_rate = sample_rate;
+    return true;
+  }
+  M5_LOGE("Si5351 write failed: %u", (unsigned)sample_rate);
+  // 途中まで書き換えた設定を、呼出し元が引き続き使う元のレートへ戻す
+  if (_sample_rate && calcClock(_sample_rate * def::audio::mclk_ratio, _xtal_freq, pll, ms)) {
+    writeClock(pll, ms);
+  }
+  return false;
+}
+
+bool internal_si5351_t::writeClock(const ratio_t& pll, const ratio_t& ms)
+{
+  // 他の出力 (CLK0/CLK2) は止めないよう、CLK1 の出力のみを停止・再開する
+  uint8_t enable = readRegister8(3) & ~0x02;
+  uint8_t config[] = {
+    2,   3, 0x02,              // OUTPUT_ENABLE_CONTROL : disable CLK1
+    9,  26, 0, 0, 0, 0, 0, 0, 0, 0,  // PLL_A setup
+    9,  50, 0, 0, 0, 0, 0, 0, 0, 0,  // MULTISYNTH1
+    2, 177, 0x20,              // PLL_RESET : reset A
+    2,   3, 0x00,              // OUTPUT_ENABLE_CONTROL : enable CLK1
+    0 // sentinel
+  };
+  config[2] |= enable;
+  config[28] = enable;
+  encodeRatio(pll, &config[5]);
+  encodeRatio(ms, &config[15]);
+  return bulk_write(config);
+}
+
 //-------------------------------------------------------------------------
 }; // namespace kanplay_ns
 
@@ -10,10 +10,31 @@ namespace kanplay_ns {
 //-------------------------------------------------------------------------
 class internal_si5351_t {
 public:
+  // 分周の設定 (a + b / c)
+  struct ratio_t {
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+  };
+
   void init(uint8_t cap = 10, uint32_t xtal = 27000000);
   void update(int freq);
+
+  // CLK1 (ES8388のMCLK) を sample_rate の mclk_ratio 倍に設定し直す
+  // CLK1 の出力のみを止めてから PLL_A と MULTISYNTH1 を書き換え、PLLをリセットした後に出力を再開する
+  // I2C の書込みに失敗した場合は元のレートの設定を書き戻し、false を返す
+  bool setSampleRate(uint32_t sample_rate);
+
+  // 出力周波数 freq を得るための PLL と MULTISYNTH の分周を求める
+  // MULTISYNTH は偶数の整数分周 (整数モード) とし、VCO が 600～900MHz に収まる最小の分周を選ぶ
+  static bool calcClock(uint32_t freq, uint32_t xtal, ratio_t& pll, ratio_t& ms);
+  // 分周の設定をレジスタの並び (8byte) に変換する
+  static void encodeRatio(const ratio_t& ratio, uint8_t* dst);
 private:
+  bool writeClock(const ratio_t& pll, const ratio_t& ms);
+
   uint32_t _xtal_freq = 27000000;
+  uint32_t _sample_rate = 0;   // 設定済みのレート (0 は未設定)
   uint8_t _clkin_div = 0;
   uint8_t _ref_correction = 0;
 };
@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_INPUT_QUANTIZER_HPP
+#define KANPLAY_INPUT_QUANTIZER_HPP
+
+/*
+input_quantizer は 手動演奏のオンビート入力をビートの分割位置に寄せます。
+ - 手動演奏の発音を常に先読み時間(lookahead)だけ遅らせ、その範囲内であればビートより遅い入力も分割位置へ寄せる
+ - ビートより早い入力はボイシングを入力時に決定し、発音のみ分割位置まで遅らせる
+ - 分割位置の基準は前回のオンビートの分割位置とし、入力時刻のずれで基準が移動しないようにする
+ - 入力から発音までの遅延と、寄せた入力の誤差の移動平均を求める
+ - 時刻と周期のみを扱うため、ホスト上で記録した入力を再生して効果を確認できる
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class input_quantizer_t {
+public:
+  struct result_t {
+    uint32_t play_usec;   // 発音する時刻
+    int32_t delay_usec;   // 入力から発音までの遅延 (0以上)
+    int32_t error_usec;   // 入力と分割位置の差 (負はビートより早い入力)
+    bool corrected;       // 分割位置に寄せた
+  };
+
+  // window_usec : 分割位置の前後この範囲内の入力を寄せる (0は無効)
+  // lookahead_usec : 手動演奏の発音を遅らせる時間。ビートより遅い入力はこの時間までしか寄せられない
+  void setConfig(int32_t window_usec, int32_t lookahead_usec) {
+    if (window_usec <= 0) {
+      window_usec = 0;
+      lookahead_usec = 0;
+    }
+    if (lookahead_usec < 0) { lookahead_usec = 0; }
+    if (_window_usec != window_usec) { _anchor_valid = false; }
+    _window_usec = window_usec;
+    _lookahead_usec = lookahead_usec;
+  }
+  int32_t getWindow(void) const { return _window_usec; }
+  int32_t getLookahead(void) const { return _lookahead_usec; }
+
+  // 分割位置の基準を破棄する (次の入力から寄せ直す)
+  void reset(void) {
+    _anchor_valid = false;
+    _hold_until_usec = 0;
+    _hold_delay_usec = 0;
+  }
+
+  // オンビートの入力を処理し、発音する時刻を返す
+  // onbeat_cycle_usec はオンビートの間隔、step_per_beat はビートあたりの分割数
+  result_t process(uint32_t press_usec, int32_t onbeat_cycle_usec, int32_t step_per_beat) {
+    result_t res = { press_usec, 0, 0, false };
+    if (_window_usec == 0) { return res; }
+
+    res.play_usec = press_usec + _lookahead_usec;
+    res.delay_usec = _lookahead_usec;
+
+    const uint32_t anchor_usec = _anchor_usec;
+    const bool anchor_valid = _anchor_valid;
+    _anchor_usec = press_usec;
+    _anchor_valid = true;
+
+    const int32_t elapsed_usec = press_usec - anchor_usec;
+    // 前回のビートから間が空きすぎている場合は演奏の再開とみなし、入力時刻を新たな基準とする
+    if (anchor_valid && onbeat_cycle_usec >= min_cycle_usec
+     && elapsed_usec > 0 && elapsed_usec <= onbeat_cycle_usec * 2) {
+      const int32_t grid_usec = onbeat_cycle_usec / (step_per_beat > 0 ? step_per_beat : 1);
+      const int32_t n = (elapsed_usec + (grid_usec >> 1)) / grid_usec;
+      if (n < 1) {
+        // 前回のビートと同じ分割位置への入力 (連打など) は基準を動かさない
+        _anchor_usec = anchor_usec;
+      } else {
+        const uint32_t grid_pos_usec = anchor_usec + n * grid_usec;
+        res.error_usec = elapsed_usec - n * grid_usec;
+        // 寄せられない入力でも、基準は最寄りの分割位置に置き、入力のずれを次の入力へ持ち越さない
+        _anchor_usec = grid_pos_usec;
+        if (abs(res.error_usec) <= _window_usec && res.error_usec <= _lookahead_usec) {
+          res.corrected = true;
+          res.play_usec = grid_pos_usec + _lookahead_usec;
+          res.delay_usec = _lookahead_usec - res.error_usec;
+        }
+      }
+    }
+
+    if (res.delay_usec > 0) {
+      _hold_until_usec = res.play_usec;
+      _hold_delay_usec = res.delay_usec;
+    }
+    _latency_avg_usec += (res.delay_usec - _latency_avg_usec) >> 3;
+    if (res.corrected) {
+      _correction_avg_usec += (abs(res.error_usec) - _correction_avg_usec) >> 3;
+    }
+    return res;
+  }
+
+  // オフビートの入力に加える遅延。遅らせたオンビートがまだ鳴っていない場合は同じだけ遅らせて順序と間隔を保つ
+  int32_t getFollowDelay(uint32_t now_usec) const {
+    if (_window_usec == 0) { return 0; }
+    if ((int32_t)(_hold_until_usec - now_usec) > 0 && _hold_delay_usec > _lookahead_usec) {
+      return _hold_delay_usec;
+    }
+    return _lookahead_usec;
+  }
+
+  // 入力から発音までの遅延の移動平均 (usec)
+  int32_t getLatencyAvg(void) const { return _latency_avg_usec; }
+  // 分割位置に寄せた入力の誤差の絶対値の移動平均 (usec)
+  int32_t getCorrectionAvg(void) const { return _correction_avg_usec; }
+
+private:
+  static constexpr const int32_t min_cycle_usec = 16384;
+
+  int32_t _window_usec = 0;
+  int32_t _lookahead_usec = 0;
+  uint32_t _anchor_usec = 0;
+  bool _anchor_valid = false;
+  uint32_t _hold_until_usec = 0;
+  int32_t _hold_delay_usec = 0;
+  int32_t _latency_avg_usec = 0;
+  int32_t _correction_avg_usec = 0;
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
@@ -0,0 +1,478 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include <M5Unified.h>
+
+#include "looper.hpp"
+
+#include "voice_manager.hpp"
+
+#include <string.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+bool looper_t::init(size_t max_event, voice_manager_t* voice_manager, reg_midi_out_control_t* midi_out)
+{
+  _voice_manager = voice_manager;
+  _midi_out = midi_out;
+  if (_buffer[0] != nullptr) { return true; }
+  for (int i = 0; i < 2; ++i) {
+    _buffer[i] = (event_t*)m5gfx::heap_alloc_psram(max_event * sizeof(event_t));
+    if (_buffer[i] == nullptr) {
+      M5_LOGE("looper_t::init: heap_alloc_psram failed. size:%u", (unsigned)(max_event * sizeof(event_t)));
+      if (i) {
+        m5gfx::heap_free(_buffer[0]);
+        _buffer[0] = nullptr;
+      }
+      return false;
+    }
+  }
+  _max_event = max_event;
+  clear();
+  return true;
+}
+
+void looper_t::clear(void)
+{
+  _play_count = 0;
+  _play_cursor = 0;
+  _write_count = 0;
+  _write_last_position = 0;
+  _loop_length_usec = 0;
+  _record_end_pending = false;
+  _state = looper_empty;
+}
+
+int32_t looper_t::getPosition(uint32_t usec) const
+{
+  int32_t elapsed = usec - _anchor_usec;
+  if (elapsed < 0 || _cycle_usec <= 0) { return _anchor_pos; }
+  return _anchor_pos + (int32_t)((int64_t)elapsed * _ref_cycle_usec / _cycle_usec);
+}
+
+void looper_t::updateNoteState(uint8_t (&note_on)[def::midi::channel_max][16], uint8_t status, uint8_t data1, uint8_t data2)
+{
+  uint8_t type = status & 0xF0;
+  if (type != 0x80 && type != 0x90) { return; }
+  uint8_t ch = status & 0x0F;
+  uint8_t bit = 1 << (data1 & 7);
+  if (type == 0x90 && data2) {
+    note_on[ch][data1 >> 3] |= bit;
+  } else {
+    note_on[ch][data1 >> 3] &= ~bit;
+  }
+}
+
+void looper_t::writeEvent(uint32_t position, uint8_t status, uint8_t data1, uint8_t data2)
+{
+  if (_write_count >= _max_event) {
+    ++_overflow_count;
+    return;
+  }
+  // 書き込み面は常に時刻順に並ぶようにする
+  if (position < _write_last_position) { position = _write_last_position; }
+  _write_last_position = position;
+  auto ev = &getWriteBuffer()[_write_count++];
+  ev->position_usec = position;
+  ev->status = status;
+  ev->data1 = data1;
+  ev->data2 = data2;
+  ev->reserved = 0;
+}
+
+// 予定時刻 usec のイベントとして出力する (処理の遅れにより出力が usec より後になっても送信側へ予定時刻を伝える)
+void looper_t::output(uint32_t usec, uint8_t status, uint8_t data1, uint8_t data2)
+{
+  if (_midi_out != nullptr) { _midi_out->setEventTime(usec); }
+  outputMessage(usec, status, data1, data2);
+  if (_midi_out != nullptr) { _midi_out->clearEventTime(); }
+}
+
+void looper_t::outputMessage(uint32_t usec, uint8_t status, uint8_t data1, uint8_t data2)
+{
+  if (_own_message_count + 1 + voice_manager_t::max_last_steal > max_own_message) {
+    // 控えが一杯の場合は先に履歴を読み進めて控えを空ける
+    captureHistory(usec);
+  }
+
+  uint8_t type = status & 0xF0;
+  if (_voice_manager != nullptr && (type == 0x80 || type == 0x90)) {
+    uint8_t ch = status & 0x0F;
+    // voice_manager が出力する形式で控える
+    if (type == 0x90 && data2) {
+      _own_message[_own_message_count++] = (0x90 | ch) | (data1 << 8) | (data2 << 16);
+      _voice_manager->noteOn(voice_manager_t::part_looper, ch, data1, data2);
+      // 再生音どうしのスティールによるノートオフは再生の副作用であり、重ね録りに含めない
+      // (演奏中の音を停止させた場合は聞こえたとおりに録音する)
+      uint8_t steals = _voice_manager->getLastStealCount();
+      if (steals > voice_manager_t::max_last_steal) { steals = voice_manager_t::max_last_steal; }
+      for (uint8_t i = 0; i < steals; ++i) {
+        auto& s = _voice_manager->getLastSteal(i);
+        if (s.part == voice_manager_t::part_looper) {
+          _own_message[_own_message_count++] = (0x80 | s.midi_ch) | (s.note << 8);
+        }
+      }
+    } else {
+      _own_message[_own_message_count++] = (0x80 | ch) | (data1 << 8);
+      _voice_manager->noteOff(ch, data1);
+    }
+    return;
+  }
+  if (_midi_out != nullptr) {
+    _own_message[_own_message_count++] = status | (data1 << 8) | (data2 << 16);
+    _midi_out->setMessage(status, data1, data2);
+  }
+}
+
+void looper_t::captureHistory(uint32_t usec)
+{
+  if (_midi_out == nullptr) { return; }
+  const bool rec = (_state == looper_recording || _state == looper_overdub);
+  int32_t position = rec ? getPosition(usec) : 0;
+  if (position < 0) { position = 0; }
+  // 重ね録り中に周回の境界をまたいだ場合は現在の周回の末尾に寄せる
+  if (_state == looper_overdub && _loop_length_usec && position >= (int32_t)_loop_length_usec) {
+    position = _loop_length_usec - 1;
+  }
+
+  const registry_base_t::history_t* history;
+  while (nullptr != (history = _midi_out->getHistory(_history_code))) {
+    uint8_t status = history->index & 0xFF;
+    if (_own_message_count) {
+      // 自身が再生したメッセージは録音対象にしない
+      uint32_t message = status | ((history->value & 0xFFFF) << 8);
+      bool own = false;
+      for (size_t i = 0; i < _own_message_count; ++i) {
+        if (_own_message[i] == message) {
+          _own_message[i] = _own_message[--_own_message_count];
+          own = true;
+          break;
+        }
+      }
+      if (own) { continue; }
+    }
+    if (!rec) { continue; }
+    // チャンネルメッセージのみ記録する
+    if (status < 0x80 || status >= 0xF0) { continue; }
+    writeEvent(position, status, history->value & 0xFF, (history->value >> 8) & 0xFF);
+  }
+  // 出力は同期的に履歴へ積まれるため、ここで見つからなかった控えは出力されなかったもの
+  // (voice_manager が発音していない音へのノートオフを省略した場合など)
+  _own_message_count = 0;
+}
+
+void looper_t::closeLoop(uint32_t usec, bool overdub)
+{
+  int32_t elapsed = getPosition(usec);
+  if (elapsed < 1) { elapsed = 1; }
+  uint32_t length = elapsed;
+  if (_beat_sync) {
+    // ループ長を最も近いビート数に丸める
+    uint32_t beats = (elapsed + (_ref_cycle_usec >> 1)) / _ref_cycle_usec;
+    if (beats < 1) { beats = 1; }
+    length = beats * _ref_cycle_usec;
+  }
+  _loop_length_usec = length;
+  _record_end_pending = true;
+  _overdub_after_record = overdub;
+}
+
+void looper_t::finishRecording(uint32_t usec)
+{
+  auto wb = getWriteBuffer();
+
+  // ループ長を切り詰めた場合は範囲外のイベントを取り除く
+  while (_write_count && wb[_write_count - 1].position_usec >= _loop_length_usec) {
+    --_write_count;
+  }
+  if (_write_last_position >= _loop_length_usec) {
+    _write_last_position = _loop_length_usec - 1;
+  }
+
+  // ループ末尾で鳴りっぱなしになる音にノートオフを追加する
+  uint8_t note_on[def::midi::channel_max][16] = {};
+  for (size_t i = 0; i < _write_count; ++i) {
+    updateNoteState(note_on, wb[i].status, wb[i].data1, wb[i].data2);
+  }
+  for (int ch = 0; ch < def::midi::channel_max; ++ch) {
+    for (int n = 0; n < 128; ++n) {
+      if (note_on[ch][n >> 3] & (1 << (n & 7))) {
+        writeEvent(_loop_length_usec - 1, 0x80 | ch, n, 0);
+      }
+    }
+  }
+
+  swapBuffer();
+  _play_cursor = 0;
+  // ループの末尾を過ぎた分から再生を始める
+  setAnchor(usec, getPosition(usec) - (int32_t)_loop_length_usec);
+  _record_end_pending = false;
+  _state = looper_playing;
+  if (_overdub_after_record) {
+    startOverdub();
+  }
+}
+
+void looper_t::swapBuffer(void)
+{
+  _play_index ^= 1;
+  _play_count = _write_count;
+  _write_count = 0;
+  _write_last_position = 0;
+}
+
+void looper_t::startOverdub(void)
+{
+  // 今回の周回で再生済みのイベントを書き込み面に写してから重ね録りを開始する
+  auto pb = getPlayBuffer();
+  _write_count = 0;
+  _write_last_position = 0;
+  if (_play_cursor) {
+    memcpy(getWriteBuffer(), pb, _play_cursor * sizeof(event_t));
+    _write_count = _play_cursor;
+    _write_last_position = pb[_play_cursor - 1].position_usec;
+  }
+  _state = looper_overdub;
+}
+
+void looper_t::stopOverdub(void)
+{
+  // 今回の周回でまだ再生していないイベントを書き込み面に写し、面を入れ替える
+  auto pb = getPlayBuffer();
+  size_t cursor = _write_count;
+  size_t remain = _play_count - _play_cursor;
+  if (remain > _max_event - _write_count) {
+    _overflow_count += remain - (_max_event - _write_count);
+    remain = _max_event - _write_count;
+  }
+  if (remain) {
+    memcpy(&getWriteBuffer()[_write_count], &pb[_play_cursor], remain * sizeof(event_t));
+    _write_count += remain;
+  }
+  swapBuffer();
+  _play_cursor = cursor;
+  _state = looper_playing;
+}
+
+void looper_t::allPlayNotesOff(uint32_t usec)
+{
+  for (int ch = 0; ch < def::midi::channel_max; ++ch) {
+    for (int n = 0; n < 128; ++n) {
+      if (_play_note_on[ch][n >> 3] & (1 << (n & 7))) {
+        output(usec, 0x80 | ch, n, 0);
+      }
+    }
+  }
+  memset(_play_note_on, 0, sizeof(_play_note_on));
+}
+
+void looper_t::control(def::command::looper_control_t ctrl, uint32_t usec)
+{
+  if (_max_event == 0) { return; }
+
+  switch (ctrl) {
+  default:
+    break;
+
+  case def::command::looper_control_t::lc_record:
+    switch (_state) {
+    case looper_empty:
+    case looper_stopped:
+    case looper_play_waiting:
+      clear();
+      _state = looper_armed;
+      break;
+    case looper_armed:
+      clear();
+      break;
+    case looper_recording:
+      if (!_record_end_pending) { closeLoop(usec, false); }
+      break;
+    case looper_playing:
+      startOverdub();
+      break;
+    case looper_overdub:
+      stopOverdub();
+      break;
+    }
+    break;
+
+  case def::command::looper_control_t::lc_overdub:
+    switch (_state) {
+    default:
+      break;
+    case looper_recording:
+      if (!_record_end_pending) { closeLoop(usec, true); }
+      break;
+    case looper_playing:
+      startOverdub();
+      break;
+    case looper_overdub:
+      stopOverdub();
+      break;
+    }
+    break;
+
+  case def::command::looper_control_t::lc_play:
+    switch (_state) {
+    default:
+      break;
+    case looper_recording:
+      if (!_record_end_pending) { closeLoop(usec, false); }
+      break;
+    case looper_stopped:
+      _state = looper_play_waiting;
+      break;
+    case looper_overdub:
+      stopOverdub();
+      break;
+    }
+    break;
+
+  case def::command::looper_control_t::lc_stop:
+    switch (_state) {
+    default:
+      break;
+    case looper_armed:
+      _state = looper_empty;
+      break;
+    case looper_play_waiting:
+      _state = looper_stopped;
+      break;
+    case looper_recording:
+      // 録音中の停止はその時点でループを確定して停止状態にする
+      if (!_record_end_pending) { closeLoop(usec, false); }
+      {
+        int32_t position = getPosition(usec);
+        if (position < (int32_t)_loop_length_usec) {
+          _loop_length_usec = (position > 0) ? position : 1;
+        }
+      }
+      finishRecording(usec);
+      allPlayNotesOff(usec);
+      _state = looper_stopped;
+      break;
+    case looper_overdub:
+      stopOverdub();
+      [[fallthrough]];
+    case looper_playing:
+      allPlayNotesOff(usec);
+      _state = looper_stopped;
+      break;
+    }
+    break;
+
+  case def::command::looper_control_t::lc_clear:
+    allPlayNotesOff(usec);
+    clear();
+    break;
+  }
+}
+
+void looper_t::onBeat(uint32_t usec, int32_t beat_cycle_usec)
+{
+  switch (_state) {
+  default:
+    break;
+
+  case looper_armed:
+    // 録音開始。これ以降に出力されたイベントを記録する
+    // ビート周期が分からない場合は実時間で記録し、ビートへの同期は行わない
+    _write_count = 0;
+    _write_last_position = 0;
+    _beat_sync = (beat_cycle_usec >= 16384);
+    _ref_cycle_usec = _beat_sync ? beat_cycle_usec : 1000000;
+    _cycle_usec = _ref_cycle_usec;
+    setAnchor(usec, 0);
+    if (_midi_out != nullptr) {
+      _history_code = _midi_out->getHistoryCode();
+    }
+    _state = looper_recording;
+    break;
+
+  case looper_play_waiting:
+    if (_beat_sync && beat_cycle_usec >= 16384) { _cycle_usec = beat_cycle_usec; }
+    setAnchor(usec, 0);
+    _play_cursor = 0;
+    _state = looper_playing;
+    break;
+
+  case looper_recording:
+  case looper_playing:
+  case looper_overdub:
+    if (_beat_sync) {
+      // 位置を最も近いビートに合わせ直し、以降は現在のビート周期で進める
+      int32_t position = getPosition(usec);
+      if (position < 0) { position = 0; }
+      int32_t beats = (position + (_ref_cycle_usec >> 1)) / _ref_cycle_usec;
+      setAnchor(usec, beats * _ref_cycle_usec);
+      if (beat_cycle_usec >= 16384) { _cycle_usec = beat_cycle_usec; }
+    }
+    break;
+  }
+}
+
+uint32_t looper_t::process(uint32_t usec)
+{
+  uint32_t next_event_timing = INT32_MAX;
+
+  captureHistory(usec);
+
+  if (_state == looper_recording && _record_end_pending) {
+    int32_t remain = _loop_length_usec - getPosition(usec);
+    if (remain > 0) {
+      next_event_timing = toUsec(remain);
+    } else {
+      finishRecording(usec);
+    }
+  }
+
+  if (_state != looper_playing && _state != looper_overdub) {
+    return next_event_timing;
+  }
+
+  bool emitted = false;
+  int32_t position = getPosition(usec);
+  for (;;) {
+    auto pb = getPlayBuffer();
+    while (_play_cursor < _play_count && (int32_t)pb[_play_cursor].position_usec <= position) {
+      auto ev = &pb[_play_cursor++];
+      // 処理の遅れを除いた本来の時刻を予定時刻とする
+      output(usec - toUsec(position - (int32_t)ev->position_usec), ev->status, ev->data1, ev->data2);
+      updateNoteState(_play_note_on, ev->status, ev->data1, ev->data2);
+      if (_state == looper_overdub) {
+        writeEvent(ev->position_usec, ev->status, ev->data1, ev->data2);
+      }
+      emitted = true;
+    }
+    if (position < (int32_t)_loop_length_usec) { break; }
+
+    // 周回の終了。重ね録り中は書き込み面を次の周回の再生面にする
+    if (_state == looper_overdub) {
+      swapBuffer();
+    }
+    _play_cursor = 0;
+    position -= _loop_length_usec;
+    setAnchor(usec, position);
+  }
+
+  // 自身が出力したイベントを履歴から取り除く
+  if (emitted) {
+    captureHistory(usec);
+  }
+
+  int32_t remain = _loop_length_usec - position;
+  if (_play_cursor < _play_count) {
+    remain = getPlayBuffer()[_play_cursor].position_usec - position;
+  }
+  if (remain < 0) { remain = 0; }
+  uint32_t remain_usec = toUsec(remain);
+  if (next_event_timing > remain_usec) {
+    next_event_timing = remain_usec;
+  }
+  return next_event_timing;
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_LOOPER_HPP
+#define KANPLAY_LOOPER_HPP
+
+/*
+looper は 演奏エンジンが出力したMIDIイベントを録音し、ループ再生・重ね録りを行います。
+ - midi_out_control の履歴を独自のカーソルで読み取り、ループ先頭からの経過時間付きで記録する
+ - 履歴のうち自身が再生したメッセージのみを取り除き、他のタスクが出力したイベントは読み飛ばさない
+ - イベントバッファは起動時にPSRAMへ確保した固定長の2面構成とし、演奏中のメモリ確保は行わない
+ - 重ね録り中は再生したイベントと新たなイベントを時刻順にもう一方の面へ書き込み、
+   ループ一周ごとに面を入れ替えるため、1イベントあたりの処理はO(1)となる
+ - 録音の開始・終了はビートに同期し、ループ長はビート単位に丸める
+ - イベントの位置は録音開始時のビート周期を基準とした時間で記録する。再生中はオンビート毎に
+   位置を最も近いビートに合わせ直し、現在のビート周期に合わせて伸縮するため、テンポが変わってもずれない
+ - 再生するノートは voice_manager を経由して出力し、同時発音数の管理対象とする
+ - 再生したノートが発音中の再生音を停止させた場合、そのノートオフも自身の出力として録音しない
+*/
+
+#include "common_define.hpp"
+#include "midi_out_control.hpp"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class voice_manager_t;
+
+class looper_t {
+public:
+  enum state_t : uint8_t {
+    looper_empty = 0,   // 録音データなし
+    looper_armed,       // 次のビートで録音開始
+    looper_recording,   // 録音中
+    looper_playing,     // 再生中
+    looper_overdub,     // 再生しながら重ね録り中
+    looper_stopped,     // 停止中 (録音データあり)
+    looper_play_waiting,// 次のビートで再生開始
+  };
+
+  struct event_t {
+    uint32_t position_usec; // ループ先頭からの経過時間 (録音開始時のビート周期での時間)
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+    uint8_t reserved;
+  };
+
+  // イベントバッファを確保する (面1つあたり max_event 個)
+  // 再生するノートは voice_manager を経由して出力し、録音は midi_out の履歴から読み取る
+  bool init(size_t max_event, voice_manager_t* voice_manager, reg_midi_out_control_t* midi_out);
+
+  // 操作コマンドの処理
+  void control(def::command::looper_control_t ctrl, uint32_t usec);
+
+  // オンビートのタイミングで呼び出す
+  void onBeat(uint32_t usec, int32_t beat_cycle_usec);
+
+  // 録音・再生処理。戻り値は次に処理が必要になるまでの時間(usec)
+  uint32_t process(uint32_t usec);
+
+  // これまでに出力されたイベントを usec の時刻のものとして記録する
+  // (演奏タスクがイベントを出力した直後に、そのイベントの時刻で呼び出す)
+  void capture(uint32_t usec) { captureHistory(usec); }
+
+  state_t getState(void) const { return _state; }
+  // 現在のビート周期でのループ長
+  uint32_t getLoopLengthUsec(void) const { return _ref_cycle_usec ? toUsec(_loop_length_usec) : 0; }
+  size_t getEventCount(void) const { return _play_count; }
+  uint32_t getOverflowCount(void) const { return _overflow_count; }
+
+protected:
+  event_t* _buffer[2] = { nullptr, nullptr };
+  size_t _max_event = 0;
+
+  // 再生用の面と書き込み用の面
+  uint8_t _play_index = 0;
+  size_t _play_count = 0;   // 再生用の面のイベント数
+  size_t _play_cursor = 0;  // 次に再生するイベントの位置
+  size_t _write_count = 0;  // 書き込み用の面のイベント数
+  uint32_t _write_last_position = 0;
+
+  state_t _state = looper_empty;
+  uint32_t _loop_length_usec = 0;   // 録音開始時のビート周期での長さ
+  bool _record_end_pending = false; // ループ長を確定し、末尾に達したら録音を終了する
+  bool _overdub_after_record = false;
+  uint32_t _overflow_count = 0;
+
+  // ループの時間軸。_anchor_usec の時点の位置が _anchor_pos で、以降は _ref_cycle_usec / _cycle_usec の速さで進む
+  int32_t _ref_cycle_usec = 0;      // 録音開始時のビート周期
+  int32_t _cycle_usec = 0;          // 現在のビート周期
+  uint32_t _anchor_usec = 0;
+  int32_t _anchor_pos = 0;          // 現在の周回の先頭からの位置
+  bool _beat_sync = false;          // ビート周期が分かる状態で録音した
+
+  uint32_t _history_code = 0;
+
+  // 自身が出力し、まだ履歴から取り除いていないメッセージ (status | data1 << 8 | data2 << 16)
+  static constexpr const size_t max_own_message = 64;
+  uint32_t _own_message[max_own_message];
+  size_t _own_message_count = 0;
+
+  voice_manager_t* _voice_manager = nullptr;
+  reg_midi_out_control_t* _midi_out = nullptr;
+
+  // 再生で発音中のノート (ループ停止時のノートオフ用) [チャンネル][ノート/8]
+  uint8_t _play_note_on[def::midi::channel_max][16] = {};
+
+  event_t* getPlayBuffer(void) const { return _buffer[_play_index]; }
+  event_t* getWriteBuffer(void) const { return _buffer[_play_index ^ 1]; }
+
+  // usec の時点のループ内の位置
+  int32_t getPosition(uint32_t usec) const;
+  // ループ内の位置の差を現在のビート周期での時間に換算する
+  uint32_t toUsec(int32_t position) const {
+    return ((int64_t)position * _cycle_usec + _ref_cycle_usec - 1) / _ref_cycle_usec;
+  }
+  void setAnchor(uint32_t usec, int32_t position) {
+    _anchor_usec = usec;
+    _anchor_pos = position;
+  }
+
+  void writeEvent(uint32_t position, uint8_t status, uint8_t data1, uint8_t data2);
+  void output(uint32_t usec, uint8_t status, uint8_t data1, uint8_t data2);
+  void outputMessage(uint32_t usec, uint8_t status, uint8_t data1, uint8_t data2);
+  void captureHistory(uint32_t usec);
+  void closeLoop(uint32_t usec, bool overdub);
+  void finishRecording(uint32_t usec);
+  void startOverdub(void);
+  void stopOverdub(void);
+  void swapBuffer(void);
+  void allPlayNotesOff(uint32_t usec);
+  void clear(void);
+
+  static void updateNoteState(uint8_t (&note_on)[def::midi::channel_max][16], uint8_t status, uint8_t data1, uint8_t data2);
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
@@ -522,11 +522,19 @@ public:
       : mi_selector_t{cate, menu_id, level, title, &name_array} {}
 };
 
-struct mi_wave_view_t : public mi_enable_selector_t {
+struct mi_wave_view_t : public mi_selector_t {
+protected:
+  static constexpr const localize_text_array_t name_array = {
+      3, (const localize_text_t[]){
+             {"Off", "オフ"},
+             {"Wave", "波形"},
+             {"Spectrum", "スペクトル"},
+         }};
+
 public:
   constexpr mi_wave_view_t(def::menu_category_t cate, uint16_t menu_id,
                            uint8_t level, const localize_text_t &title)
-      : mi_enable_selector_t{cate, menu_id, level, title} {}
+      : mi_selector_t{cate, menu_id, level, title, &name_array} {}
 
   int getValue(void) const override {
     return getMinValue() +
@@ -1106,6 +1114,213 @@ struct mi_offbeat_style_t : public mi_selector_t {
   }
 };
 
+struct mi_sample_rate_t : public mi_selector_t {
+  // def::audio::sample_rate_t の順
+  static constexpr const localize_text_array_t name_array = {
+      4, (const localize_text_t[]){
+             {"48 kHz", nullptr},
+             {"44.1 kHz", nullptr},
+             {"96 kHz", "96 kHz (高音質)"},
+             {"32 kHz", "32 kHz (省電力)"},
+         }};
+
+  constexpr mi_sample_rate_t(def::menu_category_t cate, uint16_t menu_id,
+                             uint8_t level, const localize_text_t &title)
+      : mi_selector_t{cate, menu_id, level, title, &name_array} {}
+
+  int getValue(void) const override {
+    return getMinValue() + system_registry->user_setting.getAudioSampleRate();
+  }
+  bool setValue(int value) const override {
+    if (mi_selector_t::setValue(value) == false) {
+      return false;
+    }
+    // クロックとコーデックの切替えは task_i2c が行う
+    system_registry->user_setting.setAudioSampleRate(value - getMinValue());
+    return true;
+  }
+};
+
+struct mi_play_clock_sync_t : public mi_enable_selector_t {
+public:
+  constexpr mi_play_clock_sync_t(def::menu_category_t cate, uint16_t menu_id,
+                                 uint8_t level, const localize_text_t &title)
+      : mi_enable_selector_t{cate, menu_id, level, title} {}
+
+  int getValue(void) const override {
+    return getMinValue() + static_cast<uint8_t>(
+               system_registry->user_setting.getPlaySampleClockSync());
+  }
+  bool setValue(int value) const override {
+    if (mi_selector_t::setValue(value) == false) {
+      return false;
+    }
+    value -= getMinValue();
+    system_registry->user_setting.setPlaySampleClockSync(value);
+    return true;
+  }
+};
+
+struct mi_quantize_window_t : public mi_normal_t {
+  static constexpr const localize_text_t text_off = {"Off", "オフ"};
+
+  constexpr mi_quantize_window_t(def::menu_category_t cate, uint16_t menu_id,
+                                 uint8_t level, const localize_text_t &title)
+      : mi_normal_t{cate, menu_id, level, title} {}
+
+protected:
+  // 0 は入力クオンタイズ無効
+  int getMinValue(void) const override { return 0; }
+  int getMaxValue(void) const override {
+    return def::app::quantize_window_msec_max;
+  }
+
+  int getValue(void) const override {
+    return system_registry->user_setting.getQuantizeWindow();
+  }
+  bool setValue(int value) const override {
+    if (mi_normal_t::setValue(value) == false) {
+      return false;
+    }
+    system_registry->user_setting.setQuantizeWindow(value);
+    return true;
+  }
+  const char *getSelectorText(size_t index) const override {
+    int tmp = index + getMinValue();
+    if (tmp == 0) {
+      return text_off.get();
+    }
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d ms", tmp);
+    _title_text_buffer = buf;
+    return _title_text_buffer.c_str();
+  }
+  const char *getValueText(void) const override {
+    return getSelectorText(getValue() - getMinValue());
+  }
+};
+
+struct mi_quantize_lookahead_t : public mi_quantize_window_t {
+  constexpr mi_quantize_lookahead_t(def::menu_category_t cate, uint16_t menu_id,
+                                    uint8_t level, const localize_text_t &title)
+      : mi_quantize_window_t{cate, menu_id, level, title} {}
+
+protected:
+  // 0 は先読みなし (ビートより遅い入力は寄せない)
+  int getMaxValue(void) const override {
+    return def::app::quantize_lookahead_msec_max;
+  }
+
+  int getValue(void) const override {
+    return system_registry->user_setting.getQuantizeLookahead();
+  }
+  bool setValue(int value) const override {
+    if (mi_normal_t::setValue(value) == false) {
+      return false;
+    }
+    system_registry->user_setting.setQuantizeLookahead(value);
+    return true;
+  }
+};
+
+struct mi_voice_limit_global_t : public mi_normal_t {
+  constexpr mi_voice_limit_global_t(def::menu_category_t cate,
+                                    uint16_t menu_id, uint8_t level,
+                                    const localize_text_t &title)
+      : mi_normal_t{cate, menu_id, level, title} {}
+
+protected:
+  int getMinValue(void) const override { return 1; }
+  int getMaxValue(void) const override { return def::app::max_voice; }
+
+  int getValue(void) const override {
+    return system_registry->user_setting.getVoiceLimitGlobal();
+  }
+  bool setValue(int value) const override {
+    if (mi_normal_t::setValue(value) == false) {
+      return false;
+    }
+    system_registry->user_setting.setVoiceLimitGlobal(value);
+    return true;
+  }
+  const char *getSelectorText(size_t index) const override {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", (int)index + getMinValue());
+    _title_text_buffer = buf;
+    return _title_text_buffer.c_str();
+  }
+  const char *getValueText(void) const override {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", getValue());
+    _title_text_buffer = buf;
+    return _title_text_buffer.c_str();
+  }
+};
+
+struct mi_voice_limit_part_t : public mi_normal_t {
+  static constexpr const localize_text_t text_off = {"Off", "なし"};
+
+  constexpr mi_voice_limit_part_t(def::menu_category_t cate, uint16_t menu_id,
+                                  uint8_t level, const localize_text_t &title)
+      : mi_normal_t{cate, menu_id, level, title} {}
+
+protected:
+  // 0 はパート毎の上限なし
+  int getMinValue(void) const override { return 0; }
+  int getMaxValue(void) const override { return def::app::max_voice; }
+
+  int getValue(void) const override {
+    return system_registry->user_setting.getVoiceLimitPart();
+  }
+  bool setValue(int value) const override {
+    if (mi_normal_t::setValue(value) == false) {
+      return false;
+    }
+    system_registry->user_setting.setVoiceLimitPart(value);
+    return true;
+  }
+  const char *getSelectorText(size_t index) const override {
+    int tmp = index + getMinValue();
+    if (tmp == 0) {
+      return text_off.get();
+    }
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", tmp);
+    _title_text_buffer = buf;
+    return _title_text_buffer.c_str();
+  }
+  const char *getValueText(void) const override {
+    return getSelectorText(getValue() - getMinValue());
+  }
+};
+
+struct mi_voice_steal_policy_t : public mi_selector_t {
+  // def::play::voice_steal_policy_t の順
+  static constexpr const localize_text_array_t name_array = {
+      3, (const localize_text_t[]){
+             {"Oldest", "最も古い音"},
+             {"Quietest", "最も弱い音"},
+             {"Same Pitch", "同じ音高の音"},
+         }};
+
+  constexpr mi_voice_steal_policy_t(def::menu_category_t cate,
+                                    uint16_t menu_id, uint8_t level,
+                                    const localize_text_t &title)
+      : mi_selector_t{cate, menu_id, level, title, &name_array} {}
+
+  int getValue(void) const override {
+    return getMinValue() + system_registry->user_setting.getVoiceStealPolicy();
+  }
+  bool setValue(int value) const override {
+    if (mi_selector_t::setValue(value) == false) {
+      return false;
+    }
+    system_registry->user_setting.setVoiceStealPolicy(
+        (def::play::voice_steal_policy_t)(value - getMinValue()));
+    return true;
+  }
+};
+
 struct mi_slot_perform_style_t : public mi_selector_t {
   static constexpr const localize_text_array_t name_array = {
       3, (const localize_text_t[]){
@@ -1804,6 +2019,86 @@ public:
   }
 };
 
+struct mi_midi_latency_t : public mi_normal_t {
+  constexpr mi_midi_latency_t(def::menu_category_t cate, uint16_t menu_id,
+                              uint8_t level, const localize_text_t &title,
+                              def::midi::output_port_t port)
+      : mi_normal_t{cate, menu_id, level, title}, _port{port} {}
+
+protected:
+  int getMinValue(void) const override { return 0; }
+  int getMaxValue(void) const override {
+    return def::midi::output_latency_msec_max;
+  }
+
+  int getValue(void) const override {
+    return system_registry->midi_port_setting.getOutputLatency(_port);
+  }
+  bool setValue(int value) const override {
+    if (mi_normal_t::setValue(value) == false) {
+      return false;
+    }
+    system_registry->midi_port_setting.setOutputLatency(_port, value);
+    return true;
+  }
+  const char *getSelectorText(size_t index) const override {
+    int tmp = index + getMinValue();
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d ms", tmp);
+    _title_text_buffer = buf;
+    return _title_text_buffer.c_str();
+  }
+  const char *getValueText(void) const override {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d ms", getValue());
+    _title_text_buffer = buf;
+    return _title_text_buffer.c_str();
+  }
+  const def::midi::output_port_t _port;
+};
+
+struct mi_midi_latency_measure_t : public mi_selector_t {
+protected:
+  static constexpr const localize_text_array_t name_array = {
+      5, (const localize_text_t[]){
+             {"Cancel", "キャンセル"},
+             {"PortC MIDI", "ポートC MIDI"},
+             {"BLE MIDI", nullptr},
+             {"USB MIDI", nullptr},
+             {"Internal (Audio)", "内蔵音源(音声)"},
+         }};
+  static constexpr const int internal_audio_value = 4;
+
+public:
+  constexpr mi_midi_latency_measure_t(def::menu_category_t cate,
+                                      uint16_t menu_id, uint8_t level,
+                                      const localize_text_t &title)
+      : mi_selector_t{cate, menu_id, level, title, &name_array} {}
+
+  const char *getValueText(void) const override { return "..."; }
+
+  int getValue(void) const override { return getMinValue(); }
+  bool setValue(int value) const override {
+    if (mi_selector_t::setValue(value) == false) {
+      return false;
+    }
+    value -= getMinValue();
+    if (value == internal_audio_value) {
+      // 内蔵音源は I2S の入力に現れる音で測定する (接続は不要)
+      // 結果は内蔵音源の出力レイテンシ設定に反映される
+      system_registry->operator_command.addQueue(
+          {def::command::latency_control, def::command::latency_control_t::lt_midi});
+    } else if (value > 0) {
+      // 対象ポートの出力を入力へ折り返した状態で測定する
+      // 結果は当該ポートの出力レイテンシ設定に反映される
+      system_registry->midi_port_setting.requestLatencyMeasure(
+          static_cast<def::midi::output_port_t>(def::midi::out_port_internal +
+                                                value));
+    }
+    return true;
+  }
+};
+
 struct mi_iclink_port_t : public mi_selector_t {
 protected:
   static constexpr const localize_text_array_t name_array = {
@@ -2269,6 +2564,9 @@ static constexpr menu_item_ptr menu_system[] = {
     MENU_BUILDER(mi_song_tempo_t, 2, {"BPM", "テンポ(BPM)"}),
     MENU_BUILDER(mi_song_swing_t, 2, {"Swing", "スウィング"}),
     MENU_BUILDER(mi_offbeat_style_t, 2, {"Offbeat Control", "裏拍演奏"}),
+    MENU_BUILDER(mi_play_clock_sync_t, 2, {"Audio Clock Sync", "オーディオクロック同期"}),
+    MENU_BUILDER(mi_quantize_window_t, 2, {"Input Quantize", "入力クオンタイズ"}),
+    MENU_BUILDER(mi_quantize_lookahead_t, 2, {"Quantize Lookahead", "クオンタイズ先読み"}),
     MENU_BUILDER(mi_song_step_beat_t, 2, {"Step / Beat", "ステップ／ビート"}),
     MENU_BUILDER(mi_tree_t, 1, {"Slot Setting", "スロット設定"}),
     MENU_BUILDER(mi_slot_perform_style_t, 2, {"Play Mode", "演奏モード"}),
@@ -3000,6 +3298,17 @@ static constexpr menu_item_ptr menu_system[] = {
     MENU_BUILDER(mi_usb_mode_t, 4, {"USB MODE", "USBモード設定"}),
     MENU_BUILDER(mi_usb_power_t, 4, {"Host Power Supply", "ホスト給電設定"}),
     MENU_BUILDER(mi_usb_midi_t, 4, {"USB MIDI", nullptr}),
+    MENU_BUILDER(mi_tree_t, 3, {"Output Latency", "出力レイテンシ"}),
+    MENU_BUILDER(mi_midi_latency_t, 4, {"Internal", "内蔵音源"},
+                 def::midi::out_port_internal),
+    MENU_BUILDER(mi_midi_latency_t, 4, {"PortC MIDI", "ポートC MIDI"},
+                 def::midi::out_port_port_c),
+    MENU_BUILDER(mi_midi_latency_t, 4, {"BLE MIDI", nullptr},
+                 def::midi::out_port_ble),
+    MENU_BUILDER(mi_midi_latency_t, 4, {"USB MIDI", nullptr},
+                 def::midi::out_port_usb),
+    MENU_BUILDER(mi_midi_latency_measure_t, 4,
+                 {"Measure (Loopback)", "測定(ループバック)"}),
     MENU_BUILDER(mi_tree_t, 3, {"InstaChord Link", "インスタコードリンク"}),
     MENU_BUILDER(mi_iclink_port_t, 4, {"Connect", "接続方法"}),
     MENU_BUILDER(mi_iclink_dev_t, 4, {"Play Device", "演奏デバイス"}),
@@ -3015,6 +3324,11 @@ static constexpr menu_item_ptr menu_system[] = {
     MENU_BUILDER(mi_tree_t, 2, {"Volume", "音量"}),
     MENU_BUILDER(mi_vol_midi_t, 3, {"MIDI Mastervol", "MIDIマスター音量"}),
     MENU_BUILDER(mi_vol_adcmic_t, 3, {"ADC MicAmp", "ADCマイクアンプ"}),
+    MENU_BUILDER(mi_sample_rate_t, 3, {"Sample Rate", "サンプリングレート"}),
+    MENU_BUILDER(mi_tree_t, 2, {"Polyphony", "同時発音数"}),
+    MENU_BUILDER(mi_voice_limit_global_t, 3, {"Total Limit", "全体の上限"}),
+    MENU_BUILDER(mi_voice_limit_part_t, 3, {"Part Limit", "パート毎の上限"}),
+    MENU_BUILDER(mi_voice_steal_policy_t, 3, {"Steal Policy", "停止させる音"}),
     MENU_BUILDER(mi_all_reset_t, 2, {"Reset All Settings", "全設定リセット"}),
     MENU_BUILDER(mi_manual_qr_t, 1, {"Manual QR", "説明書QR"}),
     nullptr, // end of menu
@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef MIDI_BLE_PACKETIZER_HPP
+#define MIDI_BLE_PACKETIZER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace midi_driver {
+
+// BLE-MIDI のパケット組み立て
+//  - ネゴシエーション済みのMTUまで1つの通知に詰め込む
+//  - タイムスタンプ(13bit msec)は送信時刻ではなくイベントの予定時刻から生成する
+//  - 先頭のメッセージを積んでから接続間隔に応じた猶予時間を過ぎたら送出する
+class MIDI_BLE_Packetizer {
+public:
+  using send_func_t = void (*)(void* context, const uint8_t* data, size_t length);
+
+  static constexpr const size_t packet_size_max = 512;
+  static constexpr const uint16_t default_mtu = 23;
+  static constexpr const uint32_t default_interval_usec = 7500;
+
+  void setSender(send_func_t func, void* context) {
+    _send_func = func;
+    _send_context = context;
+  }
+
+  // ATTヘッダ3バイトを除いた分がパケットの最大長となる
+  void setMTU(uint16_t mtu) {
+    size_t size = (mtu > 3) ? mtu - 3 : 0;
+    if (size < default_mtu - 3) { size = default_mtu - 3; }
+    if (size > packet_size_max) { size = packet_size_max; }
+    if (_length > size) { flush(); }
+    _payload_size = size;
+  }
+  size_t getPayloadSize(void) const { return _payload_size; }
+
+  // 接続間隔。1回の接続イベントに1パケットとなるよう、間隔の半分を送出までの猶予とする
+  // (データを積み始めた時点が接続イベントに対してどの位相かは分からないため、平均的な待ちを間隔の半分に抑える)
+  void setConnectionInterval(uint32_t usec) {
+    if (usec > hold_usec_max * 2) { usec = hold_usec_max * 2; }
+    _hold_usec = usec >> 1;
+  }
+  uint32_t getHoldUsec(void) const { return _hold_usec; }
+
+  // メッセージを積む。timestamp_msec はイベントの予定時刻 (下位13bitを使用する)
+  void add(const uint8_t* data, size_t length, uint32_t timestamp_msec, uint32_t now_usec) {
+    if (length == 0) { return; }
+    uint16_t ts = timestamp_msec & timestamp_mask;
+    if (_length) {
+      uint16_t diff = (ts - _last_ts) & timestamp_mask;
+      if (diff & 0x1000) {
+        // 先に積んだイベントより前の時刻は表現できないため揃える
+        ts = _last_ts;
+      } else if (diff >= 0x80) {
+        // 下位7bitの桁上がりを2回以上跨ぐ場合は受信側で復元できないため、新しいパケットにする
+        flush();
+      }
+    }
+
+    uint8_t status = data[0];
+    if (status == 0xF0) {
+      addSysEx(data, length, ts, now_usec);
+      return;
+    }
+    bool realtime = status >= 0xF8;
+    bool use_running = (!realtime && status < 0xF0 && status == _running_status);
+    size_t need = (use_running ? 0 : 1) + (length - 1) + ((use_running && ts == _last_ts) ? 0 : 1);
+    if (_length + need > _payload_size) { flush(); use_running = false; }
+    begin(ts, now_usec);
+    if (!use_running || ts != _last_ts) {
+      putTimestamp(ts);
+    }
+    if (!use_running) {
+      _packet[_length++] = status;
+    }
+    for (size_t i = 1; i < length; ++i) {
+      _packet[_length++] = data[i];
+    }
+    if (!realtime) {
+      _running_status = (status < 0xF0) ? status : 0;
+    }
+    if (_length + 3 > _payload_size) { flush(); }
+  }
+
+  // 受信したパケットからヘッダとタイムスタンプを除いたMIDIバイト列を ring (MIDI_ByteRing) へ書き込む
+  // パケット全体が入る空きが無い場合はパケットごと破棄し、falseを返す
+  template <typename T>
+  static bool unpack(const uint8_t* data, size_t length, T& ring) {
+    if (length < 2) { return true; }
+    // 2バイト目が上位bit付きならタイムスタンプ、そうでなければシステムエクスクルーシブの続き
+    size_t timestamp_low_index = (data[1] & 0x80) ? 1 : 0;
+    if (!ring.reserve(length)) { return false; }
+    for (size_t i = timestamp_low_index + 1; i <= length; ++i) {
+      if (i == length || data[i] & 0x80) {
+        if (timestamp_low_index + 1 < i) {
+          // ステータスから次のタイムスタンプの手前までを書き込む
+          ring.write(data + timestamp_low_index + 1, i - (timestamp_low_index + 1));
+          timestamp_low_index = i;
+        }
+      }
+    }
+    ring.commit();
+    return true;
+  }
+
+  // 保留中のパケットを直ちに送出する
+  bool flush(void) {
+    if (_length == 0) { return false; }
+    if (_send_func != nullptr) { _send_func(_send_context, _packet, _length); }
+    _length = 0;
+    _running_status = 0;
+    ++_packet_count;
+    return true;
+  }
+
+  // 送出期限に達していれば送出する
+  bool process(uint32_t now_usec) {
+    if (_length == 0 || (int32_t)(_deadline_usec - now_usec) > 0) { return false; }
+    return flush();
+  }
+
+  // 次の送出期限までの待ち時間 (保留中のデータが無い場合は UINT32_MAX)
+  uint32_t getWaitUsec(uint32_t now_usec) const {
+    if (_length == 0) { return UINT32_MAX; }
+    int32_t diff = _deadline_usec - now_usec;
+    return diff > 0 ? diff : 0;
+  }
+
+  bool empty(void) const { return _length == 0; }
+  void clear(void) { _length = 0; _running_status = 0; }
+  uint32_t getPacketCount(void) const { return _packet_count; }
+
+private:
+  static constexpr const uint16_t timestamp_mask = 0x1FFF;
+  static constexpr const uint32_t hold_usec_max = 20000;
+
+  void begin(uint16_t ts, uint32_t now_usec) {
+    if (_length) { return; }
+    _packet[_length++] = 0x80 | ((ts >> 7) & 0x3F);
+    _last_ts = ts;
+    _running_status = 0;
+    _deadline_usec = now_usec + _hold_usec;
+  }
+
+  void putTimestamp(uint16_t ts) {
+    _packet[_length++] = 0x80 | (ts & 0x7F);
+    _last_ts = ts;
+  }
+
+  // システムエクスクルーシブはパケットを跨いで分割する。続きのパケットはヘッダの後にデータバイトのみを置く
+  void addSysEx(const uint8_t* data, size_t length, uint16_t ts, uint32_t now_usec) {
+    // 終端のF7は別途タイムスタンプを付けて置く
+    size_t body_end = (data[length - 1] == 0xF7) ? length - 1 : length;
+    if (_length + 3 > _payload_size) { flush(); }
+    begin(ts, now_usec);
+    putTimestamp(ts);
+    _packet[_length++] = 0xF0;
+    for (size_t i = 1; i < body_end; ++i) {
+      if (_length >= _payload_size) {
+        flush();
+        begin(ts, now_usec);
+      }
+      _packet[_length++] = data[i];
+    }
+    if (body_end != length) {
+      if (_length + 2 > _payload_size) {
+        flush();
+        begin(ts, now_usec);
+      }
+      putTimestamp(ts);
+      _packet[_length++] = 0xF7;
+    }
+    _running_status = 0;
+  }
+
+  send_func_t _send_func = nullptr;
+  void* _send_context = nullptr;
+  uint8_t _packet[packet_size_max];
+  size_t _length = 0;
+  size_t _payload_size = default_mtu - 3;
+  uint32_t _hold_usec = default_interval_usec >> 1;
+  uint32_t _deadline_usec = 0;
+  uint32_t _packet_count = 0;
+  uint16_t _last_ts = 0;
+  uint8_t _running_status = 0;
+};
+
+} // namespace midi_driver
+
+#endif // MIDI_BLE_PACKETIZER_HPP
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef MIDI_BROADCAST_HPP
+#define MIDI_BROADCAST_HPP
+
+#include "midi_driver.hpp"
+
+#include <atomic>
+
+namespace midi_driver {
+
+  // 送信メッセージを一度だけシリアライズし、複数のトランスポートへ配信するリングバッファ
+  // 書き込みは単一タスクのみ。読み出しは各トランスポートが個別のカーソルで行う
+  // トランスポート固有の処理 (ランニングステータス、BLEタイムスタンプ、USBのCIN付与) は読み出し側で行う
+  class MIDI_BroadcastRing {
+  public:
+    static constexpr const size_t slot_count = 256; // 2の累乗であること
+
+    struct slot_t {
+      uint32_t event_usec; // イベントの予定時刻 (タイムスタンプを持つトランスポートは送信が遅れてもこの時刻を伝える)
+      uint8_t length;  // ステータスバイトを含むメッセージ長
+      uint8_t data[3];
+      uint8_t port_mask; // 配信先 (トランスポート毎のbit)
+    };
+    static constexpr const uint8_t all_port = 0xFF;
+    using cursor_t = uint32_t;
+
+    void push(uint8_t status_byte, uint8_t data1, uint8_t data2, uint8_t port_mask = all_port, uint32_t event_usec = 0) {
+      uint32_t write = _write_cursor.load(std::memory_order_relaxed);
+      auto slot = &_slot[write & (slot_count - 1)];
+      slot->event_usec = event_usec;
+      int data_length = getDataByteLength(status_byte);
+      slot->length = (data_length < 0) ? 0 : (data_length + 1);
+      slot->data[0] = status_byte;
+      slot->data[1] = data1;
+      slot->data[2] = data2;
+      slot->port_mask = port_mask;
+      _write_cursor.store(write + 1, std::memory_order_release);
+    }
+
+    // 現在の書込み位置。送信開始時に読み出しカーソルの初期値として使用する
+    cursor_t getWriteCursor(void) const { return _write_cursor.load(std::memory_order_acquire); }
+
+    // 読み出し。読み出すメッセージが無い場合はfalseを返す
+    // 書込みに追い越された場合は、失われたメッセージを読み飛ばし lost_count に失われた数を加える
+    // (読み出し側は result より前にノートオフ等が失われたものとして扱うこと)
+    bool pop(cursor_t& cursor, slot_t* result, uint32_t* lost_count = nullptr) {
+      for (;;) {
+        uint32_t write = _write_cursor.load(std::memory_order_acquire);
+        if (cursor == write) { return false; }
+        if (write - cursor > readable_count) {
+          _overrun_count.fetch_add(1, std::memory_order_relaxed);
+          if (lost_count) { *lost_count += (write - cursor) - readable_count; }
+          cursor = write - readable_count;
+        }
+        *result = _slot[cursor & (slot_count - 1)];
+        // コピー中に書き込みが追い付いていないか確認する
+        // (スロットの読み出しが再確認より後に行われないよう、フェンスで順序を保証する)
+        std::atomic_thread_fence(std::memory_order_acquire);
+        write = _write_cursor.load(std::memory_order_relaxed);
+        if (write - cursor > readable_count) { continue; }
+        ++cursor;
+        if (result->length == 0) { continue; }
+        return true;
+      }
+    }
+
+    uint32_t getOverrunCount(void) const { return _overrun_count.load(std::memory_order_relaxed); }
+
+  private:
+    // 書込み中のスロットを読まないよう、読み出し可能範囲は少し手前までとする
+    static constexpr const size_t readable_count = slot_count - 16;
+    slot_t _slot[slot_count];
+    std::atomic<uint32_t> _write_cursor { 0 };
+    std::atomic<uint32_t> _overrun_count { 0 };
+  };
+
+};
+
+#endif
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "midi_capture.hpp"
+
+#include <string.h>
+
+#if __has_include(<esp_timer.h>)
+  #include <esp_timer.h>
+#else
+  #include <chrono>
+  #include <thread>
+#endif
+
+namespace midi_driver {
+
+//-------------------------------------------------------------------------
+
+static constexpr const uint8_t capture_magic[4] = { 'K', 'P', 'M', 'C' };
+static constexpr const uint8_t capture_version = 1;
+static constexpr const size_t record_header_size = 8;
+
+uint64_t getCaptureTimeUsec(void)
+{
+#if __has_include(<esp_timer.h>)
+  return esp_timer_get_time();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static void waitUsec(uint32_t usec)
+{
+#if __has_include(<freertos/FreeRTOS.h>)
+  vTaskDelay(usec / (portTICK_PERIOD_MS * 1000) + 1);
+#else
+  std::this_thread::sleep_for(std::chrono::microseconds(usec));
+#endif
+}
+
+//-------------------------------------------------------------------------
+
+MIDI_CaptureWriter::~MIDI_CaptureWriter()
+{
+  close();
+}
+
+bool MIDI_CaptureWriter::open(const char* path)
+{
+  close();
+  std::lock_guard<std::mutex> lock(_mutex);
+  _fp = fopen(path, "wb");
+  if (_fp == nullptr) { return false; }
+  uint8_t header[8] = { 0 };
+  memcpy(header, capture_magic, sizeof(capture_magic));
+  header[4] = capture_version;
+  fwrite(header, 1, sizeof(header), _fp);
+  _prev_usec = getCaptureTimeUsec();
+  _record_count = 0;
+  return true;
+}
+
+void MIDI_CaptureWriter::close(void)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_fp != nullptr) {
+    fclose(_fp);
+    _fp = nullptr;
+  }
+}
+
+void MIDI_CaptureWriter::record(uint8_t port, MIDI_Direction dir, const uint8_t* data, size_t length)
+{
+  if (length == 0 || length > 0xFFFF) { return; }
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_fp == nullptr) { return; }
+
+  uint64_t usec = getCaptureTimeUsec();
+  uint64_t delta = usec - _prev_usec;
+  // 記録できない長さの空白は詰める
+  if (delta > UINT32_MAX) { delta = UINT32_MAX; }
+  _prev_usec = usec;
+
+  uint8_t header[record_header_size] = {
+    (uint8_t)delta, (uint8_t)(delta >> 8), (uint8_t)(delta >> 16), (uint8_t)(delta >> 24),
+    port, (uint8_t)dir,
+    (uint8_t)length, (uint8_t)(length >> 8),
+  };
+  fwrite(header, 1, sizeof(header), _fp);
+  fwrite(data, 1, length, _fp);
+  ++_record_count;
+}
+
+//-------------------------------------------------------------------------
+
+MIDI_CaptureReader::~MIDI_CaptureReader()
+{
+  close();
+}
+
+bool MIDI_CaptureReader::open(const char* path)
+{
+  close();
+  _fp = fopen(path, "rb");
+  if (_fp == nullptr) { return false; }
+  uint8_t header[8];
+  if (fread(header, 1, sizeof(header), _fp) != sizeof(header)
+   || memcmp(header, capture_magic, sizeof(capture_magic)) != 0
+   || header[4] != capture_version) {
+    printf("midi capture: invalid file %s\n", path);
+    close();
+    return false;
+  }
+  _time_usec = 0;
+  return true;
+}
+
+void MIDI_CaptureReader::close(void)
+{
+  if (_fp != nullptr) {
+    fclose(_fp);
+    _fp = nullptr;
+  }
+}
+
+bool MIDI_CaptureReader::read(record_t* record)
+{
+  if (_fp == nullptr) { return false; }
+  uint8_t header[record_header_size];
+  if (fread(header, 1, sizeof(header), _fp) != sizeof(header)) { return false; }
+  uint32_t delta = header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24;
+  size_t length = header[6] | header[7] << 8;
+  _time_usec += delta;
+  record->time_usec = _time_usec;
+  record->port = header[4];
+  record->dir = (MIDI_Direction)header[5];
+  record->data.resize(length);
+  return fread(record->data.data(), 1, length, _fp) == length;
+}
+
+//-------------------------------------------------------------------------
+
+bool MIDI_CaptureReplayer::replay(const char* path, MIDI_Transport* target, MIDIDriver* receiver, report_t* report)
+{
+  MIDI_CaptureReader reader;
+  if (!reader.open(path)) { return false; }
+
+  report_t result;
+  uint64_t lateness_sum = 0;
+  uint64_t latency_sum = 0;
+  MIDI_Message message;
+  MIDI_CaptureReader::record_t record;
+  // 受信データは読み出した単位で記録されているため、ポートと向き毎にメッセージを組み立てる
+  MIDI_MessageSplitter splitter[8][2];
+  const uint64_t start_usec = getCaptureTimeUsec();
+
+  while (reader.read(&record)) {
+    if (record.port >= 8 || !(_config.port_mask & (1 << record.port))) { continue; }
+    if (record.dir == MIDI_Direction::rx ? !_config.use_rx : !_config.use_tx) { continue; }
+
+    // 倍率に応じた送信予定時刻まで待機する。最速の場合は送信開始時点を基準とする
+    uint64_t due_usec = getCaptureTimeUsec();
+    if (_config.speed > 0.0f) {
+      uint64_t now = due_usec;
+      due_usec = start_usec + (uint64_t)(record.time_usec / _config.speed);
+      if (due_usec > now) { waitUsec(due_usec - now); }
+    }
+
+    splitter[record.port][record.dir == MIDI_Direction::rx ? 0 : 1].split(record.data.data(), record.data.size(),
+      [target](const uint8_t* data, size_t length) { target->addMessage(data, length); });
+    target->sendFlush();
+    uint64_t sent_usec = getCaptureTimeUsec();
+    uint32_t lateness = sent_usec > due_usec ? sent_usec - due_usec : 0;
+    lateness_sum += lateness;
+    if (result.lateness_max_usec < lateness) { result.lateness_max_usec = lateness; }
+
+    if (receiver != nullptr) {
+      while (receiver->receiveMessage(&message)) { ++result.messages; }
+      uint64_t decoded_usec = getCaptureTimeUsec();
+      uint32_t latency = decoded_usec > due_usec ? decoded_usec - due_usec : 0;
+      latency_sum += latency;
+      if (result.latency_max_usec < latency) { result.latency_max_usec = latency; }
+    }
+
+    ++result.records;
+    result.bytes += record.data.size();
+    result.capture_usec = record.time_usec;
+  }
+
+  result.elapsed_usec = getCaptureTimeUsec() - start_usec;
+  if (result.records) {
+    result.lateness_avg_usec = lateness_sum / result.records;
+    result.latency_avg_usec = latency_sum / result.records;
+  }
+  if (report != nullptr) { *report = result; }
+  return true;
+}
+
+void MIDI_CaptureReplayer::printReport(const report_t& report)
+{
+  double elapsed_sec = report.elapsed_usec / 1000000.0;
+  double capture_sec = report.capture_usec / 1000000.0;
+  printf("midi replay: %u records, %u bytes, %u messages\n"
+         "  capture %.3f sec, elapsed %.3f sec, throughput %.1f bytes/sec\n"
+         "  lateness avg %u usec, max %u usec\n"
+         "  latency  avg %u usec, max %u usec\n"
+         , (unsigned)report.records, (unsigned)report.bytes, (unsigned)report.messages
+         , capture_sec, elapsed_sec, elapsed_sec > 0 ? report.bytes / elapsed_sec : 0.0
+         , (unsigned)report.lateness_avg_usec, (unsigned)report.lateness_max_usec
+         , (unsigned)report.latency_avg_usec, (unsigned)report.latency_max_usec);
+}
+
+//-------------------------------------------------------------------------
+
+} // namespace midi_driver
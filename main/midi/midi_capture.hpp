@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef MIDI_CAPTURE_HPP
+#define MIDI_CAPTURE_HPP
+
+/*
+MIDIキャプチャファイル形式 (リトルエンディアン)
+ ヘッダ 8バイト : "KPMC" , バージョン(1) , 予約(3)
+ レコード      : 前レコードからの経過時間usec(4) , ポート(1) , 向き(1) , 長さ(2) , データ(長さ分)
+ ポートは def::midi::output_port_t の値、向きは MIDI_Direction の値
+*/
+
+#include "midi_driver.hpp"
+
+#include <mutex>
+
+namespace midi_driver {
+
+  // キャプチャ・再生で使用する時刻 (usec)
+  uint64_t getCaptureTimeUsec(void);
+
+  // 送受信データをファイルへ記録する
+  class MIDI_CaptureWriter : public MIDI_Recorder {
+  public:
+    ~MIDI_CaptureWriter();
+
+    bool open(const char* path);
+    void close(void);
+    bool isOpen(void) const { return _fp != nullptr; }
+
+    void record(uint8_t port, MIDI_Direction dir, const uint8_t* data, size_t length) override;
+
+    uint32_t getRecordCount(void) const { return _record_count; }
+
+  private:
+    std::mutex _mutex;
+    FILE* _fp = nullptr;
+    uint64_t _prev_usec = 0;
+    uint32_t _record_count = 0;
+  };
+
+  // キャプチャファイルを先頭から順に読み出す
+  class MIDI_CaptureReader {
+  public:
+    struct record_t {
+      uint64_t time_usec;  // キャプチャ開始からの経過時間
+      uint8_t port;
+      MIDI_Direction dir;
+      std::vector<uint8_t> data;
+    };
+
+    ~MIDI_CaptureReader();
+
+    bool open(const char* path);
+    void close(void);
+    bool read(record_t* record);
+
+  private:
+    FILE* _fp = nullptr;
+    uint64_t _time_usec = 0;
+  };
+
+  // 受信データの断片 (メッセージの途中で区切られ、ランニングステータスを含む) をメッセージ単位に分ける
+  //  - ランニングステータスは補って完全なメッセージとする
+  //  - システム・リアルタイム・メッセージは他のメッセージの途中にあっても単独で先に取り出す
+  //  - F7 以外のステータスで終わったシステムエクスクルーシブは F7 を補う
+  class MIDI_MessageSplitter {
+  public:
+    void clear(void) {
+      _message.clear();
+      _running_status = 0;
+      _sysex = false;
+    }
+
+    // メッセージが揃う毎に emit(const uint8_t* data, size_t length) を呼び出す
+    template <typename F>
+    void split(const uint8_t* data, size_t length, F&& emit) {
+      for (size_t i = 0; i < length; ++i) {
+        uint8_t d = data[i];
+        if (d >= 0xF8) {
+          emit(&d, 1);
+          continue;
+        }
+        if (_sysex) {
+          if (d < 0x80) {
+            _message.push_back(d);
+            continue;
+          }
+          _message.push_back(0xF7);
+          emit(_message.data(), _message.size());
+          _message.clear();
+          _sysex = false;
+          if (d == 0xF7) { continue; }
+        }
+        if (d >= 0x80) {
+          _message.clear();
+          if (d == 0xF0) {
+            _message.push_back(d);
+            _sysex = true;
+            _running_status = 0;
+            continue;
+          }
+          // システムコモンはランニングステータスを解除する
+          _running_status = (d < 0xF0) ? d : 0;
+          int data_length = getDataByteLength(d);
+          if (data_length == 0) {
+            if (d != 0xF7) { emit(&d, 1); }
+            continue;
+          }
+          _message.push_back(d);
+          continue;
+        }
+        if (_message.empty()) {
+          // ステータスの無いデータは破棄する
+          if (_running_status == 0) { continue; }
+          _message.push_back(_running_status);
+        }
+        _message.push_back(d);
+        if ((int)_message.size() == getDataByteLength(_message[0]) + 1) {
+          emit(_message.data(), _message.size());
+          _message.clear();
+        }
+      }
+    }
+
+  private:
+    std::vector<uint8_t> _message;
+    uint8_t _running_status = 0;
+    bool _sysex = false;
+  };
+
+  // キャプチャファイルの内容を任意のトランスポートへ送り込む
+  // 記録したデータはメッセージ単位に分け、トランスポートへは完全なメッセージのみを渡す
+  class MIDI_CaptureReplayer {
+  public:
+    struct config_t {
+      // 再生速度の倍率 (0の場合は待ち時間なしで最速に送る)
+      float speed = 1.0f;
+      // 再生対象とするポート (bit毎)
+      uint8_t port_mask = 0xFF;
+      // 再生対象とする向き (既定は受信データ。入力側の処理の評価に使用する)
+      bool use_rx = true;
+      bool use_tx = false;
+    };
+
+    struct report_t {
+      uint32_t records = 0;
+      uint32_t bytes = 0;
+      uint32_t messages = 0;          // receiver でデコードできたメッセージ数
+      uint64_t capture_usec = 0;      // 再生したキャプチャの長さ
+      uint64_t elapsed_usec = 0;      // 再生に要した時間
+      uint32_t lateness_avg_usec = 0; // 予定時刻から送信完了までの遅れ
+      uint32_t lateness_max_usec = 0;
+      uint32_t latency_avg_usec = 0;  // 予定時刻から receiver でデコード完了までの時間
+      uint32_t latency_max_usec = 0;
+    };
+
+    void setConfig(const config_t& config) { _config = config; }
+
+    // キャプチャを再生する。receiver を指定した場合は送信毎にデコードを行いレイテンシを計測する
+    bool replay(const char* path, MIDI_Transport* target, MIDIDriver* receiver = nullptr, report_t* report = nullptr);
+
+    static void printReport(const report_t& report);
+
+  private:
+    config_t _config;
+  };
+
+} // namespace midi_driver
+
+#endif // MIDI_CAPTURE_HPP
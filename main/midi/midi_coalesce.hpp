@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef MIDI_COALESCE_HPP
+#define MIDI_COALESCE_HPP
+
+#include "midi_broadcast.hpp"
+
+namespace midi_driver {
+
+  // 送信段。トランスポートの送信待ちが多い間はメッセージを待ち行列に積み、連続的なコントローラは最新値のみ残す
+  //  - 待ち行列は到着順を保つので、ノートの順序は入れ替わらない
+  //  - 送信待ちは送出時間を見積もれるトランスポートでは時間で、見積もれないものはバイト数で判定する
+  //  - queue_size は2の累乗であること
+  template <size_t queue_size>
+  class MIDI_CoalesceQueue {
+  public:
+    using slot_t = MIDI_BroadcastRing::slot_t;
+
+    // 間引きを始める送信待ちの量
+    void setThreshold(uint32_t usec, size_t bytes) {
+      _threshold_usec = usec;
+      _threshold_bytes = bytes;
+    }
+    uint32_t getThresholdUsec(void) const { return _threshold_usec; }
+
+    bool empty(void) const { return _head == _tail; }
+    void clear(void) { _head = _tail; }
+
+    // 間引きにより破棄したメッセージ数
+    uint32_t getCoalesceCount(void) const { return _coalesce_count; }
+
+    // 最新値のみ送れば良いメッセージか判定する
+    // ノート、プログラムチェンジ、スイッチ類、RPN/NRPN、チャンネルモードは間引かない
+    static bool isCoalescable(const slot_t& message) {
+      switch (message.data[0] & 0xF0) {
+      case 0xE0: // Pitch Bend
+      case 0xD0: // Channel Pressure
+        return true;
+      case 0xB0: // Control Change
+        {
+          uint8_t control = message.data[1];
+          if (control == 0 || control == 32) { return false; } // Bank Select
+          if (control == 6 || control == 38) { return false; } // Data Entry
+          if (control >= 64 && control <= 69) { return false; } // Pedal / Switch
+          if (control >= 96 && control <= 101) { return false; } // Data Inc/Dec, NRPN, RPN
+          if (control >= 120) { return false; } // Channel Mode
+        }
+        return true;
+      default:
+        return false;
+      }
+    }
+
+    // トランスポートの送信待ちが間引きを始める量を超えているか
+    bool isTxBusy(const MIDIDriver& midi, uint32_t usec) const {
+      uint32_t drain = midi.getTxDrainUsec(usec);
+      if (drain != UINT32_MAX) { return drain >= _threshold_usec; }
+      return midi.getTxPendingBytes() >= _threshold_bytes;
+    }
+
+    // メッセージを送信する。送信待ちが多い場合は待ち行列に積み、同じコントローラの古い値を破棄する
+    // 送信が遅れても、トランスポートへはメッセージの予定時刻 (slot_t::event_usec) を伝える
+    // 送信した場合はtrueを返す
+    bool send(MIDIDriver& midi, const slot_t& message, uint32_t usec) {
+      if (empty() && !isTxBusy(midi, usec)) {
+        output(midi, message);
+        return true;
+      }
+      if (isCoalescable(message)) {
+        for (uint16_t i = _head; i != _tail; ++i) {
+          auto e = &_queue[i & (queue_size - 1)];
+          if (e->valid
+           && e->message.data[0] == message.data[0]
+           && ((message.data[0] & 0xF0) != 0xB0 || e->message.data[1] == message.data[1])) {
+            e->valid = false;
+            ++_coalesce_count;
+            break;
+          }
+        }
+      }
+      bool sent = false;
+      if ((uint16_t)(_tail - _head) >= queue_size) {
+        // 待ち行列が満杯の場合は先頭を送信する (トランスポート側で待たされる)
+        auto e = &_queue[_head++ & (queue_size - 1)];
+        if (e->valid) {
+          output(midi, e->message);
+          sent = true;
+        }
+      }
+      auto e = &_queue[_tail++ & (queue_size - 1)];
+      e->message = message;
+      e->valid = true;
+      return sent;
+    }
+
+    // 送信待ちが減った分だけ待ち行列から送信する。送信した場合はtrueを返す
+    bool process(MIDIDriver& midi, uint32_t usec) {
+      bool sent = false;
+      while (!empty()) {
+        auto e = &_queue[_head & (queue_size - 1)];
+        if (e->valid) {
+          if (isTxBusy(midi, usec)) { break; }
+          output(midi, e->message);
+          sent = true;
+        }
+        ++_head;
+      }
+      return sent;
+    }
+
+    // 送信待ちが間引きの閾値を下回る見込みの時刻までの待ち時間
+    // 送出時間を見積もれないトランスポートは進み具合を見るため短い周期とする
+    uint32_t getDrainWaitUsec(const MIDIDriver& midi, uint32_t usec) const {
+      uint32_t drain = midi.getTxDrainUsec(usec);
+      if (drain == UINT32_MAX) { return 1000; }
+      return (drain > _threshold_usec) ? drain - _threshold_usec : 0;
+    }
+
+  private:
+    static void output(MIDIDriver& midi, const slot_t& message) {
+      midi.setEventTime(message.event_usec);
+      midi.sendRawMessage(message.data, message.length);
+    }
+
+    struct entry_t {
+      slot_t message;
+      bool valid;
+    };
+    entry_t _queue[queue_size];
+    uint16_t _head = 0;
+    uint16_t _tail = 0;
+    uint32_t _coalesce_count = 0;
+    uint32_t _threshold_usec = 10000;
+    size_t _threshold_bytes = 32;
+  };
+
+} // namespace midi_driver
+
+#endif // MIDI_COALESCE_HPP
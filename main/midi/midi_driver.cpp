@@ -9,7 +9,7 @@ namespace midi_driver {
 
 // MIDI ステータスバイトに基づいてデータバイトの長さを取得
 // エラー時は -1 を返す
-static int getDataByteLength(uint8_t status) {
+int getDataByteLength(uint8_t status) {
   if (status < 0x80) { return -1; }
   static constexpr const uint8_t dataByteLengths_0x80_0xE0[] = {
     2, // 0x80 Note Off
@@ -48,6 +48,7 @@ void MIDIDriver::sendMessage(uint8_t status_byte, uint8_t data1, uint8_t data2)
 {
   uint8_t data[3] = { status_byte, data1, data2 };
   size_t dataByteLength = getDataByteLength(status_byte);
+  recordData(MIDI_Direction::tx, data, dataByteLength + 1);
   _transport->addMessage(data, dataByteLength + 1);
 /*
 if (_send_data.size() >= _send_buffer_size - 3) {
@@ -95,6 +96,101 @@ void MIDI_Encoder::pushMessage(uint8_t status_byte, uint8_t data1, uint8_t data2
   }
 }
 //*/
+// システムエクスクルーシブは受信途中で本体を取り分け、上限を超える分をバッファに溜めないようにする
+void MIDI_Decoder::addData(const uint8_t* data, size_t length)
+{
+  for (size_t i = 0; i < length; ++i) {
+    uint8_t d = data[i];
+    if (_sysex_state != sysex_idle) {
+      if (d < 0x80) {
+        sysexData(d);
+        continue;
+      }
+      if (d < 0xF8) {
+        // F7 または他のステータスで終了する (F7以外のステータスはそのまま通常の処理へ)
+        bool buffered = sysexEnd();
+        if (d == 0xF7) {
+          if (buffered) { _data.push_back(d); }
+          continue;
+        }
+      }
+      // システム・リアルタイム・メッセージはシステムエクスクルーシブの途中でも通常通り処理する
+    }
+    if (d == 0xF0) {
+      sysexBegin();
+      continue;
+    }
+    _data.push_back(d);
+  }
+// printf("data.size:%d\n", _data.size());
+}
+
+void MIDI_Decoder::sysexBegin(void)
+{
+  _sysex_state = sysex_receiving;
+  _sysex_length = 0;
+  _sysex_chunk_length = 0;
+  _sysex_chunk_flags = sysex_start;
+  _sysex_buffer.clear();
+}
+
+void MIDI_Decoder::sysexData(uint8_t data)
+{
+  if (_sysex_state == sysex_dropping) { return; }
+  ++_sysex_length;
+  if (_sysex_handler != nullptr) {
+    if (_sysex_limit && _sysex_length > _sysex_limit) {
+      // 渡し済みの断片を取り消せるよう、ハンドラへ中断を通知する
+      _sysex_chunk_length = 0;
+      sysexFlushChunk(sysex_abort);
+      _sysex_state = sysex_dropping;
+      ++_sysex_drop_count;
+      return;
+    }
+    _sysex_chunk[_sysex_chunk_length++] = data;
+    if (_sysex_chunk_length == sysex_chunk_size) {
+      sysexFlushChunk(0);
+    }
+    return;
+  }
+  size_t limit = _sysex_limit ? _sysex_limit : sysex_limit_default;
+  if (_sysex_length > limit) {
+    _sysex_buffer.clear();
+    _sysex_buffer.shrink_to_fit();
+    _sysex_state = sysex_dropping;
+    ++_sysex_drop_count;
+    return;
+  }
+  _sysex_buffer.push_back(data);
+}
+
+// 組み立てたメッセージを通常の受信データに戻した場合はtrueを返す
+bool MIDI_Decoder::sysexEnd(void)
+{
+  bool buffered = false;
+  if (_sysex_state == sysex_receiving) {
+    if (_sysex_handler != nullptr) {
+      sysexFlushChunk(sysex_end);
+    } else {
+      // popMessage で取り出せるよう、受信データの並びに戻す
+      _data.push_back(0xF0);
+      _data.insert(_data.end(), _sysex_buffer.begin(), _sysex_buffer.end());
+      _sysex_buffer.clear();
+      buffered = true;
+    }
+  }
+  _sysex_state = sysex_idle;
+  return buffered;
+}
+
+void MIDI_Decoder::sysexFlushChunk(uint8_t flags)
+{
+  flags |= _sysex_chunk_flags;
+  _sysex_chunk_flags = 0;
+  _sysex_handler(_sysex_context, _sysex_chunk, _sysex_chunk_length, flags);
+  _sysex_chunk_length = 0;
+}
+
 bool MIDI_Decoder::popMessage(MIDI_Message* message)
 {
   if (_data.empty()) { return false; }
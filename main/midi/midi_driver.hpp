@@ -5,6 +5,7 @@
 #define MIDI_DRIVER_HPP
 
 #include <vector>
+#include <atomic>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -16,6 +17,9 @@
 
 namespace midi_driver {
 
+  // MIDI ステータスバイトに基づいてデータバイトの長さを取得 (エラー時は -1)
+  int getDataByteLength(uint8_t status);
+
   // MIDI Message structure
   struct MIDI_Message {
     std::vector<uint8_t> data;
@@ -27,6 +31,86 @@ namespace midi_driver {
       };
     };
   };
+  // 受信データ用の固定長リングバッファ (単一の書込み側と単一の読出し側で使用する)
+  // 書込み側はロック・メモリ確保を行わないため、通信スタックのコールバックから呼び出せる
+  template <size_t Capacity>
+  class MIDI_ByteRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+  public:
+    size_t getFreeSize(void) const {
+      return Capacity - (_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire));
+    }
+
+    // 書込み側 : 全量を書き込めない場合は何も書き込まずにfalseを返す (メッセージの途中で切れないようにする)
+    bool push(const uint8_t* data, size_t length) {
+      uint32_t head = _head.load(std::memory_order_relaxed);
+      if (Capacity - (head - _tail.load(std::memory_order_acquire)) < length) {
+        _overflow_count.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      for (size_t i = 0; i < length; ++i) {
+        _buffer[(head + i) & (Capacity - 1)] = data[i];
+      }
+      _head.store(head + length, std::memory_order_release);
+      updateHighWater(head + length);
+      return true;
+    }
+    // 複数回に分けて書き込む場合に使用する。reserveで空きを確認し、commitで公開する
+    bool reserve(size_t length) {
+      if (getFreeSize() < length) {
+        _overflow_count.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      _reserve = _head.load(std::memory_order_relaxed);
+      return true;
+    }
+    void write(const uint8_t* data, size_t length) {
+      for (size_t i = 0; i < length; ++i) {
+        _buffer[_reserve++ & (Capacity - 1)] = data[i];
+      }
+    }
+    void commit(void) {
+      _head.store(_reserve, std::memory_order_release);
+      updateHighWater(_reserve);
+    }
+
+    // 読出し側
+    size_t pop(uint8_t* data, size_t length) {
+      uint32_t tail = _tail.load(std::memory_order_relaxed);
+      size_t available = _head.load(std::memory_order_acquire) - tail;
+      if (length > available) { length = available; }
+      for (size_t i = 0; i < length; ++i) {
+        data[i] = _buffer[(tail + i) & (Capacity - 1)];
+      }
+      _tail.store(tail + length, std::memory_order_release);
+      return length;
+    }
+    // 読出し側から未読データを破棄する
+    void clear(void) { _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release); }
+
+    uint32_t getOverflowCount(void) const { return _overflow_count.load(std::memory_order_relaxed); }
+
+    // 書込み直後の未読データ量の最大値 (読出し側の処理が追いついているかの目安)
+    uint32_t getHighWater(void) const { return _high_water.load(std::memory_order_relaxed); }
+    void resetHighWater(void) { _high_water.store(0, std::memory_order_relaxed); }
+
+  private:
+    // 書込み側のみが更新する
+    void updateHighWater(uint32_t head) {
+      uint32_t used = head - _tail.load(std::memory_order_acquire);
+      if (_high_water.load(std::memory_order_relaxed) < used) {
+        _high_water.store(used, std::memory_order_relaxed);
+      }
+    }
+
+    uint8_t _buffer[Capacity];
+    std::atomic<uint32_t> _head { 0 };
+    std::atomic<uint32_t> _tail { 0 };
+    std::atomic<uint32_t> _overflow_count { 0 };
+    std::atomic<uint32_t> _high_water { 0 };
+    uint32_t _reserve = 0;
+  };
+
 /*
   // MIDI Encoder class
   class MIDI_Encoder {
@@ -43,24 +127,88 @@ namespace midi_driver {
     void pushMessage(uint8_t status_byte, uint8_t data1 = 0, uint8_t data2 = 0);
   };
 //*/
+  // システムエクスクルーシブを受信途中から逐次受け取るハンドラ
+  // data は F0/F7 を含まない本体の断片。flags は sysex_flag_t の組み合わせ
+  enum sysex_flag_t : uint8_t {
+    sysex_start = 0x01, // 最初の断片
+    sysex_end   = 0x02, // 最後の断片 (F7 または他のステータスで終了)
+    sysex_abort = 0x04, // 上限を超えたため以降を破棄する
+  };
+  using sysex_handler_t = void (*)(void* context, const uint8_t* data, size_t length, uint8_t flags);
+
   // MIDI Decoder class
   class MIDI_Decoder {
     std::vector<uint8_t> _data;
     uint8_t _runningStatus;
   public:
+    // システムエクスクルーシブ1メッセージあたりの上限の初期値 (バイト)
+    //  - ハンドラ未登録時は組み立てるバッファの上限となる
+    //  - ハンドラ登録時も初期値のままでは同じ上限が掛かり、超えた時点で sysex_abort が通知される
+    //    (転送プロトコルのように1メッセージが短いハンドラはこのままで良い)
+    //    ダンプ等の長いメッセージを逐次受け取るハンドラは setSysExLimit(0) で上限を外すこと
+    static constexpr const size_t sysex_limit_default = 512;
+
     MIDI_Decoder() : _runningStatus(0) {}
     virtual ~MIDI_Decoder() = default;
-    void clear(void) { _data.clear(); }
+    void clear(void) {
+      _data.clear();
+      _sysex_state = sysex_idle;
+      _sysex_buffer.clear();
+    }
 
     void addData(const std::vector<uint8_t>& data) {
-      _data.insert(_data.end(), data.begin(), data.end());
-// printf("data.size:%d\n", _data.size());
-    }
-    void addData(const uint8_t* data, size_t length) {
-      _data.insert(_data.end(), data, data + length);
-// printf("data.size:%d\n", _data.size());
+      addData(data.data(), data.size());
     }
+    void addData(const uint8_t* data, size_t length);
     bool popMessage(MIDI_Message* message);
+
+    // ハンドラを登録するとシステムエクスクルーシブは popMessage で取り出さず、ハンドラへ逐次渡す
+    void setSysExHandler(sysex_handler_t handler, void* context) {
+      _sysex_context = context;
+      _sysex_handler = handler;
+    }
+    // 1メッセージあたりの上限。超えたメッセージは破棄して数える
+    // 0はハンドラ登録時のみ上限なしとなり、未登録時は sysex_limit_default が適用される
+    // ハンドラへは sysex_chunk_size 毎に渡すため、上限を外してもメッセージの長さに関わらず使用メモリは一定
+    void setSysExLimit(size_t limit) { _sysex_limit = limit; }
+    uint32_t getSysExDropCount(void) const { return _sysex_drop_count; }
+
+  private:
+    enum sysex_state_t : uint8_t {
+      sysex_idle,
+      sysex_receiving,
+      sysex_dropping,
+    };
+    void sysexBegin(void);
+    void sysexData(uint8_t data);
+    bool sysexEnd(void);
+    void sysexFlushChunk(uint8_t flags);
+
+    static constexpr const size_t sysex_chunk_size = 64;
+    sysex_handler_t _sysex_handler = nullptr;
+    void* _sysex_context = nullptr;
+    std::vector<uint8_t> _sysex_buffer;
+    size_t _sysex_limit = sysex_limit_default;
+    size_t _sysex_length = 0;
+    uint32_t _sysex_drop_count = 0;
+    uint8_t _sysex_chunk[sysex_chunk_size];
+    uint8_t _sysex_chunk_length = 0;
+    uint8_t _sysex_chunk_flags = 0;
+    sysex_state_t _sysex_state = sysex_idle;
+  };
+
+  // キャプチャ用のデータの向き
+  enum class MIDI_Direction : uint8_t {
+    rx = 0,
+    tx = 1,
+  };
+
+  // MIDIDriver が送受信したバイト列を記録するためのフック
+  // 複数のドライバから同時に呼び出される可能性があるため、実装側で排他を行うこと
+  class MIDI_Recorder {
+  public:
+    virtual ~MIDI_Recorder() = default;
+    virtual void record(uint8_t port, MIDI_Direction dir, const uint8_t* data, size_t length) = 0;
   };
 
   // Abstract base class for MIDI transport
@@ -72,10 +220,19 @@ namespace midi_driver {
     virtual bool begin(void) = 0;
     virtual void end(void) = 0;
 
-    virtual std::vector<uint8_t> read(void) = 0;
+    // 受信データを指定バッファへ読み出し、読み出したバイト数を返す
+    virtual size_t read(uint8_t* data, size_t length) = 0;
     // virtual size_t write(const uint8_t* data, size_t length) = 0;
     virtual void addMessage(const uint8_t* data, size_t length) = 0;
     virtual bool sendFlush(void) = 0;
+    // 送信待ちのバイト数 (把握できないトランスポートは0を返す)
+    virtual size_t getTxPendingBytes(void) const { return 0; }
+    // 送信待ちのデータを送出し終わるまでの見積もり時間 (見積もれないトランスポートは UINT32_MAX)
+    virtual uint32_t getTxDrainUsec(uint32_t /*usec*/) const { return UINT32_MAX; }
+    // 次に追加するメッセージの予定時刻 (usec)。タイムスタンプを送るトランスポートが使用する
+    virtual void setEventTime(uint32_t /*usec*/) { }
+    // 保留中の送信データを送出すべき時刻までの待ち時間 (保留しないトランスポートは UINT32_MAX)
+    virtual uint32_t getFlushWaitUsec(uint32_t /*usec*/) const { return UINT32_MAX; }
 
     bool isConnected(void) const { return _connected; }
     bool getUseTx(void) const { return _use_tx; }
@@ -130,6 +287,18 @@ protected:
 
     void sendMessage(uint8_t status_byte, uint8_t data1, uint8_t data2);
 
+    // 長さ確定済みのメッセージをそのままトランスポートへ渡す
+    void sendRawMessage(const uint8_t* data, size_t length) {
+      recordData(MIDI_Direction::tx, data, length);
+      _transport->addMessage(data, length);
+    }
+
+    // 送受信データの記録先を設定する (nullptrで記録を停止)
+    void setRecorder(MIDI_Recorder* recorder, uint8_t port) {
+      _recorder_port = port;
+      _recorder.store(recorder, std::memory_order_release);
+    }
+
     void sendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity) {
       sendMessage(0x90 | channel, note, velocity);
     }
@@ -143,6 +312,11 @@ protected:
       sendMessage(0xC0 | channel, program, 0);
     }
 
+    size_t getTxPendingBytes(void) const { return _transport->getTxPendingBytes(); }
+    uint32_t getTxDrainUsec(uint32_t usec) const { return _transport->getTxDrainUsec(usec); }
+    void setEventTime(uint32_t usec) { _transport->setEventTime(usec); }
+    uint32_t getFlushWaitUsec(uint32_t usec) const { return _transport->getFlushWaitUsec(usec); }
+
     bool sendFlush(void) {
       return _transport->sendFlush();
 /*
@@ -154,16 +328,29 @@ return result;
 */
     }
     bool receive(void) {
-      auto data = _transport->read();
-      if (data.empty()) { return false; }
-      _decoder.addData(data);
-      return true;
+      uint8_t data[64];
+      bool result = false;
+      size_t length;
+      while (0 != (length = _transport->read(data, sizeof(data)))) {
+        recordData(MIDI_Direction::rx, data, length);
+        _decoder.addData(data, length);
+        result = true;
+        // イベント単位で取り出すトランスポート (USB等) はバッファを満たさないため、
+        // もう1イベント (最大3バイト) 入る余地を残した場合に読み切ったと判断する
+        if (length + 3 <= sizeof(data)) { break; }
+      }
+      return result;
     }
     bool receiveMessage(MIDI_Message* message) {
       receive();
       return _decoder.popMessage(message);
     }
 
+    // 受信したシステムエクスクルーシブの扱い (MIDI_Decoder を参照)
+    void setSysExHandler(sysex_handler_t handler, void* context) { _decoder.setSysExHandler(handler, context); }
+    void setSysExLimit(size_t limit) { _decoder.setSysExLimit(limit); }
+    uint32_t getSysExDropCount(void) const { return _decoder.getSysExDropCount(); }
+
     void setUseTxRx(bool tx_enable, bool rx_enable) {
       _transport->setUseTxRx(tx_enable, rx_enable);
     }
@@ -175,10 +362,17 @@ return result;
 #endif
 
   private:
+    void recordData(MIDI_Direction dir, const uint8_t* data, size_t length) {
+      auto recorder = _recorder.load(std::memory_order_acquire);
+      if (recorder != nullptr) { recorder->record(_recorder_port, dir, data, length); }
+    }
+
     MIDI_Transport* _transport;
     // MIDI_Encoder _encoder;
     MIDI_Decoder _decoder;
     size_t _send_buffer_size = 128;
+    std::atomic<MIDI_Recorder*> _recorder { nullptr };
+    uint8_t _recorder_port = 0;
   };
 
 };
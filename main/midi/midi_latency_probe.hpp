@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef MIDI_LATENCY_PROBE_HPP
+#define MIDI_LATENCY_PROBE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace midi_driver {
+
+// 出力を入力へ折り返したポートへ測定用のメッセージ(プローブ)を送り、戻るまでの往復時間を測る
+//  - プローブはチャンネル16のポリフォニック・キー・プレッシャー (data1=連番, data2=識別用の値) を使う
+//  - 応答を受けるか待ち時間が過ぎると次のプローブを送り、指定回数送ったら終了する
+//  - 時刻は呼び出し側が与えるため、ループバック接続したトランスポートを使ってホスト上で確認できる
+class MIDI_LatencyProbe {
+public:
+  static constexpr const uint8_t probe_status = 0xA0 | 0x0F;
+  static constexpr const uint8_t probe_marker = 0x4B;
+
+  enum event_t : uint8_t {
+    ev_none = 0,
+    ev_send,      // getSeq の連番でプローブを送信する
+    ev_done,      // 測定が終了した (結果は getResult で取得する)
+  };
+
+  struct result_t {
+    uint8_t sent = 0;
+    uint8_t received = 0;
+    uint32_t rtt_min = 0;
+    uint32_t rtt_avg = 0;
+    uint32_t rtt_max = 0;
+  };
+
+  void setup(uint8_t count, uint32_t timeout_usec) {
+    _count = count;
+    _timeout_usec = timeout_usec;
+  }
+
+  void start(void) {
+    _running = true;
+    _result = result_t();
+    _rtt_sum = 0;
+    _waiting = false;
+  }
+  void cancel(void) { _running = false; }
+  bool isRunning(void) const { return _running; }
+
+  // 測定の進行。プローブの送信時刻と終了を通知する
+  event_t process(uint32_t usec) {
+    if (!_running || (_waiting && (int32_t)(usec - (_send_usec + _timeout_usec)) < 0)) {
+      return ev_none;
+    }
+    if (_result.sent >= _count) {
+      _running = false;
+      if (_result.received) { _result.rtt_avg = _rtt_sum / _result.received; }
+      return ev_done;
+    }
+    ++_result.sent;
+    _seq = (_seq + 1) & 0x7F;
+    _send_usec = usec;
+    _waiting = true;
+    return ev_send;
+  }
+
+  uint8_t getSeq(void) const { return _seq; }
+
+  // 受信したメッセージがプローブであれば処理して true を返す (測定中でなくても入力としては扱わない)
+  bool checkMessage(uint8_t status, size_t data_length, const uint8_t* data, uint32_t usec) {
+    if (status != probe_status || data_length != 2 || data[1] != probe_marker) { return false; }
+    if (_running && _waiting && data[0] == _seq) {
+      uint32_t rtt = usec - _send_usec;
+      if (_result.received == 0 || _result.rtt_min > rtt) { _result.rtt_min = rtt; }
+      if (_result.rtt_max < rtt) { _result.rtt_max = rtt; }
+      _rtt_sum += rtt;
+      ++_result.received;
+      // 応答を受けたので待ち時間を打ち切り、次のプローブを送る
+      _waiting = false;
+    }
+    return true;
+  }
+
+  // 次に process を呼ぶ必要がある時刻までの時間
+  uint32_t getWaitUsec(uint32_t usec) const {
+    if (!_running) { return UINT32_MAX; }
+    if (!_waiting) { return 0; }
+    int32_t diff = (_send_usec + _timeout_usec) - usec;
+    return diff > 0 ? diff : 0;
+  }
+
+  const result_t& getResult(void) const { return _result; }
+
+private:
+  result_t _result;
+  uint32_t _rtt_sum = 0;
+  uint32_t _send_usec = 0;
+  uint32_t _timeout_usec = 500000;
+  uint8_t _count = 8;
+  uint8_t _seq = 0;
+  bool _running = false;
+  bool _waiting = false;
+};
+
+} // namespace midi_driver
+
+#endif // MIDI_LATENCY_PROBE_HPP
@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "midi_sysex_transfer.hpp"
+#include "midi_capture.hpp"
+
+#include <string.h>
+
+#if !__has_include(<freertos/FreeRTOS.h>)
+  #include <chrono>
+  #include <thread>
+#endif
+
+namespace midi_driver {
+
+//-------------------------------------------------------------------------
+
+namespace sysex_transfer {
+
+size_t pack7(uint8_t* dst, const uint8_t* src, size_t length)
+{
+  size_t result = 0;
+  for (size_t i = 0; i < length; i += 7) {
+    size_t n = (length - i < 7) ? length - i : 7;
+    uint8_t msb = 0;
+    for (size_t j = 0; j < n; ++j) {
+      msb |= (src[i + j] >> 7) << j;
+      dst[result + 1 + j] = src[i + j] & 0x7F;
+    }
+    dst[result] = msb;
+    result += n + 1;
+  }
+  return result;
+}
+
+size_t unpack7(uint8_t* dst, const uint8_t* src, size_t length)
+{
+  size_t result = 0;
+  for (size_t i = 0; i < length; i += 8) {
+    size_t n = (length - i < 8) ? length - i : 8;
+    uint8_t msb = src[i];
+    for (size_t j = 1; j < n; ++j) {
+      dst[result++] = src[i + j] | (((msb >> (j - 1)) & 1) << 7);
+    }
+  }
+  return result;
+}
+
+uint16_t crc16(const uint8_t* data, size_t length, uint16_t crc)
+{ // CRC-16/CCITT
+  for (size_t i = 0; i < length; ++i) {
+    crc ^= data[i] << 8;
+    for (int b = 0; b < 8; ++b) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc)
+{
+  crc = ~crc;
+  for (size_t i = 0; i < length; ++i) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; ++b) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+void putValue7(uint8_t* dst, uint32_t value, size_t count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = value & 0x7F;
+    value >>= 7;
+  }
+}
+
+uint32_t getValue7(const uint8_t* src, size_t count)
+{
+  uint32_t value = 0;
+  for (size_t i = count; i > 0; --i) {
+    value = (value << 7) | (src[i - 1] & 0x7F);
+  }
+  return value;
+}
+
+size_t putHeader(uint8_t* dst, command_t cmd, uint16_t seq)
+{
+  dst[0] = 0xF0;
+  dst[1] = manufacturer_id;
+  dst[2] = signature[0];
+  dst[3] = signature[1];
+  dst[4] = cmd;
+  dst[5] = seq & 0x7F;
+  dst[6] = (seq >> 7) & 0x7F;
+  return header_length + 1;
+}
+
+bool parseHeader(const uint8_t* body, size_t length, command_t* cmd, uint16_t* seq)
+{
+  if (length < header_length
+   || body[0] != manufacturer_id
+   || body[1] != signature[0]
+   || body[2] != signature[1]) {
+    return false;
+  }
+  *cmd = (command_t)body[3];
+  *seq = body[4] | (body[5] << 7);
+  return true;
+}
+
+};
+
+//-------------------------------------------------------------------------
+
+static void waitShort(void)
+{
+#if __has_include(<freertos/FreeRTOS.h>)
+  vTaskDelay(1);
+#else
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+}
+
+MIDI_SysExSender::MIDI_SysExSender(MIDI_Transport* transport, MIDIDriver* receiver)
+: _transport { transport }
+, _receiver { receiver }
+{
+  _receiver->setSysExHandler(sysexHandler, this);
+}
+
+MIDI_SysExSender::~MIDI_SysExSender()
+{
+  _receiver->setSysExHandler(nullptr, nullptr);
+}
+
+void MIDI_SysExSender::sysexHandler(void* context, const uint8_t* data, size_t length, uint8_t flags)
+{
+  auto me = (MIDI_SysExSender*)context;
+  if (flags & sysex_start) {
+    me->_rx_length = 0;
+    me->_rx_valid = true;
+  }
+  if (flags & sysex_abort) {
+    me->_rx_valid = false;
+    return;
+  }
+  if (!me->_rx_valid) { return; }
+  if (me->_rx_length + length > sizeof(me->_rx_buffer)) {
+    me->_rx_valid = false;
+    return;
+  }
+  memcpy(&me->_rx_buffer[me->_rx_length], data, length);
+  me->_rx_length += length;
+  if (!(flags & sysex_end)) { return; }
+
+  sysex_transfer::command_t cmd;
+  uint16_t seq;
+  if (sysex_transfer::parseHeader(me->_rx_buffer, me->_rx_length, &cmd, &seq)
+   && cmd == sysex_transfer::cmd_ack
+   && me->_rx_length >= sysex_transfer::header_length + 2) {
+    me->_ack_seq = seq;
+    me->_ack_status = me->_rx_buffer[sysex_transfer::header_length];
+    me->_ack_window = me->_rx_buffer[sysex_transfer::header_length + 1];
+    me->_ack_received = true;
+  }
+}
+
+void MIDI_SysExSender::sendMessage(sysex_transfer::command_t cmd, uint16_t seq, const uint8_t* payload, size_t length)
+{
+  uint8_t message[sysex_transfer::message_max + 2];
+  size_t pos = sysex_transfer::putHeader(message, cmd, seq);
+  if (length) {
+    memcpy(&message[pos], payload, length);
+    pos += length;
+  }
+  message[pos++] = 0xF7;
+  _transport->addMessage(message, pos);
+  _transport->sendFlush();
+}
+
+bool MIDI_SysExSender::waitAck(uint32_t timeout_usec)
+{
+  uint64_t start = getCaptureTimeUsec();
+  MIDI_Message message;
+  do {
+    while (_receiver->receiveMessage(&message)) {}
+    if (_ack_received) {
+      _ack_received = false;
+      return true;
+    }
+    waitShort();
+  } while (getCaptureTimeUsec() - start < timeout_usec);
+  return false;
+}
+
+bool MIDI_SysExSender::send(const char* path, uint8_t dir_type, const char* filename, report_t* report)
+{
+  using namespace sysex_transfer;
+  static constexpr const uint32_t ack_timeout_usec = 1000000;
+  static constexpr const int retry_max = 8;
+
+  report_t result;
+  auto fp = fopen(path, "rb");
+  if (fp == nullptr) {
+    if (report) { *report = result; }
+    return false;
+  }
+
+  // 終了時に送るCRC32を先に求めておく (ファイル全体をメモリに置かない)
+  uint8_t chunk[chunk_size];
+  uint32_t file_crc = 0;
+  size_t len;
+  while (0 < (len = fread(chunk, 1, sizeof(chunk), fp))) {
+    file_crc = crc32(chunk, len, file_crc);
+    result.file_size += len;
+  }
+
+  uint64_t start_usec = getCaptureTimeUsec();
+  uint8_t payload[getPackedLength(chunk_size) + 3 + filename_max];
+
+  size_t name_len = strnlen(filename, filename_max);
+  payload[0] = dir_type;
+  putValue7(&payload[1], result.file_size, 4);
+  memcpy(&payload[5], filename, name_len);
+  _ack_received = false;
+  sendMessage(cmd_begin, 0, payload, 5 + name_len);
+  bool acked = waitAck(ack_timeout_usec);
+  if (!acked || _ack_status != status_ok) {
+    result.status = acked ? _ack_status : status_invalid;
+    fclose(fp);
+    if (report) { *report = result; }
+    return false;
+  }
+  uint8_t window = _ack_window ? _ack_window : 1;
+
+  const uint32_t total = (result.file_size + chunk_size - 1) / chunk_size;
+  uint32_t base = 0;
+  uint32_t next = 0;
+  int retry = 0;
+  result.status = status_ok;
+  while (base < total) {
+    while (next < total && next - base < window) {
+      fseek(fp, next * chunk_size, SEEK_SET);
+      len = fread(chunk, 1, chunk_size, fp);
+      size_t pos = pack7(payload, chunk, len);
+      putValue7(&payload[pos], crc16(chunk, len), 3);
+      sendMessage(cmd_data, next & 0x3FFF, payload, pos + 3);
+      ++next;
+      ++result.chunks;
+    }
+    if (!waitAck(ack_timeout_usec)) {
+      // 応答が無い場合は未応答の先頭から送り直す
+      if (++retry > retry_max) { result.status = status_invalid; break; }
+      result.retransmits += next - base;
+      next = base;
+      continue;
+    }
+    retry = 0;
+    uint32_t ack_index = base + ((_ack_seq - base) & 0x3FFF);
+    if (_ack_status == status_ok) {
+      if (ack_index > base && ack_index <= next) { base = ack_index; }
+    } else if (_ack_status == status_crc_error || _ack_status == status_seq_error) {
+      result.retransmits += next - ack_index;
+      base = ack_index;
+      next = ack_index;
+    } else {
+      result.status = _ack_status;
+      break;
+    }
+  }
+  fclose(fp);
+
+  if (result.status == status_ok) {
+    putValue7(payload, file_crc, 5);
+    sendMessage(cmd_end, total & 0x3FFF, payload, 5);
+    // 未応答の data への ack が残っている場合は読み飛ばす
+    while (waitAck(ack_timeout_usec) && _ack_status == status_ok) {}
+    result.status = _ack_status;
+  } else {
+    sendMessage(cmd_abort, 0, nullptr, 0);
+  }
+  result.elapsed_usec = getCaptureTimeUsec() - start_usec;
+  if (report) { *report = result; }
+  return result.status == status_complete;
+}
+
+void MIDI_SysExSender::printReport(const report_t& report)
+{
+  double sec = report.elapsed_usec / 1000000.0;
+  printf("sysex transfer: status %u, %u bytes, %u chunks, %u retransmits, %.3f sec, %.1f bytes/sec, receiver buffer peak %u bytes\n"
+         , report.status, (unsigned)report.file_size, (unsigned)report.chunks, (unsigned)report.retransmits
+         , sec, sec > 0 ? report.file_size / sec : 0.0, (unsigned)report.rx_high_water);
+}
+
+//-------------------------------------------------------------------------
+
+} // namespace midi_driver
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef MIDI_SYSEX_TRANSFER_HPP
+#define MIDI_SYSEX_TRANSFER_HPP
+
+/*
+システムエクスクルーシブによるファイル転送プロトコル
+
+ F0 7D 4B 50 <cmd> <seq_l> <seq_h> <payload...> F7
+   7D    : 非営利用ID
+   4B 50 : 'K' 'P'
+   seq   : 14bit の通し番号 (下位7bit, 上位7bit)
+
+ 送信側 → 本体
+   cmd_begin : seq=0    payload = 保存先(1) ファイルサイズ(4 x 7bit) ファイル名(ASCII)
+   cmd_data  : seq=連番 payload = データ(7bit形式) CRC16(3 x 7bit)
+   cmd_end   : seq=連番 payload = ファイル全体のCRC32(5 x 7bit)
+   cmd_abort : seq=0
+ 本体 → 送信側
+   cmd_ack   : seq=受信を期待する次の番号  payload = 状態(1) ウィンドウ数(1)
+
+ 7bit形式 : 7バイト毎に各バイトの最上位bitをまとめた1バイトを先頭に置き、続けて下位7bitを並べる
+ 送信側は ack を待たずにウィンドウ数までの data を送ることができる。
+ 本体は data を書き込む毎に ack を返す。エラーの ack を受けた場合、送信側は ack の seq から送り直す。
+*/
+
+#include "midi_driver.hpp"
+
+namespace midi_driver {
+
+namespace sysex_transfer {
+  static constexpr const uint8_t manufacturer_id = 0x7D;
+  static constexpr const uint8_t signature[2] = { 0x4B, 0x50 };
+  static constexpr const size_t header_length = 6; // F0 を含まない ID〜seq の長さ
+
+  enum command_t : uint8_t {
+    cmd_begin = 0x01,
+    cmd_data  = 0x02,
+    cmd_end   = 0x03,
+    cmd_abort = 0x04,
+    cmd_ack   = 0x10,
+  };
+
+  enum status_t : uint8_t {
+    status_ok = 0,
+    status_crc_error,     // data のCRC不一致 (seq から送り直す)
+    status_seq_error,     // 番号の飛び (seq から送り直す)
+    status_storage_error, // 保存先に書き込めない (転送中止)
+    status_busy,          // 他の転送が進行中
+    status_invalid,       // 不正な要求 (転送中止)
+    status_complete,      // 保存完了
+  };
+
+  // 1回の data で運ぶバイト数と、本体が受け付ける未応答の data の数
+  static constexpr const size_t chunk_size = 64;
+  static constexpr const uint8_t window_size = 2;
+  static constexpr const size_t filename_max = 64;
+
+  static constexpr size_t getPackedLength(size_t length) { return length + (length + 6) / 7; }
+  // 1メッセージの最大長 (F0/F7 を除く)
+  static constexpr const size_t message_max = header_length + getPackedLength(chunk_size) + 3;
+
+  // 7bit形式への変換。変換後の長さを返す
+  size_t pack7(uint8_t* dst, const uint8_t* src, size_t length);
+  // 7bit形式からの変換。変換後の長さを返す
+  size_t unpack7(uint8_t* dst, const uint8_t* src, size_t length);
+
+  uint16_t crc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF);
+  uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+  // 数値を 7bit 毎に下位から count バイトへ分割する
+  void putValue7(uint8_t* dst, uint32_t value, size_t count);
+  uint32_t getValue7(const uint8_t* src, size_t count);
+
+  // ヘッダ (F0 を含む) を書き込み、書き込んだ長さを返す
+  size_t putHeader(uint8_t* dst, command_t cmd, uint16_t seq);
+  // F0/F7 を除いた本体が当プロトコルのものか判定し、cmd と seq を取り出す
+  bool parseHeader(const uint8_t* body, size_t length, command_t* cmd, uint16_t* seq);
+};
+
+// ファイルを転送する送信側 (PCビルドの動作確認・計測用)
+// 応答は受信側 MIDIDriver のシステムエクスクルーシブハンドラ経由で受け取る
+class MIDI_SysExSender {
+public:
+  struct report_t {
+    uint32_t file_size = 0;
+    uint32_t chunks = 0;
+    uint32_t retransmits = 0;
+    uint64_t elapsed_usec = 0;
+    // 受信側のバッファに溜まった未処理データの最大量 (計測できる場合に呼出し側で設定する)
+    uint32_t rx_high_water = 0;
+    uint8_t status = sysex_transfer::status_invalid;
+  };
+
+  MIDI_SysExSender(MIDI_Transport* transport, MIDIDriver* receiver);
+  ~MIDI_SysExSender();
+
+  // ファイルを送信し、完了または失敗するまで待つ
+  bool send(const char* path, uint8_t dir_type, const char* filename, report_t* report = nullptr);
+
+  static void printReport(const report_t& report);
+
+private:
+  static void sysexHandler(void* context, const uint8_t* data, size_t length, uint8_t flags);
+  void sendMessage(sysex_transfer::command_t cmd, uint16_t seq, const uint8_t* payload, size_t length);
+  bool waitAck(uint32_t timeout_usec);
+
+  MIDI_Transport* _transport;
+  MIDIDriver* _receiver;
+  uint8_t _rx_buffer[16];
+  size_t _rx_length = 0;
+  bool _rx_valid = false;
+  bool _ack_received = false;
+  uint16_t _ack_seq = 0;
+  uint8_t _ack_status = 0;
+  uint8_t _ack_window = 1;
+};
+
+} // namespace midi_driver
+
+#endif // MIDI_SYSEX_TRANSFER_HPP
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "midi_transport_alsa.hpp"
+
+#if defined (MIDI_TRANSPORT_ALSA_HPP)
+
+#include <stdlib.h>
+
+namespace midi_driver {
+
+//----------------------------------------------------------------
+
+MIDI_Transport_ALSA::~MIDI_Transport_ALSA()
+{
+  end();
+}
+
+bool MIDI_Transport_ALSA::begin(void)
+{
+  if (_seq != nullptr) { return true; }
+
+  if (snd_seq_open(&_seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK) < 0) {
+    printf("alsa midi: snd_seq_open failed\n");
+    _seq = nullptr;
+    return false;
+  }
+  snd_seq_set_client_name(_seq, _config.client_name);
+  _port = snd_seq_create_simple_port(_seq, _config.client_name,
+            SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ
+          | SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+            SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+  if (_port < 0
+   || snd_midi_event_new(256, &_encoder) < 0
+   || snd_midi_event_new(256, &_decoder) < 0) {
+    printf("alsa midi: port setup failed\n");
+    end();
+    return false;
+  }
+  // 受信側でランニングステータスを解釈しなくて済むよう、毎回ステータスバイトを出力させる
+  snd_midi_event_no_status(_decoder, 1);
+
+  const char* connect_to = _config.connect_to;
+  if (connect_to == nullptr) {
+    connect_to = getenv("KANPLAY_ALSA_PORT");
+  }
+  if (connect_to != nullptr) {
+    snd_seq_addr_t addr;
+    if (snd_seq_parse_address(_seq, &addr, connect_to) == 0) {
+      snd_seq_connect_to(_seq, _port, addr.client, addr.port);
+      snd_seq_connect_from(_seq, _port, addr.client, addr.port);
+    } else {
+      printf("alsa midi: unknown port %s\n", connect_to);
+    }
+  }
+  printf("alsa midi: client %d port %d\n", snd_seq_client_id(_seq), _port);
+  _connected = true;
+  return true;
+}
+
+void MIDI_Transport_ALSA::end(void)
+{
+  _connected = false;
+  if (_encoder != nullptr) { snd_midi_event_free(_encoder); _encoder = nullptr; }
+  if (_decoder != nullptr) { snd_midi_event_free(_decoder); _decoder = nullptr; }
+  if (_seq != nullptr) { snd_seq_close(_seq); _seq = nullptr; }
+  _port = -1;
+}
+
+size_t MIDI_Transport_ALSA::read(uint8_t* data, size_t length)
+{
+  if (_seq == nullptr || _use_rx == false) { return 0; }
+  size_t result = 0;
+  // 1イベント分 (SysEx以外は最大3バイト) の空きがある間だけ取り出す
+  while (result + 3 <= length) {
+    snd_seq_event_t* ev = nullptr;
+    if (snd_seq_event_input(_seq, &ev) < 0 || ev == nullptr) { break; }
+    long len = snd_midi_event_decode(_decoder, &data[result], length - result, ev);
+    if (len > 0) {
+      result += len;
+    }
+  }
+  return result;
+}
+
+void MIDI_Transport_ALSA::addMessage(const uint8_t* data, size_t length)
+{
+  if (_seq == nullptr) { return; }
+  snd_seq_event_t ev;
+  snd_seq_ev_clear(&ev);
+  long consumed = 0;
+  while (consumed < (long)length) {
+    long res = snd_midi_event_encode(_encoder, &data[consumed], length - consumed, &ev);
+    if (res <= 0) {
+      snd_midi_event_reset_encode(_encoder);
+      break;
+    }
+    consumed += res;
+    if (ev.type != SND_SEQ_EVENT_NONE) {
+      snd_seq_ev_set_source(&ev, _port);
+      snd_seq_ev_set_subs(&ev);
+      snd_seq_ev_set_direct(&ev);
+      snd_seq_event_output(_seq, &ev);
+      snd_seq_ev_clear(&ev);
+    }
+  }
+}
+
+bool MIDI_Transport_ALSA::sendFlush(void)
+{
+  if (_seq == nullptr || _use_tx == false) { return false; }
+  return snd_seq_drain_output(_seq) >= 0;
+}
+
+//----------------------------------------------------------------
+
+} // namespace midi_driver
+
+#endif
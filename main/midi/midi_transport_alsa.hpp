@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// Linux の PCビルド向け ALSAシーケンサ クライアント
+// KANPLAY_MIDI_ALSA を定義した場合のみ有効 (-lasound のリンクが必要。platformio.ini の native_linux_alsa 環境を参照)
+#if defined (M5UNIFIED_PC_BUILD) && defined (KANPLAY_MIDI_ALSA)
+#ifndef MIDI_TRANSPORT_ALSA_HPP
+#define MIDI_TRANSPORT_ALSA_HPP
+
+#include "midi_driver.hpp"
+
+#include <alsa/asoundlib.h>
+
+namespace midi_driver {
+
+class MIDI_Transport_ALSA : public MIDI_Transport {
+public:
+  struct config_t {
+    const char* client_name = "KANTAN-Play";
+    // 起動時に接続する相手 ("128:0" や "FLUID Synth" など。nullptrの場合は環境変数 KANPLAY_ALSA_PORT を参照する)
+    const char* connect_to = nullptr;
+  };
+
+  MIDI_Transport_ALSA(void) = default;
+  ~MIDI_Transport_ALSA();
+
+  void setConfig(const config_t& config) { _config = config; }
+
+  bool begin(void) override;
+  void end(void) override;
+  size_t read(uint8_t* data, size_t length) override;
+  void addMessage(const uint8_t* data, size_t length) override;
+  bool sendFlush(void) override;
+
+private:
+  config_t _config;
+  snd_seq_t* _seq = nullptr;
+  snd_midi_event_t* _encoder = nullptr;
+  snd_midi_event_t* _decoder = nullptr;
+  int _port = -1;
+};
+
+} // namespace midi_driver
+
+#endif // MIDI_TRANSPORT_ALSA_HPP
+#endif
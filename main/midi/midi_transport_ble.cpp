@@ -18,15 +18,12 @@
 
 #include <esp_bt.h>
 #include <esp32-hal-bt.h>
-#include <mutex>
 
 #define MIDI_SERVICE_UUID         "03b80e5a-ede8-4b33-a751-6ce34ec4c700"
 #define MIDI_CHARACTERISTIC_UUID  "7772e5db-3868-4112-a1a9-f2669d106bf3"
 
 namespace midi_driver {
 
-static std::mutex mutex_rx;
-
 //----------------------------------------------------------------
 
 static MIDI_Transport_BLE* _instance = nullptr;
@@ -40,11 +37,17 @@ static BLEAdvertising *pAdvertising = nullptr;
 static BLECharacteristic *pCharacteristic = nullptr;
 static int _conn_id = -1;
 // static std::deque<std::vector<uint8_t> > _rx_queue;
-static std::vector<uint8_t> _rx_data;
+// 受信データ (BLEスタックのコールバックが書込み、MIDIサブタスクが読み出す)
+static MIDI_ByteRing<1024> _rx_ring;
+static uint32_t _rx_overflow_reported = 0;
 
 // InstaChordと直結時のCharacteristic
 static BLERemoteCharacteristic* remotecharacteristic = nullptr;
-static uint16_t _mtu_size = 23;
+// ネゴシエーション済みのMTUと接続間隔 (BLEスタックのコールバックで更新し、送信時にパケタイザへ反映する)
+static volatile uint16_t _mtu_size = MIDI_BLE_Packetizer::default_mtu;
+static volatile uint32_t _conn_interval_usec = MIDI_BLE_Packetizer::default_interval_usec;
+// 相手側がMTUを拡張できるよう、こちらの受け入れ可能なMTUを設定しておく
+static constexpr const uint16_t _local_mtu = 247;
 
 // static constexpr const size_t _tx_queue_size = 4;
 // static int _tx_queue_index = 0;
@@ -54,6 +57,8 @@ static uint16_t _mtu_size = 23;
 class MyServerCallbacks: public BLEServerCallbacks {
   void onConnect(BLEServer *pServer, esp_ble_gatts_cb_param_t *param) override {
     _conn_id = pServer->getConnId();
+    // 接続間隔は 1.25msec 単位
+    _conn_interval_usec = param->connect.conn_params.interval * 1250;
     _instance->setPeripheralConnected(true);
 // printf("BLE MIDI Connected.\n");
 // pServer->updatePeerMTU(_conn_id, _mtu_size);
@@ -61,11 +66,13 @@ class MyServerCallbacks: public BLEServerCallbacks {
   };
   void onDisconnect(BLEServer *pServer, esp_ble_gatts_cb_param_t *param) override {
     _conn_id = -1;
+    _mtu_size = MIDI_BLE_Packetizer::default_mtu;
     _instance->setPeripheralConnected(false);
 // printf("BLE MIDI Disconnect.\n");
   }
   void onMtuChanged(BLEServer *pServer, esp_ble_gatts_cb_param_t *param) override {
 // printf("BLE onMtuChanged : %d\n", param->mtu.mtu);
+    _mtu_size = param->mtu.mtu;
   }
 };
 
@@ -99,13 +106,16 @@ class MyCallbacks: public BLECharacteristicCallbacks {
 class MyServerCallbacks: public BLEServerCallbacks {
   void onConnect(BLEServer *pServer, ble_gap_conn_desc *desc) override {
     _conn_id = pServer->getConnId();
+    _conn_interval_usec = desc->conn_itvl * 1250;
     _instance->setPeripheralConnected(true);
   };
   void onDisconnect(BLEServer *pServer, ble_gap_conn_desc *desc) override {
     _conn_id = -1;
+    _mtu_size = MIDI_BLE_Packetizer::default_mtu;
     _instance->setPeripheralConnected(false);
   }
   void onMtuChanged(BLEServer *pServer, ble_gap_conn_desc *desc, uint16_t mtu) override {
+    _mtu_size = mtu;
   }
 };
 
@@ -132,26 +142,8 @@ void MIDI_Transport_BLE::decodeReceive(const uint8_t* data, size_t length)
   printf("\n");
   fflush(stdout);
 //*/
-  // uint8_t timestamp_high = data[0];
-  size_t timestamp_low_index = 0;
-  if (data[1] & 0x80) {
-    timestamp_low_index = 1;
-  }
-  std::vector<uint8_t> rxtmp;
-  for (size_t i = timestamp_low_index + 1; i <= length; ++i) {
-    if (i == length || data[i] & 0x80) {
-      if (timestamp_low_index + 1 < i) {
-        // rxtmpの末尾にdata[timestamp_low_index+1]からrxValue[i]までを追加
-        rxtmp.insert(rxtmp.end(), data + timestamp_low_index + 1, data + i);
-//   printf("split:%0d-%0d\n", timestamp_low_index + 1, i);
-        timestamp_low_index = i;
-      }
-    }
-  }
-  {
-    std::lock_guard<std::mutex> lock(mutex_rx);
-    _rx_data.insert(_rx_data.end(), rxtmp.begin(), rxtmp.end());
-  }
+  // 受信パケット全体が入る空きが無い場合はパケットごと破棄する
+  MIDI_BLE_Packetizer::unpack(data, length, _rx_ring);
 }
 
 static std::vector<BLEAdvertisedDevice> ble_scan(void)
@@ -207,6 +199,7 @@ MIDI_Transport_BLE::~MIDI_Transport_BLE()
 
 bool MIDI_Transport_BLE::begin(void)
 {
+  _packetizer.setSender(sendPacket, this);
   _is_begin = false;
   return true;
 }
@@ -222,64 +215,50 @@ void MIDI_Transport_BLE::end(void)
   }
 }
 
-void MIDI_Transport_BLE::addMessage(const uint8_t* data, size_t length)
+void MIDI_Transport_BLE::sendPacket(void* context, const uint8_t* data, size_t length)
 {
-  uint32_t msec = M5.millis();
-  int len = length + (_tx_runningStatus != data[0] ? 2 : 0);
-  if (_tx_data.size() + len >= _mtu_size - 1) {
-    // If the tx_data size exceeds the buffer size, send it immediately
-    sendFlush();
-  }
-  if (_tx_data.empty()) {
-    uint32_t msec_high = 0x3F & (msec >> 7);
-    _tx_data.push_back(0x80 | msec_high);
-    _tx_runningStatus = 0;
-  }
-
-  if (_tx_runningStatus != data[0])
+  auto me = (MIDI_Transport_BLE*)context;
+ESP_LOGV("BLE", "sendPacket called, size: %d", length);
+  auto remote = remotecharacteristic;
+  if (remote)
   {
-    uint32_t msec_low = (msec & 0x7F);
-    _tx_data.push_back(0x80 | msec_low);
-    _tx_data.push_back(data[0]); // status byte
-    _tx_runningStatus = data[0];
-  }
-  _tx_data.insert(_tx_data.end(), data + 1, data + length);
-  if (_tx_data.size() + 4 >= _mtu_size - 3) {
-    // If the tx_data size exceeds the buffer size, send it immediately
-    sendFlush();
+    me->_packet_sent = true;
+    remote->writeValue((uint8_t*)data, length, false);
+  } else if (pCharacteristic && _conn_id >= 0) {
+    me->_packet_sent = true;
+    pCharacteristic->setValue((uint8_t*)data, length);
+    pCharacteristic->notify();
   }
 }
 
+void MIDI_Transport_BLE::addMessage(const uint8_t* data, size_t length)
+{
+  uint32_t usec = M5.micros();
+  _packetizer.setMTU(_mtu_size);
+  _packetizer.setConnectionInterval(_conn_interval_usec);
+  // 予定時刻が指定されていない場合は現在時刻をタイムスタンプとする
+  uint32_t event_usec = _event_time_valid ? _event_usec : usec;
+  _event_time_valid = false;
+  _packetizer.add(data, length, event_usec / 1000, usec);
+}
+
 bool MIDI_Transport_BLE::sendFlush(void)
 {
-  bool result = false;
-ESP_LOGV("BLE", "sendFlush called, tx_data size: %d", _tx_data.size());
-// printf("sendFlush called, tx_data size: %d\n", _tx_data.size());
-  auto remote = remotecharacteristic;
-  if (remote)
-  {
-    result = true;
-    if (!_tx_data.empty()) {
-      remote->writeValue(_tx_data.data(), _tx_data.size(), false);
-    }
-  } else if (pCharacteristic && _conn_id >= 0) {
-    result = true;
-    if (!_tx_data.empty()) {
-      pCharacteristic->setValue( _tx_data.data(), _tx_data.size());
-      pCharacteristic->notify();
-    }
-  }
-  _tx_data.clear();
-  _tx_runningStatus = 0;
+  // パケットは満杯になるか、接続間隔に応じた送出期限に達した時点で送出する
+  _packetizer.process(M5.micros());
+  bool result = _packet_sent;
+  _packet_sent = false;
   return result;
 }
 
-std::vector<uint8_t> MIDI_Transport_BLE::read(void)
+size_t MIDI_Transport_BLE::read(uint8_t* data, size_t length)
 {
-  std::lock_guard<std::mutex> lock(mutex_rx);
-  auto rxValueVec = _rx_data;
-  _rx_data.clear();
-  return rxValueVec;
+  uint32_t overflow = _rx_ring.getOverflowCount();
+  if (_rx_overflow_reported != overflow) {
+    ESP_LOGW("BLE", "rx buffer overflow : %lu", (unsigned long)(overflow - _rx_overflow_reported));
+    _rx_overflow_reported = overflow;
+  }
+  return _rx_ring.pop(data, length);
 }
 /*
 size_t MIDI_Transport_BLE::read(uint8_t* data, size_t length)
@@ -332,6 +311,7 @@ class MyClientCallback : public BLEClientCallbacks {
     // printf("ble client: onDisconnect\n");
     // fflush(stdout);
     remotecharacteristic = nullptr;
+    _mtu_size = MIDI_BLE_Packetizer::default_mtu;
     if (pclient == _pClient) {
       _pClient = nullptr;
       delete pclient;
@@ -388,13 +368,14 @@ void MIDI_Transport_BLE::setUseTxRx(bool use_tx, bool use_rx)
   bool prev_en = _use_tx || _use_rx;
   bool new_en = use_tx || use_rx;
   if (prev_en != new_en) {
-    _rx_data.clear();
+    _rx_ring.clear();
+    _packetizer.clear();
     if (new_en) {
       if (!_is_begin) {
         _is_begin = true;
         // BLEDevice::setMTU(_mtu_size);
         BLEDevice::init(_config.device_name);
-        // BLEDevice::setMTU(_mtu_size);
+        BLEDevice::setMTU(_local_mtu);
         pServer = BLEDevice::createServer();
         pServer->setCallbacks(&myServerCallbacks);
 
@@ -492,6 +473,7 @@ void MIDI_Transport_BLE::setUseTxRx(bool use_tx, bool use_rx)
                   fflush(stdout);
                   //*/
                 rc->registerForNotify(notifyCallback);
+                _mtu_size = pClient->getMTU();
                 remotecharacteristic = rc;
                 _pClient = pClient;
                 _instance->setCentralConnected(true);
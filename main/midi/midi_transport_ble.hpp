@@ -5,6 +5,7 @@
 #define MIDI_TRANSPORT_BLE_HPP
 
 #include "midi_driver.hpp"
+#include "midi_ble_packetizer.hpp"
 
 namespace midi_driver {
 
@@ -22,12 +23,16 @@ public:
   bool begin(void) override;
   void end(void) override;
   // size_t write(const uint8_t* data, size_t length) override;
-  // size_t read(uint8_t* data, size_t length) override;
 
   void addMessage(const uint8_t* data, size_t length) override;
   bool sendFlush(void) override;
+  void setEventTime(uint32_t usec) override {
+    _event_usec = usec;
+    _event_time_valid = true;
+  }
+  uint32_t getFlushWaitUsec(uint32_t usec) const override { return _packetizer.getWaitUsec(usec); }
 
-  std::vector<uint8_t> read(void) override;
+  size_t read(uint8_t* data, size_t length) override;
 
   void setUseTxRx(bool use_tx, bool use_rx) override;
 
@@ -37,9 +42,13 @@ public:
 
 private:
 
-  std::vector<uint8_t> _tx_data;
+  static void sendPacket(void* context, const uint8_t* data, size_t length);
+
+  MIDI_BLE_Packetizer _packetizer;
   config_t _config;
-  uint8_t _tx_runningStatus = 0;
+  uint32_t _event_usec = 0;
+  bool _event_time_valid = false;
+  bool _packet_sent = false;
   bool _is_begin = false;
 
   bool _central_connected = false;
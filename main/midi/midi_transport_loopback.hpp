@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef MIDI_TRANSPORT_LOOPBACK_HPP
+#define MIDI_TRANSPORT_LOOPBACK_HPP
+
+#include "midi_driver.hpp"
+
+namespace midi_driver {
+
+// プロセス内で2つのトランスポートを相互接続するループバック (PCビルドでの動作確認・計測用)
+// 一方の送信データがもう一方の受信データとなる。自分自身に接続するとエコーバックになる
+class MIDI_Transport_Loopback : public MIDI_Transport {
+public:
+  MIDI_Transport_Loopback(void) = default;
+
+  static void connect(MIDI_Transport_Loopback* a, MIDI_Transport_Loopback* b) {
+    a->_peer = b;
+    b->_peer = a;
+  }
+
+  bool begin(void) override {
+    _connected = true;
+    return true;
+  }
+  void end(void) override { _connected = false; }
+
+  void addMessage(const uint8_t* data, size_t length) override {
+    _tx_data.insert(_tx_data.end(), data, data + length);
+  }
+  bool sendFlush(void) override {
+    if (_use_tx == false) { return false; }
+    if (!_tx_data.empty()) {
+      // 相手側が受信無効、または受信バッファが満杯の場合は破棄する
+      if (_peer != nullptr && _peer->_use_rx) {
+        _peer->_rx_ring.push(_tx_data.data(), _tx_data.size());
+      }
+      _tx_data.clear();
+    }
+    return true;
+  }
+  size_t read(uint8_t* data, size_t length) override {
+    return _rx_ring.pop(data, length);
+  }
+
+  uint32_t getRxOverflowCount(void) const { return _rx_ring.getOverflowCount(); }
+  uint32_t getRxHighWater(void) const { return _rx_ring.getHighWater(); }
+  void resetRxHighWater(void) { _rx_ring.resetHighWater(); }
+
+private:
+  MIDI_Transport_Loopback* _peer = nullptr;
+  std::vector<uint8_t> _tx_data;
+  MIDI_ByteRing<4096> _rx_ring;
+};
+
+} // namespace midi_driver
+
+#endif // MIDI_TRANSPORT_LOOPBACK_HPP
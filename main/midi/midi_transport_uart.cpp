@@ -8,6 +8,7 @@
 #include "../system_registry.hpp"
 
 #include <driver/uart.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 
@@ -52,9 +53,15 @@ void MIDI_Transport_UART::addMessage(const uint8_t* data, size_t length)
   if (_tx_data.empty()) {
     _tx_runningStatus = 0;
   }
-  if (_tx_runningStatus != data[0]) {
-    _tx_runningStatus = data[0];
-    _tx_data.push_back(data[0]); // status byte
+  uint8_t status = data[0];
+  if (status >= 0xF0) {
+    // システムコモン・システムエクスクルーシブはランニングステータスを解除する
+    // (リアルタイムメッセージはランニングステータスに影響しない)
+    if (status < 0xF8) { _tx_runningStatus = 0; }
+    _tx_data.push_back(status);
+  } else if (_tx_runningStatus != status) {
+    _tx_runningStatus = status;
+    _tx_data.push_back(status); // status byte
   }
   _tx_data.insert(_tx_data.end(), data + 1, data + length);
 }
@@ -64,8 +71,10 @@ bool MIDI_Transport_UART::sendFlush(void)
   if (_use_tx == false) { return false; }
   uart_port_t uart_num = (uart_port_t) _config.uart_port_num;
   if (!_tx_data.empty()) {
-    bool res = uart_write_bytes(uart_num, _tx_data.data(), _tx_data.size());
+    int res = uart_write_bytes(uart_num, _tx_data.data(), _tx_data.size());
     if (res > 0) {
+      // ドライバのリングバッファが満杯の場合は書込みが待たされるため、戻った時点の時刻で積む
+      _tx_backlog.add(res, (uint32_t)esp_timer_get_time());
       _tx_data.clear();
       _tx_runningStatus = 0;
     }
@@ -73,25 +82,37 @@ bool MIDI_Transport_UART::sendFlush(void)
   return true;
 }
 
-std::vector<uint8_t> MIDI_Transport_UART::read(void)
+size_t MIDI_Transport_UART::getTxPendingBytes(void) const
 {
-  std::vector<uint8_t> rxValueVec;
-  if (_use_rx == true)
-  {
-    size_t length = 0;
-    uart_port_t uart_num = (uart_port_t) _config.uart_port_num;
-    uart_get_buffered_data_len(uart_num, &length);
-    if (length > 0)
-    {
-      rxValueVec.resize(length);
-      size_t read_length = uart_read_bytes(uart_num, rxValueVec.data(), length, 1);
-      if (read_length != length) {
-        rxValueVec.resize(read_length);
-        // error
-      }
+  size_t pending = 0;
+  if (_is_begin) {
+    // UARTドライバの送信リングバッファに残っている量と、送出速度からの見積もりの大きい方を使う
+    size_t free_size = 0;
+    if (ESP_OK == uart_get_tx_buffer_free_size((uart_port_t)_config.uart_port_num, &free_size)
+     && free_size < _config.buffer_size_tx) {
+      pending = _config.buffer_size_tx - free_size;
     }
+    size_t estimate = _tx_backlog.getPendingBytes((uint32_t)esp_timer_get_time());
+    if (pending < estimate) { pending = estimate; }
   }
-  return rxValueVec;
+  return pending + _tx_data.size();
+}
+
+uint32_t MIDI_Transport_UART::getTxDrainUsec(uint32_t usec) const
+{
+  return _tx_backlog.getDrainUsec(usec) + _tx_backlog.getTransferUsec(_tx_data.size());
+}
+
+size_t MIDI_Transport_UART::read(uint8_t* data, size_t length)
+{
+  if (_use_rx == false) { return 0; }
+  size_t buffered = 0;
+  uart_port_t uart_num = (uart_port_t) _config.uart_port_num;
+  uart_get_buffered_data_len(uart_num, &buffered);
+  if (buffered == 0) { return 0; }
+  if (length > buffered) { length = buffered; }
+  int read_length = uart_read_bytes(uart_num, data, length, 1);
+  return (read_length > 0) ? read_length : 0;
 }
 
 void MIDI_Transport_UART::uart_rx_task(MIDI_Transport_UART* me)
@@ -139,6 +160,7 @@ void MIDI_Transport_UART::setUseTxRx(bool tx_enable, bool rx_enable)
   esp_err_t err = uart_param_config(uart_num, &uart_config);
   // M5_LOGD("uart_midi:uart_param_config: %d", err);
   if (err == ESP_OK) {
+    _tx_backlog.setBaudRate(_config.baud_rate);
     if (_config.pin_rx >= 0) {
       err = uart_driver_install(uart_num, _config.buffer_size_rx, _config.buffer_size_tx, 4, &uart_queue, 0);
       xTaskCreatePinnedToCore((TaskFunction_t)uart_rx_task, "uart_rx", 1024*3, this, kanplay_ns::def::system::task_priority_midi_sub, nullptr, kanplay_ns::def::system::task_cpu_midi_sub);
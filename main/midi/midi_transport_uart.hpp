@@ -5,6 +5,7 @@
 #define MIDI_TRANSPORT_UART_HPP
 
 #include "midi_driver.hpp"
+#include "midi_tx_backlog.hpp"
 
 namespace midi_driver {
 
@@ -27,15 +28,19 @@ public:
   bool begin(void) override;
   void end(void) override;
   // size_t write(const uint8_t* data, size_t length) override;
-  std::vector<uint8_t> read(void) override;
+  size_t read(uint8_t* data, size_t length) override;
   void addMessage(const uint8_t* data, size_t length) override;
   bool sendFlush(void) override;
+  size_t getTxPendingBytes(void) const override;
+  uint32_t getTxDrainUsec(uint32_t usec) const override;
 
   void setUseTxRx(bool tx_enable, bool rx_enable) override;
   
 private:
   static void uart_rx_task(MIDI_Transport_UART* me);
   std::vector<uint8_t> _tx_data;
+  // ドライバに渡した送信データの残量の見積もり (ハードウェアFIFO内の分はドライバから取得できないため)
+  MIDI_TxBacklog _tx_backlog;
   config_t _config;
   uint8_t _tx_runningStatus = 0;
   bool _is_begin = false;
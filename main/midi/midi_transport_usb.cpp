@@ -2,20 +2,21 @@
 // Copyright (c) 2025 InstaChord Corp.
 
 #include "midi_transport_usb.hpp"
+#include "midi_usb_packet.hpp"
 
 #include "../common_define.hpp"
 #include "../system_registry.hpp"
 
 #include <string.h>
-#include <mutex>
 
 #if __has_include(<usb/usb_host.h>)
 
 namespace midi_driver {
 
   static MIDI_Transport_USB* _instance = nullptr;
-  static std::vector<uint8_t> _rx_data;
-  static std::mutex mutex_rx;
+  // 受信したUSB-MIDIイベントパケット (4バイト単位)。USBタスク/コールバックが書込み、MIDIサブタスクが読み出す
+  static MIDI_ByteRing<1024> _rx_ring;
+  static uint32_t _rx_overflow_reported = 0;
   static bool isMIDIReady = false;
 
 
@@ -80,13 +81,9 @@ namespace midi_driver {
           } while (!_instance->isConnected());
         }
         if (usb_midi.readPacket(&event)) {
-          {
-            std::lock_guard<std::mutex> lock(mutex_rx);
-            do {
-              uint8_t* ptr = reinterpret_cast<uint8_t*>(&event);
-              _rx_data.insert(_rx_data.end(), ptr, ptr + 4);
-            } while (usb_midi.readPacket(&event));
-          }
+          do {
+            _rx_ring.push(reinterpret_cast<uint8_t*>(&event), 4);
+          } while (usb_midi.readPacket(&event));
           _instance->execTaskNotify();
         }
       }
@@ -205,14 +202,11 @@ namespace midi_driver {
     if (Device_Handle == transfer->device_handle) {
       if (transfer->status == USB_TRANSFER_STATUS_COMPLETED && USB_EP_DESC_GET_EP_DIR(transfer)) {
         uint8_t *const p = transfer->data_buffer;
-        {
-          std::lock_guard<std::mutex> lock(mutex_rx);
-          for (int i = 0; i < transfer->actual_num_bytes; i += 4) {
-            if ((p[i] + p[i+1] + p[i+2] + p[i+3]) == 0) break;
-            _rx_data.insert(_rx_data.end(), p + i, p + i + 4);
-            ESP_LOGI("", "midi: %02x %02x %02x %02x",
-                p[i], p[i+1], p[i+2], p[i+3]);
-          }
+        for (int i = 0; i < transfer->actual_num_bytes; i += 4) {
+          if ((p[i] + p[i+1] + p[i+2] + p[i+3]) == 0) break;
+          _rx_ring.push(p + i, 4);
+          ESP_LOGI("", "midi: %02x %02x %02x %02x",
+              p[i], p[i+1], p[i+2], p[i+3]);
         }
         esp_err_t err = usb_host_transfer_submit(transfer);
         if (err != ESP_OK) {
@@ -528,11 +522,12 @@ void MIDI_Transport_USB::addMessage(const uint8_t* data, size_t length)
     return;
   }
 
-  // TODO:システムエクスクルーシブの送信には未対応。
-  // 必要に応じて実装すること…。
+  MIDI_USB_Packet::encode(data, length, [this](const uint8_t* packet) { addPacket(packet); });
+}
 
-  _tx_data.push_back(data[0] >> 4);
-  _tx_data.insert(_tx_data.end(), data, data + 3);
+void MIDI_Transport_USB::addPacket(const uint8_t* packet)
+{
+  _tx_data.insert(_tx_data.end(), packet, packet + 4);
   int remain = _midi_usb_instance->getSendBufSize() - _tx_data.size();
   if (remain - 4 <= 0) {
     sendFlush();
@@ -564,26 +559,21 @@ bool MIDI_Transport_USB::sendFlush(void)
   // return (err == ESP_OK);
 }
 
-std::vector<uint8_t> MIDI_Transport_USB::read(void)
+size_t MIDI_Transport_USB::read(uint8_t* data, size_t length)
 {
-  std::vector<uint8_t> rxValueVec;
-  std::lock_guard<std::mutex> lock(mutex_rx);
-  if (!_rx_data.empty()) {
+  uint32_t overflow = _rx_ring.getOverflowCount();
+  if (_rx_overflow_reported != overflow) {
+    ESP_LOGW("", "usb midi rx buffer overflow : %lu", (unsigned long)(overflow - _rx_overflow_reported));
+    _rx_overflow_reported = overflow;
+  }
 
-    static constexpr uint8_t cin_length_table[] = {
-       0, 0, 2, 3, 3, 1, 2, 3,
-       3, 3, 3, 3, 2, 2, 3, 1,
-    };
-    for (int i = 0; i < _rx_data.size(); i += 4) {
-      uint8_t cin = _rx_data[i] & 0x0f; // Code Index Number
-      size_t len = cin_length_table[cin];
-      if (len) {
-        rxValueVec.insert(rxValueVec.end(), _rx_data.begin() + i + 1, _rx_data.begin() + i + 1 + len);
-      }
-    }
-    _rx_data.clear();
+  size_t result = 0;
+  uint8_t packet[MIDI_USB_Packet::packet_size];
+  // イベントパケット1つ分 (最大3バイト) の空きがある間、パケット単位で取り出す
+  while (result + 3 <= length && _rx_ring.pop(packet, sizeof(packet)) == sizeof(packet)) {
+    result += MIDI_USB_Packet::decode(packet, &data[result]);
   }
-  return rxValueVec;
+  return result;
 }
 
 void MIDI_Transport_USB::setConnected(bool flg)
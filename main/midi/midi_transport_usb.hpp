@@ -30,7 +30,7 @@ public:
   bool begin(void) override;
   void end(void) override;
   // size_t write(const uint8_t* data, size_t length) override;
-  std::vector<uint8_t> read(void) override;
+  size_t read(uint8_t* data, size_t length) override;
   void addMessage(const uint8_t* data, size_t length) override;
   bool sendFlush(void) override;
 
@@ -39,6 +39,8 @@ public:
   void setConnected(bool flg);
 
 private:
+  // USB-MIDIの4バイトパケットを送信バッファに積む
+  void addPacket(const uint8_t* packet);
 
   std::vector<uint8_t> _tx_data;
   config_t _config;
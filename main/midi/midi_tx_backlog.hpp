@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef MIDI_TX_BACKLOG_HPP
+#define MIDI_TX_BACKLOG_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace midi_driver {
+
+// 通信速度の限られた回線の送信待ちを、書き込んだ量と時刻から見積もる
+//  - UARTドライバのリングバッファに加え、ハードウェアFIFOに残っている分も含めて扱える
+//  - 回線は書き込まれた順に一定速度で送出するものとし、送出が終わる時刻を保持する
+class MIDI_TxBacklog {
+public:
+  // 1バイトあたりのビット数は スタート1 + データ8 + ストップ1 = 10
+  void setBaudRate(uint32_t baud_rate, uint8_t bits_per_byte = 10) {
+    if (baud_rate == 0) { baud_rate = 31250; }
+    _byte_usec_x256 = ((uint64_t)bits_per_byte * 1000000u * 256u + baud_rate - 1) / baud_rate;
+  }
+
+  // 1バイトの送出時間 (usec, 下位8bitは小数部)
+  uint32_t getByteUsecX256(void) const { return _byte_usec_x256; }
+
+  // bytes バイトを回線に書き込んだ
+  void add(size_t bytes, uint32_t now_usec) {
+    uint32_t now_x256 = now_usec << 8;
+    if ((int32_t)(_busy_until_x256 - now_x256) < 0) { _busy_until_x256 = now_x256; }
+    _busy_until_x256 += bytes * _byte_usec_x256;
+  }
+
+  // bytes バイトの送出にかかる時間
+  uint32_t getTransferUsec(size_t bytes) const {
+    return ((uint64_t)bytes * _byte_usec_x256 + 255) >> 8;
+  }
+
+  // 書き込み済みのデータが送出し終わるまでの時間
+  uint32_t getDrainUsec(uint32_t now_usec) const {
+    return (getDrainX256(now_usec) + 255) >> 8;
+  }
+
+  // 送出されずに残っているバイト数
+  size_t getPendingBytes(uint32_t now_usec) const {
+    return (getDrainX256(now_usec) + _byte_usec_x256 - 1) / _byte_usec_x256;
+  }
+
+  void clear(uint32_t now_usec) { _busy_until_x256 = now_usec << 8; }
+
+private:
+  // 時刻は usec の 256倍で保持する (約16秒で一周するが、差分のみを使うため問題ない)
+  uint32_t getDrainX256(uint32_t now_usec) const {
+    int32_t diff = _busy_until_x256 - (now_usec << 8);
+    return diff > 0 ? diff : 0;
+  }
+
+  uint32_t _byte_usec_x256 = 320 * 256; // 31250bps
+  uint32_t _busy_until_x256 = 0;
+};
+
+} // namespace midi_driver
+
+#endif // MIDI_TX_BACKLOG_HPP
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef MIDI_USB_PACKET_HPP
+#define MIDI_USB_PACKET_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace midi_driver {
+
+  // USB-MIDI 1.0 のイベントパケット (4バイト) とMIDIバイト列の変換 (ケーブル番号は0のみ)
+  class MIDI_USB_Packet {
+  public:
+    static constexpr const size_t packet_size = 4;
+
+    // メッセージをイベントパケットに分割し、パケット毎に emit(const uint8_t* packet) を呼び出す
+    template <typename T>
+    static void encode(const uint8_t* data, size_t length, T emit) {
+      uint8_t status = data[0];
+      if (status == 0xF0) {
+        // システムエクスクルーシブは3バイト毎のパケットに分割する
+        // CIN 0x4:開始/継続  0x5,0x6,0x7:終了(1,2,3バイト)
+        size_t pos = 0;
+        while (pos < length) {
+          size_t n = length - pos;
+          bool end = (data[length - 1] == 0xF7 && n <= 3);
+          if (n > 3) { n = 3; }
+          uint8_t packet[packet_size] = { (uint8_t)(end ? 0x04 + n : 0x04), 0, 0, 0 };
+          memcpy(&packet[1], &data[pos], n);
+          emit(packet);
+          pos += n;
+        }
+        return;
+      }
+
+      uint8_t cin = status >> 4;
+      if (status >= 0xF0) {
+        switch (status) {
+        case 0xF1: case 0xF3: cin = 0x02; break;
+        case 0xF2:            cin = 0x03; break;
+        case 0xF7:            cin = 0x05; break;
+        default:              cin = (status >= 0xF8) ? 0x0F : 0x05; break;
+        }
+      }
+      uint8_t packet[packet_size] = { cin, 0, 0, 0 };
+      memcpy(&packet[1], data, length < 3 ? length : 3);
+      emit(packet);
+    }
+
+    // イベントパケットからMIDIバイト列を dst (3バイト以上) へ取り出し、その長さを返す
+    static size_t decode(const uint8_t* packet, uint8_t* dst) {
+      static constexpr const uint8_t cin_length_table[] = {
+         0, 0, 2, 3, 3, 1, 2, 3,
+         3, 3, 3, 3, 2, 2, 3, 1,
+      };
+      uint8_t cin = packet[0] & 0x0f; // Code Index Number
+      size_t len = cin_length_table[cin];
+      memcpy(dst, &packet[1], len);
+      return len;
+    }
+  };
+
+} // namespace midi_driver
+
+#endif // MIDI_USB_PACKET_HPP
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_MIDI_OUT_CONTROL_HPP
+#define KANPLAY_MIDI_OUT_CONTROL_HPP
+
+#include "common_define.hpp"
+#include "registry.hpp"
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+// MIDI出力コントロール
+// 演奏タスク等が送信するMIDIメッセージを履歴として積み、task_midi や looper がそれぞれのカーソルで読み出す
+struct reg_midi_out_control_t : public registry_base_t {
+  // 読み出しには非対応、値をセットすると履歴として取得できる
+  reg_midi_out_control_t(void) : registry_base_t(history_count) {}
+
+  void setMessage(uint8_t status, uint8_t data1, uint8_t data2 = 0) {
+    stampEventTime();
+    set16(status, data1 + (data2 << 8), true);
+  }
+  // 出力先ポートを限定して送信する (port_mask は output_port_t のbit毎、上位16bitに格納する)
+  // ※ 上位16bitが0のメッセージは全ポートへ送信される
+  void setRoutedMessage(uint8_t status, uint8_t data1, uint8_t data2, uint8_t port_mask) {
+    stampEventTime();
+    set32(status, data1 + (data2 << 8) + (port_mask << 16), true);
+  }
+
+  // 演奏タスクの時間軸と M5.micros() の対応を設定する (演奏タスクが処理周期毎に呼び出す)
+  void setEventClock(uint32_t timebase_usec, uint32_t micros) {
+    _clock_timebase_usec = timebase_usec;
+    _clock_micros = micros;
+  }
+  // 以降に積むメッセージの予定時刻 (演奏タスクの時間軸)。clearEventTime を呼ぶまで有効
+  // 予定より遅れて積んだ場合も、送信側は予定時刻を BLE-MIDI のタイムスタンプ等に使う
+  void setEventTime(uint32_t timebase_usec) {
+    _event_micros = _clock_micros + (timebase_usec - _clock_timebase_usec);
+    _event_time_valid = true;
+  }
+  void clearEventTime(void) { _event_time_valid = false; }
+  // 履歴のメッセージの予定時刻 (M5.micros() の時刻)。予定時刻を設定せずに積んだ場合はfalseを返す
+  bool getEventTime(const history_t* history, uint32_t* micros) const {
+    auto e = &_event_time[(history - _history) & (history_count - 1)];
+    *micros = e->micros;
+    return e->valid;
+  }
+  void setNoteVelocity(uint8_t channel, uint8_t note, uint8_t value) {
+    uint8_t status = 0x80 + ((value & 0x80) >> 3);
+    setMessage((status | channel), note, value & 0x7F);
+  }
+  void setProgramChange(uint8_t channel, uint8_t value) {
+    if (_program_number[channel] == value) {
+      return;
+    }
+    _program_number[channel] = value;
+    uint8_t status = 0xC0;
+    setMessage((status | channel), value);
+  }
+  void setControlChange(uint8_t channel, uint8_t control, uint8_t value) {
+    uint8_t status = 0xB0;
+    setMessage((status | channel), control, value);
+  }
+  void setChannelVolume(uint8_t channel, uint8_t value) {
+    if (_channel_volume[channel] == value) {
+      return;
+    }
+    _channel_volume[channel] = value;
+    setControlChange(channel, 7, value);
+  }
+  uint8_t getProgramChange(uint8_t channel) const {
+    return _program_number[channel] & 0x7F;
+  }
+  uint8_t getChannelVolume(uint8_t channel) const {
+    return _channel_volume[channel] & 0x7F;
+  }
+  // 起動後に一度でも送信したか (未送信の場合は初期値の 128 のまま)
+  bool hasProgramChange(uint8_t channel) const { return _program_number[channel] < 128; }
+  bool hasChannelVolume(uint8_t channel) const { return _channel_volume[channel] < 128; }
+
+protected:
+  static constexpr const uint16_t history_count = 256; // 2の累乗であること
+
+  // 次に書き込む履歴と同じ位置に予定時刻を記録する
+  void stampEventTime(void) {
+    auto e = &_event_time[_history_code & (history_count - 1)];
+    e->micros = _event_micros;
+    e->valid = _event_time_valid;
+  }
+
+  struct event_time_t {
+    uint32_t micros = 0;
+    bool valid = false;
+  };
+  event_time_t _event_time[history_count];
+  uint32_t _clock_timebase_usec = 0;
+  uint32_t _clock_micros = 0;
+  uint32_t _event_micros = 0;
+  bool _event_time_valid = false;
+
+  uint8_t _channel_volume[def::midi::channel_max] = {
+      128, 128, 128, 128, 128, 128, 128, 128,
+      128, 128, 128, 128, 128, 128, 128, 128,
+  };
+  uint8_t _program_number[def::midi::channel_max] = {
+      128, 128, 128, 128, 128, 128, 128, 128,
+      128, 128, 128, 128, 128, 128, 128, 128,
+  };
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
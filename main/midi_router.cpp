@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "midi_router.hpp"
+
+#include <M5Unified.h>
+
+#include <math.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+midi_router_t::midi_router_t(void)
+{
+  for (int v = 0; v < 128; ++v) {
+    _velocity_table[def::midi::velocity_linear][v] = v;
+    _velocity_table[def::midi::velocity_soft][v] = (uint8_t)(sqrtf(v * 127.0f) + 0.5f);
+    _velocity_table[def::midi::velocity_hard][v] = (uint8_t)((v * v + 126) / 127);
+    _velocity_table[def::midi::velocity_full][v] = v ? 127 : 0;
+  }
+  compile(_table[0]);
+}
+
+void midi_router_t::compile(table_t& table) const
+{
+  // 初期状態は全ての入力を全ての出力へ変換なしで送る
+  for (auto& src : table) {
+    for (auto& type : src) {
+      for (auto& route : type) {
+        route = { all_port, channel_keep, 0, def::midi::velocity_linear };
+      }
+    }
+  }
+  for (auto& rule : _rules) {
+    for (int src = 0; src < def::midi::out_port_max; ++src) {
+      if (!(rule.src_mask & (1 << src))) { continue; }
+      for (int type = 0; type < def::midi::route_type_max; ++type) {
+        if (!(rule.type_mask & (1 << type))) { continue; }
+        for (int ch = 0; ch < def::midi::channel_max; ++ch) {
+          if (!(rule.channel_mask & (1 << ch))) { continue; }
+          auto route = &table[src][type][ch];
+          route->dst_mask = rule.dst_mask & all_port;
+          route->channel = rule.channel;
+          route->transpose = rule.transpose;
+          route->velocity = rule.velocity < def::midi::velocity_curve_max ? rule.velocity : def::midi::velocity_linear;
+        }
+      }
+    }
+  }
+}
+
+void midi_router_t::setRules(const std::vector<rule_t>& rules)
+{
+  _rules = rules;
+  uint8_t next = _active.load(std::memory_order_acquire) ^ 1;
+  // 前回の切替より前に読み始めた読み手が、これから書き換える面を参照し終えるまで待つ
+  // (読み手の登録と有効な面の確認との順序を保つため、ここは seq_cst とする)
+  while (_readers[next].load()) { M5.delay(1); }
+  compile(_table[next]);
+  _active.store(next);
+}
+
+bool midi_router_t::route(def::midi::output_port_t src_port, uint8_t& status, uint8_t& data1, uint8_t& data2, uint8_t& dst_mask) const
+{
+  if (status < 0x80 || src_port >= def::midi::out_port_max) { return false; }
+  uint8_t type = (status >> 4) - 8;
+  uint8_t ch = status & 0x0F;
+  // 参照する面を登録してから、その面がまだ有効であることを確かめる
+  // (登録の前に切り替わっていた場合は、その面が再構築される可能性があるため登録を取り消してやり直す)
+  uint8_t active;
+  for (;;) {
+    active = _active.load(std::memory_order_acquire);
+    _readers[active].fetch_add(1);
+    if (_active.load() == active) { break; }
+    _readers[active].fetch_sub(1, std::memory_order_release);
+  }
+  route_t route = _table[active][src_port][type][ch];
+  _readers[active].fetch_sub(1, std::memory_order_release);
+
+  dst_mask = route.dst_mask;
+  if (dst_mask == 0) { return false; }
+  if (type == def::midi::route_system) { return true; }
+
+  if (route.channel != channel_keep) {
+    status = (status & 0xF0) | (route.channel & 0x0F);
+  }
+  if (type <= def::midi::route_poly_pressure) {
+    int note = data1 + route.transpose;
+    // 音域外に移動したノートは破棄する
+    if (note < 0 || note > 127) { return false; }
+    data1 = note;
+    // ベロシティ0のノートオンはノートオフなので変換しない
+    if (type == def::midi::route_note_on && data2) {
+      data2 = _velocity_table[route.velocity][data2 & 0x7F];
+      if (data2 == 0) { data2 = 1; }
+    }
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_MIDI_ROUTER_HPP
+#define KANPLAY_MIDI_ROUTER_HPP
+
+/*
+midi_router は 外部MIDI入力のスルー経路を決定します。
+ - 入力ポート × メッセージ種別 × チャンネル 毎に、出力先ポートと変換(チャンネル変更/トランスポーズ/ベロシティカーブ/破棄)を持つ
+ - ルールの一覧からテーブルを事前に構築しておき、メッセージ毎の処理はテーブル参照のみで行う
+ - ルールは設定JSONから読み込まれ、後に書かれたルールが前のルールを上書きする
+*/
+
+#include "common_define.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class midi_router_t {
+public:
+  static constexpr const uint8_t channel_keep = 0xFF;
+  static constexpr const uint16_t all_channel = 0xFFFF;
+  static constexpr const uint8_t all_port = (1 << def::midi::out_port_max) - 1;
+
+  // ルーティングルール (設定JSONと対応する)
+  struct rule_t {
+    uint8_t src_mask = all_port;    // 対象とする入力ポート (bit毎)
+    uint8_t type_mask = 0xFF;       // 対象とするメッセージ種別 (route_type_t のbit毎)
+    uint16_t channel_mask = all_channel; // 対象とするチャンネル (bit毎)
+    uint8_t dst_mask = all_port;    // 出力先ポート (bit毎、0は破棄)
+    uint8_t channel = channel_keep; // 出力チャンネル (channel_keep は変更なし)
+    int8_t transpose = 0;           // ノート番号の移動量
+    def::midi::velocity_curve_t velocity = def::midi::velocity_linear;
+  };
+
+  midi_router_t(void);
+
+  // ルールを設定してテーブルを再構築する
+  void setRules(const std::vector<rule_t>& rules);
+  const std::vector<rule_t>& getRules(void) const { return _rules; }
+
+  // 入力メッセージを変換する。破棄する場合はfalseを返す
+  bool route(def::midi::output_port_t src_port, uint8_t& status, uint8_t& data1, uint8_t& data2, uint8_t& dst_mask) const;
+
+protected:
+  struct route_t {
+    uint8_t dst_mask;
+    uint8_t channel;
+    int8_t transpose;
+    uint8_t velocity;
+  };
+  using table_t = route_t[def::midi::out_port_max][def::midi::route_type_max][def::midi::channel_max];
+
+  void compile(table_t& table) const;
+
+  std::vector<rule_t> _rules;
+  // 再構築中も参照できるようテーブルを2面持ち、構築後に切り替える
+  // 切替前の面を参照中の読み手が残っている間は、その面を再構築しない (面毎に参照中の数を持つ)
+  table_t _table[2];
+  std::atomic<uint8_t> _active { 0 };
+  mutable std::atomic<uint32_t> _readers[2] { { 0 }, { 0 } };
+  uint8_t _velocity_table[def::midi::velocity_curve_max][128];
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_SAMPLE_CLOCK_HPP
+#define KANPLAY_SAMPLE_CLOCK_HPP
+
+#include "common_define.hpp"
+#include "double_buffer.hpp"
+
+#include <stdint.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+// I2S DMAブロック単位で進むサンプルクロック
+// task_i2s がブロック毎に publish し、演奏タスク等が読み出す (書き込みは1タスクのみ)
+// 64bitの値を整合性を保って読み出すため、スナップショット全体を2面バッファで受け渡す
+struct sample_clock_t {
+  struct snapshot_t {
+    uint64_t sample_count = 0; // 処理済みの総フレーム数
+    uint32_t block_usec = 0;   // 最新ブロックを取得した時点の M5.micros()
+    uint32_t block_frames = 0; // 最新ブロックのフレーム数
+    uint32_t sample_rate = def::audio::sample_rate_reference; // サンプリングレート (Hz)
+    uint32_t base_usec = 0;    // 現在のサンプリングレートに切り替えた時点のサンプルクロック基準の時刻
+    uint64_t base_count = 0;   // 現在のサンプリングレートに切り替えた時点の sample_count
+  };
+
+  // DMAブロックの処理毎に呼び出す
+  void publish(uint32_t frames, uint32_t usec) {
+    _latest.sample_count += frames;
+    _latest.block_usec = usec;
+    _latest.block_frames = frames;
+    _snapshot.publish(_latest);
+  }
+
+  // サンプリングレートを変更する (task_i2s のみが呼び出す)
+  // 時刻 (usec) が連続するよう、変更時点のサンプル位置と時刻を基準として以降の時刻を求める
+  void setSampleRate(uint32_t sample_rate) {
+    if (sample_rate == 0 || sample_rate == _latest.sample_rate) { return; }
+    _latest.base_usec += (uint32_t)((_latest.sample_count - _latest.base_count) * 1000000u / _latest.sample_rate);
+    _latest.base_count = _latest.sample_count;
+    _latest.sample_rate = sample_rate;
+    _snapshot.publish(_latest);
+  }
+
+  snapshot_t getSnapshot(void) const { return _snapshot.get(); }
+
+  uint64_t getSampleCount(void) const { return getSnapshot().sample_count; }
+  uint32_t getSampleRate(void) const { return getSnapshot().sample_rate; }
+
+  // サンプルクロックが進んでいるか否か (最新ブロックから一定時間以上経過していたら停止とみなす)
+  bool isRunning(uint32_t now_usec) const {
+    auto snap = getSnapshot();
+    if (snap.sample_count == 0) { return false; }
+    return (int32_t)(now_usec - snap.block_usec) < stall_threshold_usec;
+  }
+
+  // 現在時刻(M5.micros)に対応するサンプルクロック基準の時刻(usec)を得る
+  // ブロック間は CPUタイマで補間するが、1ブロック分を上限とするため単調増加が保たれる
+  uint32_t getUsec(uint32_t now_usec) const {
+    auto snap = getSnapshot();
+    int32_t diff = (int32_t)(now_usec - snap.block_usec);
+    uint32_t max_diff = (uint32_t)((uint64_t)snap.block_frames * 1000000u / snap.sample_rate);
+    if (diff < 0) { diff = 0; }
+    if ((uint32_t)diff > max_diff) { diff = max_diff; }
+    return snap.base_usec + (uint32_t)((snap.sample_count - snap.base_count) * 1000000u / snap.sample_rate) + diff;
+  }
+
+  // サンプルクロック基準の時刻(usec)をサンプル位置に変換する
+  // getUsecの戻り値は32bitで一周するため、現在のサンプル位置に近い側に展開する
+  uint64_t usecToSample(uint32_t usec) const {
+    auto snap = getSnapshot();
+    uint32_t base_usec = snap.base_usec + (uint32_t)((snap.sample_count - snap.base_count) * 1000000u / snap.sample_rate);
+    int64_t sample = (int64_t)snap.sample_count
+                   + (int64_t)(int32_t)(usec - base_usec) * snap.sample_rate / 1000000;
+    return sample < 0 ? 0 : (uint64_t)sample;
+  }
+
+protected:
+  static constexpr const int32_t stall_threshold_usec = 20000;
+  snapshot_t _latest;  // 書き込み側 (task_i2s) のみが参照する
+  double_buffer_t<snapshot_t> _snapshot;
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include <M5Unified.h>
+
+#include "song_transfer.hpp"
+
+#include "system_registry.hpp"
+#include "file_manage.hpp"
+
+#include <mutex>
+#include <string.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+using namespace midi_driver::sysex_transfer;
+
+std::atomic<song_transfer_t*> song_transfer_t::_owner { nullptr };
+
+// file_manage の分割書込みは1つの書込み先を共有するため、各ポートのサブタスクからの操作を直列化する
+// (引き継ぎ時に前の転送の書込み途中でファイルを閉じないようにする)
+static std::mutex transfer_mutex;
+
+// 応答の途絶えた転送は、他のポートからの開始要求で破棄できるようにする
+static constexpr const uint32_t transfer_timeout_msec = 3000;
+
+song_transfer_t::~song_transfer_t()
+{
+  cancel();
+}
+
+void song_transfer_t::sysexHandler(void* context, const uint8_t* data, size_t length, uint8_t flags)
+{
+  auto me = (song_transfer_t*)context;
+  if (flags & midi_driver::sysex_start) {
+    me->_rx_length = 0;
+    me->_rx_valid = true;
+  }
+  if (flags & midi_driver::sysex_abort) {
+    me->_rx_valid = false;
+    return;
+  }
+  if (!me->_rx_valid) { return; }
+  // 当プロトコルの最大長を超えるものは他の用途のシステムエクスクルーシブとして無視する
+  if (me->_rx_length + length > sizeof(me->_rx_buffer)) {
+    me->_rx_valid = false;
+    return;
+  }
+  memcpy(&me->_rx_buffer[me->_rx_length], data, length);
+  me->_rx_length += length;
+  if (flags & midi_driver::sysex_end) {
+    me->_rx_valid = false;
+    me->process(me->_rx_buffer, me->_rx_length);
+  }
+}
+
+size_t song_transfer_t::popReply(uint8_t* dst)
+{
+  size_t length = _reply_length;
+  if (length) {
+    memcpy(dst, _reply, length);
+    _reply_length = 0;
+  }
+  return length;
+}
+
+void song_transfer_t::setReply(status_t status, uint16_t seq)
+{
+  // 未送信の応答は最新のもので置き換える (ackは次に期待する番号を示すため、古いものは不要)
+  size_t pos = putHeader(_reply, cmd_ack, seq);
+  _reply[pos++] = status;
+  _reply[pos++] = window_size;
+  _reply[pos++] = 0xF7;
+  _reply_length = pos;
+}
+
+void song_transfer_t::cancel(void)
+{
+  std::lock_guard<std::mutex> lock(transfer_mutex);
+  if (isActive()) {
+    finish(false);
+  }
+}
+
+// transfer_mutex を保持した状態で呼び出すこと
+bool song_transfer_t::finish(bool commit)
+{
+  bool result = file_manage.endWriteFile(commit);
+  _owner.store(nullptr);
+  return result;
+}
+
+void song_transfer_t::process(const uint8_t* body, size_t length)
+{
+  command_t cmd;
+  uint16_t seq;
+  if (!parseHeader(body, length, &cmd, &seq)) { return; }
+  const uint8_t* payload = &body[header_length];
+  size_t payload_length = length - header_length;
+
+  std::lock_guard<std::mutex> lock(transfer_mutex);
+  switch (cmd) {
+  case cmd_begin:
+    processBegin(payload, payload_length);
+    break;
+
+  case cmd_data:
+    processData(seq, payload, payload_length);
+    break;
+
+  case cmd_end:
+    processEnd(seq, payload, payload_length);
+    break;
+
+  case cmd_abort:
+    if (isActive()) {
+      finish(false);
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+void song_transfer_t::processBegin(const uint8_t* payload, size_t length)
+{
+  if (length < 6) {
+    setReply(status_invalid, 0);
+    return;
+  }
+  auto dir_type = (def::app::data_type_t)payload[0];
+  uint32_t file_size = getValue7(&payload[1], 4);
+
+  char filename[filename_max + 1];
+  size_t name_len = length - 5;
+  if (name_len > filename_max) { name_len = filename_max; }
+  memcpy(filename, &payload[5], name_len);
+  filename[name_len] = 0;
+
+  // 保存先はユーザーソング・追加ソングのフォルダのみ。ディレクトリを含むファイル名は受け付けない
+  const size_t ext_len = strlen(def::app::fileext_song);
+  if ((dir_type != def::app::data_type_t::data_song_users && dir_type != def::app::data_type_t::data_song_extra)
+   || file_size == 0 || file_size > def::app::max_file_len
+   || filename[0] == '.' || strchr(filename, '/') != nullptr || strchr(filename, '\\') != nullptr
+   || name_len <= ext_len || strcmp(&filename[name_len - ext_len], def::app::fileext_song) != 0) {
+    setReply(status_invalid, 0);
+    return;
+  }
+
+  uint32_t msec = M5.millis();
+  song_transfer_t* owner = nullptr;
+  if (!_owner.compare_exchange_strong(owner, this) && owner != this) {
+    if (msec - owner->_last_msec < transfer_timeout_msec) {
+      setReply(status_busy, 0);
+      return;
+    }
+    // 応答の途絶えた転送を破棄して引き継ぐ (元のポートの書込みとは transfer_mutex で排他される)
+    owner->finish(false);
+    _owner.store(this);
+  } else if (owner == this) {
+    // 同じポートから再度開始された場合は前回の転送を破棄する
+    file_manage.endWriteFile(false);
+  }
+
+  if (!file_manage.beginWriteFile(dir_type, filename)) {
+    _owner.store(nullptr);
+    setReply(status_storage_error, 0);
+    return;
+  }
+  M5_LOGI("song transfer: begin %s size:%u", filename, (unsigned)file_size);
+  _file_size = file_size;
+  _received = 0;
+  _crc = 0;
+  _expected_seq = 0;
+  _nak_sent = false;
+  _last_msec = msec;
+  setReply(status_ok, 0);
+}
+
+bool song_transfer_t::needNak(uint16_t seq)
+{
+  // 要求済みの番号より後のものは、要求前に送られていたものとみなす
+  // 同じかそれ以前の番号が届いた場合は送り直しが始まっているため、再度要求できる
+  if (_nak_sent && ((seq - _nak_seq) & 0x3FFF) != 0 && ((seq - _nak_seq) & 0x3FFF) < 0x2000) {
+    return false;
+  }
+  _nak_sent = true;
+  _nak_seq = seq;
+  return true;
+}
+
+void song_transfer_t::processData(uint16_t seq, const uint8_t* payload, size_t length)
+{
+  if (!isActive()) {
+    setReply(status_invalid, seq);
+    return;
+  }
+  _last_msec = M5.millis();
+  if (seq != _expected_seq) {
+    if (((_expected_seq - seq) & 0x3FFF) < 0x2000) {
+      // 送り直しにより重複して届いたものは、次に期待する番号を改めて伝える
+      setReply(status_ok, _expected_seq);
+    } else if (needNak(seq)) {
+      // 取りこぼしの後に続くものは、送り直しが始まるまで1回だけ要求する
+      setReply(status_seq_error, _expected_seq);
+    }
+    return;
+  }
+
+  uint8_t chunk[chunk_size];
+  if (length < 4 || length - 3 > getPackedLength(chunk_size)) {
+    setReply(status_invalid, _expected_seq);
+    finish(false);
+    return;
+  }
+  size_t chunk_len = unpack7(chunk, payload, length - 3);
+  uint16_t crc = getValue7(&payload[length - 3], 3);
+  if (crc != crc16(chunk, chunk_len)) {
+    if (needNak(seq)) {
+      setReply(status_crc_error, _expected_seq);
+    }
+    return;
+  }
+  if (_received + chunk_len > _file_size) {
+    setReply(status_invalid, _expected_seq);
+    finish(false);
+    return;
+  }
+  if (file_manage.writeFile(chunk, chunk_len) != (int)chunk_len) {
+    M5_LOGE("song transfer: write failed");
+    setReply(status_storage_error, _expected_seq);
+    finish(false);
+    return;
+  }
+  _received += chunk_len;
+  _crc = crc32(chunk, chunk_len, _crc);
+  _expected_seq = (_expected_seq + 1) & 0x3FFF;
+  _nak_sent = false;
+  setReply(status_ok, _expected_seq);
+}
+
+void song_transfer_t::processEnd(uint16_t seq, const uint8_t* payload, size_t length)
+{
+  if (!isActive()) {
+    setReply(status_invalid, seq);
+    return;
+  }
+  if (seq != _expected_seq || length < 5
+   || _received != _file_size
+   || _crc != getValue7(payload, 5)) {
+    M5_LOGE("song transfer: verify failed. received:%u / %u", (unsigned)_received, (unsigned)_file_size);
+    setReply(status_invalid, _expected_seq);
+    finish(false);
+    return;
+  }
+  if (!finish(true)) {
+    M5_LOGE("song transfer: save failed");
+    setReply(status_storage_error, _expected_seq);
+    return;
+  }
+  M5_LOGI("song transfer: complete");
+  setReply(status_complete, _expected_seq);
+  system_registry->popup_notify.setPopup(true, def::notify_type_t::NOTIFY_FILE_SAVE);
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
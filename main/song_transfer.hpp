@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_SONG_TRANSFER_HPP
+#define KANPLAY_SONG_TRANSFER_HPP
+
+/*
+song_transfer は MIDI のシステムエクスクルーシブで送られたソングファイルを受信し保存します。
+ - プロトコルは midi/midi_sysex_transfer.hpp を参照
+ - 受信した data は都度 file_manage の分割書込みで保存し、ファイル全体をメモリに置かない
+ - 各MIDIポートのサブタスクが1つずつ持つが、同時に転送できるのは1ポートのみ
+*/
+
+#include "common_define.hpp"
+#include "midi/midi_sysex_transfer.hpp"
+
+#include <atomic>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class song_transfer_t {
+public:
+  ~song_transfer_t();
+
+  // MIDIDriver::setSysExHandler に登録するハンドラ
+  static void sysexHandler(void* context, const uint8_t* data, size_t length, uint8_t flags);
+
+  // 送信すべき応答があれば dst へ書き込み、その長さを返す (F0〜F7を含む)
+  size_t popReply(uint8_t* dst);
+
+  // 転送中であれば中止する (ポートの切断時など)
+  void cancel(void);
+
+  bool isActive(void) const { return _owner.load() == this; }
+
+protected:
+  void process(const uint8_t* body, size_t length);
+  void processBegin(const uint8_t* payload, size_t length);
+  void processData(uint16_t seq, const uint8_t* payload, size_t length);
+  void processEnd(uint16_t seq, const uint8_t* payload, size_t length);
+  void setReply(midi_driver::sysex_transfer::status_t status, uint16_t seq);
+  bool finish(bool commit);
+  bool needNak(uint16_t seq);
+
+  // 転送中のインスタンス (ファイルの分割書込みは同時に1つのみ)
+  static std::atomic<song_transfer_t*> _owner;
+
+  uint8_t _rx_buffer[midi_driver::sysex_transfer::message_max];
+  size_t _rx_length = 0;
+  bool _rx_valid = false;
+
+  uint8_t _reply[midi_driver::sysex_transfer::header_length + 4];
+  size_t _reply_length = 0;
+
+  uint32_t _file_size = 0;
+  uint32_t _received = 0;
+  uint32_t _crc = 0;
+  uint32_t _last_msec = 0;
+  uint16_t _expected_seq = 0;
+  uint16_t _nak_seq = 0;
+  bool _nak_sent = false;
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
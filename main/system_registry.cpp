@@ -108,6 +108,7 @@ void system_registry_t::init(void) {
   internal_imu.init();
   rgbled_control.init();
   midi_out_control.init();
+  midi_note_request.init();
   operator_command.init();
   player_command.init();
   chord_play.init();
@@ -294,6 +295,47 @@ void system_registry_t::reset(void) {
   // 運転モード (0: Instrument)
   user_setting.setAppRunMode(0);
 
+  // 演奏タイミングのサンプルクロック同期 (初期値はCPUタイマ基準)
+  user_setting.setPlaySampleClockSync(false);
+
+  // 同時発音数の上限 (初期値は管理可能な最大数・パート毎の上限なし)
+  user_setting.setVoiceLimitGlobal(def::app::max_voice);
+  user_setting.setVoiceLimitPart(0);
+  user_setting.setVoiceStealPolicy(def::play::voice_steal_policy_t::steal_oldest);
+
+  // 入力クオンタイズ (初期値は無効、有効にした場合の先読みは20msec)
+  user_setting.setQuantizeWindow(0);
+  user_setting.setQuantizeLookahead(20);
+
+  // 出力エフェクト (初期値は無効、各段は効果の無い設定)
+  user_setting.setEffectEnable(false);
+  user_setting.setEffectEqLow(0);
+  user_setting.setEffectEqMid(0);
+  user_setting.setEffectEqHigh(0);
+  user_setting.setEffectCompThreshold(0);
+  user_setting.setEffectCompRatio(1);
+  user_setting.setEffectReverbLevel(0);
+
+  // メトロノーム (初期値は無効、4拍子で小節の頭を強拍とする)
+  user_setting.setMetronomeMode(audio_metronome_t::mode_off);
+  user_setting.setMetronomeLevel(50);
+  user_setting.setMetronomeBeats(4);
+  user_setting.setMetronomeAccent(1);
+  user_setting.setMetronomeCountIn(0);
+
+  // I2S DMA (初期値は従来と同じ固定の大きさ。処理時間に応じた自動選択は設定で選んだ場合のみ)
+  user_setting.setAudioDmaFrames(audio_dma_tuner_t::frames_default);
+  user_setting.setAudioDmaDesc(def::audio::dma_desc_default);
+  user_setting.setAudioSampleRate(def::audio::sr_48000);
+
+  // 内蔵シンセ (初期値は無効)
+  user_setting.setSynthEnable(false);
+  user_setting.setSynthLevel(def::audio::synth_level_default);
+
+  // 発音の遅れ (未測定)
+  user_setting.setAudioLatencyMidiUsec(0);
+  user_setting.setAudioLatencyLoopUsec(0);
+
   // パターン編集時ベロシティ設定
   runtime_info.setEditVelocity(100);
 
@@ -306,6 +348,15 @@ void system_registry_t::reset(void) {
   // USBホスト時パワーサプライ
   midi_port_setting.setUSBPowerEnabled(true);
 
+  // 出力レイテンシ補正 (初期値は補正なし)
+  for (int i = 0; i < def::midi::out_port_max; ++i) {
+    midi_port_setting.setOutputLatency((def::midi::output_port_t)i, 0);
+  }
+  midi_port_setting.clearLatencyMeasure();
+
+  // MIDIルーティング (初期値はルール無し)
+  midi_router.setRules({});
+
   // マスターボリューム設定
   user_setting.setMasterVolume(75);
 
@@ -847,6 +898,123 @@ loadMappingInternal(system_registry_t::reg_command_mapping_t *mapping,
   return false;
 }
 
+static constexpr const char *midi_route_port_name[] = {
+    "internal", "port_c", "ble", "usb",
+};
+static constexpr const char *midi_route_type_name[] = {
+    "note_off", "note_on", "poly_pressure", "cc", "program", "channel_pressure", "pitch_bend", "system",
+};
+static constexpr const char *midi_route_velocity_name[] = {
+    "linear", "soft", "hard", "full",
+};
+
+static int findName(const char *const *names, size_t count, const char *name) {
+  if (name != nullptr) {
+    for (size_t i = 0; i < count; ++i) {
+      if (strcmp(names[i], name) == 0) {
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+
+// 名前の配列をビットマスクに変換する。キーが無い場合は default_mask を返す
+static uint32_t loadNameMask(const JsonVariantConst &json, const char *const *names,
+                             size_t count, uint32_t default_mask) {
+  if (!json.is<JsonArrayConst>()) {
+    return default_mask;
+  }
+  uint32_t mask = 0;
+  for (auto item : json.as<JsonArrayConst>()) {
+    auto name = item.as<const char *>();
+    int index = findName(names, count, name);
+    if (index >= 0) {
+      mask |= 1 << index;
+    } else if (name != nullptr && strcmp(name, "note") == 0 && names == midi_route_type_name) {
+      mask |= (1 << def::midi::route_note_off) | (1 << def::midi::route_note_on);
+    }
+  }
+  return mask;
+}
+
+static void saveNameMask(JsonObject &json, const char *key, const char *const *names,
+                         size_t count, uint32_t mask, uint32_t default_mask) {
+  if (mask == default_mask) {
+    return;
+  }
+  auto array = json[key].to<JsonArray>();
+  for (size_t i = 0; i < count; ++i) {
+    if (mask & (1 << i)) {
+      array.add(names[i]);
+    }
+  }
+}
+
+static void saveMidiRoutingInternal(const midi_router_t &router, JsonArray json) {
+  for (auto &rule : router.getRules()) {
+    auto obj = json.add<JsonObject>();
+    saveNameMask(obj, "src", midi_route_port_name, def::midi::out_port_max, rule.src_mask, midi_router_t::all_port);
+    saveNameMask(obj, "type", midi_route_type_name, def::midi::route_type_max, rule.type_mask, 0xFF);
+    if (rule.channel_mask != midi_router_t::all_channel) {
+      auto channel = obj["channel"].to<JsonArray>();
+      for (int ch = 0; ch < def::midi::channel_max; ++ch) {
+        if (rule.channel_mask & (1 << ch)) {
+          channel.add(ch + 1);
+        }
+      }
+    }
+    if (rule.dst_mask == 0) {
+      obj["drop"] = true;
+    } else {
+      saveNameMask(obj, "dst", midi_route_port_name, def::midi::out_port_max, rule.dst_mask, midi_router_t::all_port);
+    }
+    if (rule.channel != midi_router_t::channel_keep) {
+      obj["remap_channel"] = rule.channel + 1;
+    }
+    if (rule.transpose) {
+      obj["transpose"] = rule.transpose;
+    }
+    if (rule.velocity != def::midi::velocity_linear) {
+      obj["velocity"] = midi_route_velocity_name[rule.velocity];
+    }
+  }
+}
+
+static void loadMidiRoutingInternal(midi_router_t &router, const JsonArrayConst &json) {
+  std::vector<midi_router_t::rule_t> rules;
+  for (auto obj : json) {
+    midi_router_t::rule_t rule;
+    rule.src_mask = loadNameMask(obj["src"], midi_route_port_name, def::midi::out_port_max, midi_router_t::all_port);
+    rule.type_mask = loadNameMask(obj["type"], midi_route_type_name, def::midi::route_type_max, 0xFF);
+    if (obj["channel"].is<JsonArrayConst>()) {
+      rule.channel_mask = 0;
+      for (auto ch : obj["channel"].as<JsonArrayConst>()) {
+        int c = ch.as<int>();
+        if (c >= 1 && c <= def::midi::channel_max) {
+          rule.channel_mask |= 1 << (c - 1);
+        }
+      }
+    }
+    rule.dst_mask = loadNameMask(obj["dst"], midi_route_port_name, def::midi::out_port_max, midi_router_t::all_port);
+    if (obj["drop"].as<bool>()) {
+      rule.dst_mask = 0;
+    }
+    int channel = obj["remap_channel"] | 0;
+    if (channel >= 1 && channel <= def::midi::channel_max) {
+      rule.channel = channel - 1;
+    }
+    int transpose = obj["transpose"] | 0;
+    rule.transpose = transpose < -127 ? -127 : (transpose > 127 ? 127 : transpose);
+    int velocity = findName(midi_route_velocity_name, def::midi::velocity_curve_max, obj["velocity"].as<const char *>());
+    if (velocity >= 0) {
+      rule.velocity = (def::midi::velocity_curve_t)velocity;
+    }
+    rules.push_back(rule);
+  }
+  router.setRules(rules);
+}
+
 //-------------------------------------------------------------------------
 bool system_registry_t::saveSettingInternal(JsonVariant &json_root) {
   {
@@ -855,7 +1023,7 @@ bool system_registry_t::saveSettingInternal(JsonVariant &json_root) {
     json["display_brightness"] = user_setting.getDisplayBrightness();
     json["language"] = (uint8_t)user_setting.getLanguage();
     json["gui_detail_mode"] = user_setting.getGuiDetailMode();
-    json["gui_wave_view"] = user_setting.getGuiWaveView();
+    json["gui_wave_view"] = (uint8_t)user_setting.getGuiWaveView();
     json["master_volume"] = user_setting.getMasterVolume();
     json["midi_master_volume"] = user_setting.getMIDIMasterVolume();
     json["adc_mic_amp"] = user_setting.getADCMicAmp();
@@ -864,6 +1032,31 @@ bool system_registry_t::saveSettingInternal(JsonVariant &json_root) {
     json["chattering_threshold"] = user_setting.getChatteringThreshold();
     json["timezone"] = user_setting.getTimeZone();
     json["app_run_mode"] = user_setting.getAppRunMode();
+    json["play_sample_clock_sync"] = user_setting.getPlaySampleClockSync();
+    json["voice_limit_global"] = user_setting.getVoiceLimitGlobal();
+    json["voice_limit_part"] = user_setting.getVoiceLimitPart();
+    json["voice_steal_policy"] = (uint8_t)user_setting.getVoiceStealPolicy();
+    json["quantize_window"] = user_setting.getQuantizeWindow();
+    json["quantize_lookahead"] = user_setting.getQuantizeLookahead();
+    json["effect_enable"] = user_setting.getEffectEnable();
+    json["effect_eq_low"] = user_setting.getEffectEqLow();
+    json["effect_eq_mid"] = user_setting.getEffectEqMid();
+    json["effect_eq_high"] = user_setting.getEffectEqHigh();
+    json["effect_comp_threshold"] = user_setting.getEffectCompThreshold();
+    json["effect_comp_ratio"] = user_setting.getEffectCompRatio();
+    json["effect_reverb_level"] = user_setting.getEffectReverbLevel();
+    json["metronome_mode"] = user_setting.getMetronomeMode();
+    json["metronome_level"] = user_setting.getMetronomeLevel();
+    json["metronome_beats"] = user_setting.getMetronomeBeats();
+    json["metronome_accent"] = user_setting.getMetronomeAccent();
+    json["metronome_count_in"] = user_setting.getMetronomeCountIn();
+    json["audio_dma_frames"] = user_setting.getAudioDmaFrames();
+    json["audio_dma_desc"] = user_setting.getAudioDmaDesc();
+    json["synth_enable"] = user_setting.getSynthEnable();
+    json["synth_level"] = user_setting.getSynthLevel();
+    json["audio_latency_midi_usec"] = user_setting.getAudioLatencyMidiUsec();
+    json["audio_latency_loop_usec"] = user_setting.getAudioLatencyLoopUsec();
+    json["audio_sample_rate"] = def::audio::sample_rate_hz[user_setting.getAudioSampleRate()];
   }
 
   {
@@ -874,8 +1067,14 @@ bool system_registry_t::saveSettingInternal(JsonVariant &json_root) {
         (uint8_t)midi_port_setting.getInstaChordLinkStyle();
     json["usb_mode"] = (uint8_t)midi_port_setting.getUSBMode();
     json["usb_power"] = (uint8_t)midi_port_setting.getUSBPowerEnabled();
+    auto output_latency = json["output_latency"].to<JsonArray>();
+    for (int i = 0; i < def::midi::out_port_max; ++i) {
+      output_latency.add(midi_port_setting.getOutputLatency((def::midi::output_port_t)i));
+    }
   }
 
+  saveMidiRoutingInternal(midi_router, json_root["midi_routing"].to<JsonArray>());
+
   /* 以下廃止、新仕様では control_mapping に統一
     auto json_key_mapping = json_root["key_mapping"].to<JsonObject>();
     {
@@ -927,7 +1126,12 @@ bool system_registry_t::loadSettingInternal(JsonVariant &json_root) {
     user_setting.setLanguage(
         (def::lang::language_t)json["language"].as<uint8_t>());
     user_setting.setGuiDetailMode(json["gui_detail_mode"].as<bool>());
-    user_setting.setGuiWaveView(json["gui_wave_view"].as<bool>());
+    // 以前の設定ファイルでは true/false で保存されている
+    if (json["gui_wave_view"].is<bool>()) {
+      user_setting.setGuiWaveView(json["gui_wave_view"].as<bool>() ? def::wv_wave : def::wv_off);
+    } else {
+      user_setting.setGuiWaveView(json["gui_wave_view"].as<uint8_t>());
+    }
     user_setting.setMasterVolume(json["master_volume"].as<uint8_t>());
     user_setting.setMIDIMasterVolume(json["midi_master_volume"].as<uint8_t>());
     user_setting.setADCMicAmp(json["adc_mic_amp"].as<uint8_t>());
@@ -938,6 +1142,50 @@ bool system_registry_t::loadSettingInternal(JsonVariant &json_root) {
         json["chattering_threshold"].as<uint8_t>());
     user_setting.setTimeZone(json["timezone"].as<int8_t>());
     user_setting.setAppRunMode(json["app_run_mode"].as<uint8_t>());
+    user_setting.setPlaySampleClockSync(json["play_sample_clock_sync"].as<bool>());
+    user_setting.setVoiceLimitGlobal(json["voice_limit_global"].as<uint8_t>());
+    user_setting.setVoiceLimitPart(json["voice_limit_part"].as<uint8_t>());
+    user_setting.setVoiceStealPolicy(
+        (def::play::voice_steal_policy_t)json["voice_steal_policy"].as<uint8_t>());
+    user_setting.setQuantizeWindow(json["quantize_window"].as<uint8_t>());
+    if (json["quantize_lookahead"].is<uint8_t>()) {
+      user_setting.setQuantizeLookahead(json["quantize_lookahead"].as<uint8_t>());
+    }
+    user_setting.setEffectEnable(json["effect_enable"].as<bool>());
+    user_setting.setEffectEqLow(json["effect_eq_low"].as<int8_t>());
+    user_setting.setEffectEqMid(json["effect_eq_mid"].as<int8_t>());
+    user_setting.setEffectEqHigh(json["effect_eq_high"].as<int8_t>());
+    user_setting.setEffectCompThreshold(json["effect_comp_threshold"].as<uint8_t>());
+    user_setting.setEffectCompRatio(json["effect_comp_ratio"].as<uint8_t>());
+    user_setting.setEffectReverbLevel(json["effect_reverb_level"].as<uint8_t>());
+    if (json["metronome_mode"].is<uint8_t>()) {
+      user_setting.setMetronomeMode(json["metronome_mode"].as<uint8_t>());
+      user_setting.setMetronomeLevel(json["metronome_level"].as<uint8_t>());
+      user_setting.setMetronomeBeats(json["metronome_beats"].as<uint8_t>());
+      user_setting.setMetronomeAccent(json["metronome_accent"].as<uint8_t>());
+      user_setting.setMetronomeCountIn(json["metronome_count_in"].as<uint8_t>());
+    }
+    if (json["audio_dma_desc"].is<uint8_t>()) {
+      user_setting.setAudioDmaFrames(json["audio_dma_frames"].as<uint8_t>());
+      user_setting.setAudioDmaDesc(json["audio_dma_desc"].as<uint8_t>());
+    }
+    if (json["synth_level"].is<uint8_t>()) {
+      user_setting.setSynthEnable(json["synth_enable"].as<bool>());
+      user_setting.setSynthLevel(json["synth_level"].as<uint8_t>());
+    }
+    if (json["audio_latency_midi_usec"].is<uint16_t>()) {
+      user_setting.setAudioLatencyMidiUsec(json["audio_latency_midi_usec"].as<uint16_t>());
+      user_setting.setAudioLatencyLoopUsec(json["audio_latency_loop_usec"].as<uint16_t>());
+    }
+    if (json["audio_sample_rate"].is<uint32_t>()) {
+      // 保存値は Hz とし、選択肢に無い値は 48kHz とする
+      uint32_t hz = json["audio_sample_rate"].as<uint32_t>();
+      uint8_t rate = def::audio::sr_48000;
+      for (uint8_t i = 0; i < def::audio::sr_max; ++i) {
+        if (def::audio::sample_rate_hz[i] == hz) { rate = i; }
+      }
+      user_setting.setAudioSampleRate(rate);
+    }
   }
   {
     auto json = json_root["midi_port_setting"].as<JsonObject>();
@@ -950,8 +1198,20 @@ bool system_registry_t::loadSettingInternal(JsonVariant &json_root) {
     midi_port_setting.setUSBMode(
         (def::command::usb_mode_t)json["usb_mode"].as<uint8_t>());
     midi_port_setting.setUSBPowerEnabled(json["usb_power"].as<bool>());
+    if (json["output_latency"].is<JsonArray>()) {
+      auto output_latency = json["output_latency"].as<JsonArray>();
+      int i = 0;
+      for (auto msec : output_latency) {
+        if (i >= def::midi::out_port_max) { break; }
+        midi_port_setting.setOutputLatency((def::midi::output_port_t)i, msec.as<uint8_t>());
+        ++i;
+      }
+    }
   }
 
+  // 項目が無い場合はルール無し (全ての入力を全ての出力へスルー)
+  loadMidiRoutingInternal(midi_router, json_root["midi_routing"].as<JsonArrayConst>());
+
   {
     // control_assignment::play button ( 旧名 key mapping )
     auto json_key_mapping = json_root["key_mapping"].as<JsonObject>();
@@ -10,9 +10,18 @@
 
 #include "common_define.hpp"
 #include "registry.hpp"
+#include "midi_router.hpp"
+#include "audio_metronome.hpp"
+#include "audio_analyzer.hpp"
+#include "audio_dma_tuner.hpp"
+#include "audio_block_ring.hpp"
+#include "midi_out_control.hpp"
+#include "double_buffer.hpp"
+#include "sample_clock.hpp"
 
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <stdio.h>
 #include <string.h>
@@ -101,7 +110,7 @@ public:
   // ユーザー設定で変更される情報
   // ユーザーが設定する情報で、終了時に保存され起動時に再現される情報
   struct reg_user_setting_t : public registry_t {
-    reg_user_setting_t(void) : registry_t(16, 0, DATA_SIZE_8) {}
+    reg_user_setting_t(void) : registry_t(48, 0, DATA_SIZE_8) {}
     enum index_t : uint16_t {
       LED_BRIGHTNESS,
       DISPLAY_BRIGHTNESS,
@@ -116,7 +125,36 @@ public:
       CHATTERING_THRESHOLD,
       TIMEZONE,
       APP_RUN_MODE,
+      PLAY_SAMPLE_CLOCK_SYNC,
+      VOICE_LIMIT_GLOBAL,
+      VOICE_LIMIT_PART,
+      VOICE_STEAL_POLICY,
+      QUANTIZE_WINDOW,
+      EFFECT_ENABLE,
+      EFFECT_EQ_LOW,
+      EFFECT_EQ_MID,
+      EFFECT_EQ_HIGH,
+      EFFECT_COMP_THRESHOLD,
+      EFFECT_COMP_RATIO,
+      EFFECT_REVERB_LEVEL,
+      METRONOME_MODE,
+      METRONOME_LEVEL,
+      METRONOME_BEATS,
+      METRONOME_ACCENT,
+      METRONOME_COUNT_IN,
+      AUDIO_DMA_FRAMES,
+      AUDIO_DMA_DESC,
+      SYNTH_ENABLE,
+      SYNTH_LEVEL,
+      AUDIO_LATENCY_MIDI_USEC_L,
+      AUDIO_LATENCY_MIDI_USEC_H,
+      AUDIO_LATENCY_LOOP_USEC_L,
+      AUDIO_LATENCY_LOOP_USEC_H,
+      AUDIO_SAMPLE_RATE,
+      QUANTIZE_LOOKAHEAD,
     };
+    static_assert((AUDIO_LATENCY_MIDI_USEC_L & 1) == 0, "16bit value must be aligned");
+    static_assert((AUDIO_LATENCY_LOOP_USEC_L & 1) == 0, "16bit value must be aligned");
 
     // ディスプレイの明るさ
     void setDisplayBrightness(uint8_t brightness) {
@@ -144,9 +182,9 @@ public:
     void setGuiDetailMode(bool enabled) { set8(GUI_DETAIL_MODE, enabled); }
     bool getGuiDetailMode(void) const { return get8(GUI_DETAIL_MODE); }
 
-    // GUIの波形モニター表示
-    void setGuiWaveView(bool enabled) { set8(GUI_WAVE_VIEW, enabled); }
-    bool getGuiWaveView(void) const { return get8(GUI_WAVE_VIEW); }
+    // GUIの波形モニター表示 (def::gui_wave_view_t)
+    void setGuiWaveView(uint8_t mode) { set8(GUI_WAVE_VIEW, mode < def::wv_max ? mode : def::wv_off); }
+    def::gui_wave_view_t getGuiWaveView(void) const { return (def::gui_wave_view_t)get8(GUI_WAVE_VIEW); }
 
     // 現在の全体ボリューム (0-100)
     void setMasterVolume(uint8_t volume) {
@@ -196,11 +234,153 @@ public:
     // Core run mode (0: Instrument, 1: ROS2 Bridge)
     void setAppRunMode(uint8_t mode) { set8(APP_RUN_MODE, mode); }
     uint8_t getAppRunMode(void) const { return get8(APP_RUN_MODE); }
+
+    // 演奏タイミングの基準をI2Sのサンプルクロックに同期するか否か
+    // (false=CPUタイマ(M5.micros) / true=I2S DMAのサンプルカウンタ)
+    void setPlaySampleClockSync(bool enabled) {
+      set8(PLAY_SAMPLE_CLOCK_SYNC, enabled);
+    }
+    bool getPlaySampleClockSync(void) const {
+      return get8(PLAY_SAMPLE_CLOCK_SYNC);
+    }
+
+    // 全体の同時発音数の上限 (1~def::app::max_voice 。範囲外の値は最大値とする)
+    void setVoiceLimitGlobal(uint8_t limit) {
+      if (limit == 0 || limit > def::app::max_voice) {
+        limit = def::app::max_voice;
+      }
+      set8(VOICE_LIMIT_GLOBAL, limit);
+    }
+    uint8_t getVoiceLimitGlobal(void) const { return get8(VOICE_LIMIT_GLOBAL); }
+
+    // パート毎の同時発音数の上限 (0はパート毎の上限なし、全体の上限のみを適用する)
+    void setVoiceLimitPart(uint8_t limit) {
+      if (limit > def::app::max_voice) {
+        limit = def::app::max_voice;
+      }
+      set8(VOICE_LIMIT_PART, limit);
+    }
+    uint8_t getVoiceLimitPart(void) const { return get8(VOICE_LIMIT_PART); }
+
+    // 発音数の上限を超えた時に停止させる音の選び方
+    void setVoiceStealPolicy(def::play::voice_steal_policy_t policy) {
+      if (policy >= def::play::voice_steal_policy_t::steal_policy_max) {
+        policy = def::play::voice_steal_policy_t::steal_oldest;
+      }
+      set8(VOICE_STEAL_POLICY, policy);
+    }
+    def::play::voice_steal_policy_t getVoiceStealPolicy(void) const {
+      return (def::play::voice_steal_policy_t)get8(VOICE_STEAL_POLICY);
+    }
+
+    // 入力クオンタイズの許容幅(msec) ビートの前後この範囲内の入力をビート位置に寄せる (0は無効)
+    void setQuantizeWindow(uint8_t msec) {
+      set8(QUANTIZE_WINDOW, std::min<uint8_t>(msec, def::app::quantize_window_msec_max));
+    }
+    uint8_t getQuantizeWindow(void) const { return get8(QUANTIZE_WINDOW); }
+
+    // 入力クオンタイズの先読み時間(msec) 手動演奏の発音をこの時間だけ遅らせ、ビートより遅い入力も寄せられるようにする
+    void setQuantizeLookahead(uint8_t msec) {
+      set8(QUANTIZE_LOOKAHEAD, std::min<uint8_t>(msec, def::app::quantize_lookahead_msec_max));
+    }
+    uint8_t getQuantizeLookahead(void) const { return get8(QUANTIZE_LOOKAHEAD); }
+
+    // 出力エフェクト (EQ / コンプレッサ / リバーブ) の有効/無効
+    void setEffectEnable(bool enabled) { set8(EFFECT_ENABLE, enabled); }
+    bool getEffectEnable(void) const { return get8(EFFECT_ENABLE); }
+
+    // EQの各バンドの増減量 (dB, ±effect_eq_db_max)
+    void setEffectEqLow(int8_t db) { set8(EFFECT_EQ_LOW, clampEqDb(db)); }
+    int8_t getEffectEqLow(void) const { return get8(EFFECT_EQ_LOW); }
+    void setEffectEqMid(int8_t db) { set8(EFFECT_EQ_MID, clampEqDb(db)); }
+    int8_t getEffectEqMid(void) const { return get8(EFFECT_EQ_MID); }
+    void setEffectEqHigh(int8_t db) { set8(EFFECT_EQ_HIGH, clampEqDb(db)); }
+    int8_t getEffectEqHigh(void) const { return get8(EFFECT_EQ_HIGH); }
+
+    // コンプレッサの閾値 (フルスケールから下げる dB)
+    void setEffectCompThreshold(uint8_t db) {
+      set8(EFFECT_COMP_THRESHOLD, std::min<uint8_t>(db, def::audio::effect_comp_threshold_db_max));
+    }
+    uint8_t getEffectCompThreshold(void) const { return get8(EFFECT_COMP_THRESHOLD); }
+
+    // コンプレッサの圧縮比 (1で無効、最大値でリミッタ)
+    void setEffectCompRatio(uint8_t ratio) {
+      set8(EFFECT_COMP_RATIO, std::min<uint8_t>(std::max<uint8_t>(ratio, 1), def::audio::effect_comp_ratio_max));
+    }
+    uint8_t getEffectCompRatio(void) const { return get8(EFFECT_COMP_RATIO); }
+
+    // リバーブの量 (0-100、0で無効)
+    void setEffectReverbLevel(uint8_t level) {
+      set8(EFFECT_REVERB_LEVEL, std::min<uint8_t>(level, 100));
+    }
+    uint8_t getEffectReverbLevel(void) const { return get8(EFFECT_REVERB_LEVEL); }
+
+    // メトロノームの動作 (audio_metronome_t::mode_t)
+    void setMetronomeMode(uint8_t mode) {
+      set8(METRONOME_MODE, mode <= audio_metronome_t::mode_count_in_only ? mode : audio_metronome_t::mode_off);
+    }
+    uint8_t getMetronomeMode(void) const { return get8(METRONOME_MODE); }
+
+    // メトロノームの音量 (0-100)
+    void setMetronomeLevel(uint8_t level) { set8(METRONOME_LEVEL, std::min<uint8_t>(level, 100)); }
+    uint8_t getMetronomeLevel(void) const { return get8(METRONOME_LEVEL); }
+
+    // メトロノームの1小節の拍数
+    void setMetronomeBeats(uint8_t beats) {
+      set8(METRONOME_BEATS, std::min<uint8_t>(std::max<uint8_t>(beats, 1), def::app::metronome_beats_max));
+    }
+    uint8_t getMetronomeBeats(void) const { return get8(METRONOME_BEATS); }
+
+    // メトロノームで強拍とする小節内の拍 (bit0 が小節の頭)
+    void setMetronomeAccent(uint8_t mask) { set8(METRONOME_ACCENT, mask); }
+    uint8_t getMetronomeAccent(void) const { return get8(METRONOME_ACCENT); }
+
+    // 自動演奏の開始前に鳴らすカウントインの小節数 (0は無し)
+    void setMetronomeCountIn(uint8_t bars) {
+      set8(METRONOME_COUNT_IN, std::min<uint8_t>(bars, def::app::metronome_count_in_max));
+    }
+    uint8_t getMetronomeCountIn(void) const { return get8(METRONOME_COUNT_IN); }
+
+    // I2S DMAの1ブロックのフレーム数 (0は処理時間に応じて自動で選択する)
+    void setAudioDmaFrames(uint8_t frames) {
+      set8(AUDIO_DMA_FRAMES, std::min<uint8_t>(frames, audio_dma_tuner_t::frames_max));
+    }
+    uint8_t getAudioDmaFrames(void) const { return get8(AUDIO_DMA_FRAMES); }
+
+    // I2S DMAのディスクリプタ数 (キューに保持するブロック数)
+    void setAudioDmaDesc(uint8_t desc) {
+      set8(AUDIO_DMA_DESC, std::min<uint8_t>(std::max<uint8_t>(desc, def::audio::dma_desc_min), def::audio::dma_desc_max));
+    }
+    uint8_t getAudioDmaDesc(void) const { return get8(AUDIO_DMA_DESC); }
+
+    // サンプリングレート (def::audio::sample_rate_t)
+    void setAudioSampleRate(uint8_t rate) { set8(AUDIO_SAMPLE_RATE, rate < def::audio::sr_max ? rate : def::audio::sr_48000); }
+    def::audio::sample_rate_t getAudioSampleRate(void) const { return (def::audio::sample_rate_t)get8(AUDIO_SAMPLE_RATE); }
+
+    // 内蔵シンセで演奏を発音する
+    void setSynthEnable(bool enable) { set8(SYNTH_ENABLE, enable); }
+    bool getSynthEnable(void) const { return get8(SYNTH_ENABLE); }
+
+    // 内蔵シンセの音量 (0-100)
+    void setSynthLevel(uint8_t level) { set8(SYNTH_LEVEL, std::min<uint8_t>(level, 100)); }
+    uint8_t getSynthLevel(void) const { return get8(SYNTH_LEVEL); }
+
+    // 測定した発音の遅れ (中央値、usec、0は未測定)
+    // MIDI : 内部MIDIのノートから内蔵音源の音が入力に現れるまで / LOOP : 出力から入力へ折り返すまで
+    void setAudioLatencyMidiUsec(uint16_t usec) { set16(AUDIO_LATENCY_MIDI_USEC_L, usec); }
+    uint16_t getAudioLatencyMidiUsec(void) const { return get16(AUDIO_LATENCY_MIDI_USEC_L); }
+    void setAudioLatencyLoopUsec(uint16_t usec) { set16(AUDIO_LATENCY_LOOP_USEC_L, usec); }
+    uint16_t getAudioLatencyLoopUsec(void) const { return get16(AUDIO_LATENCY_LOOP_USEC_L); }
+
+  private:
+    static int8_t clampEqDb(int8_t db) {
+      return std::min<int8_t>(std::max<int8_t>(db, -def::audio::effect_eq_db_max), def::audio::effect_eq_db_max);
+    }
   } user_setting;
 
   // MIDIポートに関する設定情報
   struct reg_midi_port_setting_t : public registry_t {
-    reg_midi_port_setting_t(void) : registry_t(8, 0, DATA_SIZE_8) {}
+    reg_midi_port_setting_t(void) : registry_t(16, 0, DATA_SIZE_8) {}
     enum index_t : uint16_t {
       PORT_C_MIDI,
       BLE_MIDI,
@@ -210,6 +390,11 @@ public:
       INSTACHORD_LINK_STYLE,
       USB_POWER_ENABLED, // USB給電 オン・オフ
       USB_MODE,          // USBモード(Host/Device)
+      OUTPUT_LATENCY_INTERNAL, // 出力レイテンシ 内部MIDI (msec)
+      OUTPUT_LATENCY_PORT_C,   // 出力レイテンシ PortC (msec)
+      OUTPUT_LATENCY_BLE,      // 出力レイテンシ BLE (msec)
+      OUTPUT_LATENCY_USB,      // 出力レイテンシ USB (msec)
+      LATENCY_MEASURE,         // レイテンシ測定要求 (0:なし 1~:ポート番号+1) ※保存しない
     };
     void setPortCMIDI(def::command::ex_midi_mode_t mode) {
       set8(PORT_C_MIDI, static_cast<uint8_t>(mode));
@@ -267,11 +452,32 @@ public:
     def::command::usb_mode_t getUSBMode(void) const {
       return static_cast<def::command::usb_mode_t>(get8(USB_MODE));
     }
+
+    // 各出力ポートの出力レイテンシ。最も遅いポートに揃うよう他のポートの送信を遅延させる
+    void setOutputLatency(def::midi::output_port_t port, uint8_t msec) {
+      if (port >= def::midi::out_port_max) { return; }
+      if (msec > def::midi::output_latency_msec_max) { msec = def::midi::output_latency_msec_max; }
+      set8(OUTPUT_LATENCY_INTERNAL + port, msec);
+    }
+    uint8_t getOutputLatency(def::midi::output_port_t port) const {
+      if (port >= def::midi::out_port_max) { return 0; }
+      return get8(OUTPUT_LATENCY_INTERNAL + port);
+    }
+
+    // ループバック接続によるレイテンシ測定の要求
+    void requestLatencyMeasure(def::midi::output_port_t port) { set8(LATENCY_MEASURE, port + 1); }
+    void clearLatencyMeasure(void) { set8(LATENCY_MEASURE, 0); }
+    bool getLatencyMeasure(def::midi::output_port_t* port) const {
+      uint8_t value = get8(LATENCY_MEASURE);
+      if (value == 0) { return false; }
+      *port = static_cast<def::midi::output_port_t>(value - 1);
+      return true;
+    }
   } midi_port_setting;
 
   // 実行時に変化する保存されない情報 (設定画面が存在しない可変情報)
   struct reg_runtime_info_t : public registry_t {
-    reg_runtime_info_t(void) : registry_t(48, 0, DATA_SIZE_8) {}
+    reg_runtime_info_t(void) : registry_t(96, 0, DATA_SIZE_8) {}
     enum index_t : uint16_t {
       SEQUENCE_STEP_L,
       SEQUENCE_STEP_H,
@@ -316,10 +522,63 @@ public:
       MIDI_RX_COUNT_BLE,
       MIDI_TX_COUNT_USB,
       MIDI_RX_COUNT_USB,
+      MIDI_TX_BACKLOG_INTERNAL,
+      MIDI_TX_BACKLOG_PC,
       CHORD_MINOR_SWAP_PRESS_COUNT,
       CHORD_SEMITONE_FLAT_PRESS_COUNT,
       CHORD_SEMITONE_SHARP_PRESS_COUNT,
+      VOICE_STEAL_COUNT,
+      QUANTIZE_LATENCY,
+      QUANTIZE_CORRECTION,
+      LOOPER_STATE,
+      AUDIO_EFFECT_LOAD,
+      AUDIO_EFFECT_OVERRUN,
+      RECORDER_STATE,
+      RECORDER_OVERRUN,
+      RECORDER_UNDERRUN,
+      AUDIO_ANALYZER_LOAD,
+      AUDIO_DMA_FRAMES,
+      AUDIO_DMA_DESC,
+      AUDIO_BLOCK_WORST_USEC_L,
+      AUDIO_BLOCK_WORST_USEC_H,
+      AUDIO_UNDERRUN,
+      AUDIO_LATE_BLOCK,
+      AUDIO_LAST_UNDERRUN_MSEC_0,
+      AUDIO_LAST_UNDERRUN_MSEC_1,
+      AUDIO_LAST_UNDERRUN_MSEC_2,
+      AUDIO_LAST_UNDERRUN_MSEC_3,
+      AUDIO_LAST_LATE_BLOCK_MSEC_0,
+      AUDIO_LAST_LATE_BLOCK_MSEC_1,
+      AUDIO_LAST_LATE_BLOCK_MSEC_2,
+      AUDIO_LAST_LATE_BLOCK_MSEC_3,
+      SYNTH_VOICE_CAPACITY,
+      SYNTH_VOICE_LIMIT,
+      SYNTH_ACTIVE_VOICES,
+      SYNTH_LOAD,
+      LATENCY_STATE,
+      LATENCY_PROGRESS,
+      LATENCY_MIN_USEC_L,
+      LATENCY_MIN_USEC_H,
+      LATENCY_MEDIAN_USEC_L,
+      LATENCY_MEDIAN_USEC_H,
+      LATENCY_MAX_USEC_L,
+      LATENCY_MAX_USEC_H,
+      LATENCY_JITTER_USEC_L,
+      LATENCY_JITTER_USEC_H,
+      MIDI_INTERNAL_DELAY,
+      AUDIO_CLOCK_RATE,
+      MIDI_OUT_OVERRUN,
+      MIDI_COALESCE_COUNT_INTERNAL,
+      MIDI_COALESCE_COUNT_PC,
+      MIDI_SYSEX_DROP_COUNT_PC,
+      MIDI_SYSEX_DROP_COUNT_BLE,
+      MIDI_SYSEX_DROP_COUNT_USB,
+      AUDIO_RATE_SWITCH_FAIL_COUNT,
     };
+    static_assert((AUDIO_BLOCK_WORST_USEC_L & 1) == 0, "16bit value must be aligned");
+    static_assert((AUDIO_LAST_UNDERRUN_MSEC_0 & 3) == 0, "32bit value must be aligned");
+    static_assert((AUDIO_LAST_LATE_BLOCK_MSEC_0 & 3) == 0, "32bit value must be aligned");
+    static_assert((LATENCY_MIN_USEC_L & 1) == 0, "16bit value must be aligned");
 
     // 音が鳴ったパートへの発光エフェクト設定
     void hitPartEffect(uint8_t part_index) {
@@ -576,6 +835,147 @@ public:
     void setMidiRxCountUSB(uint8_t count) { set8(MIDI_RX_COUNT_USB, count); }
     uint8_t getMidiRxCountUSB(void) const { return get8(MIDI_RX_COUNT_USB); }
 
+    // 内部MIDI 送信待ちの送出時間の直近の最大値 (msec)
+    void setMidiTxBacklogInternal(uint8_t msec) { set8(MIDI_TX_BACKLOG_INTERNAL, msec); }
+    uint8_t getMidiTxBacklogInternal(void) const { return get8(MIDI_TX_BACKLOG_INTERNAL); }
+
+    // ポートC MIDI 送信待ちの送出時間の直近の最大値 (msec)
+    void setMidiTxBacklogPC(uint8_t msec) { set8(MIDI_TX_BACKLOG_PC, msec); }
+    // 出力レイテンシ補正により内部MIDIの送信に加えている遅延 (msec)
+    void setMidiInternalDelay(uint8_t msec) { set8(MIDI_INTERNAL_DELAY, msec); }
+    uint8_t getMidiInternalDelay(void) const { return get8(MIDI_INTERNAL_DELAY); }
+    // コーデックへ供給しているクロックのサンプリングレート (def::audio::sample_rate_t)
+    // task_i2c がクロックを切り替えた後に更新し、task_i2s がこれに合わせて I2S と各処理を設定し直す
+    void setAudioClockRate(uint8_t rate) { set8(AUDIO_CLOCK_RATE, rate); }
+    def::audio::sample_rate_t getAudioClockRate(void) const { return (def::audio::sample_rate_t)get8(AUDIO_CLOCK_RATE); }
+    uint8_t getMidiTxBacklogPC(void) const { return get8(MIDI_TX_BACKLOG_PC); }
+
+    // 送信メッセージの配信用リングで、読み出しが書込みに追い越された回数 (下位8bitのみ)
+    void setMidiOutOverrunCount(uint8_t count) { set8(MIDI_OUT_OVERRUN, count); }
+    uint8_t getMidiOutOverrunCount(void) const { return get8(MIDI_OUT_OVERRUN); }
+
+    // 送信が滞った際に間引いたメッセージの数 (下位8bitのみ)
+    void setMidiCoalesceCountInternal(uint8_t count) { set8(MIDI_COALESCE_COUNT_INTERNAL, count); }
+    uint8_t getMidiCoalesceCountInternal(void) const { return get8(MIDI_COALESCE_COUNT_INTERNAL); }
+    void setMidiCoalesceCountPC(uint8_t count) { set8(MIDI_COALESCE_COUNT_PC, count); }
+    uint8_t getMidiCoalesceCountPC(void) const { return get8(MIDI_COALESCE_COUNT_PC); }
+
+    // 受信バッファの上限を超えたため破棄したシステムエクスクルーシブの数 (下位8bitのみ)
+    void setMidiSysExDropCountPC(uint8_t count) { set8(MIDI_SYSEX_DROP_COUNT_PC, count); }
+    uint8_t getMidiSysExDropCountPC(void) const { return get8(MIDI_SYSEX_DROP_COUNT_PC); }
+    void setMidiSysExDropCountBLE(uint8_t count) { set8(MIDI_SYSEX_DROP_COUNT_BLE, count); }
+    uint8_t getMidiSysExDropCountBLE(void) const { return get8(MIDI_SYSEX_DROP_COUNT_BLE); }
+    void setMidiSysExDropCountUSB(uint8_t count) { set8(MIDI_SYSEX_DROP_COUNT_USB, count); }
+    uint8_t getMidiSysExDropCountUSB(void) const { return get8(MIDI_SYSEX_DROP_COUNT_USB); }
+
+    // サンプリングレートの切替えに失敗し、設定を元に戻した回数 (下位8bitのみ)
+    void setAudioRateSwitchFailCount(uint8_t count) { set8(AUDIO_RATE_SWITCH_FAIL_COUNT, count); }
+    uint8_t getAudioRateSwitchFailCount(void) const { return get8(AUDIO_RATE_SWITCH_FAIL_COUNT); }
+
+    // 同時発音数の上限によって停止させた音の数 (下位8bitのみ)
+    void setVoiceStealCount(uint8_t count) { set8(VOICE_STEAL_COUNT, count); }
+    uint8_t getVoiceStealCount(void) const { return get8(VOICE_STEAL_COUNT); }
+
+    // 入力クオンタイズにより付加された遅延の平均値 (msec)
+    void setQuantizeLatency(uint8_t msec) { set8(QUANTIZE_LATENCY, msec); }
+    uint8_t getQuantizeLatency(void) const { return get8(QUANTIZE_LATENCY); }
+
+    // 入力クオンタイズで分割位置に寄せた入力の、寄せる前のタイミング誤差の平均値 (msec)
+    void setQuantizeCorrection(uint8_t msec) { set8(QUANTIZE_CORRECTION, msec); }
+    uint8_t getQuantizeCorrection(void) const { return get8(QUANTIZE_CORRECTION); }
+
+    // ルーパーの状態 (looper_t::state_t)
+    void setLooperState(uint8_t state) { set8(LOOPER_STATE, state); }
+    uint8_t getLooperState(void) const { return get8(LOOPER_STATE); }
+
+    // 出力エフェクトの処理時間の直近の最大値 (DMAブロック周期に対する %)
+    void setAudioEffectLoad(uint8_t percent) { set8(AUDIO_EFFECT_LOAD, percent); }
+    uint8_t getAudioEffectLoad(void) const { return get8(AUDIO_EFFECT_LOAD); }
+
+    // 出力エフェクトが処理時間の予算を超過した回数 (下位8bitのみ)
+    void setAudioEffectOverrun(uint8_t count) { set8(AUDIO_EFFECT_OVERRUN, count); }
+    uint8_t getAudioEffectOverrun(void) const { return get8(AUDIO_EFFECT_OVERRUN); }
+
+    // 出力音声の解析処理の時間の直近の最大値 (DMAブロック周期に対する %。I2Sタスクとは別のタスクで処理する)
+    void setAudioAnalyzerLoad(uint8_t percent) { set8(AUDIO_ANALYZER_LOAD, percent); }
+    uint8_t getAudioAnalyzerLoad(void) const { return get8(AUDIO_ANALYZER_LOAD); }
+
+    // I2S DMAの現在の1ブロックのフレーム数とディスクリプタ数
+    void setAudioDmaGeometry(uint8_t frames, uint8_t desc) {
+      set8(AUDIO_DMA_FRAMES, frames);
+      set8(AUDIO_DMA_DESC, desc);
+    }
+    uint8_t getAudioDmaFrames(void) const { return get8(AUDIO_DMA_FRAMES); }
+    uint8_t getAudioDmaDesc(void) const { return get8(AUDIO_DMA_DESC); }
+
+    // I2Sタスクの1ブロックの処理時間の直近の最悪値 (usec)
+    void setAudioBlockWorstUsec(uint16_t usec) { set16(AUDIO_BLOCK_WORST_USEC_L, usec); }
+    uint16_t getAudioBlockWorstUsec(void) const { return get16(AUDIO_BLOCK_WORST_USEC_L); }
+
+    // I2S DMAのアンダーラン (キューの溢れ) の回数 (下位8bitのみ) と最後に発生した時刻 (M5.millis)
+    void setAudioUnderrun(uint8_t count, uint32_t msec) {
+      set32(AUDIO_LAST_UNDERRUN_MSEC_0, msec);
+      set8(AUDIO_UNDERRUN, count);
+    }
+    uint8_t getAudioUnderrun(void) const { return get8(AUDIO_UNDERRUN); }
+    uint32_t getAudioLastUnderrunMsec(void) const { return get32(AUDIO_LAST_UNDERRUN_MSEC_0); }
+
+    // 処理がブロックの周期に間に合わなかった回数 (下位8bitのみ) と最後に発生した時刻 (M5.millis)
+    void setAudioLateBlock(uint8_t count, uint32_t msec) {
+      set32(AUDIO_LAST_LATE_BLOCK_MSEC_0, msec);
+      set8(AUDIO_LATE_BLOCK, count);
+    }
+    uint8_t getAudioLateBlock(void) const { return get8(AUDIO_LATE_BLOCK); }
+    uint32_t getAudioLastLateBlockMsec(void) const { return get32(AUDIO_LAST_LATE_BLOCK_MSEC_0); }
+
+    // 内蔵シンセの起動時のベンチマークによる、CPUコア1つで発音できるボイス数の推定値 (255で頭打ち)
+    void setSynthVoiceCapacity(uint8_t voices) { set8(SYNTH_VOICE_CAPACITY, voices); }
+    uint8_t getSynthVoiceCapacity(void) const { return get8(SYNTH_VOICE_CAPACITY); }
+
+    // 内蔵シンセの処理時間の予算から決まるボイス数の上限と、直近の最大発音数
+    void setSynthVoices(uint8_t limit, uint8_t active) {
+      set8(SYNTH_VOICE_LIMIT, limit);
+      set8(SYNTH_ACTIVE_VOICES, active);
+    }
+    uint8_t getSynthVoiceLimit(void) const { return get8(SYNTH_VOICE_LIMIT); }
+    uint8_t getSynthActiveVoices(void) const { return get8(SYNTH_ACTIVE_VOICES); }
+
+    // 内蔵シンセの処理時間の直近の最大値 (DMAブロック周期に対する %)
+    void setSynthLoad(uint8_t percent) { set8(SYNTH_LOAD, percent); }
+    uint8_t getSynthLoad(void) const { return get8(SYNTH_LOAD); }
+
+    // 発音の遅れの測定の状態 (audio_latency_t::state_t) と完了した回数
+    void setLatencyState(uint8_t state, uint8_t progress) {
+      set8(LATENCY_PROGRESS, progress);
+      set8(LATENCY_STATE, state);
+    }
+    uint8_t getLatencyState(void) const { return get8(LATENCY_STATE); }
+    uint8_t getLatencyProgress(void) const { return get8(LATENCY_PROGRESS); }
+
+    // 発音の遅れの測定結果 (usec)
+    void setLatencyResult(uint16_t min_usec, uint16_t median_usec, uint16_t max_usec, uint16_t jitter_usec) {
+      set16(LATENCY_MIN_USEC_L, min_usec);
+      set16(LATENCY_MEDIAN_USEC_L, median_usec);
+      set16(LATENCY_MAX_USEC_L, max_usec);
+      set16(LATENCY_JITTER_USEC_L, jitter_usec);
+    }
+    uint16_t getLatencyMinUsec(void) const { return get16(LATENCY_MIN_USEC_L); }
+    uint16_t getLatencyMedianUsec(void) const { return get16(LATENCY_MEDIAN_USEC_L); }
+    uint16_t getLatencyMaxUsec(void) const { return get16(LATENCY_MAX_USEC_L); }
+    uint16_t getLatencyJitterUsec(void) const { return get16(LATENCY_JITTER_USEC_L); }
+
+    // オーディオ録音の状態 (audio_recorder_t::state_t)
+    void setRecorderState(uint8_t state) { set8(RECORDER_STATE, state); }
+    uint8_t getRecorderState(void) const { return get8(RECORDER_STATE); }
+
+    // 録音のリングバッファが溢れて破棄したブロック数 (下位8bitのみ)
+    void setRecorderOverrun(uint8_t count) { set8(RECORDER_OVERRUN, count); }
+    uint8_t getRecorderOverrun(void) const { return get8(RECORDER_OVERRUN); }
+
+    // 録音の書込みが音声の長さ以上に停滞した回数 (下位8bitのみ)
+    void setRecorderUnderrun(uint8_t count) { set8(RECORDER_UNDERRUN, count); }
+    uint8_t getRecorderUnderrun(void) const { return get8(RECORDER_UNDERRUN); }
+
     // 現在のシーケンスのステップ位置
     uint16_t getSequenceStepIndex(void) const { return get16(SEQUENCE_STEP_L); }
     void setSequenceStepIndex(uint16_t step_index) {
@@ -861,53 +1261,18 @@ public:
   };
 
   // MIDI出力コントロール
-  struct reg_midi_out_control_t : public registry_base_t {
+  reg_midi_out_control_t midi_out_control;
+
+  // 外部から要求された発音 (演奏タスクが voice_manager を経由して midi_out_control へ出力する)
+  struct reg_midi_note_request_t : public registry_base_t {
     // 読み出しには非対応、値をセットすると履歴として取得できる
-    reg_midi_out_control_t(void) : registry_base_t(256) {}
+    reg_midi_note_request_t(void) : registry_base_t(64) {}
 
-    void setMessage(uint8_t status, uint8_t data1, uint8_t data2 = 0) {
-      set16(status, data1 + (data2 << 8), true);
-    }
+    // value は bit7 が立っていればノートオン、下位7bitがベロシティ
     void setNoteVelocity(uint8_t channel, uint8_t note, uint8_t value) {
-      uint8_t status = 0x80 + ((value & 0x80) >> 3);
-      setMessage((status | channel), note, value & 0x7F);
-    }
-    void setProgramChange(uint8_t channel, uint8_t value) {
-      if (_program_number[channel] == value) {
-        return;
-      }
-      _program_number[channel] = value;
-      uint8_t status = 0xC0;
-      setMessage((status | channel), value);
+      set16(channel, note + (value << 8), true);
     }
-    void setControlChange(uint8_t channel, uint8_t control, uint8_t value) {
-      uint8_t status = 0xB0;
-      setMessage((status | channel), control, value);
-    }
-    void setChannelVolume(uint8_t channel, uint8_t value) {
-      if (_channel_volume[channel] == value) {
-        return;
-      }
-      _channel_volume[channel] = value;
-      setControlChange(channel, 7, value);
-    }
-    uint8_t getProgramChange(uint8_t channel) const {
-      return _program_number[channel] & 0x7F;
-    }
-    uint8_t getChannelVolume(uint8_t channel) const {
-      return _channel_volume[channel] & 0x7F;
-    }
-
-  protected:
-    uint8_t _channel_volume[def::midi::channel_max] = {
-        128, 128, 128, 128, 128, 128, 128, 128,
-        128, 128, 128, 128, 128, 128, 128, 128,
-    };
-    uint8_t _program_number[def::midi::channel_max] = {
-        128, 128, 128, 128, 128, 128, 128, 128,
-        128, 128, 128, 128, 128, 128, 128, 128,
-    };
-  } midi_out_control;
+  } midi_note_request;
 
   // コード演奏アルペジオパターン
   struct reg_arpeggio_table_t : public registry_t {
@@ -1932,11 +2297,43 @@ public:
 
   void checkSongModified(void) const;
 
+  // 波形表示用のピークの履歴。task_i2s の monitor タスクが audio_block_ring から求めて要素を書き込んだ後に raw_wave_pos を更新し、GUI が読み出す
   static constexpr const size_t raw_wave_length = 320;
   std::pair<uint8_t, uint8_t> raw_wave[raw_wave_length] = {
       {128, 128},
   };
-  uint16_t raw_wave_pos = 0;
+  std::atomic<uint16_t> raw_wave_pos { 0 };
+
+  // task_i2s が処理したDMAブロック (エフェクト適用後、マスターボリューム適用前の信号)
+  // 書き手は task_i2s のみ。波形表示・解析などの読み手はそれぞれ reader_t を持ち、コピーせずに参照する
+  // task_i2s の開始前に init する
+  audio_block_ring_t audio_block_ring;
+
+  // I2S DMAブロック単位で進むサンプルクロック
+  // task_i2s がブロック毎に publish し、演奏タスク等が読み出す (書き込みは1タスクのみ)
+  sample_clock_t sample_clock;
+
+  // 演奏エンジンの拍のタイミング (サンプルクロック基準)
+  // task_kantanplay が拍毎に publish し、task_i2s がメトロノームの合成に使用する (書き込みは1タスクのみ)
+  struct beat_clock_t {
+    using timeline_t = audio_metronome_t::timeline_t;
+
+    void publish(const timeline_t& timeline) { _timeline.publish(timeline); }
+    // 優先度の高い task_i2s から呼び出すため、書き込み中でも待たずに直前の値を返す
+    timeline_t getTimeline(void) const { return _timeline.get(); }
+
+  protected:
+    double_buffer_t<timeline_t> _timeline;
+  } beat_clock;
+
+  // 出力音声の解析結果 (スペクトル・レベルメータ)
+  // task_i2s の monitor タスクが更新毎に publish し、GUI が読み出す (書き込みは1タスクのみ)
+  struct audio_analysis_t : public double_buffer_t<audio_analyzer_t::result_t> {
+    using result_t = audio_analyzer_t::result_t;
+  } audio_analysis;
+
+  // 外部MIDI入力のスルー経路 (設定JSONの midi_routing から構築する)
+  midi_router_t midi_router;
 
 protected:
   // 変更前のソングデータのCRC32値 (変更検出用)
@@ -7,6 +7,16 @@
 
 #include "common_define.hpp"
 #include "system_registry.hpp"
+#include "audio_kernel.hpp"
+#include "audio_effect.hpp"
+#include "audio_recorder.hpp"
+#include "audio_metronome.hpp"
+#include "audio_analyzer.hpp"
+#include "audio_dma_tuner.hpp"
+#include "audio_synth.hpp"
+#include "audio_latency.hpp"
+
+#include <atomic>
 
 #if !defined (M5UNIFIED_PC_BUILD)
 
@@ -15,18 +25,85 @@
 #else
  #include <driver/i2s.h>
 #endif
+#include <esp_timer.h>
+
+#else
+
+#include <stdio.h>
+#include <stdlib.h>
 
 #endif
 
 namespace kanplay_ns {
 //-------------------------------------------------------------------------
 
-static constexpr const uint16_t i2s_dma_frame_num = 96;
+static audio_synth_t synth;
+static uint32_t synth_cost_nsec = 0;
+
+static uint32_t _synth_get_usec(void) { return M5.micros(); }
+
+// 計測した処理時間から、CPUコア1つで発音できるボイス数を求める
+static void _synth_publish_capacity(uint32_t sample_rate)
+{
+  uint32_t period_nsec = (uint32_t)((uint64_t)audio_dma_tuner_t::frames_default * 1000000000u / sample_rate);
+  uint32_t capacity = synth_cost_nsec ? period_nsec / synth_cost_nsec : 0;
+  M5_LOGI("synth: %u nsec/voice/block, %u voices per core", (unsigned)synth_cost_nsec, (unsigned)capacity);
+  system_registry->runtime_info.setSynthVoiceCapacity(capacity < 255 ? capacity : 255);
+}
+
+// 起動時に内蔵シンセの処理時間を計測する
+static void _synth_benchmark(int32_t* buf, uint32_t sample_rate)
+{
+  synth.setup(sample_rate);
+  synth_cost_nsec = synth.benchmark(buf, audio_dma_tuner_t::frames_default, def::audio::synth_benchmark_blocks, _synth_get_usec);
+  _synth_publish_capacity(sample_rate);
+}
+
+// 処理時間の予算 (基準のサンプリングレートの frames_default 分のブロックに対する値) をブロックの長さに比例させる
+static uint32_t _scale_budget(uint32_t budget_usec, uint32_t frames, uint32_t sample_rate)
+{
+  return (uint32_t)((uint64_t)budget_usec * frames * def::audio::sample_rate_reference
+                    / ((uint64_t)audio_dma_tuner_t::frames_default * sample_rate));
+}
+
+// midi_out_control の履歴から内蔵シンセへ演奏を渡す
+static void _synth_poll(registry_t::history_code_t &history_code)
+{
+  const registry_t::history_t* history;
+  while (nullptr != (history = system_registry->midi_out_control.getHistory(history_code))) {
+    // 出力先ポートを限定したメッセージは外部機器に向けたものなので鳴らさない
+    if (history->value >> 16) { continue; }
+    uint8_t status = history->index & 0xFF;
+    if (status < 0x80 || status >= 0xF0) { continue; }
+    synth.message(status, history->value & 0xFF, (history->value >> 8) & 0xFF);
+  }
+}
+
+// 内蔵シンセを有効にした時点の音色と音量を反映し、それ以前の演奏は鳴らさない
+static void _synth_start(registry_t::history_code_t &history_code)
+{
+  history_code = system_registry->midi_out_control.getHistoryCode();
+  synth.reset();
+  auto& moc = system_registry->midi_out_control;
+  for (uint8_t ch = 0; ch < audio_synth_t::channel_max; ++ch) {
+    if (moc.hasProgramChange(ch)) { synth.message(0xC0 | ch, moc.getProgramChange(ch), 0); }
+    if (moc.hasChannelVolume(ch)) { synth.message(0xB0 | ch, 7, moc.getChannelVolume(ch)); }
+  }
+}
 
 #if !defined (M5UNIFIED_PC_BUILD)
 
 static constexpr const i2s_port_t i2s_port = I2S_NUM_1;
-static constexpr const uint16_t i2s_dma_desc_num = 4;
+
+// DMAキューの溢れ (アンダーラン) の回数と最後に発生した時刻 (msec)。ISRまたはI2Sタスクから更新する
+static std::atomic<uint32_t> _underrun_count { 0 };
+static std::atomic<uint32_t> _underrun_msec { 0 };
+
+static void IRAM_ATTR _count_underrun(void)
+{
+  _underrun_msec.store((uint32_t)(esp_timer_get_time() / 1000), std::memory_order_relaxed);
+  _underrun_count.fetch_add(1, std::memory_order_relaxed);
+}
 
 static const size_t overwrap = 0;
 // static int32_t bufdata[overwrap + i2s_dma_frame_num];
@@ -36,13 +113,26 @@ static const size_t overwrap = 0;
 
 static i2s_chan_handle_t _i2s_tx_handle = nullptr;
 static i2s_chan_handle_t _i2s_rx_handle = nullptr;
-static esp_err_t _i2s_init(void)
+
+// 送信キューの溢れ (書込みが間に合わず、送信済みのデータを再送する) / 受信キューの溢れ (読出しが間に合わず、受信データを失う)
+static bool IRAM_ATTR _i2s_on_queue_overflow(i2s_chan_handle_t /*handle*/, i2s_event_data_t* /*event*/, void* /*user_ctx*/)
+{
+  _count_underrun();
+  return false;
+}
+
+static esp_err_t _i2s_init(const audio_dma_tuner_t::geometry_t& geometry)
 {
   i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG((i2s_port_t)i2s_port, I2S_ROLE_SLAVE);
-  chan_cfg.dma_desc_num = i2s_dma_desc_num;
-  chan_cfg.dma_frame_num = i2s_dma_frame_num >> 1;
+  chan_cfg.dma_desc_num = geometry.desc;
+  chan_cfg.dma_frame_num = geometry.frames;
   esp_err_t err = i2s_new_channel(&chan_cfg, &_i2s_tx_handle, &_i2s_rx_handle);
-  if (err != ESP_OK) { return err; }
+  if (err != ESP_OK) {
+    M5_LOGE("i2s_new_channel: %d", err);
+    _i2s_tx_handle = nullptr;
+    _i2s_rx_handle = nullptr;
+    return err;
+  }
   i2s_std_config_t i2s_config;
   memset(&i2s_config, 0, sizeof(i2s_std_config_t));
   i2s_config.clk_cfg.clk_src = i2s_clock_src_t::I2S_CLK_SRC_PLL_160M;
@@ -67,12 +157,36 @@ static esp_err_t _i2s_init(void)
   i2s_config.gpio_cfg.dout = def::hw::pin::i2s_out;
   i2s_config.gpio_cfg.mclk = def::hw::pin::i2s_mclk;
   i2s_config.gpio_cfg.din  = def::hw::pin::i2s_in;
-  err = i2s_channel_init_std_mode(_i2s_tx_handle, &i2s_config);
-  err = i2s_channel_init_std_mode(_i2s_rx_handle, &i2s_config);
+  if (ESP_OK != (err = i2s_channel_init_std_mode(_i2s_tx_handle, &i2s_config))
+   || ESP_OK != (err = i2s_channel_init_std_mode(_i2s_rx_handle, &i2s_config))) {
+    M5_LOGE("i2s_channel_init_std_mode: %d", err);
+    return err;
+  }
+
+  i2s_event_callbacks_t tx_cbs = {};
+  tx_cbs.on_send_q_ovf = _i2s_on_queue_overflow;
+  i2s_channel_register_event_callback(_i2s_tx_handle, &tx_cbs, nullptr);
+  i2s_event_callbacks_t rx_cbs = {};
+  rx_cbs.on_recv_q_ovf = _i2s_on_queue_overflow;
+  i2s_channel_register_event_callback(_i2s_rx_handle, &rx_cbs, nullptr);
 
   return ESP_OK;
 }
 
+static void _i2s_deinit(void)
+{
+  if (_i2s_tx_handle == nullptr) { return; }
+  i2s_channel_disable(_i2s_tx_handle);
+  i2s_channel_disable(_i2s_rx_handle);
+  i2s_del_channel(_i2s_tx_handle);
+  i2s_del_channel(_i2s_rx_handle);
+  _i2s_tx_handle = nullptr;
+  _i2s_rx_handle = nullptr;
+}
+
+// キューの溢れはコールバックで数えるため、ここでは何もしない
+static void _i2s_poll_events(void) {}
+
 static esp_err_t _i2s_start(void) {
   if (_i2s_tx_handle == nullptr) { return ESP_FAIL; }
   return i2s_channel_enable(_i2s_tx_handle) || i2s_channel_enable(_i2s_rx_handle);
@@ -88,7 +202,9 @@ static esp_err_t _i2s_read(void* buf, size_t len, size_t* result, TickType_t tic
 
 #else
 
-static esp_err_t _i2s_init(void)
+static QueueHandle_t _i2s_event_queue = nullptr;
+
+static esp_err_t _i2s_init(const audio_dma_tuner_t::geometry_t& geometry)
 {
     i2s_config_t i2s_config;
     memset(&i2s_config, 0, sizeof(i2s_config_t));
@@ -104,14 +220,14 @@ static esp_err_t _i2s_init(void)
     i2s_config.mclk_multiple        = i2s_mclk_multiple_t::I2S_MCLK_MULTIPLE_DEFAULT;
     i2s_config.bits_per_chan        = i2s_bits_per_chan_t::I2S_BITS_PER_CHAN_32BIT;
 #if I2S_DRIVER_VERSION > 1
-    i2s_config.dma_desc_num         = i2s_dma_desc_num;
-    i2s_config.dma_frame_num        = i2s_dma_frame_num >> 1;
+    i2s_config.dma_desc_num         = geometry.desc;
+    i2s_config.dma_frame_num        = geometry.frames;
 #else
-    i2s_config.dma_buf_count        = i2s_dma_desc_num;
-    i2s_config.dma_buf_len          = i2s_dma_frame_num >> 1;
+    i2s_config.dma_buf_count        = geometry.desc;
+    i2s_config.dma_buf_len          = geometry.frames;
 #endif
     esp_err_t err;
-    if (ESP_OK != (err = i2s_driver_install(i2s_port, &i2s_config, 0, nullptr)))
+    if (ESP_OK != (err = i2s_driver_install(i2s_port, &i2s_config, 8, &_i2s_event_queue)))
     {
       M5_LOGE("i2s_driver_install: %d", err);
       return err;
@@ -138,6 +254,24 @@ static esp_err_t _i2s_start(void) {
   return i2s_start(i2s_port);
 }
 
+static void _i2s_deinit(void)
+{
+  i2s_driver_uninstall(i2s_port);
+  _i2s_event_queue = nullptr;
+}
+
+// ドライバのイベントキューからキューの溢れを数える
+static void _i2s_poll_events(void)
+{
+  if (_i2s_event_queue == nullptr) { return; }
+  i2s_event_t event;
+  while (xQueueReceive(_i2s_event_queue, &event, 0) == pdTRUE) {
+    if (event.type == I2S_EVENT_TX_Q_OVF || event.type == I2S_EVENT_RX_Q_OVF) {
+      _count_underrun();
+    }
+  }
+}
+
 static esp_err_t _i2s_write(void* buf, size_t len, size_t* result, TickType_t tick) {
   return i2s_write(i2s_port, buf, len, result, tick);
 }
@@ -151,7 +285,143 @@ static esp_err_t _i2s_read(void* buf, size_t len, size_t* result, TickType_t tic
 #endif
 
 static int32_t* bufdata = nullptr;
-static constexpr const size_t buf_size = (i2s_dma_frame_num) * sizeof(int32_t);
+// 選択できる最大の DMAブロック分を確保する
+static constexpr const size_t buf_size = audio_dma_tuner_t::frames_max * 2 * sizeof(int32_t);
+
+#if !defined (M5UNIFIED_PC_BUILD)
+// 指定した DMAの大きさで I2S を開始する (送信側は無音で満たしてから開始する)
+// 開始できなかった場合は途中まで確保したものを解放し、falseを返す
+static bool _i2s_begin(const audio_dma_tuner_t::geometry_t& geometry, int32_t* buf)
+{
+  esp_err_t err = _i2s_init(geometry);
+#if __has_include(<driver/i2s_std.h>)
+  if (err == ESP_OK) {
+    const size_t block_bytes = geometry.frames * 2 * sizeof(int32_t);
+    memset(buf, 0, block_bytes);
+    size_t transfer_size = 0;
+    do {
+      err = i2s_channel_preload_data(_i2s_tx_handle, buf, block_bytes, &transfer_size);
+    } while (err == ESP_OK && transfer_size == block_bytes);
+    if (err != ESP_OK) { M5_LOGE("i2s_channel_preload_data: %d", err); }
+  }
+#endif
+  if (err == ESP_OK && ESP_OK != (err = _i2s_start())) {
+    M5_LOGE("i2s start: %d", err);
+  }
+  if (err != ESP_OK) {
+    _i2s_deinit();
+    return false;
+  }
+  system_registry->runtime_info.setAudioDmaGeometry(geometry.frames, geometry.desc);
+  return true;
+}
+#endif
+
+#if !defined (M5UNIFIED_PC_BUILD)
+// 録音データをSDカードへ書き込むタスク。I2Sタスクはリングバッファへ書き込むのみで、ファイル操作を待たない
+static void recorder_task_func(void*)
+{
+  for (;;) {
+    if (audio_recorder.process()) { continue; }
+    system_registry->runtime_info.setRecorderState(audio_recorder.getState());
+    system_registry->runtime_info.setRecorderOverrun(audio_recorder.getOverrunCount());
+    system_registry->runtime_info.setRecorderUnderrun(audio_recorder.getUnderrunCount());
+    M5.delay(10);
+  }
+}
+
+static TaskHandle_t monitor_task_handle = nullptr;
+#endif
+
+// 共有リングバッファから出力音声を読み出し、波形表示のピークとスペクトル解析を行うタスク
+// I2Sタスクはリングバッファへ書き込んでこのタスクを起こすのみで、表示のための処理を行わない
+static void monitor_task_func(void*)
+{
+  static audio_analyzer_t analyzer;
+  // 参照中に上書きされても処理が乱れないよう、ブロックを複写してから処理する
+  static int32_t block_buf[audio_dma_tuner_t::frames_max * 2];
+  auto& ring = system_registry->audio_block_ring;
+  audio_block_ring_t::reader_t reader;
+  ring.attach(reader);
+  uint32_t overrun = 0;
+
+  bool analyzer_active = false;
+  uint32_t analyzer_load_max = 0;
+  uint32_t analyzer_publish_msec = M5.millis();
+  audio_peak_t wave_peak = { 0, 0 };
+  uint32_t wave_frames = 0;
+
+  for (;;) {
+#if defined (M5UNIFIED_PC_BUILD)
+    M5.delay(2);
+#else
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#endif
+    audio_block_ring_t::block_t block;
+    while (ring.acquire(reader, block)) {
+      const uint32_t frames = block.frames;
+      memcpy(block_buf, block.data, frames * 2 * sizeof(int32_t));
+      bool valid = ring.release(reader);
+      if (overrun != reader.overrun) {
+        // 読み飛ばしたブロックがある場合は、途切れた信号がスペクトルへ混ざらないよう解析をやり直す
+        overrun = reader.overrun;
+        analyzer.reset();
+      }
+      if (!valid || frames == 0) { continue; }
+
+      // 波形表示の横軸の時間がDMAの大きさで変わらないよう、frames_default 分を1つにまとめる
+      if (wave_frames == 0) {
+        wave_peak.min_level = INT32_MAX;
+        wave_peak.max_level = INT32_MIN;
+      }
+      for (uint32_t i = 0; i < frames * 2; ++i) {
+        int32_t v = block_buf[i];
+        if (wave_peak.min_level > v) { wave_peak.min_level = v; }
+        if (wave_peak.max_level < v) { wave_peak.max_level = v; }
+      }
+      wave_frames += frames;
+      if (wave_frames >= audio_dma_tuner_t::frames_default) {
+        wave_frames = 0;
+        int32_t min_level = ((wave_peak.min_level >> 16) + 32768 + 128) >> 8;
+        int32_t max_level = ((wave_peak.max_level >> 16) + 32768 + 128) >> 8;
+
+        auto wav_buf = system_registry->raw_wave;
+        uint16_t raw_wave_pos = system_registry->raw_wave_pos.load(std::memory_order_relaxed);
+        wav_buf[raw_wave_pos ++] = std::make_pair<uint8_t, uint8_t>(min_level, max_level);
+
+        if (raw_wave_pos >= (system_registry->raw_wave_length)) {
+          raw_wave_pos = 0;
+        }
+        system_registry->raw_wave_pos.store(raw_wave_pos, std::memory_order_release);
+      }
+
+      // スペクトル表示中のみ出力音声を解析する (録音と同じくマスターボリューム適用前の信号とする)
+      if (system_registry->user_setting.getGuiWaveView() == def::wv_spectrum) {
+        uint32_t sample_rate = system_registry->sample_clock.getSampleRate();
+        analyzer.setup(sample_rate);
+        analyzer_active = true;
+        uint32_t start_usec = M5.micros();
+        if (analyzer.process(block_buf, frames)) {
+          system_registry->audio_analysis.publish(analyzer.getResult());
+        }
+        uint32_t elapsed = M5.micros() - start_usec;
+        uint32_t period_usec = (uint32_t)((uint64_t)frames * 1000000u / sample_rate);
+        uint32_t load = elapsed * 100 / period_usec;
+        if (analyzer_load_max < load) { analyzer_load_max = load; }
+      } else if (analyzer_active) {
+        // 表示を再開した際に古い履歴がメータへ混ざらないようにする
+        analyzer_active = false;
+        analyzer.reset();
+      }
+    }
+    uint32_t msec = M5.millis();
+    if (msec - analyzer_publish_msec >= def::audio::effect_load_publish_msec) {
+      analyzer_publish_msec = msec;
+      system_registry->runtime_info.setAudioAnalyzerLoad(analyzer_load_max < 255 ? analyzer_load_max : 255);
+      analyzer_load_max = 0;
+    }
+  }
+}
 
 bool task_i2s_t::start(void)
 {
@@ -161,8 +431,14 @@ bool task_i2s_t::start(void)
     wav_buf[i] = std::make_pair(128, 128);
   }
 
+  // 書き手・読み手のタスクを開始する前に確保しておく
+  if (!system_registry->audio_block_ring.init(def::audio::block_ring_slots, audio_dma_tuner_t::frames_max)) {
+    M5_LOGE("i2s: block ring allocation failed");
+  }
+
 #if defined (M5UNIFIED_PC_BUILD)
   auto thread = SDL_CreateThread((SDL_ThreadFunction)task_func, "i2s", this);
+  SDL_CreateThread((SDL_ThreadFunction)monitor_task_func, "audio_monitor", nullptr);
 #else
 
   // メモリブロックの断片化への対策として、小さい断片化領域から使用するため、敢えて最大領域を先回りして確保する。
@@ -176,9 +452,16 @@ bool task_i2s_t::start(void)
   }
   memset(bufdata, 0, buf_size);
 
-  _i2s_init();
+  // I2Sタスクが起こす対象となるため、先に開始しておく
+  xTaskCreatePinnedToCore((TaskFunction_t)monitor_task_func, "audio_monitor", 1024*3, nullptr, def::system::task_priority_audio_monitor, &monitor_task_handle, def::system::task_cpu_audio_monitor);
 
   xTaskCreatePinnedToCore((TaskFunction_t)task_func, "i2s", 1024*3, this, def::system::task_priority_i2s, nullptr, def::system::task_cpu_i2s);
+
+  if (audio_recorder.init(def::audio::recorder_ring_bytes, def::audio::recorder_chunk_bytes)) {
+    xTaskCreatePinnedToCore((TaskFunction_t)recorder_task_func, "recorder", 1024*4, nullptr, def::system::task_priority_recorder, nullptr, def::system::task_cpu_recorder);
+  } else {
+    M5_LOGE("recorder: buffer allocation failed");
+  }
 #endif
   return true;
 }
@@ -186,93 +469,283 @@ bool task_i2s_t::start(void)
 void task_i2s_t::task_func(task_i2s_t* me)
 {
 #if defined (M5UNIFIED_PC_BUILD)
-  auto raw_wave_pos = system_registry->raw_wave_pos;
-  auto wav_buf = system_registry->raw_wave;
+  // PC版では実際のI2Sが存在しないため、ホストの時計で進む仮想DMAクロックでサンプルクロックを進める
+  // (ホストの時計とずれたDMAクロックへの追従は test/test_sample_clock で確認する)
+  const uint32_t frames_per_block = audio_dma_tuner_t::frames_default;
+  system_registry->runtime_info.setAudioDmaGeometry(frames_per_block, def::audio::dma_desc_default);
+  uint64_t sample_rate = system_registry->sample_clock.getSampleRate();
+
+  // 内蔵シンセの音は仮想DMAブロック毎に描画する。
+  // 環境変数 KANPLAY_SYNTH_WAV でファイル名を指定すると、描画した音を WAVファイルへ書き出す
+  // (内蔵シンセを有効にしておくこと。KANPLAY_MIDI_REPLAY と組み合わせると、キャプチャした演奏を実時間で WAVにできる)
+  // 描画は仮想DMAクロックに従うため実時間でのみ進む。実時間に依らないオフラインの描画は test/bench_audio_synth で行う
+  static int32_t synth_buf[audio_dma_tuner_t::frames_max * 2];
+  _synth_benchmark(synth_buf, sample_rate);
+  registry_t::history_code_t synth_history = 0;
+  bool synth_active = false;
+  FILE* wav_file = nullptr;
+  uint32_t wav_data_bytes = 0;
+  uint32_t wav_header_usec = M5.micros();
+  {
+    const char* path = getenv("KANPLAY_SYNTH_WAV");
+    if (path != nullptr) {
+      wav_file = fopen(path, "wb");
+      if (wav_file == nullptr) {
+        printf("synth wav: can not open %s\n", path);
+      } else {
+        uint8_t header[audio_recorder_t::wav_header_bytes];
+        audio_recorder_t::makeWavHeader(header, sample_rate, 0);
+        fwrite(header, 1, sizeof(header), wav_file);
+      }
+    }
+  }
+
+  uint64_t host_elapsed_usec = 0;
+  uint64_t virtual_frames = 0;
+  uint32_t prev_usec = M5.micros();
+  // サンプリングレートを切り替えた時点の仮想時刻とフレーム数
+  uint64_t rate_base_usec = 0;
+  uint64_t rate_base_frames = 0;
   for (;;) {
-    uint8_t min_level = 32 + (rand() & 127);
-    uint8_t max_level = min_level + 64;
+    uint32_t now_usec = M5.micros();
+    host_elapsed_usec += now_usec - prev_usec;
+    prev_usec = now_usec;
+
+    // PC版にはクロックを切り替える task_i2c が無いため、設定に合わせて仮想DMAクロックのレートを直接切り替える
+    auto rate = system_registry->user_setting.getAudioSampleRate();
+    if (system_registry->runtime_info.getAudioClockRate() != rate) {
+      system_registry->runtime_info.setAudioClockRate(rate);
+      sample_rate = def::audio::sample_rate_hz[rate];
+      system_registry->sample_clock.setSampleRate(sample_rate);
+      _synth_publish_capacity(sample_rate);
+      synth.setup(sample_rate);
+      rate_base_usec = host_elapsed_usec;
+      rate_base_frames = virtual_frames;
+      M5_LOGI("audio: sample rate %u Hz", (unsigned)sample_rate);
+    }
+    uint64_t target_frames = rate_base_frames + (host_elapsed_usec - rate_base_usec) * sample_rate / 1000000;
+    while (virtual_frames + frames_per_block <= target_frames) {
+      virtual_frames += frames_per_block;
+      system_registry->sample_clock.publish(frames_per_block, now_usec);
+
+      if (system_registry->user_setting.getSynthEnable()) {
+        if (!synth_active) {
+          synth_active = true;
+          _synth_start(synth_history);
+        }
+        _synth_poll(synth_history);
+        synth.setLevel(system_registry->user_setting.getSynthLevel());
+        memset(synth_buf, 0, frames_per_block * 2 * sizeof(int32_t));
+        synth.render(synth_buf, frames_per_block);
+      } else if (synth_active) {
+        synth_active = false;
+        synth.reset();
+      }
+      if (wav_file != nullptr) {
+        int16_t pcm[audio_dma_tuner_t::frames_max * 2];
+        for (size_t i = 0; i < frames_per_block * 2; ++i) {
+          pcm[i] = synth_active ? (int16_t)(synth_buf[i] >> 16) : 0;
+        }
+        wav_data_bytes += fwrite(pcm, sizeof(int16_t), frames_per_block * 2, wav_file) * sizeof(int16_t);
+      }
+
+      // 波形表示・解析が実機と同様に動作するよう、描画した音 (無効時は無音) を共有する
+      if (!synth_active) {
+        memset(synth_buf, 0, frames_per_block * 2 * sizeof(int32_t));
+      }
+      system_registry->audio_block_ring.write(synth_buf, frames_per_block, virtual_frames - frames_per_block);
+    }
 
-    wav_buf[raw_wave_pos] = std::make_pair(min_level, max_level);
-  
-    if (++raw_wave_pos >= (system_registry->raw_wave_length)) {
-      raw_wave_pos = 0;
+    // 途中で終了しても再生できるよう、一定時間ごとに WAVのヘッダを更新する
+    if (wav_file != nullptr && (int32_t)(now_usec - wav_header_usec) >= 1000000) {
+      wav_header_usec = now_usec;
+      uint8_t header[audio_recorder_t::wav_header_bytes];
+      audio_recorder_t::makeWavHeader(header, sample_rate, wav_data_bytes);
+      fseek(wav_file, 0, SEEK_SET);
+      fwrite(header, 1, sizeof(header), wav_file);
+      fseek(wav_file, 0, SEEK_END);
+      fflush(wav_file);
     }
-    system_registry->raw_wave_pos = raw_wave_pos;
     SDL_Delay(1);
   }
 
 #else
   int32_t* i2sbuf = &bufdata[overwrap];
 
-  size_t transfer_size;
+  size_t transfer_size = 0;
 
-// M5.delay(4000);
-#if __has_include(<driver/i2s_std.h>)
-  do {
-    // ++preload;
-    i2s_channel_preload_data(_i2s_tx_handle, i2sbuf, buf_size, &transfer_size);
-  } while (transfer_size == buf_size);
-#endif
-  // M5_LOGD("preload: %d", preload);
+  // I2Sの開始前 (DMAバッファの未使用時) に内蔵シンセの処理時間を計測しておく
+  _synth_benchmark(i2sbuf, system_registry->sample_clock.getSampleRate());
+
+  // DMAの大きさは設定 (固定または自動) に従い、変更された場合はI2Sを開始し直す
+  static audio_dma_tuner_t tuner;
+  uint8_t setting_frames = system_registry->user_setting.getAudioDmaFrames();
+  uint8_t setting_desc = system_registry->user_setting.getAudioDmaDesc();
+  tuner.setup(setting_frames, setting_desc, system_registry->sample_clock.getSampleRate(), M5.millis());
+  auto geometry = tuner.getGeometry();
+  // 開始できない間は少し待って再試行する (読み書きは開始できた I2S に対してのみ行う)
+  while (!_i2s_begin(geometry, i2sbuf)) { M5.delay(100); }
+  // コーデックのクロックのサンプリングレート (task_i2c が切り替える)
+  auto clock_rate = system_registry->runtime_info.getAudioClockRate();
 
-  _i2s_start();
+  uint32_t prev_underrun = 0;
+  uint32_t late_count = 0;
+  uint32_t late_msec = 0;
+  uint32_t block_worst_usec = 0;
+  uint32_t dma_publish_msec = M5.millis();
 
   int32_t current_volume = 0;
-  int volume_shift = 8;
-  int shifted_volume = 0;
+  int32_t shifted_volume = 0;
+
+  static audio_effect_chain_t effect_chain;
+  static audio_metronome_t metronome;
+  uint32_t effect_load_max = 0;
+  uint32_t effect_publish_msec = M5.millis();
+  registry_t::history_code_t synth_history = 0;
+  bool synth_active = false;
+  uint32_t synth_load_max = 0;
+  uint32_t synth_voices_max = 0;
+  uint32_t synth_publish_msec = effect_publish_msec;
 
   // int32_t min_level = 0;
   // int32_t max_level = 0;
 
   for (;;) {
-    _i2s_read(i2sbuf, buf_size, &transfer_size, 128);
+    const uint32_t frames = geometry.frames;
+    const size_t block_bytes = frames * 2 * sizeof(int32_t);
+    _i2s_read(i2sbuf, block_bytes, &transfer_size, 128);
+    // ブロックの処理時間は受信の完了から送信の開始までとする
+    const uint32_t block_start_usec = M5.micros();
     system_registry->task_status.setWorking(system_registry_t::reg_task_status_t::bitindex_t::TASK_I2S);
 
+    // 受信したフレーム数だけサンプルクロックを進める (1フレーム = L/R 2サンプル)
+    if (transfer_size) {
+      system_registry->sample_clock.publish(transfer_size / (sizeof(int32_t) * 2), M5.micros());
+    }
+
+    { // 発音の遅れの測定 (測定中のみ、他の音を加える前の受信した音を解析する)
+      // ノートの送信と結果の保存は task_operator が行う (I2Sタスクはレジストリや設定を書き換えない)
+      uint64_t block_sample = system_registry->sample_clock.getSampleCount() - frames;
+      audio_latency.process(i2sbuf, frames, block_sample, system_registry->sample_clock.getSampleRate());
+    }
+
     // マスターボリュームのレンジ0~100を 1~256に変換
     int32_t target_volume = system_registry->user_setting.getMasterVolume() << 8;
     if (target_volume > 25600) { target_volume = 25600; }
 
     // 現在の音量と目標の音量に差がある場合は滑らかに接近させる
+    int32_t prev_volume = shifted_volume;
     if (current_volume != target_volume) {
       current_volume += (target_volume - current_volume + (target_volume < current_volume ? 0 : 32)) >> 5;
       shifted_volume = current_volume / 100;
     }
-    volume_shift = 8;
 
-    int32_t min_level = INT32_MAX;
-    int32_t max_level = INT32_MIN;
+    { // 内蔵シンセの音を入力の音に加える (エフェクトと録音の対象とする)
+      auto& us = system_registry->user_setting;
+      if (us.getSynthEnable()) {
+        uint32_t sample_rate = system_registry->sample_clock.getSampleRate();
+        synth.setup(sample_rate);
+        if (!synth_active) {
+          synth_active = true;
+          _synth_start(synth_history);
+        }
+        _synth_poll(synth_history);
+        synth.setLevel(us.getSynthLevel());
+
+        uint32_t start_usec = M5.micros();
+        synth.render(i2sbuf, frames);
+        uint32_t elapsed = M5.micros() - start_usec;
+        synth.reportElapsed(elapsed, _scale_budget(def::audio::synth_budget_usec, frames, sample_rate));
+
+        uint32_t period_usec = (uint32_t)((uint64_t)frames * 1000000u / sample_rate);
+        uint32_t load = elapsed * 100 / period_usec;
+        if (synth_load_max < load) { synth_load_max = load; }
+        uint32_t voices = synth.getActiveVoices();
+        if (synth_voices_max < voices) { synth_voices_max = voices; }
+      } else if (synth_active) {
+        // 無効にした時点で発音中の音を止める
+        synth_active = false;
+        synth.reset();
+      }
+      uint32_t msec = M5.millis();
+      if (msec - synth_publish_msec >= def::audio::effect_load_publish_msec) {
+        synth_publish_msec = msec;
+        system_registry->runtime_info.setSynthLoad(synth_load_max < 255 ? synth_load_max : 255);
+        system_registry->runtime_info.setSynthVoices(synth.getVoiceLimit(), synth_voices_max);
+        synth_load_max = 0;
+        synth_voices_max = 0;
+      }
+    }
 
-// if (current_volume != 25600)
-{
-    // ボリュームを適用
-    for (int i = 0; i < i2s_dma_frame_num; i+=2) {
-      int l = i2sbuf[i  ];
-      int r = i2sbuf[i+1];
-      if (min_level > l) { min_level = l; }
-      if (max_level < l) { max_level = l; }
-      if (min_level > r) { min_level = r; }
-      if (max_level < r) { max_level = r; }
-      i2sbuf[i  ] = (l >> volume_shift) * shifted_volume;
-      i2sbuf[i+1] = (r >> volume_shift) * shifted_volume;
+    { // 出力エフェクトを適用する (全て無効の場合は process の先頭で戻る)
+      auto& us = system_registry->user_setting;
+      audio_effect_chain_t::config_t config;
+      config.enabled = us.getEffectEnable();
+      config.eq_low_db = us.getEffectEqLow();
+      config.eq_mid_db = us.getEffectEqMid();
+      config.eq_high_db = us.getEffectEqHigh();
+      config.comp_threshold_db = -(int8_t)us.getEffectCompThreshold();
+      config.comp_ratio = us.getEffectCompRatio();
+      config.reverb_level = us.getEffectReverbLevel();
+      config.sample_rate = system_registry->sample_clock.getSampleRate();
+      if (config != effect_chain.getConfig()) {
+        effect_chain.setConfig(config);
+      }
+
+      if (effect_chain.isActive()) {
+        uint32_t start_usec = M5.micros();
+        effect_chain.process(i2sbuf, frames);
+        uint32_t elapsed = M5.micros() - start_usec;
+        uint32_t budget_usec = _scale_budget(def::audio::effect_budget_usec, frames, config.sample_rate);
+        effect_chain.reportElapsed(elapsed, budget_usec, def::audio::effect_suspend_blocks);
+
+        // 負荷はDMAブロック1回分の周期に対する割合で示す
+        uint32_t period_usec = (uint32_t)((uint64_t)frames * 1000000u / config.sample_rate);
+        uint32_t load = elapsed * 100 / period_usec;
+        if (effect_load_max < load) { effect_load_max = load; }
+      }
+      uint32_t msec = M5.millis();
+      if (msec - effect_publish_msec >= def::audio::effect_load_publish_msec) {
+        effect_publish_msec = msec;
+        system_registry->runtime_info.setAudioEffectLoad(effect_load_max < 255 ? effect_load_max : 255);
+        system_registry->runtime_info.setAudioEffectOverrun(effect_chain.getOverrunCount());
+        effect_load_max = 0;
+      }
     }
-    min_level = ((min_level >> 16) + 32768 + 128) >> 8;
-    max_level = ((max_level >> 16) + 32768 + 128) >> 8;
 
-    auto wav_buf = system_registry->raw_wave;
-    auto raw_wave_pos = system_registry->raw_wave_pos;
-    wav_buf[raw_wave_pos ++] = std::make_pair<uint8_t, uint8_t>(min_level, max_level);
+    // 録音はエフェクト適用後、マスターボリューム適用前の信号とする (ヘッドホンの音量に影響されない)
+    audio_recorder.push(i2sbuf, frames);
 
-    if (raw_wave_pos >= (system_registry->raw_wave_length)) {
-      raw_wave_pos = 0;
+    { // 波形表示・解析を行う読み手へ共有する (読み手を待たない)
+      // 読み手はリングバッファの 1/4 周毎に起こし、読み手の処理で I2Sタスクが頻繁に中断されないようにする
+      auto& ring = system_registry->audio_block_ring;
+      ring.write(i2sbuf, frames, system_registry->sample_clock.getSampleCount() - frames);
+      if (monitor_task_handle != nullptr && (ring.getWriteCount() & ((ring.getSlots() >> 2) - 1)) == 0) {
+        xTaskNotifyGive(monitor_task_handle);
+      }
     }
-    system_registry->raw_wave_pos = raw_wave_pos;
-}
+
+    { // メトロノームのクリック音を演奏エンジンの拍の位置に合わせて加える (録音には含めない)
+      auto& us = system_registry->user_setting;
+      audio_metronome_t::config_t config;
+      config.mode = (audio_metronome_t::mode_t)us.getMetronomeMode();
+      config.level = us.getMetronomeLevel();
+      config.beats_per_bar = us.getMetronomeBeats();
+      config.accent_mask = us.getMetronomeAccent();
+      metronome.setup(system_registry->sample_clock.getSampleRate());
+      // サンプルクロックは受信したブロックの分を進めているため、ブロックの先頭はその手前となる
+      uint64_t block_sample = system_registry->sample_clock.getSampleCount() - frames;
+      metronome.process(i2sbuf, frames, block_sample, system_registry->beat_clock.getTimeline(), config);
+    }
+
+    // ボリュームを適用する (ブロック内で前回の音量から直線的に変化させる)
+    audio_apply_gain(i2sbuf, frames, prev_volume, shifted_volume);
 
 // M5_LOGE("readsize: %d", readsize);
 /* デバッグ用 ノコギリ波をミキシングする
 static int32_t value;
 int add = system_registry->internal_input.get16(0);
-for (int i = 0; i < i2s_dma_frame_num; i++) {
+for (int i = 0; i < frames * 2; i++) {
   i2sbuf[i] = (i2sbuf[i] + (value << 12)) >> 2;
   value += add;
   if (value > 65536) {
@@ -280,9 +753,65 @@ for (int i = 0; i < i2s_dma_frame_num; i++) {
   }
 }
 //*/
+    { // 処理時間を計測し、アンダーランと処理遅れを記録する
+      uint32_t elapsed = M5.micros() - block_start_usec;
+      uint32_t msec = M5.millis();
+      if (block_worst_usec < elapsed) { block_worst_usec = elapsed; }
+      if (tuner.reportBlock(elapsed)) {
+        ++late_count;
+        late_msec = msec;
+      }
+      _i2s_poll_events();
+      uint32_t underrun = _underrun_count.load(std::memory_order_relaxed);
+      if (prev_underrun != underrun) {
+        tuner.reportUnderrun(underrun - prev_underrun);
+        prev_underrun = underrun;
+      }
+      if (msec - dma_publish_msec >= def::audio::effect_load_publish_msec) {
+        dma_publish_msec = msec;
+        auto& ri = system_registry->runtime_info;
+        ri.setAudioBlockWorstUsec(block_worst_usec < UINT16_MAX ? block_worst_usec : UINT16_MAX);
+        ri.setAudioUnderrun(underrun, _underrun_msec.load(std::memory_order_relaxed));
+        ri.setAudioLateBlock(late_count, late_msec);
+        block_worst_usec = 0;
+      }
+      tuner.evaluate(msec);
+    }
+
 // size_t result;
     system_registry->task_status.setSuspend(system_registry_t::reg_task_status_t::bitindex_t::TASK_I2S);
-    _i2s_write(bufdata, buf_size, &transfer_size, 128);
+    _i2s_write(bufdata, block_bytes, &transfer_size, 128);
+
+    { // DMAの設定やサンプリングレートが変更された場合は I2S を開始し直す (切替えの間は音が途切れる)
+      auto& us = system_registry->user_setting;
+      bool restart = false;
+      if (clock_rate != system_registry->runtime_info.getAudioClockRate()) {
+        // クロックの切替えの間に受信したブロックは境界がずれている可能性があるため、DMAを含めて開始し直す
+        // 各処理の係数は、ブロック毎に参照するサンプルクロックのレートに従って更新される
+        clock_rate = system_registry->runtime_info.getAudioClockRate();
+        uint32_t sample_rate = def::audio::sample_rate_hz[clock_rate];
+        system_registry->sample_clock.setSampleRate(sample_rate);
+        _synth_publish_capacity(sample_rate);
+        // 録音はファイル内でレートが混在しないよう停止し、遅れの測定は中止する
+        audio_recorder.requestStop();
+        audio_latency.requestCancel();
+        setting_frames = us.getAudioDmaFrames();
+        setting_desc = us.getAudioDmaDesc();
+        tuner.setup(setting_frames, setting_desc, sample_rate, M5.millis());
+        restart = true;
+      }
+      if (setting_frames != us.getAudioDmaFrames() || setting_desc != us.getAudioDmaDesc()) {
+        setting_frames = us.getAudioDmaFrames();
+        setting_desc = us.getAudioDmaDesc();
+        tuner.setup(setting_frames, setting_desc, system_registry->sample_clock.getSampleRate(), M5.millis());
+      }
+      if (restart || geometry != tuner.getGeometry()) {
+        geometry = tuner.getGeometry();
+        M5_LOGI("i2s: dma %d frames x %d", geometry.frames, geometry.desc);
+        _i2s_deinit();
+        while (!_i2s_begin(geometry, i2sbuf)) { M5.delay(100); }
+      }
+    }
   }
 #endif
 }
@@ -17,6 +17,9 @@ void task_kantanplay_t::start(void)
 {
   memset(_midi_pitch_manage, 0xFF, sizeof(_midi_pitch_manage));
 
+  _voice_manager.setOutput(&system_registry->midi_out_control);
+  _looper.init(def::app::looper_max_event, &_voice_manager, &system_registry->midi_out_control);
+
   _current_usec = M5.micros();
 
 #if defined (M5UNIFIED_PC_BUILD)
@@ -25,6 +28,7 @@ void task_kantanplay_t::start(void)
   TaskHandle_t handle = nullptr;
   xTaskCreatePinnedToCore((TaskFunction_t)task_func, "kanplay", 1024*3, this, def::system::task_priority_kantanplay, &handle, def::system::task_cpu_kantanplay);
   system_registry->player_command.setNotifyTaskHandle(handle);
+  system_registry->midi_note_request.setNotifyTaskHandle(handle);
 #endif
 }
 
@@ -34,11 +38,20 @@ void task_kantanplay_t::task_func(task_kantanplay_t* me)
     uint32_t next_usec;
     do {
       me->sustainProc();
+      me->_voice_manager.setLimit(system_registry->user_setting.getVoiceLimitGlobal(),
+                                  system_registry->user_setting.getVoiceLimitPart());
+      me->_voice_manager.setPolicy(system_registry->user_setting.getVoiceStealPolicy());
+      me->noteRequestProc();
       me->_prev_usec = me->_current_usec;
-      me->_current_usec = M5.micros();
+      me->_current_usec = me->getTimebaseUsec();
+      system_registry->midi_out_control.setEventClock(me->_current_usec, M5.micros());
       auto next1 = me->autoProc();
       auto next2 = me->chordProc();
+      auto next3 = me->_looper.process(me->_current_usec);
       next_usec = next1 < next2 ? next1 : next2;
+      if (next_usec > next3) { next_usec = next3; }
+      system_registry->runtime_info.setLooperState(me->_looper.getState());
+      system_registry->runtime_info.setVoiceStealCount(me->_voice_manager.getStealCount());
     } while (me->commandProccessor());
 
 #if !defined (M5UNIFIED_PC_BUILD)
@@ -62,6 +75,60 @@ void task_kantanplay_t::task_func(task_kantanplay_t* me)
   }
 }
 
+uint32_t task_kantanplay_t::getTimebaseUsec(void)
+{
+  const uint32_t now_usec = M5.micros();
+  const auto& sample_clock = system_registry->sample_clock;
+
+  // I2Sが動作していない場合はサンプルクロックを使用しない
+  bool use_sample_clock = system_registry->user_setting.getPlaySampleClockSync()
+                       && sample_clock.isRunning(now_usec);
+
+  uint32_t base_usec = use_sample_clock ? sample_clock.getUsec(now_usec) : now_usec;
+  if (_timebase_sample_clock != use_sample_clock) {
+    _timebase_sample_clock = use_sample_clock;
+    // 基準が切り替わった場合は直前の時刻から連続するよう補正値を更新する
+    _timebase_offset_usec = _current_usec - base_usec;
+  }
+  return base_usec + _timebase_offset_usec;
+}
+
+uint64_t task_kantanplay_t::timebaseToSample(uint32_t usec)
+{
+  const auto& sample_clock = system_registry->sample_clock;
+  if (_timebase_sample_clock) {
+    return sample_clock.usecToSample(usec - _timebase_offset_usec);
+  }
+  // CPUタイマ基準の場合は、現在時刻との差をサンプルクロックの現在位置に加える
+  const uint32_t now_usec = M5.micros();
+  return sample_clock.usecToSample(sample_clock.getUsec(now_usec) + (usec - (now_usec + _timebase_offset_usec)));
+}
+
+void task_kantanplay_t::publishBeat(uint32_t beat_usec, int32_t cycle_usec)
+{
+  audio_metronome_t::timeline_t timeline;
+  // 内蔵音源の発音の遅れ (送信の遅延を含む) だけクリックを遅らせ、演奏の音と揃える
+  uint32_t latency_usec = system_registry->user_setting.getAudioLatencyMidiUsec()
+                        + system_registry->runtime_info.getMidiInternalDelay() * 1000u;
+  timeline.anchor_sample = timebaseToSample(beat_usec)
+                         + (uint64_t)latency_usec * system_registry->sample_clock.getSampleRate() / 1000000u;
+  timeline.anchor_beat = _metronome_beat;
+  timeline.period_x256 = (uint32_t)((uint64_t)cycle_usec * system_registry->sample_clock.getSampleRate() * 256 / 1000000u);
+  timeline.count_in_beats = _metronome_count_in;
+  timeline.session = _metronome_session;
+  system_registry->beat_clock.publish(timeline);
+  _metronome_running = true;
+}
+
+void task_kantanplay_t::stopBeat(void)
+{
+  if (!_metronome_running) { return; }
+  _metronome_running = false;
+  audio_metronome_t::timeline_t timeline;
+  timeline.session = _metronome_session;
+  system_registry->beat_clock.publish(timeline);
+}
+
 bool task_kantanplay_t::commandProccessor(void)
 {
   def::command::command_param_t command_param;
@@ -101,6 +168,11 @@ bool task_kantanplay_t::commandProccessor(void)
   case def::command::play_control:
     procPlayEffect(command_param, is_pressed);
     break;
+  case def::command::looper_control:
+    if (is_pressed) {
+      _looper.control((def::command::looper_control_t)command_param.getParam(), _current_usec);
+    }
+    break;
   case def::command::sequence_step_ud:
     procSequenceStepUd(command_param, is_pressed);
     break;
@@ -218,6 +290,9 @@ bool task_kantanplay_t::commandProccessor(void)
     break;
   }
 
+  // コマンドにより出力されたイベントは、コマンドを処理した時刻でルーパーに記録する
+  _looper.capture(_current_usec);
+
   return true;
 }
 
@@ -227,6 +302,22 @@ void task_kantanplay_t::setSustain(bool sustain_on)
   sustainProc();
 }
 
+void task_kantanplay_t::noteRequestProc(void)
+{
+  // 外部から要求された発音を voice_manager へ渡す
+  const registry_base_t::history_t* history;
+  while (nullptr != (history = system_registry->midi_note_request.getHistory(_note_request_history_code))) {
+    uint8_t midi_ch = history->index & 0x0F;
+    uint8_t note = history->value & 0x7F;
+    uint8_t value = (history->value >> 8) & 0xFF;
+    if (value & 0x80) {
+      _voice_manager.noteOn(voice_manager_t::part_external, midi_ch, note, value & 0x7F);
+    } else {
+      _voice_manager.noteOff(midi_ch, note);
+    }
+  }
+}
+
 void task_kantanplay_t::sustainProc(void)
 {
   auto sustain_state = system_registry->runtime_info.getSustainState();
@@ -269,6 +360,11 @@ uint32_t task_kantanplay_t::autoProc(void)
   uint32_t next_event_timing = INT32_MAX;
   const int progress_usec = (int32_t)(_current_usec - _prev_usec);
 
+  // 自動演奏が止まった場合はメトロノームも止める
+  if (system_registry->runtime_info.getAutoplayState() != def::play::auto_play_state_t::auto_play_running) {
+    stopBeat();
+  }
+
   // 入力遅延の許容時間を更新
   _auto_play_input_tolerating_remain_usec -= progress_usec;
 
@@ -298,7 +394,7 @@ uint32_t task_kantanplay_t::autoProc(void)
   if (_auto_play_onbeat_remain_usec >= 0) {
     int remain_usec = _auto_play_onbeat_remain_usec - progress_usec;
     if (remain_usec < 0) {
-      _auto_play_input_tolerating_remain_usec = def::app::input_tolerating_msec * 1000 + remain_usec;
+      _auto_play_input_tolerating_remain_usec = getInputToleratingUsec() + remain_usec;
       auto autoplay_state = system_registry->runtime_info.getGuiAutoplayState();
       if (autoplay_state == def::play::auto_play_state_t::auto_play_running)
       {
@@ -307,6 +403,10 @@ uint32_t task_kantanplay_t::autoProc(void)
         // 曲のテンポ情報に基づいてオンビートのサイクルを更新
         setOnbeatCycle(onbeat_cycle_usec);
 
+        // 本来の拍の時刻 (処理の遅れを除いた時刻) をメトロノームへ伝える
+        publishBeat(_current_usec + remain_usec, onbeat_cycle_usec);
+        ++_metronome_beat;
+
         updateOffbeatTiming();
 
         // 次回オフビートのタイミングを今回のオンビートのズレ分を加味して調整する
@@ -330,6 +430,7 @@ uint32_t task_kantanplay_t::autoProc(void)
         default:
         // オンビートの演奏を行う
           updateNextOptions();
+          _looper.onBeat(_current_usec, onbeat_cycle_usec);
           chordBeat(true);
           addSequence();
         }
@@ -367,9 +468,10 @@ uint32_t task_kantanplay_t::chordProc(void)
             auto midi_ch = manage->midi_ch;
             auto velocity = manage->velocity;
             if (velocity) {
-              velocity |= 0x80;
               // system_registry->midi_out_control.setNoteVelocity(midi_ch, note_number, 0);
-              system_registry->midi_out_control.setNoteVelocity(midi_ch, note_number, velocity);
+              // 処理の遅れを除いた本来の発音時刻を予定時刻とする
+              system_registry->midi_out_control.setEventTime(_current_usec + press_usec);
+              _voice_manager.noteOn(part, midi_ch, note_number, velocity);
               hit_flg = true;
             }
           } else if (next_event_timing > press_usec) {
@@ -386,7 +488,8 @@ uint32_t task_kantanplay_t::chordProc(void)
             auto midi_ch = manage->midi_ch;
             // 同じノートナンバーの音が他のピッチで鳴っていない場合は音を停止する
             if (0 == checkOtherPitchNote(part, pitch, midi_ch, note_number)) {
-              system_registry->midi_out_control.setNoteVelocity(manage->midi_ch, manage->note_number, 0);
+              system_registry->midi_out_control.setEventTime(_current_usec + release_usec);
+              _voice_manager.noteOff(manage->midi_ch, manage->note_number);
             }
             manage->note_number = 0xFF;
             manage->velocity = 0;
@@ -401,6 +504,7 @@ uint32_t task_kantanplay_t::chordProc(void)
       system_registry->runtime_info.hitPartEffect(part);
     }
   }
+  system_registry->midi_out_control.clearEventTime();
 
   // パターン編集モードでない場合 && 自動演奏の一時停止モードでない場合
   if (!system_registry->runtime_info.getGuiFlag_PartEdit()
@@ -474,6 +578,20 @@ void task_kantanplay_t::procChordDegree(const def::command::command_param_t& com
       // 自動演奏の開始待ち受け状態または一時停止状態の場合はこのタイミングで自動演奏の開始
       _auto_play_onbeat_remain_usec = 0;
       system_registry->runtime_info.setAutoplayState(def::play::auto_play_state_t::auto_play_running);
+
+      // メトロノームの拍の通し番号を先頭に戻す
+      ++_metronome_session;
+      _metronome_beat = 0;
+      _metronome_count_in = 0;
+      const auto& us = system_registry->user_setting;
+      if (us.getMetronomeMode() != audio_metronome_t::mode_off && us.getMetronomeCountIn()) {
+        // カウントインの小節数だけ最初の拍を遅らせ、その間はメトロノームのみ鳴らす
+        int32_t cycle_usec = getOnbeatCycleBySongTempo();
+        _metronome_count_in = us.getMetronomeCountIn() * us.getMetronomeBeats();
+        _auto_play_onbeat_remain_usec = _metronome_count_in * cycle_usec;
+        publishBeat(_current_usec, cycle_usec);
+        _metronome_beat = _metronome_count_in;
+      }
     }
   }
 }
@@ -558,7 +676,22 @@ void task_kantanplay_t::procChordBeat(const def::command::command_param_t& comma
     }
   }
 
+  // 入力クオンタイズ (発音を先読み時間だけ遅らせ、その間にビート位置へ寄せる)
+  // 寄せた時刻は発音にのみ使い、オンビート周期の推定には実際の入力時刻を使う
+  uint32_t play_usec = _current_usec;
+  _play_delay_usec = 0;
+  if (on_beat) {
+    play_usec = quantizeOnbeat();
+  } else {
+    // オフビートもオンビートと同じだけ遅らせて順序と間隔を保つ
+    _play_delay_usec = _input_quantizer.getFollowDelay(_current_usec);
+  }
+
+  if (on_beat) {
+    _looper.onBeat(play_usec, getOnbeatCycle());
+  }
   chordBeat(on_beat);
+  _play_delay_usec = 0;
 
   if (on_beat) {
     addSequence();
@@ -631,6 +764,41 @@ void task_kantanplay_t::setOnbeatCycle(int32_t usec)
   _reactive_onbeat_cycle_usec = usec;
 }
 
+// 手動演奏時のオンビート入力をビートの分割位置に寄せる
+// 戻り値は発音する時刻。_play_delay_usec に入力から発音までの待ち時間を設定する
+uint32_t task_kantanplay_t::quantizeOnbeat(void)
+{
+  int32_t window_usec = system_registry->user_setting.getQuantizeWindow() * 1000;
+  if (system_registry->runtime_info.getGuiAutoplayState() != def::play::auto_play_state_t::auto_play_none) {
+    window_usec = 0;
+  }
+  _input_quantizer.setConfig(window_usec, system_registry->user_setting.getQuantizeLookahead() * 1000);
+  if (window_usec == 0) {
+    _input_quantizer.reset();
+    return _current_usec;
+  }
+
+  const int32_t step_per_beat = system_registry->current_slot->slot_info.getStepPerBeat();
+  // ビートの周期が未確定の間は基準の設定のみ行う
+  const int32_t onbeat_cycle_usec = (_reactive_onbeat_cycle_usec < 16384) ? 0 : getOnbeatCycle();
+  auto res = _input_quantizer.process(_current_usec, onbeat_cycle_usec, step_per_beat);
+  _play_delay_usec = res.delay_usec;
+
+  system_registry->runtime_info.setQuantizeLatency(_input_quantizer.getLatencyAvg() / 1000);
+  system_registry->runtime_info.setQuantizeCorrection(_input_quantizer.getCorrectionAvg() / 1000);
+// M5_LOGV("quantize: error %d usec, delay %d usec", res.error_usec, res.delay_usec);
+
+  return res.play_usec;
+}
+
+// 自動演奏時のユーザーによるオンビート操作の遅延許容時間を取得する
+int32_t task_kantanplay_t::getInputToleratingUsec(void)
+{
+  int32_t msec = system_registry->user_setting.getQuantizeWindow();
+  if (msec == 0) { msec = def::app::input_tolerating_msec; }
+  return msec * 1000;
+}
+
 // オンビート演奏の間隔を取得する
 int32_t task_kantanplay_t::getOnbeatCycle(void)
 {
@@ -914,7 +1082,7 @@ void task_kantanplay_t::chordStepPlay(void)
 
     int displacement_usec = 1000 * part_info->getStrokeSpeed();
     int autorelease_usec = 1000 * def::app::autorelease_msec;
-    int32_t press_usec = 0;
+    int32_t press_usec = _play_delay_usec;
     int step = system_registry->chord_play.getPartStep(part);
     if (step < 0) {
       continue;
@@ -1283,6 +1451,7 @@ void task_kantanplay_t::allPartsNoteOff(void)
   }
   for (int i = 0; i < 16; ++i) { // CC#120はすべてのMIDI音を停止する
     system_registry->midi_out_control.setControlChange(i, 120, 0);
+    _voice_manager.resetChannel(i);
   }
 }
 
@@ -1325,7 +1494,7 @@ void task_kantanplay_t::chordNoteOff(int part)
         manage->note_number = 0xFF;
         auto midi_ch = manage->midi_ch;
         if (note < def::midi::max_note && midi_ch < def::midi::channel_max) {
-          system_registry->midi_out_control.setNoteVelocity(midi_ch, note, 0);
+          _voice_manager.noteOff(midi_ch, note);
         }
       }
     }
@@ -1344,7 +1513,7 @@ void task_kantanplay_t::setPitchManage(uint8_t part, uint8_t pitch, uint8_t midi
       // 同じノートナンバーの音が他のピッチで鳴っていない場合は音を停止する
       if (0 == checkOtherPitchNote(part, pitch, midi_ch, note_number)) {
 // M5_LOGV("stop note: %d, pitch: %d, midi_ch: %d, note_number: %d, velocity: %d, press_usec: %d, release_usec: %d", part, pitch, midi_ch, note_number, velocity, press_usec, release_usec);
-        system_registry->midi_out_control.setNoteVelocity(midi_ch, note_number, 0);
+        _voice_manager.noteOff(midi_ch, note_number);
       }
     }
   }
@@ -1397,7 +1566,7 @@ void task_kantanplay_t::procNoteButton(const def::command::command_param_t& comm
   auto midi_ch = manage->midi_ch;
   auto note = manage->note_number;
   if (note < 127 && midi_ch < def::midi::channel_max) {
-    system_registry->midi_out_control.setNoteVelocity(midi_ch, note, 0);
+    _voice_manager.noteOff(midi_ch, note);
     manage->note_number = 0xFF;
   }
   if (!on_beat) {
@@ -1423,9 +1592,9 @@ void task_kantanplay_t::procNoteButton(const def::command::command_param_t& comm
     manage->note_number = note;
     system_registry->midi_out_control.setChannelVolume(midi_ch, chvolume);
     system_registry->midi_out_control.setProgramChange(midi_ch, program);
-    system_registry->midi_out_control.setNoteVelocity(midi_ch, note, 0);
-    uint8_t velocity = 0x80 | (_press_velocity > 127 ? 127 : _press_velocity);
-    system_registry->midi_out_control.setNoteVelocity(midi_ch, note, velocity);
+    _voice_manager.noteOff(midi_ch, note);
+    uint8_t velocity = _press_velocity > 127 ? 127 : _press_velocity;
+    _voice_manager.noteOn(voice_manager_t::part_direct, midi_ch, note, velocity);
   }
 }
 
@@ -1441,7 +1610,7 @@ void task_kantanplay_t::procDrumButton(const def::command::command_param_t& comm
   auto note = manage->note_number;
 
   if (note < 127 && midi_ch < def::midi::channel_max) {
-    system_registry->midi_out_control.setNoteVelocity(midi_ch, note, 0);
+    _voice_manager.noteOff(midi_ch, note);
     manage->note_number = 0xFF;
   }
   if (!on_beat) {
@@ -1461,8 +1630,8 @@ void task_kantanplay_t::procDrumButton(const def::command::command_param_t& comm
     manage->note_number = note;
     system_registry->midi_out_control.setChannelVolume(midi_ch, chvolume);
 
-    uint8_t velocity = 0x80 | (_press_velocity > 127 ? 127 : _press_velocity);
-    system_registry->midi_out_control.setNoteVelocity(def::midi::channel_10, note, velocity);
+    uint8_t velocity = _press_velocity > 127 ? 127 : _press_velocity;
+    _voice_manager.noteOn(voice_manager_t::part_direct, def::midi::channel_10, note, velocity);
   }
 }
 
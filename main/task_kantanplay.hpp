@@ -5,6 +5,9 @@
 #define KANPLAY_TASK_KANTANPLAY_HPP
 
 #include "system_registry.hpp"
+#include "voice_manager.hpp"
+#include "looper.hpp"
+#include "input_quantizer.hpp"
 
 namespace kanplay_ns {
 //-------------------------------------------------------------------------
@@ -13,6 +16,7 @@ public:
   void start(void);
 private:
   registry_t::history_code_t _player_command_history_code = 0;
+  registry_t::history_code_t _note_request_history_code = 0;
   static void task_func(task_kantanplay_t* me);
   bool commandProccessor(void);
 
@@ -99,6 +103,12 @@ Degree操作コマンド {
   // 最新のオンビート演奏時点の時間情報 (usec)
   uint32_t _reactive_onbeat_usec = 0;
 
+  // 演奏する音の発音を遅らせる時間 (usec) 入力クオンタイズでビート位置まで待つ場合に使用する
+  int32_t _play_delay_usec = 0;
+
+  // 手動演奏の入力クオンタイズ
+  input_quantizer_t _input_quantizer;
+
   // ステップのオン・オフ進行状況保持用 0==オンビート , 1~3==オフビート位置
   uint8_t _current_beat_index = 0;
 
@@ -118,11 +128,14 @@ Degree操作コマンド {
   int32_t calcStepAdvance(const bool on_beat);
   void updateOffbeatTiming(void);
   void setOnbeatCycle(int32_t usec = -1);
+  uint32_t quantizeOnbeat(void);
+  int32_t getInputToleratingUsec(void);
   int32_t getOnbeatCycle(void);
   int32_t getOnbeatCycleBySongTempo(void);
   uint32_t autoProc(void);
   uint32_t chordProc(void);
   void sustainProc(void);
+  void noteRequestProc(void);
   void setSustain(bool sustain_on);
 
   void updateNextOptions(void);
@@ -168,6 +181,32 @@ Degree操作コマンド {
   uint32_t _prev_usec = 0;
   uint32_t _current_usec = 0;
 
+  // 演奏タイミングの基準時刻を取得する (設定に応じてCPUタイマまたはI2Sサンプルクロック)
+  uint32_t getTimebaseUsec(void);
+
+  // 同時発音数の管理
+  voice_manager_t _voice_manager;
+
+  // 演奏のループ録音・再生
+  looper_t _looper;
+
+  // 基準の切替時に時刻が飛ばないよう保持する補正値 (usec)
+  uint32_t _timebase_offset_usec = 0;
+
+  // 現在サンプルクロックを基準としているか否か
+  bool _timebase_sample_clock = false;
+
+  // 演奏タイミングの基準時刻をサンプルクロックの位置に変換する
+  uint64_t timebaseToSample(uint32_t usec);
+
+  // メトロノーム用に拍のタイミングを公開する
+  void publishBeat(uint32_t beat_usec, int32_t cycle_usec);
+  void stopBeat(void);
+  uint32_t _metronome_beat = 0;       // 次に公開する拍の通し番号
+  uint32_t _metronome_count_in = 0;   // カウントインの拍数
+  uint32_t _metronome_session = 0;
+  bool _metronome_running = false;
+
   // 自動でアルペジエータが先頭に戻るまでのタイムアウト残り時間(マイクロ秒)
   int32_t _arpeggio_reset_remain_usec = -1;
 
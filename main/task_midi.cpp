@@ -12,6 +12,14 @@
 #include "midi/midi_transport_uart.hpp"
 #include "midi/midi_transport_ble.hpp"
 #include "midi/midi_transport_usb.hpp"
+#include "midi/midi_broadcast.hpp"
+#include "midi/midi_coalesce.hpp"
+#include "midi/midi_transport_loopback.hpp"
+#include "midi/midi_transport_alsa.hpp"
+#include "midi/midi_capture.hpp"
+#include "midi/midi_latency_probe.hpp"
+#include "midi/midi_sysex_transfer.hpp"
+#include "song_transfer.hpp"
 
 #if __has_include(<freertos/freertos.h>)
  #include <freertos/FreeRTOS.h>
@@ -20,10 +28,44 @@
 
 namespace kanplay_ns {
 //-------------------------------------------------------------------------
+// 送信メッセージの配信用リング。MIDI親タスクが midi_out_control の履歴を一度だけ書き込み、各サブタスクが読み出す
+static midi_driver::MIDI_BroadcastRing midi_out_ring;
+
 class subtask_midi_t {
 private:
+  // 出力レイテンシ補正用の遅延ライン
+  struct delay_event_t {
+    uint32_t due_usec;
+    midi_driver::MIDI_BroadcastRing::slot_t message;
+  };
+  static constexpr const size_t delay_line_size = 128; // 2の累乗であること
+
   midi_driver::MIDIDriver _midi;
   system_registry_t::reg_task_status_t::bitindex_t _task_status_index;
+  def::midi::output_port_t _port;
+
+  delay_event_t _delay_line[delay_line_size];
+  uint16_t _delay_head = 0;
+  uint16_t _delay_tail = 0;
+  volatile uint32_t _delay_usec = 0;
+
+  // 送信が滞っている間のメッセージ待ち行列 (連続的なコントローラは最新値のみ残す)
+  midi_driver::MIDI_CoalesceQueue<def::midi::coalesce_queue_size> _coalesce;
+
+  // マスターボリューム設定の送信状態。送信が滞っている間は送らず、空いてから最新値のみを送る
+  uint8_t _sent_midi_volume = 255;
+  bool _master_volume_pending = false;
+
+  // 送信待ちの送出時間の最大値 (runtime_info へ反映する周期毎にリセット)
+  uint32_t _tx_backlog_max_usec = 0;
+  uint32_t _tx_backlog_publish_msec = 0;
+
+  // システムエクスクルーシブによるソングファイルの受信
+  song_transfer_t _transfer;
+
+// レイテンシ測定の状態
+  volatile bool _measure_request = false;
+  midi_driver::MIDI_LatencyProbe _probe;
 
 // インスタコードリンク判定フラグ
   bool _flg_instachord_link = false;
@@ -37,12 +79,26 @@ private:
 #endif
 
 public:
-  subtask_midi_t(midi_driver::MIDI_Transport* transport, system_registry_t::reg_task_status_t::bitindex_t task_status_index)
+  subtask_midi_t(midi_driver::MIDI_Transport* transport, system_registry_t::reg_task_status_t::bitindex_t task_status_index, def::midi::output_port_t port)
   : _midi { transport }
   , _task_status_index { task_status_index }
+  , _port { port }
   {
+    _midi.setSysExHandler(song_transfer_t::sysexHandler, &_transfer);
+    _probe.setup(def::midi::latency_probe_count, def::midi::latency_probe_timeout_usec);
+    _coalesce.setThreshold(def::midi::coalesce_threshold_usec, def::midi::coalesce_threshold_bytes);
   }
 
+  def::midi::output_port_t getPort(void) const { return _port; }
+
+  // 送信を遅らせる時間 (他ポートとの出力レイテンシ差)
+  void setDelayUsec(uint32_t usec) { _delay_usec = usec; }
+
+  void requestLatencyMeasure(void) { _measure_request = true; }
+
+  // 送受信データのキャプチャ先を設定する
+  void setRecorder(midi_driver::MIDI_Recorder* recorder) { _midi.setRecorder(recorder, _port); }
+
   void start(void)
   {
     if (_handle == nullptr) {
@@ -71,14 +127,228 @@ public:
     _flg_instachord_pad = (style == def::command::instachord_link_style_t::icls_pad);
   }
 
+protected:
+  bool delayLineEmpty(void) const { return _delay_head == _delay_tail; }
+
+public:
+  // 間引きにより破棄したメッセージ数
+  uint32_t getCoalesceCount(void) const { return _coalesce.getCoalesceCount(); }
+
+protected:
+
+  bool sendOut(uint8_t status, uint8_t data1, uint8_t data2)
+  {
+    midi_driver::MIDI_BroadcastRing::slot_t message;
+    message.length = midi_driver::getDataByteLength(status) + 1;
+    message.data[0] = status;
+    message.data[1] = data1;
+    message.data[2] = data2;
+    message.port_mask = midi_driver::MIDI_BroadcastRing::all_port;
+    message.event_usec = M5.micros();
+    return sendOut(message);
+  }
+
+  // 送信段。トランスポートの送信待ちが多い場合は待ち行列に積む (MIDI_CoalesceQueue 参照)。送信した場合はtrueを返す
+  bool sendOut(const midi_driver::MIDI_BroadcastRing::slot_t& message)
+  {
+    return _coalesce.send(_midi, message, M5.micros());
+  }
+
+  // 送信時刻を指定して遅延ラインに積む。満杯の場合は最も古いイベントを即時送信する
+  void delayLinePush(uint32_t due_usec, const midi_driver::MIDI_BroadcastRing::slot_t& message)
+  {
+    if ((uint16_t)(_delay_tail - _delay_head) >= delay_line_size) {
+      auto e = &_delay_line[_delay_head++ & (delay_line_size - 1)];
+      sendOut(e->message);
+    }
+    auto e = &_delay_line[_delay_tail++ & (delay_line_size - 1)];
+    e->due_usec = due_usec;
+    e->message = message;
+  }
+
+  // 配信用リングから読み出したメッセージを送信する。遅延させる場合は遅延ラインに積む
+  // 予定時刻も遅延させた分だけ後にずらす
+  bool outputMessage(const midi_driver::MIDI_BroadcastRing::slot_t& message, uint32_t usec, uint32_t delay_usec)
+  {
+    if (delay_usec == 0 && delayLineEmpty()) {
+      return sendOut(message);
+    }
+    // 他の遅いポートと発音タイミングを揃えるため遅延させて送信する
+    auto delayed = message;
+    delayed.event_usec += delay_usec;
+    delayLinePush(usec + delay_usec, delayed);
+    return false;
+  }
+
+  // マスターボリュームの変更を送信する。送信が滞っている場合は送らずに保留し、空いてから最新値のみを送る
+  bool processMasterVolume(uint32_t usec)
+  {
+    auto midi_volume = system_registry->user_setting.getMIDIMasterVolume();
+    _master_volume_pending = false;
+    if (_sent_midi_volume == midi_volume) { return false; }
+    if (!_coalesce.empty() || _coalesce.isTxBusy(_midi, usec)) {
+      _master_volume_pending = true;
+      return false;
+    }
+    _sent_midi_volume = midi_volume;
+
+    // マスターボリューム設定
+    sendOut(def::midi::control_change | def::midi::channel_1, 99, 55);
+    sendOut(def::midi::control_change | def::midi::channel_1, 98,  7);
+    sendOut(def::midi::control_change | def::midi::channel_1,  6, midi_volume);
+    for (int i = 0; i < 16; ++i) {
+      // チャンネルボリュームおよびプログラムチェンジを設定
+      sendOut(def::midi::control_change | (def::midi::channel_1 + i), 7, system_registry->midi_out_control.getChannelVolume(i));
+      sendOut(def::midi::program_change | (def::midi::channel_1 + i), system_registry->midi_out_control.getProgramChange(i), 0);
+    }
+    return true;
+  }
+
+  // 配信用リングの読み出しが追い越された場合の処理
+  // 失われたメッセージにノートオフが含まれていると音が鳴り続けるため、全チャンネルの発音を止める
+  bool outputAllNotesOff(uint32_t usec, uint32_t delay_usec)
+  {
+    M5_LOGW("midi out ring overrun. port:%d", _port);
+    bool sent = false;
+    midi_driver::MIDI_BroadcastRing::slot_t message;
+    message.length = 3;
+    message.data[1] = 123; // CC#123 オールノートオフ
+    message.data[2] = 0;
+    message.port_mask = midi_driver::MIDI_BroadcastRing::all_port;
+    message.event_usec = usec;
+    for (int i = 0; i < 16; ++i) {
+      message.data[0] = def::midi::control_change | (def::midi::channel_1 + i);
+      sent |= outputMessage(message, usec, delay_usec);
+    }
+    return sent;
+  }
+
+  // 送信時刻に達したイベントを送信する。送信した場合はtrueを返す
+  bool delayLineProcess(uint32_t usec)
+  {
+    bool sent = false;
+    while (!delayLineEmpty()) {
+      auto e = &_delay_line[_delay_head & (delay_line_size - 1)];
+      if ((int32_t)(e->due_usec - usec) > 0) { break; }
+      sent |= sendOut(e->message);
+      ++_delay_head;
+    }
+    return sent;
+  }
+
+  // 次の処理までの待ち時間 (usec)
+  uint32_t getWaitUsec(uint32_t usec) const
+  {
+    uint32_t wait = UINT32_MAX;
+    if (!delayLineEmpty()) {
+      int32_t diff = _delay_line[_delay_head & (delay_line_size - 1)].due_usec - usec;
+      wait = diff > 0 ? diff : 0;
+    }
+    if (!_coalesce.empty() || _master_volume_pending) {
+      // 送信待ち行列や保留中の設定がある場合は、送信待ちが間引きの閾値を下回る見込みの時刻に起床する
+      uint32_t coalesce_wait = _coalesce.getDrainWaitUsec(_midi, usec);
+      if (wait > coalesce_wait) { wait = coalesce_wait; }
+    }
+    // トランスポートが送信データを保留している場合は送出期限に起床する
+    uint32_t flush_wait = _midi.getFlushWaitUsec(usec);
+    if (wait > flush_wait) { wait = flush_wait; }
+    uint32_t probe_wait = _probe.getWaitUsec(usec);
+    if (wait > probe_wait) { wait = probe_wait; }
+    return wait;
+  }
+
+  // レイテンシ測定の進行。プローブを送信した場合はtrueを返す
+  bool processMeasure(uint32_t usec, bool rx_enable)
+  {
+    if (_measure_request) {
+      _measure_request = false;
+      if (!rx_enable) {
+        M5_LOGW("midi latency measure: input is not enabled. port:%d", _port);
+        return false;
+      }
+      _probe.start();
+    }
+    switch (_probe.process(usec)) {
+    default:
+      return false;
+
+    case midi_driver::MIDI_LatencyProbe::ev_done:
+      finishMeasure();
+      return false;
+
+    case midi_driver::MIDI_LatencyProbe::ev_send:
+      _midi.sendMessage(midi_driver::MIDI_LatencyProbe::probe_status, _probe.getSeq(), midi_driver::MIDI_LatencyProbe::probe_marker);
+      return true;
+    }
+  }
+
+  // 送信不可になった場合は送信待ちと測定を破棄する
+  void cancelPending(void)
+  {
+    _delay_head = _delay_tail;
+    _coalesce.clear();
+    _master_volume_pending = false;
+    _measure_request = false;
+    _probe.cancel();
+  }
+
+  // 送信待ちの送出時間を記録し、周期毎に最大値を runtime_info へ反映する
+  void updateTxBacklog(uint32_t usec)
+  {
+    uint32_t drain = _midi.getTxDrainUsec(usec);
+    if (drain != UINT32_MAX && _tx_backlog_max_usec < drain) {
+      _tx_backlog_max_usec = drain;
+    }
+    uint32_t msec = usec / 1000;
+    if (msec - _tx_backlog_publish_msec < def::midi::tx_backlog_publish_msec) { return; }
+    _tx_backlog_publish_msec = msec;
+    uint32_t backlog_msec = (_tx_backlog_max_usec + 999) / 1000;
+    if (backlog_msec > 255) { backlog_msec = 255; }
+    _tx_backlog_max_usec = 0;
+    system_registry->runtime_info.setMidiOutOverrunCount(midi_out_ring.getOverrunCount());
+    switch (_task_status_index) {
+    case system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_INTERNAL:
+      system_registry->runtime_info.setMidiTxBacklogInternal(backlog_msec);
+      system_registry->runtime_info.setMidiCoalesceCountInternal(_coalesce.getCoalesceCount());
+      break;
+    case system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_EXTERNAL:
+      system_registry->runtime_info.setMidiTxBacklogPC(backlog_msec);
+      system_registry->runtime_info.setMidiCoalesceCountPC(_coalesce.getCoalesceCount());
+      break;
+    default:
+      break;
+    }
+  }
+
+  void finishMeasure(void)
+  {
+    auto& result = _probe.getResult();
+    if (result.received == 0) {
+      M5_LOGW("midi latency measure: no loopback response. port:%d", _port);
+      return;
+    }
+    // 片道レイテンシは往復時間の半分とみなす
+    uint32_t latency_msec = (result.rtt_avg / 2 + 500) / 1000;
+    M5_LOGI("midi latency measure: port:%d  rtt min:%lu avg:%lu max:%lu usec (%d/%d)", _port
+           , (unsigned long)result.rtt_min, (unsigned long)result.rtt_avg, (unsigned long)result.rtt_max
+           , result.received, result.sent);
+    system_registry->midi_port_setting.setOutputLatency(_port, latency_msec > UINT8_MAX ? UINT8_MAX : latency_msec);
+  }
+
+  // 受信メッセージが測定用プローブの応答であれば処理してtrueを返す
+  bool checkProbe(const midi_driver::MIDI_Message& message, uint32_t usec)
+  {
+    return _probe.checkMessage(message.status, message.data.size(), message.data.data(), usec);
+  }
+
+public:
   static void task_func(subtask_midi_t* me)
   {
     auto midi = &(me->_midi);
-    registry_t::history_code_t history_code_midi_out = 0;
+    midi_driver::MIDI_BroadcastRing::cursor_t midi_out_cursor = 0;
     uint32_t prev_on_beat_msec = 0;
     degree_param_t prev_on_beat_degree;
     degree_param_t on_beat_degree;
-    uint8_t prev_midi_volume = 0;
     bool prev_tx_enable = false;
     bool prev_rx_enable = false;
     uint8_t prev_slot_key = 255;
@@ -97,12 +367,21 @@ public:
 #else
       if (ulTaskNotifyTake(pdTRUE, 0) == 0)
       {
+        // 遅延ラインに送信待ちがある場合は送信時刻に起床する
+        TickType_t wait_tick = 2048;
+        uint32_t wait_usec = me->getWaitUsec(M5.micros());
+        if (wait_usec != UINT32_MAX) {
+          wait_tick = pdMS_TO_TICKS((wait_usec + 999) / 1000);
+          if (wait_tick == 0) { wait_tick = 1; }
+          if (wait_tick > 2048) { wait_tick = 2048; }
+        }
         system_registry->task_status.setSuspend(me->_task_status_index);
         // ulTaskNotifyTake(pdTRUE, (prev_tx_enable) ? 32 : 512);
-        ulTaskNotifyTake(pdTRUE, 2048);
+        ulTaskNotifyTake(pdTRUE, wait_tick);
         system_registry->task_status.setWorking(me->_task_status_index);
       } 
 #endif
+      const uint32_t usec = M5.micros();
       bool connected = midi->isConnected();
       bool tx_enable = connected && midi->getUseTx();
       bool rx_enable = connected && midi->getUseRx();
@@ -121,6 +400,8 @@ public:
 
           do {
             ++rx_count;
+            // レイテンシ測定用プローブの応答は入力として扱わない
+            if (me->checkProbe(message, usec)) { continue; }
 //  printf("status:%02x  len:%d  data:%02x %02x\n", message.status, message.data.size(), message.data[0], message.data[1]);
 //  fflush(stdout);
             // MIDIスルーフラグ
@@ -187,19 +468,41 @@ public:
             }
             if (midi_thru == true && message.data.size() > 1 && message.data.size() <= 2) {
               // MIDIノートがコマンドマッピングされていない場合
-              system_registry->midi_out_control.setMessage(message.status, message.data[0], message.data[1]);
+              // ルーティング設定に従って出力先と変換を決定する
+              uint8_t status = message.status;
+              uint8_t data1 = message.data[0];
+              uint8_t data2 = message.data[1];
+              uint8_t port_mask;
+              if (system_registry->midi_router.route(me->_port, status, data1, data2, port_mask)) {
+                if (port_mask == midi_router_t::all_port) {
+                  system_registry->midi_out_control.setMessage(status, data1, data2);
+                } else {
+                  system_registry->midi_out_control.setRoutedMessage(status, data1, data2, port_mask);
+                }
+              }
             }
           } while (midi->receiveMessage(&message));
         }
+        // ソング転送の応答を返す (応答は受信処理の中で作られる)
+        uint8_t reply[16];
+        size_t reply_len = me->_transfer.popReply(reply);
+        if (reply_len && tx_enable) {
+          midi->sendRawMessage(reply, reply_len);
+          midi->sendFlush();
+        }
+      } else if (prev_rx_enable) {
+        prev_rx_enable = false;
+        // 受信できなくなった場合は転送中のソングを破棄する
+        me->_transfer.cancel();
       }
 
       bool queued = false;
       if (prev_tx_enable != tx_enable) {
         prev_tx_enable = tx_enable;
         if (tx_enable) {
-          prev_midi_volume = 255;
+          me->_sent_midi_volume = 255;
           prev_slot_key = 255;
-          history_code_midi_out = system_registry->midi_out_control.getHistoryCode();
+          midi_out_cursor = midi_out_ring.getWriteCursor();
           for (int i = 0; i < 16; ++i) { // CC#120はすべてのMIDI音を停止する
             midi->sendControlChange(def::midi::channel_1 + i, 120, 0);
           }
@@ -217,62 +520,64 @@ public:
           if (prev_slot_key != slot_key) {
             prev_slot_key = slot_key;
             // マスタースロットキー設定
-            midi->sendControlChange(def::midi::channel_15, 0x0F, slot_key);
+            me->sendOut(def::midi::control_change | def::midi::channel_15, 0x0F, slot_key);
             queued = true;
           }
         }
         if (!me->_flg_instachord_link || me->_flg_instachord_out)
         {
-          auto midi_volume = system_registry->user_setting.getMIDIMasterVolume();
-          if (prev_midi_volume != midi_volume) {
-            prev_midi_volume = midi_volume;
-
-            // マスターボリューム設定
-            midi->sendControlChange(def::midi::channel_1, 99, 55);
-            midi->sendControlChange(def::midi::channel_1, 98,  7);
-            midi->sendControlChange(def::midi::channel_1,  6, midi_volume);
-            for (int i = 0; i < 16; ++i) {
-              // チャンネルボリュームおよびプログラムチェンジを設定
-              uint8_t vol = system_registry->midi_out_control.getChannelVolume(i);
-              uint8_t prg = system_registry->midi_out_control.getProgramChange(i);
-              midi->sendControlChange(def::midi::channel_1 + i, 7, vol);
-              midi->sendProgramChange(def::midi::channel_1 + i, prg);
-  // printf("MIDI Channel %d Volume: %d, Program: %d\n", i, vol, prg);
-  // fflush(stdout);
-            }
+          if (me->processMasterVolume(M5.micros())) {
             queued = true;
           }
 
-          const registry_t::history_t* history;
-          while (nullptr != (history = system_registry->midi_out_control.getHistory(history_code_midi_out))) {
-            uint8_t status = history->index & 0xFF;
-//          uint8_t midi_ch = status & 0x0F;
-            uint8_t data1 = history->value & 0xFF;
-            uint8_t data2 = (history->value >> 8) & 0xFF;
-            midi->sendMessage(status, data1, data2);
+          const uint32_t delay_usec = me->_delay_usec;
+          // 親タスクでシリアライズ済みのメッセージを、トランスポート固有の形式にして送信する
+          midi_driver::MIDI_BroadcastRing::slot_t message;
+          uint32_t lost_count = 0;
+          while (midi_out_ring.pop(midi_out_cursor, &message, &lost_count)) {
+            if (lost_count) {
+              lost_count = 0;
+              queued |= me->outputAllNotesOff(usec, delay_usec);
+            }
+            if (!(message.port_mask & (1 << me->_port))) { continue; }
+            queued |= me->outputMessage(message, usec, delay_usec);
+          }
+          if (me->delayLineProcess(M5.micros())) {
+            queued = true;
+          }
+          if (me->_coalesce.process(*midi, M5.micros())) {
             queued = true;
           }
         }
-        if (queued) {
+        if (me->processMeasure(usec, rx_enable)) {
+          queued = true;
+        }
+        if (queued || midi->getFlushWaitUsec(M5.micros()) == 0) {
           // MIDI送信バッファをフラッシュ
           if (midi->sendFlush()) {
             tx_count++;
           };
         }
+        me->updateTxBacklog(M5.micros());
+      } else {
+        me->cancelPending();
       }
 
       switch (me->_task_status_index) {
       case system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_EXTERNAL:
         system_registry->runtime_info.setMidiTxCountPC(tx_count);
         system_registry->runtime_info.setMidiRxCountPC(rx_count);
+        system_registry->runtime_info.setMidiSysExDropCountPC(midi->getSysExDropCount());
         break;
       case system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_BLE:
         system_registry->runtime_info.setMidiTxCountBLE(tx_count);
         system_registry->runtime_info.setMidiRxCountBLE(rx_count);
+        system_registry->runtime_info.setMidiSysExDropCountBLE(midi->getSysExDropCount());
         break;
       case system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_USB:
         system_registry->runtime_info.setMidiTxCountUSB(tx_count);
         system_registry->runtime_info.setMidiRxCountUSB(rx_count);
+        system_registry->runtime_info.setMidiSysExDropCountUSB(midi->getSysExDropCount());
         break;
       default:
         break;
@@ -283,23 +588,92 @@ public:
 
 #if defined (M5UNIFIED_PC_BUILD)
 
-static subtask_midi_t* subtask_array[] = {};
+// PCビルドでは PortC の代わりにループバックを使用する (KANPLAY_MIDI_ALSA を定義した場合は ALSAシーケンサ)
+#ifdef MIDI_TRANSPORT_ALSA_HPP
+static midi_driver::MIDI_Transport_ALSA pc_midi_transport;
+#else
+// ループバックの相手側は計測用に受信データを溜めるのみ
+static midi_driver::MIDI_Transport_Loopback pc_midi_transport;
+static midi_driver::MIDI_Transport_Loopback pc_midi_loopback_peer;
+#endif
+static subtask_midi_t pc_midi_subtask { &pc_midi_transport, system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_EXTERNAL, def::midi::out_port_port_c };
+
+static subtask_midi_t* subtask_array[] = {
+  &pc_midi_subtask,
+};
+
+// 環境変数 KANPLAY_MIDI_CAPTURE で指定したファイルへ送受信データを記録する
+static midi_driver::MIDI_CaptureWriter pc_midi_capture;
+
+#ifndef MIDI_TRANSPORT_ALSA_HPP
+// 環境変数 KANPLAY_MIDI_REPLAY で指定したキャプチャをループバック経由で PortC の入力へ流し込む
+// (PortC の MIDI入力を有効にしておくこと。再生速度は KANPLAY_MIDI_REPLAY_SPEED で指定する)
+static int pc_midi_replay_func(void*)
+{
+  const char* path = getenv("KANPLAY_MIDI_REPLAY");
+  const char* speed = getenv("KANPLAY_MIDI_REPLAY_SPEED");
+  midi_driver::MIDI_CaptureReplayer::config_t config;
+  if (speed != nullptr) { config.speed = atof(speed); }
+  midi_driver::MIDI_CaptureReplayer replayer;
+  replayer.setConfig(config);
+
+  // 起動直後の設定読込みを待ってから開始する
+  M5.delay(1000);
+  pc_midi_loopback_peer.setUseTx(true);
+  midi_driver::MIDI_CaptureReplayer::report_t report;
+  if (replayer.replay(path, &pc_midi_loopback_peer, nullptr, &report)) {
+    midi_driver::MIDI_CaptureReplayer::printReport(report);
+    printf("midi replay: loopback overflow %u\n", (unsigned)pc_midi_transport.getRxOverflowCount());
+  } else {
+    printf("midi replay: can not open %s\n", path);
+  }
+  pc_midi_loopback_peer.setUseTx(false);
+  return 0;
+}
+
+// 環境変数 KANPLAY_SYSEX_SEND で指定したソングファイルをループバック経由でシステムエクスクルーシブ転送する
+// (PortC の MIDI入出力を有効にしておくこと。保存名は KANPLAY_SYSEX_NAME で指定できる)
+static int pc_sysex_send_func(void*)
+{
+  const char* path = getenv("KANPLAY_SYSEX_SEND");
+  const char* name = getenv("KANPLAY_SYSEX_NAME");
+  if (name == nullptr) {
+    name = strrchr(path, '/');
+    name = (name != nullptr) ? name + 1 : path;
+  }
+
+  M5.delay(1000);
+  pc_midi_loopback_peer.setUseTx(true);
+  {
+    midi_driver::MIDIDriver receiver { &pc_midi_loopback_peer };
+    midi_driver::MIDI_SysExSender sender { &pc_midi_loopback_peer, &receiver };
+    midi_driver::MIDI_SysExSender::report_t report;
+    pc_midi_transport.resetRxHighWater();
+    sender.send(path, (uint8_t)def::app::data_type_t::data_song_users, name, &report);
+    // 受信側 (PortCのサブタスク) のループバックの受信バッファ
+    report.rx_high_water = pc_midi_transport.getRxHighWater();
+    midi_driver::MIDI_SysExSender::printReport(report);
+  }
+  pc_midi_loopback_peer.setUseTx(false);
+  return 0;
+}
+#endif
 
 #else
 
 static midi_driver::MIDI_Transport_UART in_uart_midi_transport; // かんぷれ内部MIDI
 static midi_driver::MIDI_Transport_UART portc_midi_transport; // PortC外部MIDI
 
-static subtask_midi_t in_uart_midi_subtask { &in_uart_midi_transport, system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_INTERNAL };
-static subtask_midi_t portc_midi_subtask { &portc_midi_transport, system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_EXTERNAL };
+static subtask_midi_t in_uart_midi_subtask { &in_uart_midi_transport, system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_INTERNAL, def::midi::out_port_internal };
+static subtask_midi_t portc_midi_subtask { &portc_midi_transport, system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_EXTERNAL, def::midi::out_port_port_c };
 
 #ifdef MIDI_TRANSPORT_BLE_HPP
 static midi_driver::MIDI_Transport_BLE ble_midi_transport; // BLE-MIDI
-static subtask_midi_t ble_midi_subtask { &ble_midi_transport, system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_BLE };
+static subtask_midi_t ble_midi_subtask { &ble_midi_transport, system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_BLE, def::midi::out_port_ble };
 #endif
 #ifdef MIDI_TRANSPORT_USB_HPP
 static midi_driver::MIDI_Transport_USB usb_midi_transport; // USB-MIDI
-static subtask_midi_t usb_midi_subtask { &usb_midi_transport, system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_USB };
+static subtask_midi_t usb_midi_subtask { &usb_midi_transport, system_registry_t::reg_task_status_t::bitindex_t::TASK_MIDI_USB, def::midi::out_port_usb };
 #endif
 
 
@@ -327,6 +701,25 @@ void task_midi_t::start(void)
   // windows_midi_transport.changeEnable(true, false);
 
   // auto thread = SDL_CreateThread((SDL_ThreadFunction)task_func, "midi", this);
+#ifndef MIDI_TRANSPORT_ALSA_HPP
+  midi_driver::MIDI_Transport_Loopback::connect(&pc_midi_transport, &pc_midi_loopback_peer);
+  pc_midi_loopback_peer.begin();
+  pc_midi_loopback_peer.setUseTxRx(false, true);
+  if (getenv("KANPLAY_MIDI_REPLAY") != nullptr) {
+    SDL_CreateThread(pc_midi_replay_func, "midi_replay", nullptr);
+  }
+  if (getenv("KANPLAY_SYSEX_SEND") != nullptr) {
+    SDL_CreateThread(pc_sysex_send_func, "sysex_send", nullptr);
+  }
+#endif
+  if (const char* path = getenv("KANPLAY_MIDI_CAPTURE")) {
+    if (pc_midi_capture.open(path)) {
+      for (auto subtask : subtask_array) { subtask->setRecorder(&pc_midi_capture); }
+    } else {
+      printf("midi capture: can not open %s\n", path);
+    }
+  }
+  SDL_CreateThread((SDL_ThreadFunction)task_func, "midi", this);
 #else
   {
     midi_driver::MIDI_Transport_UART::config_t config;
@@ -372,11 +765,47 @@ void task_midi_t::start(void)
 
 }
 
+// midi_out_control の変更履歴を配信用リングへシリアライズする
+// 各トランスポートが個別に履歴を解釈する必要がないよう、ここで一度だけ行う
+// 演奏タスクが予定時刻を付けたメッセージはその時刻を、それ以外は読み出した時刻を予定時刻とする
+static void serializeMidiOut(registry_t::history_code_t &history_code)
+{
+  const registry_t::history_t* history;
+  const uint32_t usec = M5.micros();
+  while (nullptr != (history = system_registry->midi_out_control.getHistory(history_code))) {
+    uint32_t event_usec;
+    if (!system_registry->midi_out_control.getEventTime(history, &event_usec)) { event_usec = usec; }
+    uint8_t status = history->index & 0xFF;
+    uint8_t data1 = history->value & 0xFF;
+    uint8_t data2 = (history->value >> 8) & 0xFF;
+    // ルーティングにより出力先が限定されている場合は上位に出力先ポートが格納されている
+    uint8_t port_mask = (history->value >> 16) & 0xFF;
+    midi_out_ring.push(status, data1, data2, port_mask ? port_mask : midi_driver::MIDI_BroadcastRing::all_port, event_usec);
+  }
+}
+
 void task_midi_t::task_func(task_midi_t* me)
 {
+  registry_t::history_code_t history_code_midi_out = system_registry->midi_out_control.getHistoryCode();
 #if defined (M5UNIFIED_PC_BUILD)
+  bool prev_portc_out = false;
+  bool prev_portc_in = false;
   for (;;) {
     M5.delay(1);
+    serializeMidiOut(history_code_midi_out);
+
+    auto portc_setting = system_registry->midi_port_setting.getPortCMIDI();
+    bool portc_out = portc_setting & def::command::ex_midi_mode_t::midi_output;
+    bool portc_in  = portc_setting & def::command::ex_midi_mode_t::midi_input;
+    if (prev_portc_out != portc_out || prev_portc_in != portc_in) {
+      if (portc_in || portc_out) {
+        pc_midi_subtask.start();
+      }
+      prev_portc_out = portc_out;
+      prev_portc_in  = portc_in;
+      pc_midi_transport.setUseTxRx(portc_out, portc_in);
+      system_registry->runtime_info.setMidiPortStatePC((portc_out || portc_in) ? def::command::midiport_info_t::mp_connected : def::command::midiport_info_t::mp_off);
+    }
   }
 #else
   bool prev_portc_out = false;
@@ -398,6 +827,8 @@ void task_midi_t::task_func(task_midi_t* me)
   for (;;) {
     ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
+    serializeMidiOut(history_code_midi_out);
+
     auto iclink_port = system_registry->midi_port_setting.getInstaChordLinkPort();
     auto iclink_dev = system_registry->midi_port_setting.getInstaChordLinkDev();
     auto iclink_style = system_registry->midi_port_setting.getInstaChordLinkStyle();
@@ -495,6 +926,39 @@ void task_midi_t::task_func(task_midi_t* me)
     }
 #endif
 
+    { // 出力レイテンシ補正 : 出力が有効なポートのうち最も遅いポートに合わせて、他のポートの送信を遅延させる
+      bool output_enabled[def::midi::out_port_max] = { true, portc_out, false, false };
+#ifdef MIDI_TRANSPORT_BLE_HPP
+      output_enabled[def::midi::out_port_ble] = ble_out;
+#endif
+#ifdef MIDI_TRANSPORT_USB_HPP
+      output_enabled[def::midi::out_port_usb] = usb_out;
+#endif
+      uint8_t latency_max = 0;
+      for (int i = 0; i < def::midi::out_port_max; ++i) {
+        if (!output_enabled[i]) { continue; }
+        uint8_t latency = system_registry->midi_port_setting.getOutputLatency((def::midi::output_port_t)i);
+        if (latency_max < latency) { latency_max = latency; }
+      }
+      def::midi::output_port_t measure_port;
+      bool measure = system_registry->midi_port_setting.getLatencyMeasure(&measure_port);
+      if (measure) {
+        system_registry->midi_port_setting.clearLatencyMeasure();
+      }
+      for (auto &subtask : subtask_array) {
+        auto port = subtask->getPort();
+        uint8_t latency = system_registry->midi_port_setting.getOutputLatency(port);
+        uint8_t delay = output_enabled[port] ? (latency_max - latency) : 0;
+        subtask->setDelayUsec(delay * 1000u);
+        if (port == def::midi::out_port_internal) {
+          system_registry->runtime_info.setMidiInternalDelay(delay);
+        }
+        if (measure && measure_port == port) {
+          subtask->requestLatencyMeasure();
+        }
+      }
+    }
+
     for (auto &subtask : subtask_array) {
       subtask->execNotify();
     }
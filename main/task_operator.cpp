@@ -8,6 +8,8 @@
 #include "task_operator.hpp"
 #include "system_registry.hpp"
 #include "file_manage.hpp"
+#include "audio_recorder.hpp"
+#include "audio_latency.hpp"
 #include "menu_data.hpp"
 
 #if !defined (M5UNIFIED_PC_BUILD)
@@ -183,6 +185,7 @@ void task_operator_t::start(void)
   xTaskCreatePinnedToCore((TaskFunction_t)task_func, "operator", 4096, this, def::system::task_priority_operator, &handle, def::system::task_cpu_operator);
   system_registry->operator_command.setNotifyTaskHandle(handle);
   system_registry->working_command.setNotifyTaskHandle(handle);
+  audio_latency.setNotifyTaskHandle(handle);
 #endif
 }
 
@@ -198,6 +201,8 @@ void task_operator_t::task_func(task_operator_t* me)
 #endif
     system_registry->task_status.setWorking(system_registry_t::reg_task_status_t::bitindex_t::TASK_OPERATOR);
 
+    me->procLatencyProbe();
+
     bool is_pressed;
     def::command::command_param_t command_param;
     while (system_registry->operator_command.getQueue(&me->_history_code, &command_param, &is_pressed))
@@ -379,6 +384,7 @@ void task_operator_t::commandProccessor(const def::command::command_param_t& com
   case def::command::chord_step_reset_request:
   case def::command::autoplay_switch:
   case def::command::play_control:
+  case def::command::looper_control:
     system_registry->player_command.addQueue(command_param, is_pressed);
     break;
 
@@ -693,6 +699,18 @@ void task_operator_t::commandProccessor(const def::command::command_param_t& com
     }
     break;
 
+  case def::command::recorder_control:
+    if (is_pressed) {
+      procRecorderControl((def::command::recorder_control_t)param);
+    }
+    break;
+
+  case def::command::latency_control:
+    if (is_pressed) {
+      procLatencyControl((def::command::latency_control_t)param);
+    }
+    break;
+
   case def::command::system_control:
     if (is_pressed) {
       switch (param) {
@@ -1231,6 +1249,95 @@ void task_operator_t::procChordBassSemitone(const def::command::command_param_t&
   system_registry->chord_play.setChordBassSemitoneShift(value);
 }
 
+// オーディオ録音の開始・停止 (ファイルの作成と書込みは録音の書込みタスクが行う)
+void task_operator_t::procRecorderControl(def::command::recorder_control_t ctrl)
+{
+  auto state = audio_recorder.getState();
+  bool busy = (state != audio_recorder_t::rec_idle && state != audio_recorder_t::rec_error);
+  if (ctrl == def::command::recorder_control_t::rc_stop
+   || (ctrl == def::command::recorder_control_t::rc_toggle && busy)) {
+    audio_recorder.requestStop();
+    return;
+  }
+  if (busy) { return; }
+
+  if (!storage_sd.isBegin() && !storage_sd.beginStorage()) { return; }
+  storage_sd.makeDirectory(def::audio::recorder_path);
+
+  char path[64];
+  time_t t = time(nullptr);
+  auto tm = localtime(&t);
+  snprintf(path, sizeof(path), "%srec_%04d%02d%02d_%02d%02d%02d.wav", def::audio::recorder_path
+          , tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec);
+  if (!audio_recorder.requestStart(&storage_sd, path, system_registry->sample_clock.getSampleRate())) {
+    M5_LOGE("recorder: start failed");
+  }
+}
+
+void task_operator_t::procLatencyControl(def::command::latency_control_t ctrl)
+{
+  // 測定中に再度操作した場合は中止する
+  if (ctrl == def::command::latency_control_t::lt_cancel
+   || audio_latency.getState() == audio_latency_t::lat_measuring) {
+    audio_latency.requestCancel();
+    return;
+  }
+  auto mode = (ctrl == def::command::latency_control_t::lt_click)
+            ? audio_latency_t::mode_click
+            : audio_latency_t::mode_midi;
+  audio_latency.requestStart(mode, def::audio::latency_trials);
+}
+
+// I2Sタスクが測定した発音の遅れを反映する (ノートの送信と結果の保存はこのタスクで行う)
+void task_operator_t::procLatencyProbe(void)
+{
+  uint32_t probe = audio_latency.getProbe();
+  if (_latency_probe != probe) {
+    // 内蔵音源のみへ送信する (外部機器や内蔵シンセは鳴らさない)
+    auto send = [](bool on) {
+      system_registry->midi_out_control.setRoutedMessage((on ? 0x90 : 0x80) | def::audio::latency_midi_channel
+                                                        , def::audio::latency_midi_note
+                                                        , on ? def::audio::latency_midi_velocity : 0
+                                                        , 1 << def::midi::out_port_internal);
+    };
+    if (_latency_probe >> 1 != probe >> 1) {
+      // 新しいノートオン。前の音が鳴ったままなら先に止める (取り出す前に止まった音は送信しない)
+      if (_latency_probe & 1) { send(false); }
+      if (probe & 1) { send(true); }
+    } else if ((_latency_probe & 1) && !(probe & 1)) {
+      send(false);
+    }
+    _latency_probe = probe;
+  }
+
+  uint8_t state = audio_latency.getState();
+  uint8_t progress = audio_latency.getProgress();
+  if (_latency_state == state && _latency_progress == progress) { return; }
+  _latency_state = state;
+  _latency_progress = progress;
+  auto& ri = system_registry->runtime_info;
+  if (state == audio_latency_t::lat_done) {
+    // 中央値を以降のタイミング補正に使用するため保存する
+    auto& result = audio_latency.getResult();
+    auto clip = [](uint32_t usec) { return (uint16_t)(usec < UINT16_MAX ? usec : UINT16_MAX); };
+    ri.setLatencyResult(clip(result.min_usec), clip(result.median_usec), clip(result.max_usec), clip(result.jitter_usec));
+    if (result.mode == audio_latency_t::mode_midi) {
+      // 測定値には出力レイテンシ補正による送信の遅延が含まれるため、それを除いた内蔵音源そのものの遅れを保存し
+      // 内蔵音源の出力レイテンシとして設定して、外部ポートとの発音のずれを補正する
+      uint32_t applied_usec = ri.getMidiInternalDelay() * 1000u;
+      uint32_t usec = result.median_usec > applied_usec ? result.median_usec - applied_usec : 0;
+      system_registry->user_setting.setAudioLatencyMidiUsec(clip(usec));
+      uint32_t msec = (usec + 500) / 1000;
+      system_registry->midi_port_setting.setOutputLatency(def::midi::out_port_internal, msec < UINT8_MAX ? msec : UINT8_MAX);
+    } else {
+      system_registry->user_setting.setAudioLatencyLoopUsec(clip(result.median_usec));
+    }
+    M5_LOGI("latency: mode %d  %u/%u  min %u  median %u  max %u  jitter %u usec", result.mode, result.count, result.count + result.failures
+           , (unsigned)result.min_usec, (unsigned)result.median_usec, (unsigned)result.max_usec, (unsigned)result.jitter_usec);
+  }
+  ri.setLatencyState(state, progress);
+}
+
 // スロット番号設定操作
 void task_operator_t::setSlotIndex(uint8_t slot_index)
 {
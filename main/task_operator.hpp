@@ -27,6 +27,9 @@ private:
   void procChordBassDegree(const def::command::command_param_t& command_param, const bool is_pressed);
   void procChordBassSemitone(const def::command::command_param_t& command_param, const bool is_pressed);
   void procEditFunction(const def::command::command_param_t& command_param);
+  void procRecorderControl(def::command::recorder_control_t ctrl);
+  void procLatencyControl(def::command::latency_control_t ctrl);
+  void procLatencyProbe(void);
   void setSlotIndex(uint8_t slot_index);
 
   void changeCommandMapping(void);
@@ -38,6 +41,11 @@ private:
 
   uint8_t _modifier_press_order[8];
   uint8_t _bass_degree_press_order[8];
+
+  // 発音の遅れの測定 (I2Sタスクから受け取った発音状態と、反映済みの測定の状態)
+  uint32_t _latency_probe = 0;
+  uint8_t _latency_state = 0;
+  uint8_t _latency_progress = 0;
 };
 
 //-------------------------------------------------------------------------
@@ -144,14 +144,15 @@ void task_serial_listener_t::start() {
 
 void task_serial_listener_t::note_on(uint8_t ch, uint8_t note, uint8_t vel) {
   if (system_registry) {
-    system_registry->midi_out_control.setNoteVelocity(
+    // Routed through the play task so the voice manager can count and steal it
+    system_registry->midi_note_request.setNoteVelocity(
         ch, note, (vel & 0x7F) | KAN_ON_FLAG);
   }
 }
 
 void task_serial_listener_t::note_off(uint8_t ch, uint8_t note) {
   if (system_registry) {
-    system_registry->midi_out_control.setNoteVelocity(ch, note, 0);
+    system_registry->midi_note_request.setNoteVelocity(ch, note, 0);
   }
 }
 
@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#include "voice_manager.hpp"
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+
+int voice_manager_t::findVoice(uint8_t midi_ch, uint8_t note) const
+{
+  for (int i = 0; i < max_voice; ++i) {
+    auto v = &_voice[i];
+    if (v->velocity && v->midi_ch == midi_ch && v->note == note) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int voice_manager_t::findFreeVoice(void) const
+{
+  for (int i = 0; i < max_voice; ++i) {
+    if (_voice[i].velocity == 0) { return i; }
+  }
+  return -1;
+}
+
+int voice_manager_t::selectVictim(uint8_t part, uint8_t note) const
+{
+  int result = -1;
+  for (int i = 0; i < max_voice; ++i) {
+    auto v = &_voice[i];
+    if (v->velocity == 0) { continue; }
+    if (part < max_part && v->part != part) { continue; }
+    if (result < 0) {
+      result = i;
+      continue;
+    }
+    auto r = &_voice[result];
+    bool better = false;
+    switch (_policy) {
+    default:
+    case def::play::voice_steal_policy_t::steal_oldest:
+      better = v->order < r->order;
+      break;
+
+    case def::play::voice_steal_policy_t::steal_quietest:
+      better = (v->velocity < r->velocity)
+            || (v->velocity == r->velocity && v->order < r->order);
+      break;
+
+    case def::play::voice_steal_policy_t::steal_same_pitch:
+      { // 同じノートナンバーの音を優先し、その中で最も古いものを選ぶ
+        bool v_same = (v->note == note);
+        bool r_same = (r->note == note);
+        better = (v_same != r_same) ? v_same : (v->order < r->order);
+      }
+      break;
+    }
+    if (better) { result = i; }
+  }
+  return result;
+}
+
+void voice_manager_t::releaseVoice(int index, bool send_note_off)
+{
+  auto v = &_voice[index];
+  if (v->velocity == 0) { return; }
+  if (send_note_off && _midi_out != nullptr) {
+    _midi_out->setNoteVelocity(v->midi_ch, v->note, 0);
+  }
+  v->velocity = 0;
+  if (_part_count[v->part]) { --_part_count[v->part]; }
+  if (_active_count) { --_active_count; }
+}
+
+void voice_manager_t::stealVoice(int index)
+{
+  auto v = &_voice[index];
+  if (_last_steal_count < max_last_steal) {
+    _last_steal[_last_steal_count] = { v->part, v->midi_ch, v->note };
+  }
+  ++_last_steal_count;
+  ++_steal_count;
+  releaseVoice(index, true);
+}
+
+void voice_manager_t::noteOn(uint8_t part, uint8_t midi_ch, uint8_t note, uint8_t velocity)
+{
+  if (part >= max_part) { part = part_direct; }
+  _last_steal_count = 0;
+  velocity &= 0x7F;
+  if (velocity == 0) {
+    noteOff(midi_ch, note);
+    return;
+  }
+
+  int index = findVoice(midi_ch, note);
+  if (index >= 0) {
+    // 同じ音が既に鳴っている場合は同じボイスで再発音する (ボイス数は増えない)
+    auto v = &_voice[index];
+    if (v->part != part) {
+      if (_part_count[v->part]) { --_part_count[v->part]; }
+      ++_part_count[part];
+      v->part = part;
+    }
+  } else {
+    // パート毎の上限を超える場合は同じパート内から停止させる
+    if (_part_limit && _part_count[part] >= _part_limit) {
+      int victim = selectVictim(part, note);
+      if (victim >= 0) {
+        stealVoice(victim);
+      }
+    }
+    // 全体の上限を超える場合は全パートから停止させる
+    while (_active_count >= _global_limit) {
+      int victim = selectVictim(max_part, note);
+      if (victim < 0) { break; }
+      stealVoice(victim);
+    }
+    index = findFreeVoice();
+    if (index < 0) { return; }
+    ++_part_count[part];
+    ++_active_count;
+  }
+
+  auto v = &_voice[index];
+  v->order = ++_order_counter;
+  v->part = part;
+  v->midi_ch = midi_ch;
+  v->note = note;
+  v->velocity = velocity;
+  if (_midi_out != nullptr) {
+    _midi_out->setNoteVelocity(midi_ch, note, velocity | 0x80);
+  }
+}
+
+void voice_manager_t::noteOff(uint8_t midi_ch, uint8_t note)
+{
+  int index = findVoice(midi_ch, note);
+  if (index >= 0) {
+    releaseVoice(index, true);
+  }
+}
+
+void voice_manager_t::resetChannel(uint8_t midi_ch)
+{
+  for (int i = 0; i < max_voice; ++i) {
+    if (_voice[i].velocity && _voice[i].midi_ch == midi_ch) {
+      releaseVoice(i, false);
+    }
+  }
+}
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_VOICE_MANAGER_HPP
+#define KANPLAY_VOICE_MANAGER_HPP
+
+/*
+voice_manager は 演奏エンジンと midi_out_control の間で発音数を管理します。
+ - パート毎と全体の同時発音数の上限を適用する
+ - 上限を超えた場合は設定されたポリシーに従って発音中のボイスを停止(スティール)する
+ - 発音していない音へのノートオフは送信しない
+ - 手動演奏に加え、ルーパーの再生や外部から要求された発音もここを経由して数える
+*/
+
+#include "common_define.hpp"
+#include "midi_out_control.hpp"
+
+#include <stdint.h>
+
+namespace kanplay_ns {
+//-------------------------------------------------------------------------
+class voice_manager_t {
+public:
+  // 管理可能なボイスの最大数 (全体の上限設定の最大値)
+  static constexpr const uint8_t max_voice = def::app::max_voice;
+
+  // コード演奏パートに加え、ノート演奏・ドラム演奏のボタン用と、外部入力用、ルーパー再生用のパートを持つ
+  static constexpr const uint8_t part_direct = def::app::max_chord_part;
+  static constexpr const uint8_t part_external = def::app::max_chord_part + 1;
+  static constexpr const uint8_t part_looper = def::app::max_chord_part + 2;
+  static constexpr const uint8_t max_part = def::app::max_chord_part + 3;
+
+  // 直前の noteOn で停止させたボイス (ルーパーが自身の再生で生じたノートオフを録音しないために使用する)
+  struct steal_t {
+    uint8_t part;
+    uint8_t midi_ch;
+    uint8_t note;
+  };
+  static constexpr const uint8_t max_last_steal = 8;
+
+  // ノートオン・オフの出力先 (未設定の場合は数えるのみで出力しない)
+  void setOutput(reg_midi_out_control_t* midi_out) { _midi_out = midi_out; }
+
+  // 同時発音数の上限 (global_limit は 1~max_voice 、part_limit は 0 でパート毎の上限なし)
+  void setLimit(uint8_t global_limit, uint8_t part_limit) {
+    if (global_limit == 0 || global_limit > max_voice) { global_limit = max_voice; }
+    _global_limit = global_limit;
+    _part_limit = part_limit;
+  }
+  void setPolicy(def::play::voice_steal_policy_t policy) { _policy = policy; }
+
+  // ノートオン (velocity は 1~127)
+  void noteOn(uint8_t part, uint8_t midi_ch, uint8_t note, uint8_t velocity);
+
+  // ノートオフ (発音中でない音は無視する)
+  void noteOff(uint8_t midi_ch, uint8_t note);
+
+  // 指定チャンネルの管理情報を破棄する (CC#120等でチャンネルの音を止めた場合に使用)
+  void resetChannel(uint8_t midi_ch);
+
+  // これまでにスティールしたボイスの総数
+  uint32_t getStealCount(void) const { return _steal_count; }
+
+  // 直前の noteOn で停止させたボイス (max_last_steal を超えた分は数のみ)
+  uint8_t getLastStealCount(void) const { return _last_steal_count; }
+  const steal_t& getLastSteal(uint8_t index) const { return _last_steal[index]; }
+
+  // 現在発音中のボイス数
+  uint8_t getActiveCount(void) const { return _active_count; }
+
+protected:
+  struct voice_t {
+    uint32_t order;     // 発音順序 (小さいほど古い)
+    uint8_t part;
+    uint8_t midi_ch;
+    uint8_t note;
+    uint8_t velocity;   // 0 は未使用のボイス
+  };
+  voice_t _voice[max_voice] = {};
+  reg_midi_out_control_t* _midi_out = nullptr;
+  uint8_t _part_count[max_part] = {};
+  uint8_t _active_count = 0;
+  uint8_t _global_limit = max_voice;
+  uint8_t _part_limit = 0;
+  def::play::voice_steal_policy_t _policy = def::play::voice_steal_policy_t::steal_oldest;
+  uint32_t _order_counter = 0;
+  uint32_t _steal_count = 0;
+  steal_t _last_steal[max_last_steal] = {};
+  uint8_t _last_steal_count = 0;
+
+  int findVoice(uint8_t midi_ch, uint8_t note) const;
+  int findFreeVoice(void) const;
+
+  // 停止させるボイスを選ぶ (part が max_part 以上の場合は全パートから選ぶ)
+  int selectVictim(uint8_t part, uint8_t note) const;
+
+  void releaseVoice(int index, bool send_note_off);
+  void stealVoice(int index);
+};
+
+//-------------------------------------------------------------------------
+}; // namespace kanplay_ns
+
+#endif
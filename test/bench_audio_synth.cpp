@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// audio_synth_t の処理時間を測定する
+//  - benchmark() による 1ボイス × 1ブロックあたりの処理時間 (ブロック長 48 / 96 フレーム)
+//  - 演奏 (コードのストラム・ベース・ドラム) を実時間に依らずオフラインで描画し、実時間に対する速度を求める
+// 環境変数 KANPLAY_SYNTH_WAV でファイル名を指定すると、オフラインで描画した音を WAVファイルへ書き出す
+// (PC版の KANPLAY_SYNTH_WAV は仮想DMAクロックに合わせて実時間で描画するため、長い演奏の確認にはこちらを使う)
+
+#include "test_util.hpp"
+#include "audio_synth.hpp"
+#include "audio_recorder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace kanplay_ns;
+
+namespace {
+
+static constexpr const uint32_t sample_rate = 48000;
+static constexpr const size_t block_frames = 48;
+static constexpr const uint32_t play_sec = 20;
+
+uint32_t getUsec(void)
+{
+  static const auto base = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - base).count();
+}
+
+// 1拍毎にメッセージを送る。4拍毎にコードを変え、ストラム (弦毎に少しずつ遅らせる) とベース・ドラムを鳴らす
+void playBeat(uint32_t beat, std::vector<std::pair<uint32_t, uint32_t>>& schedule, uint32_t beat_frames)
+{
+  static constexpr const uint8_t roots[] = { 48, 53, 55, 45 };
+  static constexpr const uint8_t chord[] = { 0, 7, 12, 16, 19, 24 };
+  uint32_t frame = beat * beat_frames;
+  uint8_t root = roots[(beat / 4) % 4];
+  // 前の拍の音を止める
+  if (beat) {
+    uint8_t prev_root = roots[((beat - 1) / 4) % 4];
+    for (auto c : chord) { schedule.push_back({ frame, 0x80u | (uint32_t)(prev_root + c) << 8 }); }
+    schedule.push_back({ frame, 0x81u | (uint32_t)(prev_root - 12) << 8 });
+  }
+  for (size_t i = 0; i < sizeof(chord); ++i) {
+    schedule.push_back({ frame + (uint32_t)i * sample_rate / 100, 0x90u | (uint32_t)(root + chord[i]) << 8 | 100u << 16 });
+  }
+  schedule.push_back({ frame, 0x91u | (uint32_t)(root - 12) << 8 | 110u << 16 });
+  schedule.push_back({ frame, 0x99u | ((beat & 1) ? 38u : 36u) << 8 | 120u << 16 });
+  schedule.push_back({ frame, 0x99u | 42u << 8 | 80u << 16 });
+  schedule.push_back({ frame + beat_frames / 2, 0x99u | 42u << 8 | 60u << 16 });
+}
+
+}
+
+int main(void)
+{
+  static audio_synth_t synth;
+  synth.setup(sample_rate);
+
+  int32_t buf[audio_synth_t::frames_max * 2];
+  for (size_t frames : { (size_t)48, audio_synth_t::frames_max }) {
+    uint32_t cost = synth.benchmark(buf, frames, 2000, getUsec);
+    double period_usec = frames * 1000000.0 / sample_rate;
+    printf("benchmark %2zu frames: %6u nsec / voice / block (%5.2f%% of the block period per voice)\n",
+           frames, cost, cost / (period_usec * 10.0));
+    TEST_CHECK(cost > 0);
+  }
+
+  // Strings (2系統の発振器) のコード、Bass、ドラム
+  synth.reset();
+  synth.message(0xC0, 48, 0);
+  synth.message(0xC1, 33, 0);
+  const uint32_t beat_frames = sample_rate / 2;   // 120 BPM
+  std::vector<std::pair<uint32_t, uint32_t>> schedule;
+  for (uint32_t beat = 0; beat < play_sec * 2; ++beat) { playBeat(beat, schedule, beat_frames); }
+  std::stable_sort(schedule.begin(), schedule.end(), [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) { return a.first < b.first; });
+
+  FILE* wav_file = nullptr;
+  const char* path = getenv("KANPLAY_SYNTH_WAV");
+  if (path != nullptr) {
+    wav_file = fopen(path, "wb");
+    if (wav_file == nullptr) {
+      printf("synth wav: can not open %s\n", path);
+    } else {
+      uint8_t header[audio_recorder_t::wav_header_bytes] = {};
+      fwrite(header, 1, sizeof(header), wav_file);
+    }
+  }
+
+  const uint32_t total_frames = play_sec * sample_rate;
+  size_t next = 0;
+  size_t max_voices = 0;
+  uint32_t wav_data_bytes = 0;
+  double render_usec = 0;
+  for (uint32_t frame = 0; frame < total_frames; frame += block_frames) {
+    // ブロックの先頭でその時点までのメッセージを渡す (実機の I2Sタスクと同じ粒度)
+    while (next < schedule.size() && schedule[next].first <= frame) {
+      uint32_t m = schedule[next++].second;
+      synth.message(m & 0xFF, (m >> 8) & 0xFF, (m >> 16) & 0xFF);
+    }
+    memset(buf, 0, block_frames * 2 * sizeof(int32_t));
+    auto start = std::chrono::steady_clock::now();
+    synth.render(buf, block_frames);
+    render_usec += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    size_t voices = synth.getActiveVoices();
+    if (max_voices < voices) { max_voices = voices; }
+
+    if (wav_file != nullptr) {
+      int16_t pcm[block_frames * 2];
+      for (size_t i = 0; i < block_frames * 2; ++i) { pcm[i] = (int16_t)(buf[i] >> 16); }
+      wav_data_bytes += fwrite(pcm, sizeof(int16_t), block_frames * 2, wav_file) * sizeof(int16_t);
+    }
+  }
+  double realtime = play_sec * 1000000.0 / render_usec;
+  printf("offline render: %u sec of audio in %.1f msec (%.0fx real time), max %zu voices\n",
+         play_sec, render_usec / 1000.0, realtime, max_voices);
+  TEST_CHECK(max_voices > 8);
+  TEST_CHECK(realtime > 1.0);
+
+  if (wav_file != nullptr) {
+    uint8_t header[audio_recorder_t::wav_header_bytes];
+    audio_recorder_t::makeWavHeader(header, sample_rate, wav_data_bytes);
+    fseek(wav_file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), wav_file);
+    fclose(wav_file);
+    printf("synth wav: %s (%u bytes)\n", path, wav_data_bytes);
+  }
+
+  return test_result();
+}
@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// 送信メッセージの配信にかかるCPU時間をノート1音あたりで測定する (ポート数 1 と 4)
+//  - 個別方式 : 各ポートが midi_out_control の履歴を個別に読み出して解釈し、送信する (MIDI_BroadcastRing 導入前)
+//  - 配信方式 : 履歴を一度だけ MIDI_BroadcastRing へシリアライズし、各ポートはリングから読み出して送信する
+// どちらも送信は MIDIDriver のエンコーダ (ランニングステータス) を経由し、送信先は何もしないトランスポートとする
+
+#include "test_util.hpp"
+#include "midi_broadcast.hpp"
+#include "midi_out_control.hpp"
+
+#include <M5Unified.h>
+
+#include <chrono>
+#include <vector>
+
+using namespace kanplay_ns;
+using namespace midi_driver;
+
+mock_m5_t M5;
+
+namespace {
+
+class null_transport_t : public MIDI_Transport {
+public:
+  bool begin(void) override { _connected = true; _use_tx = true; return true; }
+  void end(void) override { _connected = false; }
+  size_t read(uint8_t*, size_t) override { return 0; }
+  void addMessage(const uint8_t* data, size_t length) override {
+    for (size_t i = 0; i < length; ++i) { checksum = checksum * 31 + data[i]; }
+    bytes += length;
+  }
+  bool sendFlush(void) override { return true; }
+  uint64_t bytes = 0;
+  uint32_t checksum = 0;
+};
+
+static constexpr const int max_port = 4;
+static constexpr const int batch_notes = 64;    // 1回の処理で送るノート数 (履歴とリングの容量以内)
+static constexpr const int batches = 20000;
+
+struct port_t {
+  null_transport_t transport;
+  MIDIDriver driver { &transport };
+  registry_t::history_code_t code = 0;
+  MIDI_BroadcastRing::cursor_t cursor = 0;
+};
+
+// 演奏タスクの出力 (ノートオンとノートオフ、時々コントロールチェンジ)
+void playBatch(reg_midi_out_control_t& midi_out, int batch)
+{
+  for (int i = 0; i < batch_notes; ++i) {
+    uint8_t ch = i & 3;
+    uint8_t note = 36 + ((batch * 7 + i) % 48);
+    midi_out.setNoteVelocity(ch, note, 100 | 0x80);
+    if ((i & 15) == 0) { midi_out.setControlChange(ch, 11, (batch + i) & 0x7F); }
+    midi_out.setNoteVelocity(ch, note, 0);
+  }
+}
+
+struct result_t {
+  double nsec_per_note;
+  uint64_t bytes;
+  uint32_t checksum;
+};
+
+// 個別方式 : 各ポートが履歴を解釈して送信する
+result_t runPerPort(int ports)
+{
+  static reg_midi_out_control_t midi_out;
+  midi_out.init();
+  std::vector<port_t> port(ports);
+  for (auto& p : port) {
+    p.driver.begin();
+    p.code = midi_out.getHistoryCode();
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (int b = 0; b < batches; ++b) {
+    playBatch(midi_out, b);
+    for (auto& p : port) {
+      const registry_t::history_t* history;
+      while (nullptr != (history = midi_out.getHistory(p.code))) {
+        uint8_t status = history->index & 0xFF;
+        uint8_t port_mask = (history->value >> 16) & 0xFF;
+        if (port_mask && !(port_mask & 1)) { continue; }
+        p.driver.sendMessage(status, history->value & 0xFF, (history->value >> 8) & 0xFF);
+      }
+      p.driver.sendFlush();
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  result_t res = { std::chrono::duration<double, std::nano>(end - start).count() / ((double)batches * batch_notes), 0, 0 };
+  res.bytes = port[0].transport.bytes;
+  res.checksum = port[0].transport.checksum;
+  return res;
+}
+
+// 配信方式 : 一度だけシリアライズし、各ポートはリングから読み出す
+result_t runBroadcast(int ports)
+{
+  static reg_midi_out_control_t midi_out;
+  static MIDI_BroadcastRing ring;
+  midi_out.init();
+  registry_t::history_code_t code = midi_out.getHistoryCode();
+  std::vector<port_t> port(ports);
+  for (auto& p : port) {
+    p.driver.begin();
+    p.cursor = ring.getWriteCursor();
+  }
+  uint32_t lost = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int b = 0; b < batches; ++b) {
+    playBatch(midi_out, b);
+    const registry_t::history_t* history;
+    while (nullptr != (history = midi_out.getHistory(code))) {
+      uint8_t port_mask = (history->value >> 16) & 0xFF;
+      ring.push(history->index & 0xFF, history->value & 0xFF, (history->value >> 8) & 0xFF,
+                port_mask ? port_mask : MIDI_BroadcastRing::all_port);
+    }
+    for (auto& p : port) {
+      MIDI_BroadcastRing::slot_t slot;
+      while (ring.pop(p.cursor, &slot, &lost)) {
+        if (!(slot.port_mask & 1)) { continue; }
+        p.driver.sendMessage(slot.data[0], slot.data[1], slot.data[2]);
+      }
+      p.driver.sendFlush();
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  TEST_CHECK(lost == 0);
+  result_t res = { std::chrono::duration<double, std::nano>(end - start).count() / ((double)batches * batch_notes), 0, 0 };
+  res.bytes = port[0].transport.bytes;
+  res.checksum = port[0].transport.checksum;
+  for (auto& p : port) {
+    // 全ポートに同じバイト列が届く
+    TEST_CHECK(p.transport.bytes == res.bytes && p.transport.checksum == res.checksum);
+  }
+  return res;
+}
+
+}
+
+int main(void)
+{
+  result_t per_port[max_port + 1];
+  result_t broadcast[max_port + 1];
+  for (int ports : { 1, max_port }) {
+    per_port[ports] = runPerPort(ports);
+    broadcast[ports] = runBroadcast(ports);
+    printf("%d port(s): per-port history %.1f nsec/note, broadcast ring %.1f nsec/note\n",
+           ports, per_port[ports].nsec_per_note, broadcast[ports].nsec_per_note);
+    // どちらの方式でも送信されるバイト列は同じ
+    TEST_CHECK(per_port[ports].bytes == broadcast[ports].bytes);
+    TEST_CHECK(per_port[ports].checksum == broadcast[ports].checksum);
+  }
+  printf("cost of 3 extra ports: per-port history %.1f nsec/note, broadcast ring %.1f nsec/note\n",
+         per_port[max_port].nsec_per_note - per_port[1].nsec_per_note,
+         broadcast[max_port].nsec_per_note - broadcast[1].nsec_per_note);
+
+  return test_result();
+}
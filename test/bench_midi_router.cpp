@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// 4ポートの入力を記録した演奏を模したメッセージ列を midi_router_t へ通し、1メッセージあたりの処理時間を測定する
+//  - ルール一覧を順に評価する方式 (テーブル導入前) と比べ、結果が一致することも確認する
+//  - 別スレッドで2種類のルールを交互に設定し続けながら処理し、どのメッセージも
+//    いずれかのルールによる結果になる (再構築中のテーブルを参照しない) ことを確認する
+
+#include "test_util.hpp"
+#include "midi_router.hpp"
+
+#include <M5Unified.h>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <math.h>
+
+using namespace kanplay_ns;
+
+mock_m5_t M5;
+
+namespace {
+
+struct message_t {
+  def::midi::output_port_t port;
+  uint8_t status;
+  uint8_t data1;
+  uint8_t data2;
+};
+
+struct routed_t {
+  bool pass;
+  uint8_t status;
+  uint8_t data1;
+  uint8_t data2;
+  uint8_t dst_mask;
+  bool operator==(const routed_t& rhs) const {
+    if (pass != rhs.pass) { return false; }
+    if (!pass) { return true; }
+    return status == rhs.status && data1 == rhs.data1 && data2 == rhs.data2 && dst_mask == rhs.dst_mask;
+  }
+};
+
+// 演奏の記録 : 内蔵鍵盤(ノートとペダル)、PortC(鍵盤とモジュレーション)、BLE(ピッチベンドとアフタータッチ)、USB(クロックとプログラムチェンジ)
+std::vector<message_t> makeTrace(size_t count)
+{
+  std::mt19937 rng(3);
+  std::vector<message_t> trace;
+  trace.reserve(count);
+  while (trace.size() < count) {
+    auto port = (def::midi::output_port_t)(rng() % def::midi::out_port_max);
+    uint8_t ch = rng() % 4;
+    uint8_t note = 36 + rng() % 60;
+    switch (port) {
+    case def::midi::out_port_internal:
+      trace.push_back({ port, (uint8_t)(0x90 | ch), note, (uint8_t)(1 + rng() % 127) });
+      trace.push_back({ port, (uint8_t)(0x80 | ch), note, 64 });
+      if (rng() % 8 == 0) { trace.push_back({ port, (uint8_t)(0xB0 | ch), 64, (uint8_t)((rng() & 1) ? 127 : 0) }); }
+      break;
+    case def::midi::out_port_port_c:
+      trace.push_back({ port, (uint8_t)(0x90 | 9), note, (uint8_t)(1 + rng() % 127) });
+      trace.push_back({ port, (uint8_t)(0x90 | 9), note, 0 });
+      trace.push_back({ port, (uint8_t)(0xB0 | ch), 1, (uint8_t)(rng() & 0x7F) });
+      break;
+    case def::midi::out_port_ble:
+      trace.push_back({ port, (uint8_t)(0xE0 | ch), (uint8_t)(rng() & 0x7F), (uint8_t)(rng() & 0x7F) });
+      trace.push_back({ port, (uint8_t)(0xD0 | ch), (uint8_t)(rng() & 0x7F), 0 });
+      break;
+    default:
+      trace.push_back({ port, 0xF8, 0, 0 });
+      if (rng() % 16 == 0) { trace.push_back({ port, (uint8_t)(0xC0 | ch), (uint8_t)(rng() & 0x7F), 0 }); }
+      break;
+    }
+  }
+  return trace;
+}
+
+std::vector<midi_router_t::rule_t> makeRulesA(void)
+{
+  std::vector<midi_router_t::rule_t> rules;
+  midi_router_t::rule_t r;
+  r.src_mask = 1 << def::midi::out_port_port_c;   // PortC : 1オクターブ上げてチャンネル2へ、ソフトなカーブ
+  r.transpose = 12;
+  r.channel = def::midi::channel_2;
+  r.velocity = def::midi::velocity_soft;
+  rules.push_back(r);
+  r = midi_router_t::rule_t();
+  r.src_mask = 1 << def::midi::out_port_usb;      // USB : クロックを破棄
+  r.type_mask = 1 << def::midi::route_system;
+  r.dst_mask = 0;
+  rules.push_back(r);
+  r = midi_router_t::rule_t();
+  r.src_mask = 1 << def::midi::out_port_ble;      // BLE : チャンネル1のみ内部音源へ
+  r.channel_mask = 1 << def::midi::channel_1;
+  r.dst_mask = 1 << def::midi::out_port_internal;
+  rules.push_back(r);
+  return rules;
+}
+
+std::vector<midi_router_t::rule_t> makeRulesB(void)
+{
+  std::vector<midi_router_t::rule_t> rules;
+  midi_router_t::rule_t r;
+  r.src_mask = (1 << def::midi::out_port_internal) | (1 << def::midi::out_port_port_c);
+  r.type_mask = (1 << def::midi::route_note_off) | (1 << def::midi::route_note_on);
+  r.transpose = -5;
+  r.velocity = def::midi::velocity_hard;
+  r.dst_mask = 1 << def::midi::out_port_usb;
+  rules.push_back(r);
+  r = midi_router_t::rule_t();
+  r.type_mask = 1 << def::midi::route_control_change;
+  r.channel = def::midi::channel_16;
+  rules.push_back(r);
+  return rules;
+}
+
+uint8_t applyCurve(uint8_t curve, uint8_t v)
+{
+  switch (curve) {
+  case def::midi::velocity_soft: return (uint8_t)(sqrtf(v * 127.0f) + 0.5f);
+  case def::midi::velocity_hard: return (uint8_t)((v * v + 126) / 127);
+  case def::midi::velocity_full: return v ? 127 : 0;
+  default: return v;
+  }
+}
+
+// ルール一覧をメッセージ毎に評価する (後に書かれたルールが優先)
+routed_t routeByRules(const std::vector<midi_router_t::rule_t>& rules, const message_t& m)
+{
+  routed_t res = { false, m.status, m.data1, m.data2, midi_router_t::all_port };
+  uint8_t type = (m.status >> 4) - 8;
+  uint8_t ch = m.status & 0x0F;
+  const midi_router_t::rule_t* match = nullptr;
+  for (auto& rule : rules) {
+    if ((rule.src_mask & (1 << m.port)) && (rule.type_mask & (1 << type)) && (rule.channel_mask & (1 << ch))) {
+      match = &rule;
+    }
+  }
+  uint8_t channel = midi_router_t::channel_keep;
+  int transpose = 0;
+  uint8_t velocity = def::midi::velocity_linear;
+  if (match) {
+    res.dst_mask = match->dst_mask & midi_router_t::all_port;
+    channel = match->channel;
+    transpose = match->transpose;
+    velocity = match->velocity;
+  }
+  if (res.dst_mask == 0) { return res; }
+  if (type == def::midi::route_system) { res.pass = true; return res; }
+  if (channel != midi_router_t::channel_keep) { res.status = (m.status & 0xF0) | (channel & 0x0F); }
+  if (type <= def::midi::route_poly_pressure) {
+    int note = m.data1 + transpose;
+    if (note < 0 || note > 127) { return res; }
+    res.data1 = note;
+    if (type == def::midi::route_note_on && m.data2) {
+      res.data2 = applyCurve(velocity, m.data2);
+      if (res.data2 == 0) { res.data2 = 1; }
+    }
+  }
+  res.pass = true;
+  return res;
+}
+
+routed_t routeByTable(const midi_router_t& router, const message_t& m)
+{
+  routed_t res = { false, m.status, m.data1, m.data2, 0 };
+  res.pass = router.route(m.port, res.status, res.data1, res.data2, res.dst_mask);
+  return res;
+}
+
+}
+
+int main(void)
+{
+  static constexpr const size_t trace_length = 1 << 20;
+  auto trace = makeTrace(trace_length);
+  auto rules_a = makeRulesA();
+  auto rules_b = makeRulesB();
+
+  static midi_router_t router;
+  router.setRules(rules_a);
+
+  // ルール評価との一致
+  std::vector<routed_t> expect_a, expect_b;
+  expect_a.reserve(trace.size());
+  expect_b.reserve(trace.size());
+  for (auto& m : trace) {
+    expect_a.push_back(routeByRules(rules_a, m));
+    expect_b.push_back(routeByRules(rules_b, m));
+  }
+  uint32_t mismatch = 0;
+  for (size_t i = 0; i < trace.size(); ++i) {
+    if (!(routeByTable(router, trace[i]) == expect_a[i])) { ++mismatch; }
+  }
+  TEST_CHECK(mismatch == 0);
+
+  // 処理時間 (ルール評価はルール数に比例し、テーブル参照はルール数に依らない)
+  std::vector<midi_router_t::rule_t> rules_many;
+  for (int i = 0; i < 4; ++i) {
+    rules_many.insert(rules_many.end(), rules_b.begin(), rules_b.end());
+    rules_many.insert(rules_many.end(), rules_a.begin(), rules_a.end());
+  }
+  const double count = trace.size() * 4.0;
+  uint32_t passed = 0;
+  std::chrono::steady_clock::time_point start, end;
+  for (auto rules : { &rules_a, &rules_many }) {
+    router.setRules(*rules);
+    start = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < 4; ++rep) {
+      for (auto& m : trace) { passed += routeByRules(*rules, m).pass; }
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < 4; ++rep) {
+      for (auto& m : trace) { passed += routeByTable(router, m).pass; }
+    }
+    end = std::chrono::steady_clock::now();
+    printf("%2zu rules: rule walk %.1f nsec/msg, table %.1f nsec/msg\n", rules->size(),
+           std::chrono::duration<double, std::nano>(mid - start).count() / count,
+           std::chrono::duration<double, std::nano>(end - mid).count() / count);
+  }
+  printf("(%u passed)\n", passed);
+  router.setRules(rules_a);
+
+  // ルールを設定し続けながら処理する
+  std::atomic<bool> stop { false };
+  uint32_t updates = 0;
+  std::thread writer([&]() {
+    while (!stop.load()) {
+      router.setRules((updates & 1) ? rules_a : rules_b);
+      ++updates;
+      M5.In_I2C.log.clear();
+      std::this_thread::yield();
+    }
+  });
+  uint32_t torn = 0;
+  start = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < 4; ++rep) {
+    for (size_t i = 0; i < trace.size(); ++i) {
+      auto r = routeByTable(router, trace[i]);
+      if (!(r == expect_a[i]) && !(r == expect_b[i])) { ++torn; }
+    }
+  }
+  end = std::chrono::steady_clock::now();
+  stop.store(true);
+  writer.join();
+  printf("while updating: table %.1f nsec/msg, %u rule updates, %u inconsistent results\n",
+         std::chrono::duration<double, std::nano>(end - start).count() / count, updates, torn);
+  TEST_CHECK(updates > 0);
+  TEST_CHECK(torn == 0);
+
+  return test_result();
+}
@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_TEST_STUB_M5UNIFIED_H
+#define KANPLAY_TEST_STUB_M5UNIFIED_H
+
+// ホスト用テストのための M5Unified の代用品。I2C の書込みと delay を順に記録する
+
+// PC版と同じく、ESP-IDF 固有の処理を含めない
+#ifndef M5UNIFIED_PC_BUILD
+#define M5UNIFIED_PC_BUILD
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+struct mock_i2c_op_t {
+  uint8_t addr;   // delay の場合は 0xFF
+  uint8_t reg;
+  std::vector<uint8_t> data;
+};
+
+struct mock_i2c_t {
+  std::vector<mock_i2c_op_t> log;
+  uint8_t read_value = 0;  // 読出しは常にこの値を返す (記録しない)
+  uint8_t fail_reg = 0;    // このレジスタへの書込みを fail_count 回失敗させる (失敗した書込みは記録しない)
+  uint32_t fail_count = 0;
+  bool writeRegister8(uint8_t addr, uint8_t reg, uint8_t data, uint32_t) { return writeRegister(addr, reg, &data, 1, 0); }
+  bool writeRegister(uint8_t addr, uint8_t reg, const uint8_t* data, size_t len, uint32_t) {
+    if (fail_count && reg == fail_reg) { --fail_count; return false; }
+    log.push_back({ addr, reg, std::vector<uint8_t>(data, data + len) });
+    return true;
+  }
+  bool readRegister(uint8_t, uint8_t, uint8_t* data, size_t len, uint32_t) { for (size_t i = 0; i < len; ++i) { data[i] = read_value; } return true; }
+  uint8_t readRegister8(uint8_t, uint8_t, uint32_t) { return read_value; }
+};
+
+struct mock_m5_t {
+  mock_i2c_t In_I2C;
+  void delay(uint32_t msec) { In_I2C.log.push_back({ 0xFF, 0, { (uint8_t)msec } }); }
+};
+extern mock_m5_t M5;
+
+namespace m5gfx {
+  static inline void* heap_alloc_psram(size_t size) { return malloc(size); }
+  static inline void* heap_alloc_dma(size_t size) { return malloc(size); }
+  static inline void heap_free(void* buf) { free(buf); }
+}
+
+#define M5_LOGE(...) (printf("E: " __VA_ARGS__), printf("\n"))
+#define M5_LOGW(...) (printf("W: " __VA_ARGS__), printf("\n"))
+#define M5_LOGI(...) (printf("I: " __VA_ARGS__), printf("\n"))
+#define M5_LOGD(...) ((void)0)
+#define M5_LOGV(...) ((void)0)
+
+#endif
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// audio_analyzer_t のレベル・ラウドネス・帯域の検出を正弦波と無音で確認し、処理時間を計測する
+
+#include "test_util.hpp"
+#include "audio_analyzer.hpp"
+
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+using namespace kanplay_ns;
+
+int main(void)
+{
+  struct case_t { double freq; double db; int ch_mask; int band; };
+  for (uint32_t rate : { 44100u, 48000u }) {
+    for (case_t c : { case_t { 997, 0, 3, 20 }, case_t { 997, -20, 3, 20 }, case_t { 100, -6, 3, 1 }, case_t { 997, -80, 3, 20 }, case_t { 997, 0, 1, 20 } }) {
+      audio_analyzer_t analyzer;
+      analyzer.setup(rate);
+      std::vector<int32_t> buf(96);
+      double phase = 0;
+      double amp = pow(10, c.db / 20) * 2147483000.0;
+      for (uint32_t blk = 0; blk < rate * 4 / 48; ++blk) {
+        for (int i = 0; i < 48; ++i) {
+          int32_t v = (int32_t)lround(amp * sin(phase));
+          phase += 2 * M_PI * c.freq / rate;
+          buf[i * 2] = (c.ch_mask & 1) ? v : 0;
+          buf[i * 2 + 1] = (c.ch_mask & 2) ? v : 0;
+        }
+        analyzer.process(buf.data(), 48);
+      }
+      auto r = analyzer.getResult();
+      int best = 0;
+      for (int b = 0; b < 32; ++b) { if (r.band[b] > r.band[best]) { best = b; } }
+      double band_db = r.band[best] * 90.0 / 255 - 90;
+      // 片チャンネルのみの場合、RMS は -3dB、ラウドネスは -3LU となる
+      double ch_db = (c.ch_mask == 3) ? 0 : -3;
+      printf("rate %u %5.0fHz %4.0fdB ch%d: peak %.1f rms %.1f M %.1f S %.1f band %d (%.1f dB)\n", rate, c.freq, c.db, c.ch_mask,
+             r.peak_db10 / 10.0, r.rms_db10 / 10.0, r.momentary_lu10 / 10.0, r.short_term_lu10 / 10.0, best, band_db);
+      TEST_CHECK(fabs(r.peak_db10 / 10.0 - c.db) < 0.2);
+      TEST_CHECK(fabs(r.rms_db10 / 10.0 - (c.db - 3 + ch_db)) < 0.2);
+      TEST_CHECK(best == c.band);
+      if (c.freq == 997) {
+        // 1kHz 付近は K特性の影響が小さく、ラウドネスはほぼピークのレベルとなる
+        TEST_CHECK(fabs(r.momentary_lu10 / 10.0 - (c.db + ch_db)) < 0.5);
+        TEST_CHECK(fabs(band_db - (c.db + ch_db * 2)) < 1.0);
+      }
+    }
+  }
+
+  // 無音
+  {
+    audio_analyzer_t analyzer;
+    analyzer.setup(48000);
+    std::vector<int32_t> buf(96, 0);
+    for (int i = 0; i < 2000; ++i) { analyzer.process(buf.data(), 48); }
+    auto r = analyzer.getResult();
+    int band_max = 0;
+    for (int b = 0; b < 32; ++b) { if (r.band[b] > band_max) { band_max = r.band[b]; } }
+    TEST_CHECK(r.peak_db10 == -900 && r.momentary_lu10 == -900 && band_max == 0);
+  }
+
+  // ベンチマーク (結果は表示のみ。判定には使わない)
+  {
+    audio_analyzer_t analyzer;
+    analyzer.setup(48000);
+    std::vector<int32_t> buf(96);
+    uint32_t x = 1;
+    double total = 0, worst = 0;
+    static constexpr const int loop = 48000;
+    for (int blk = 0; blk < loop; ++blk) {
+      for (auto& v : buf) { x = x * 1664525 + 1013904223; v = (int32_t)x >> 2; }
+      auto t0 = std::chrono::steady_clock::now();
+      analyzer.process(buf.data(), 48);
+      auto t1 = std::chrono::steady_clock::now();
+      double nsec = std::chrono::duration<double, std::nano>(t1 - t0).count();
+      total += nsec;
+      if (blk > 100 && worst < nsec) { worst = nsec; }
+    }
+    printf("benchmark: avg %.0f ns/block, max %.0f ns/block\n", total / loop, worst);
+  }
+
+  return test_result();
+}
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// audio_block_ring_t を1つの書き手と速度の異なる複数の読み手で同時に動かし、
+// 読み手が壊れたブロックを有効として受け取らないこと、順序が崩れないことを確認する
+
+#include "test_util.hpp"
+#include "audio_block_ring.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace kanplay_ns;
+
+int main(void)
+{
+  static audio_block_ring_t ring;
+  {
+    audio_block_ring_t::reader_t reader;
+    audio_block_ring_t::block_t block;
+    TEST_CHECK(!ring.isReady());
+    TEST_CHECK(!ring.acquire(reader, block));
+    // init 前の書込みは何もしない
+    int32_t buf[2] = { 1, 1 };
+    ring.write(buf, 1, 0);
+    TEST_CHECK(ring.getWriteCount() == 0 && !ring.acquire(reader, block));
+  }
+  TEST_CHECK(ring.init(20, 96));
+  TEST_CHECK(ring.isReady() && ring.getSlots() == 16 && ring.getFramesMax() == 96);
+  TEST_CHECK(!ring.init(16, 96));
+
+  static constexpr const uint32_t total = 50000;
+  static constexpr const int reader_count = 5;
+  struct stat_t { uint32_t start = 0, got = 0, torn = 0, overrun = 0, undetected = 0, disorder = 0; };
+  std::vector<stat_t> stat(reader_count);
+  std::atomic<bool> done { false };
+  std::vector<std::thread> threads;
+  for (int r = 0; r < reader_count; ++r) {
+    threads.emplace_back([r, &stat, &done] {
+      audio_block_ring_t::reader_t reader;
+      audio_block_ring_t::block_t block;
+      ring.attach(reader);
+      stat[r].start = reader.seq;
+      uint32_t last = UINT32_MAX;
+      for (;;) {
+        if (!ring.acquire(reader, block)) {
+          if (done.load() && ring.getWriteCount() == reader.seq) { break; }
+          std::this_thread::yield();
+          continue;
+        }
+        bool ok = (block.frames >= 16 && block.frames <= 96) && block.sample == (uint64_t)block.seq * 1000;
+        for (uint32_t i = 0; ok && i < block.frames * 2; ++i) {
+          if (block.data[i] != (int32_t)(block.seq * 7 + i)) { ok = false; }
+        }
+        // 読み手毎に処理時間を変え、一部は書き手に追い越されるようにする
+        for (volatile int k = 0; k < r * 400; k = k + 1) {}
+        if (r == 4 && (block.seq % 50) == 0) { std::this_thread::sleep_for(std::chrono::microseconds(2000)); }
+        if (r == 3 && (block.seq % 7) == 0) { std::this_thread::sleep_for(std::chrono::microseconds(300)); }
+        if (ring.release(reader)) {
+          ++stat[r].got;
+          if (!ok) { ++stat[r].undetected; }
+          if (last != UINT32_MAX && block.seq <= last) { ++stat[r].disorder; }
+          last = block.seq;
+        } else {
+          ++stat[r].torn;
+        }
+      }
+      stat[r].overrun = reader.overrun;
+    });
+  }
+
+  for (uint32_t s = 0; s < total; ++s) {
+    uint32_t frames = 16 + (s % 81);
+    int32_t* p = ring.beginWrite();
+    for (uint32_t i = 0; i < frames * 2; ++i) { p[i] = (int32_t)(s * 7 + i); }
+    ring.commitWrite(frames, (uint64_t)s * 1000);
+    // DMAブロックの間隔を模擬する
+    auto t0 = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - t0 < std::chrono::microseconds(40)) { std::this_thread::yield(); }
+  }
+  done = true;
+  for (auto& t : threads) { t.join(); }
+
+  TEST_CHECK(ring.getWriteCount() == total);
+  for (int r = 0; r < reader_count; ++r) {
+    printf("reader %d: got %u torn %u overrun %u\n", r, stat[r].got, stat[r].torn, stat[r].overrun);
+    TEST_CHECK(stat[r].undetected == 0);
+    TEST_CHECK(stat[r].disorder == 0);
+    TEST_CHECK(stat[r].got > 0);
+    // 有効なブロックとオーバーラン (破損を含む) を合わせると、読み始めた後に書き込まれた全ブロックとなる
+    TEST_CHECK(stat[r].got + stat[r].overrun == total - stat[r].start);
+  }
+
+  return test_result();
+}
@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// audio_effect_chain_t のバイパス・EQ・コンプレッサ/リミッタ・リバーブの特性を確認し、
+// エフェクト毎の処理時間を計測する
+
+#include "test_util.hpp"
+#include "audio_effect.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace kanplay_ns;
+
+static constexpr const int sample_rate = 48000;
+static constexpr const int block_frames = 48;
+
+static double level_db(const std::vector<int32_t>& v, size_t from)
+{
+  double sum = 0;
+  for (size_t i = from; i < v.size(); ++i) { sum += (double)v[i] * v[i]; }
+  return 10 * log10(sum / (v.size() - from) / (2147483648.0 * 2147483648.0));
+}
+
+static double peak_db(const std::vector<int32_t>& v, size_t from, size_t to)
+{
+  double peak = 0;
+  for (size_t i = from; i < to && i < v.size(); ++i) { peak = std::max(peak, fabs((double)v[i])); }
+  return 20 * log10(peak / 2147483648.0);
+}
+
+static std::vector<int32_t> sine(double freq, double amp_db, int frames)
+{
+  std::vector<int32_t> v(frames * 2);
+  double amp = pow(10, amp_db / 20) * 2147483647.0;
+  for (int i = 0; i < frames; ++i) {
+    int32_t s = (int32_t)(amp * sin(2 * M_PI * freq * i / sample_rate));
+    v[i * 2] = s;
+    v[i * 2 + 1] = s;
+  }
+  return v;
+}
+
+static void run(audio_effect_chain_t& chain, std::vector<int32_t>& v)
+{
+  for (size_t i = 0; i + block_frames * 2 <= v.size(); i += block_frames * 2) {
+    chain.process(&v[i], block_frames);
+  }
+}
+
+// 定常状態での入出力のレベル差 (後半のみで評価する)
+static double gain_db(const audio_effect_chain_t::config_t& cfg, double freq)
+{
+  audio_effect_chain_t chain;
+  chain.setConfig(cfg);
+  auto src = sine(freq, -18, sample_rate / 2);
+  auto dst = src;
+  run(chain, dst);
+  return level_db(dst, sample_rate / 2) - level_db(src, sample_rate / 2);
+}
+
+int main(void)
+{
+  // 無効時、及び全パラメータが中立の場合は入力をそのまま出力する
+  {
+    audio_effect_chain_t chain;
+    audio_effect_chain_t::config_t cfg;
+    cfg.enabled = false;
+    cfg.eq_low_db = 6;
+    cfg.reverb_level = 50;
+    chain.setConfig(cfg);
+    auto src = sine(440, -6, 4800);
+    auto dst = src;
+    run(chain, dst);
+    TEST_CHECK(src == dst);
+
+    cfg.enabled = true;
+    cfg.eq_low_db = 0;
+    cfg.reverb_level = 0;
+    chain.setConfig(cfg);
+    TEST_CHECK(!chain.isActive());
+    dst = src;
+    run(chain, dst);
+    TEST_CHECK(src == dst);
+  }
+
+  // EQ の周波数特性
+  for (int gain : { 12, -12, 6 }) {
+    audio_effect_chain_t::config_t cfg;
+    cfg.enabled = true;
+    cfg.eq_low_db = gain;
+    TEST_CHECK(fabs(gain_db(cfg, 50) - gain) < 1.0);
+    TEST_CHECK(fabs(gain_db(cfg, 1000)) < 0.1);
+
+    cfg.eq_low_db = 0;
+    cfg.eq_mid_db = gain;
+    TEST_CHECK(fabs(gain_db(cfg, 1000) - gain) < 0.1);
+    TEST_CHECK(fabs(gain_db(cfg, 50)) < 0.2);
+
+    cfg.eq_mid_db = 0;
+    cfg.eq_high_db = gain;
+    TEST_CHECK(fabs(gain_db(cfg, 15000) - gain) < 1.0);
+    TEST_CHECK(fabs(gain_db(cfg, 1000)) < 0.1);
+  }
+
+  // EQ の精度: 固定小数の biquad と倍精度の biquad の差 (ピーキング +6dB, ホワイトノイズ)
+  {
+    audio_biquad_t biquad;
+    biquad.design(audio_biquad_t::peaking, 1000, 6, 0.7, sample_rate);
+    double A = pow(10, 6 / 40.0);
+    double w0 = 2 * M_PI * 1000 / sample_rate;
+    double alpha = sin(w0) / 1.4;
+    double b0 = 1 + alpha * A, b1 = -2 * cos(w0), b2 = 1 - alpha * A;
+    double a0 = 1 + alpha / A, a1 = -2 * cos(w0), a2 = 1 - alpha / A;
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0, 0.25 * 2147483647.0 / 4);
+    std::vector<int32_t> v(sample_rate * 2);
+    for (auto& x : v) { x = (int32_t)noise(rng); }
+    auto r = v;
+    double x1[2] = { 0 }, x2[2] = { 0 }, y1[2] = { 0 }, y2[2] = { 0 };
+    for (int i = 0; i < sample_rate; ++i) {
+      for (int ch = 0; ch < 2; ++ch) {
+        double x = r[i * 2 + ch];
+        double y = (b0 * x + b1 * x1[ch] + b2 * x2[ch] - a1 * y1[ch] - a2 * y2[ch]) / a0;
+        x2[ch] = x1[ch]; x1[ch] = x;
+        y2[ch] = y1[ch]; y1[ch] = y;
+        r[i * 2 + ch] = (int32_t)y;
+      }
+    }
+    for (size_t i = 0; i < v.size(); i += block_frames * 2) { biquad.process(&v[i], block_frames); }
+    double err = 0, sig = 0;
+    for (size_t i = 0; i < v.size(); ++i) {
+      double d = (double)v[i] - r[i];
+      err += d * d;
+      sig += (double)r[i] * r[i];
+    }
+    double snr = 10 * log10(sig / err);
+    printf("EQ fixed vs double: SNR %.1f dB\n", snr);
+    TEST_CHECK(snr > 120);
+  }
+
+  // コンプレッサの定常レベル (ratio 20 はリミッタとして動作する)
+  for (int threshold : { -20, -12 }) {
+    for (int ratio : { 2, 4, 20 }) {
+      audio_effect_chain_t chain;
+      audio_effect_chain_t::config_t cfg;
+      cfg.enabled = true;
+      cfg.comp_threshold_db = threshold;
+      cfg.comp_ratio = ratio;
+      chain.setConfig(cfg);
+      auto v = sine(1000, -3, sample_rate);
+      run(chain, v);
+      double peak = peak_db(v, sample_rate, sample_rate * 2);
+      double expect = (ratio >= 20) ? threshold : threshold + (-3.0 - threshold) / ratio;
+      TEST_CHECK(fabs(peak - expect) < 0.5);
+    }
+  }
+
+  // リミッタの先読み: 無音から突然フルスケールになってもスレッショルドを大きく超えない
+  {
+    audio_effect_chain_t chain;
+    audio_effect_chain_t::config_t cfg;
+    cfg.enabled = true;
+    cfg.comp_threshold_db = -6;
+    cfg.comp_ratio = 20;
+    chain.setConfig(cfg);
+    std::vector<int32_t> v(sample_rate * 2, 0);
+    auto burst = sine(3000, 0, sample_rate / 2);
+    std::copy(burst.begin(), burst.end(), v.begin() + sample_rate);
+    run(chain, v);
+    double overshoot = peak_db(v, 0, v.size()) + 6;
+    printf("limiter -6dB burst: overshoot %.2f dB\n", overshoot);
+    TEST_CHECK(overshoot < 1.0);
+  }
+
+  // リバーブ: インパルス応答が減衰し、過大入力の後も発散しない
+  {
+    audio_effect_chain_t chain;
+    audio_effect_chain_t::config_t cfg;
+    cfg.enabled = true;
+    cfg.reverb_level = 100;
+    chain.setConfig(cfg);
+    std::vector<int32_t> v(sample_rate * 4, 0);
+    v[0] = v[1] = INT32_MAX / 2;
+    run(chain, v);
+    double wet = peak_db(v, 2, v.size());
+    double tail = peak_db(v, sample_rate * 3 / 2 * 2, v.size());
+    printf("reverb impulse: peak wet %.1f dBFS, tail after 1.5s %.1f dBFS\n", wet, tail);
+    TEST_CHECK(wet < -6 && wet > -40);
+    TEST_CHECK(tail < wet - 60);
+
+    auto loud = sine(200, 0, sample_rate * 5);
+    run(chain, loud);
+    std::vector<int32_t> silence(sample_rate * 6, 0);
+    run(chain, silence);
+    double after = peak_db(silence, sample_rate * 4, sample_rate * 6);
+    printf("reverb after full-scale: tail at 2s %.1f dBFS\n", after);
+    TEST_CHECK(after < -60);
+  }
+
+  // ベンチマーク (結果は表示のみ。判定には使わない)
+  {
+    static constexpr const int loop = 50000;
+    auto v = sine(440, -6, block_frames);
+    auto bench = [&](const char* name, audio_effect_chain_t::config_t cfg) {
+      audio_effect_chain_t chain;
+      chain.setConfig(cfg);
+      auto t0 = std::chrono::steady_clock::now();
+      for (int i = 0; i < loop; ++i) {
+        chain.process(v.data(), block_frames);
+        v[i % (block_frames * 2)] ^= 1;
+      }
+      auto t1 = std::chrono::steady_clock::now();
+      printf("  %-12s %6.2f ns/frame\n", name, std::chrono::duration<double, std::nano>(t1 - t0).count() / loop / block_frames);
+    };
+    printf("benchmark:\n");
+    audio_effect_chain_t::config_t cfg;
+    cfg.enabled = false;
+    bench("bypass", cfg);
+    cfg.enabled = true;
+    cfg.eq_low_db = 3;
+    bench("EQ 1 band", cfg);
+    cfg.eq_mid_db = 3;
+    cfg.eq_high_db = 3;
+    bench("EQ 3 band", cfg);
+    cfg.comp_threshold_db = -12;
+    cfg.comp_ratio = 4;
+    cfg.reverb_level = 30;
+    bench("full chain", cfg);
+  }
+
+  return test_result();
+}
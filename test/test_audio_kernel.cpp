@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// audio_apply_gain が従来のI2Sループ及び素朴な基準実装とビット単位で一致することを確認し、
+// 1ブロックあたりの処理時間を計測する
+
+#include "test_util.hpp"
+#include "audio_kernel.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using namespace kanplay_ns;
+
+// 従来のI2Sループ (固定ゲイン)
+static void ref_const(int32_t* buf, int count, int gain, int32_t& min_level, int32_t& max_level)
+{
+  min_level = INT32_MAX;
+  max_level = INT32_MIN;
+  for (int i = 0; i < count; i += 2) {
+    int32_t l = buf[i];
+    int32_t r = buf[i + 1];
+    min_level = std::min({ min_level, l, r });
+    max_level = std::max({ max_level, l, r });
+    buf[i] = (l >> 8) * gain;
+    buf[i + 1] = (r >> 8) * gain;
+  }
+}
+
+// 直線補間・飽和の基準 (64bit演算)
+static void ref_ramp(int32_t* buf, int frames, int gain_from, int gain_to, int32_t& min_level, int32_t& max_level)
+{
+  min_level = INT32_MAX;
+  max_level = INT32_MIN;
+  int64_t diff = (int64_t)(gain_to - gain_from) * 65536;
+  int64_t step = diff / frames;
+  int64_t acc = (int64_t)gain_from * 65536 + 32768 + (diff - step * frames);
+  for (int i = 0; i < frames; ++i) {
+    acc += step;
+    int64_t gain = acc >> 16;
+    for (int c = 0; c < 2; ++c) {
+      int32_t x = buf[i * 2 + c];
+      min_level = std::min(min_level, x);
+      max_level = std::max(max_level, x);
+      buf[i * 2 + c] = (int32_t)std::clamp<int64_t>((int64_t)(x >> 8) * gain, INT32_MIN, INT32_MAX);
+    }
+  }
+}
+
+int main(void)
+{
+  static constexpr const int frames_max = 48;
+  std::mt19937 rng(7);
+  int32_t a[frames_max * 2];
+  int32_t b[frames_max * 2];
+  auto fill = [&](int32_t* p) {
+    for (int i = 0; i < frames_max * 2; ++i) {
+      int k = rng() % 8;
+      p[i] = (k == 0) ? INT32_MAX : (k == 1) ? INT32_MIN : (int32_t)rng();
+    }
+  };
+
+  // 固定ゲイン: 従来のループと一致すること
+  for (int gain = 0; gain <= 256; ++gain) {
+    for (int it = 0; it < 50; ++it) {
+      fill(a);
+      memcpy(b, a, sizeof(a));
+      int32_t mn, mx;
+      ref_const(a, frames_max * 2, gain, mn, mx);
+      auto peak = audio_apply_gain(b, frames_max, gain, gain);
+      TEST_CHECK(memcmp(a, b, sizeof(a)) == 0);
+      TEST_CHECK(peak.min_level == mn && peak.max_level == mx);
+    }
+  }
+
+  // ゲインの直線補間: 基準実装と一致すること (256 を超えるゲインの飽和を含む)
+  for (int it = 0; it < 50000; ++it) {
+    int gain_from = rng() % 1024;
+    int gain_to = rng() % 1024;
+    if (it & 1) { gain_from %= 257; gain_to %= 257; }
+    int frames = 1 + rng() % frames_max;
+    fill(a);
+    memcpy(b, a, sizeof(a));
+    int32_t mn, mx;
+    ref_ramp(a, frames, gain_from, gain_to, mn, mx);
+    auto peak = audio_apply_gain(b, frames, gain_from, gain_to);
+    TEST_CHECK(memcmp(a, b, frames * 2 * sizeof(int32_t)) == 0);
+    TEST_CHECK(peak.min_level == mn && peak.max_level == mx);
+    if (test_fail_count) { printf("ramp %d -> %d, %d frames\n", gain_from, gain_to, frames); break; }
+  }
+
+  // ベンチマーク (結果は表示のみ。判定には使わない)
+  static constexpr const int loop = 200000;
+  int32_t buf[frames_max * 2];
+  fill(buf);
+  volatile int32_t sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < loop; ++i) {
+    int32_t mn, mx;
+    ref_const(buf, frames_max * 2, 256, mn, mx);
+    sink = sink + mn + mx;
+    buf[i % (frames_max * 2)] ^= i;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < loop; ++i) {
+    auto peak = audio_apply_gain(buf, frames_max, 256, 256);
+    sink = sink + peak.min_level + peak.max_level;
+    buf[i % (frames_max * 2)] ^= i;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  for (int i = 0; i < loop; ++i) {
+    auto peak = audio_apply_gain(buf, frames_max, 200 + (i & 31), 200 + ((i + 1) & 31));
+    sink = sink + peak.min_level + peak.max_level;
+    buf[i % (frames_max * 2)] ^= i;
+  }
+  auto t3 = std::chrono::steady_clock::now();
+  auto nsec = [](std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double, std::nano>(to - from).count() / loop;
+  };
+  printf("per %d-frame block: legacy loop %.1f ns, kernel const %.1f ns, kernel ramp %.1f ns\n",
+         frames_max, nsec(t0, t1), nsec(t1, t2), nsec(t2, t3));
+
+  return test_result();
+}
@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// audio_latency_t を合成した遅延ループ (MIDI方式: ノートオンの後に減衰正弦波、クリック方式: 出力を遅延して入力へ戻す) で確認する
+
+#include "test_util.hpp"
+#include "audio_latency.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace kanplay_ns;
+
+struct run_result_t {
+  audio_latency_t::state_t state;
+  audio_latency_t::result_t result;
+  double true_mean_usec;
+};
+
+static run_result_t run(audio_latency_t::mode_t mode, int frames, int delay, int jitter, double noise_db, double sig_db, int trials, bool drop_half = false)
+{
+  audio_latency_t latency;
+  std::mt19937 rng(1);
+  std::normal_distribution<double> normal(0, 1);
+  std::vector<int32_t> in(48000 * 60 * 2, 0);
+  double noise_amp = pow(10, noise_db / 20) * 2147483647.0;
+  double sig_amp = pow(10, sig_db / 20) * 2147483647.0;
+  latency.requestStart(mode, trials);
+  std::vector<int32_t> buf(frames * 2);
+  std::vector<int> actual;
+  uint64_t pos = 0;
+  int notes = 0;
+  uint32_t probe = latency.getProbe();
+  while (pos + frames < in.size() / 2) {
+    for (int i = 0; i < frames; ++i) {
+      int32_t n = (int32_t)(normal(rng) * noise_amp);
+      buf[i * 2] = in[(pos + i) * 2] + n;
+      buf[i * 2 + 1] = in[(pos + i) * 2 + 1] + n;
+    }
+    auto ev = latency.process(buf.data(), frames, pos, 48000);
+    uint64_t end = pos + frames;
+    // 発音状態はイベントに合わせて更新される (ノートオン毎に通し番号が進む)
+    uint32_t next = latency.getProbe();
+    if (ev == audio_latency_t::ev_note_on) {
+      TEST_CHECK(next == (((probe >> 1) + 1) << 1 | 1));
+    } else if (ev == audio_latency_t::ev_note_off) {
+      TEST_CHECK(next == (probe & ~1u));
+    } else {
+      TEST_CHECK(next == probe);
+    }
+    probe = next;
+    if (mode == audio_latency_t::mode_midi && ev == audio_latency_t::ev_note_on) {
+      ++notes;
+      if (!drop_half || !(notes & 1)) {
+        int d = delay + (jitter ? (int)(rng() % (2 * jitter + 1)) - jitter : 0);
+        actual.push_back(d);
+        for (int i = 0; i < 4800 && (end + d + i) * 2 + 1 < in.size(); ++i) {
+          double env = exp(-i / 1000.0) * std::min(1.0, i / 24.0);
+          int32_t v = (int32_t)(sig_amp * env * sin(2 * M_PI * 440 * i / 48000.0 + 0.3));
+          in[(end + d + i) * 2] += v;
+          in[(end + d + i) * 2 + 1] += v;
+        }
+      }
+    }
+    if (mode == audio_latency_t::mode_click) {
+      for (int i = 0; i < frames; ++i) {
+        if (buf[i * 2] == (1 << 30) || buf[i * 2] == -(1 << 30)) {
+          in[(end + i + delay) * 2] += buf[i * 2] / 2;
+          in[(end + i + delay) * 2 + 1] += buf[i * 2] / 2;
+        }
+      }
+    }
+    pos = end;
+    auto state = latency.getState();
+    if (state == audio_latency_t::lat_done || state == audio_latency_t::lat_failed) { break; }
+  }
+  run_result_t r;
+  r.state = latency.getState();
+  r.result = latency.getResult();
+  double sum = 0;
+  for (int d : actual) { sum += d; }
+  // クリック方式は遅延そのものが真値となる
+  r.true_mean_usec = actual.empty() ? delay / 0.048 : sum / actual.size() / 0.048;
+  printf("mode %d frames %d delay %d jitter %d noise %.0fdB: state %d count %u fail %u min %u med %u max %u mean %u (true %.0f) sd %u\n",
+         mode, frames, delay, jitter, noise_db, r.state, r.result.count, r.result.failures, r.result.min_usec, r.result.median_usec,
+         r.result.max_usec, r.result.mean_usec, r.true_mean_usec, r.result.jitter_usec);
+  return r;
+}
+
+int main(void)
+{
+  // 検出の誤差は1ブロック分の立ち上がり検出幅に収まること
+  auto r = run(audio_latency_t::mode_midi, 48, 720, 0, -80, -12, 10);
+  TEST_CHECK(r.state == audio_latency_t::lat_done && r.result.count == 10 && r.result.failures == 0);
+  TEST_CHECK(fabs(r.result.mean_usec - r.true_mean_usec) < 200 && r.result.jitter_usec < 50);
+
+  r = run(audio_latency_t::mode_midi, 48, 720, 96, -80, -12, 10);
+  TEST_CHECK(r.state == audio_latency_t::lat_done && r.result.count == 10);
+  TEST_CHECK(fabs(r.result.mean_usec - r.true_mean_usec) < 200 && r.result.jitter_usec > 500);
+
+  r = run(audio_latency_t::mode_midi, 16, 333, 0, -70, -30, 10);
+  TEST_CHECK(r.state == audio_latency_t::lat_done && fabs(r.result.mean_usec - r.true_mean_usec) < 300);
+
+  r = run(audio_latency_t::mode_midi, 96, 1500, 50, -60, -20, 16);
+  TEST_CHECK(r.state == audio_latency_t::lat_done && fabs(r.result.mean_usec - r.true_mean_usec) < 300);
+
+  r = run(audio_latency_t::mode_click, 48, 500, 0, -80, 0, 10);
+  TEST_CHECK(r.state == audio_latency_t::lat_done && fabs(r.result.mean_usec - r.true_mean_usec) < 50);
+
+  r = run(audio_latency_t::mode_click, 32, 1234, 0, -70, 0, 8);
+  TEST_CHECK(r.state == audio_latency_t::lat_done && fabs(r.result.mean_usec - r.true_mean_usec) < 50);
+
+  // 半分は音が出ない場合も、検出できた分で測定を完了する
+  r = run(audio_latency_t::mode_midi, 48, 720, 0, -80, -12, 10, true);
+  TEST_CHECK(r.state == audio_latency_t::lat_done && r.result.failures > 0 && r.result.count > 0);
+
+  // 雑音が大きく無音にならない場合は失敗とする
+  r = run(audio_latency_t::mode_midi, 48, 720, 0, -10, -12, 6);
+  TEST_CHECK(r.state == audio_latency_t::lat_failed && r.result.count == 0);
+
+  // 集計
+  {
+    uint32_t v[] = { 480, 432, 528, 480, 456, 504 };
+    audio_latency_t::result_t s;
+    audio_latency_t::summarize(v, 6, 48000, s);
+    TEST_CHECK(s.min_usec == 9000 && s.median_usec == 10000 && s.max_usec == 11000 && s.mean_usec == 10000);
+    TEST_CHECK(s.jitter_usec > 600 && s.jitter_usec < 720);
+  }
+  {
+    int32_t b[8] = { 0, 0, 0, 0, INT32_MIN, INT32_MIN, 5, 5 };
+    TEST_CHECK(audio_latency_t::peakLevel(b, 4) == INT32_MAX);
+    TEST_CHECK(audio_latency_t::findOnset(b, 4, 1000) == 2);
+  }
+
+  return test_result();
+}
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// audio_metronome_t へ、演奏タスクを模して拍毎に timeline_t を公開しながら I2Sのブロック単位で合成させ、
+// 出力からクリック音の立ち上がり位置を検出して本来の拍の位置と比べる
+//  - 公開のタイミングは拍に対して揺らぎ (拍より前・後) を持ち、テンポの変更やブロック長の違いも含む
+//  - 全ての拍で立ち上がりが1サンプル以内に収まり、同じ拍が二重に鳴らないこと
+//  - カウントインのみの設定ではカウントインの拍だけが鳴ること
+
+#include "test_util.hpp"
+#include "audio_metronome.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <math.h>
+#include <stdlib.h>
+
+using namespace kanplay_ns;
+
+namespace {
+
+static constexpr const uint32_t sample_rate = 48000;
+
+struct beat_t {
+  double sample;      // 本来の拍の位置 (小数を含む)
+};
+
+struct publish_t {
+  uint64_t at_sample;   // 演奏タスクが公開する時刻
+  audio_metronome_t::timeline_t timeline;
+};
+
+struct result_t {
+  uint32_t expected = 0;
+  uint32_t detected = 0;
+  double max_error = 0;
+  uint32_t missing = 0;
+};
+
+// テンポを変えながら beat_count 拍を演奏し、拍の位置と公開の予定を作る
+void makeSchedule(std::mt19937& rng, uint32_t beat_count, uint32_t count_in,
+                  std::vector<beat_t>& beats, std::vector<publish_t>& publishes)
+{
+  static constexpr const double bpm_list[] = { 120.0, 128.0, 97.0, 173.5, 60.0 };
+  double pos = 20000.3;
+  double period = 0;
+  std::uniform_real_distribution<double> jitter_msec(-8.0, 15.0);
+  for (uint32_t b = 0; b < beat_count; ++b) {
+    if (b % 8 == 0) { period = sample_rate * 60.0 / bpm_list[(b / 8) % 5]; }
+    beats.push_back({ pos });
+    // 拍の位置で基準を更新する。公開は拍の前後に揺らぐ (拍より前の公開は前の拍の予測と一致する)
+    publish_t p;
+    p.timeline.anchor_sample = (uint64_t)llround(pos);
+    p.timeline.anchor_beat = b;
+    p.timeline.period_x256 = (uint32_t)llround(period * 256);
+    p.timeline.count_in_beats = count_in;
+    p.timeline.session = 1;
+    double at = pos + jitter_msec(rng) * sample_rate / 1000.0;
+    // 最初の拍は演奏開始時に先行して公開する
+    if (b == 0) { at = pos - sample_rate * 0.1; }
+    p.at_sample = (uint64_t)llround(at);
+    publishes.push_back(p);
+    // 同じ拍を再度公開することもある (二重に鳴らないこと)
+    if (rng() % 3 == 0) {
+      p.at_sample += sample_rate / 100;
+      publishes.push_back(p);
+    }
+    pos += period;
+  }
+}
+
+result_t run(uint32_t seed, audio_metronome_t::mode_t mode, uint32_t count_in)
+{
+  static audio_metronome_t metronome;
+  metronome.setup(sample_rate);
+  metronome.reset();
+
+  std::mt19937 rng(seed);
+  std::vector<beat_t> beats;
+  std::vector<publish_t> publishes;
+  makeSchedule(rng, 40, count_in, beats, publishes);
+
+  audio_metronome_t::config_t config;
+  config.mode = mode;
+  config.level = 100;
+  config.beats_per_bar = 4;
+  config.accent_mask = 1;
+
+  // 公開順に並べる (揺らぎにより前後することがある)
+  std::stable_sort(publishes.begin(), publishes.end(), [](const publish_t& a, const publish_t& b) { return a.at_sample < b.at_sample; });
+
+  audio_metronome_t::timeline_t timeline;   // 公開前は停止中
+  size_t next_publish = 0;
+  // 最後の拍の後、次の拍 (予測により鳴る) の前までを合成する
+  const uint64_t end_sample = (uint64_t)beats.back().sample + sample_rate / 4;
+  std::vector<int32_t> out;
+  out.reserve(end_sample * 2 + 4096);
+  static constexpr const size_t block_list[] = { 96, 48, 64, 96, 128 };
+  uint64_t block_sample = 0;
+  for (size_t blk = 0; block_sample < end_sample; ++blk) {
+    size_t frames = block_list[blk % 5];
+    // I2Sタスクはブロックの先頭で、その時点までに公開された最新の timeline_t を読む
+    while (next_publish < publishes.size() && publishes[next_publish].at_sample <= block_sample) {
+      timeline = publishes[next_publish++].timeline;
+    }
+    std::vector<int32_t> buf(frames * 2, 0);
+    metronome.process(buf.data(), frames, block_sample, timeline, config);
+    out.insert(out.end(), buf.begin(), buf.end());
+    block_sample += frames;
+  }
+
+  // 無音からの立ち上がりを検出する (クリック音は振幅最大の位相から始まる)
+  // 波形の零交差と区別するため、直前の silent_frames フレームが無音であることを条件とする
+  static constexpr const size_t silent_frames = 16;
+  std::vector<uint64_t> onsets;
+  size_t silent = silent_frames;
+  for (size_t i = 0; i < out.size() / 2; ++i) {
+    // 減衰し切る前に次のクリック音が始まることは無いテンポとしている
+    if (silent >= silent_frames && abs(out[i * 2]) > (1 << 28)) { onsets.push_back(i); }
+    silent = (out[i * 2] == 0) ? silent + 1 : 0;
+    TEST_CHECK(out[i * 2] == out[i * 2 + 1]);
+  }
+
+  result_t r;
+  for (uint32_t b = 0; b < beats.size(); ++b) {
+    if (mode == audio_metronome_t::mode_count_in_only && b >= count_in) { continue; }
+    ++r.expected;
+    // 最も近い立ち上がりとの差
+    double best = 1e9;
+    for (auto o : onsets) {
+      double e = fabs((double)o - beats[b].sample);
+      if (best > e) { best = e; }
+    }
+    if (best > sample_rate * 0.01) { ++r.missing; continue; }
+    if (r.max_error < best) { r.max_error = best; }
+  }
+  r.detected = onsets.size();
+  return r;
+}
+
+}
+
+int main(void)
+{
+  for (uint32_t seed = 1; seed <= 8; ++seed) {
+    auto r = run(seed, audio_metronome_t::mode_on, 4);
+    printf("seed %u: %u / %u clicks, max onset error %.2f samples\n", seed, r.detected, r.expected, r.max_error);
+    TEST_CHECK(r.missing == 0);
+    // 同じ拍が二重に鳴らない
+    TEST_CHECK(r.detected == r.expected);
+    TEST_CHECK(r.max_error <= 1.0);
+  }
+
+  { // カウントインのみ
+    auto r = run(100, audio_metronome_t::mode_count_in_only, 4);
+    printf("count-in only: %u / %u clicks, max onset error %.2f samples\n", r.detected, r.expected, r.max_error);
+    TEST_CHECK(r.expected == 4);
+    TEST_CHECK(r.missing == 0 && r.detected == 4);
+    TEST_CHECK(r.max_error <= 1.0);
+  }
+
+  return test_result();
+}
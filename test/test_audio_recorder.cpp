@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// audio_recorder_t に I2Sタスクを模したスレッドから実時間でブロックを渡し、書込みタスクを模したスレッドが
+// 書込み速度を制限した偽のストレージへ保存する
+//  - 十分に速いストレージでは、オーバーラン・アンダーランが無く、全ブロックが順に保存される
+//  - 遅いストレージでは、アンダーラン (書込みが録音に追いつかない) とオーバーラン (ブロックの破棄) を数える
+//  - 途中で書込みに失敗するストレージでは、エラーで停止する
+// いずれの場合も保存したファイルは正しいWAVとなり、破棄はブロック単位で起き、数えた回数と一致すること
+
+#include "test_util.hpp"
+#include "audio_recorder.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <string.h>
+
+using namespace kanplay_ns;
+
+namespace {
+
+static constexpr const uint32_t sample_rate = 48000;
+static constexpr const size_t block_frames = 96;     // I2Sタスクの1ブロック (2msec)
+static constexpr const uint32_t block_count = 400;   // 0.8秒分
+static constexpr const size_t ring_bytes = 16384;
+static constexpr const size_t chunk_bytes = 4096;
+
+// 書込み速度を bytes_per_sec に制限し、メモリ上にファイルを保持する
+class throttled_storage_t : public storage_base_t {
+public:
+  throttled_storage_t(uint32_t bytes_per_sec, size_t fail_after = SIZE_MAX)
+  : _bytes_per_sec { bytes_per_sec }
+  , _fail_after { fail_after }
+  {}
+
+  bool beginStreamFile(const char*) override {
+    file.clear();
+    _open = true;
+    return true;
+  }
+  int writeStreamFile(const uint8_t* data, size_t length) override {
+    if (!_open) { return -1; }
+    if (_bytes_per_sec) {
+      std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)length * 1000000u / _bytes_per_sec));
+    }
+    // 上限を超える書込みは途中まで書き込んで失敗する
+    if (file.size() + length > _fail_after) { length = _fail_after - file.size(); }
+    file.insert(file.end(), data, data + length);
+    return length;
+  }
+  bool rewriteStreamFile(size_t offset, const uint8_t* data, size_t length) override {
+    if (!_open || offset + length > file.size()) { return false; }
+    memcpy(&file[offset], data, length);
+    return true;
+  }
+  bool endStreamFile(void) override {
+    bool result = _open;
+    _open = false;
+    return result;
+  }
+
+  std::vector<uint8_t> file;
+
+private:
+  uint32_t _bytes_per_sec;
+  size_t _fail_after;
+  bool _open = false;
+};
+
+uint32_t get32(const uint8_t* src) { return src[0] | src[1] << 8 | src[2] << 16 | (uint32_t)src[3] << 24; }
+uint16_t get16(const uint8_t* src) { return src[0] | src[1] << 8; }
+
+struct result_t {
+  audio_recorder_t::state_t state;
+  uint32_t overrun = 0;
+  uint32_t underrun = 0;
+  size_t max_fill = 0;
+  uint32_t saved_blocks = 0;
+  bool wav_valid = false;
+  bool blocks_valid = false;
+};
+
+result_t run(throttled_storage_t& storage)
+{
+  static audio_recorder_t recorder;   // リングバッファは初回のみ確保する
+  TEST_CHECK(recorder.init(ring_bytes, chunk_bytes));
+  TEST_CHECK(recorder.requestStart(&storage, "/test.wav", sample_rate));
+
+  std::atomic<bool> done { false };
+  std::thread writer([&]() {
+    while (!done.load()) {
+      if (!recorder.process()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+      }
+    }
+  });
+  while (recorder.getState() == audio_recorder_t::rec_starting) { std::this_thread::yield(); }
+
+  // 各フレームの L にブロック番号、R にブロック内のフレーム番号を入れる (上位16bitが保存される)
+  int32_t buf[block_frames * 2];
+  auto next = std::chrono::steady_clock::now();
+  for (uint32_t b = 0; b < block_count; ++b) {
+    for (size_t i = 0; i < block_frames; ++i) {
+      buf[i * 2] = (int32_t)(b << 16);
+      buf[i * 2 + 1] = (int32_t)(i << 16);
+    }
+    recorder.push(buf, block_frames);
+    next += std::chrono::microseconds(block_frames * 1000000u / sample_rate);
+    std::this_thread::sleep_until(next);
+  }
+  recorder.requestStop();
+  while (recorder.getState() == audio_recorder_t::rec_stopping
+      || recorder.getState() == audio_recorder_t::rec_recording) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  done.store(true);
+  writer.join();
+
+  result_t r;
+  r.state = recorder.getState();
+  r.overrun = recorder.getOverrunCount();
+  r.underrun = recorder.getUnderrunCount();
+  r.max_fill = recorder.getMaxFill();
+
+  // WAVヘッダとファイルの長さが一致すること
+  auto& f = storage.file;
+  if (f.size() < audio_recorder_t::wav_header_bytes) { return r; }
+  uint32_t data_bytes = get32(&f[40]);
+  r.wav_valid = memcmp(&f[0], "RIFF", 4) == 0
+             && get32(&f[4]) == data_bytes + audio_recorder_t::wav_header_bytes - 8
+             && memcmp(&f[8], "WAVEfmt ", 8) == 0
+             && get16(&f[20]) == 1 && get16(&f[22]) == 2
+             && get32(&f[24]) == sample_rate
+             && get16(&f[32]) == audio_recorder_t::bytes_per_frame && get16(&f[34]) == 16
+             && memcmp(&f[36], "data", 4) == 0
+             && data_bytes % audio_recorder_t::bytes_per_frame == 0
+             && data_bytes == recorder.getDataBytes()
+             && audio_recorder_t::wav_header_bytes + data_bytes <= f.size();
+  if (!r.wav_valid) { return r; }
+
+  // ブロックは欠けるとしても丸ごと欠け、順序は保たれること
+  r.blocks_valid = true;
+  const uint8_t* data = &f[audio_recorder_t::wav_header_bytes];
+  uint32_t frames = data_bytes / audio_recorder_t::bytes_per_frame;
+  int32_t prev_block = -1;
+  for (uint32_t i = 0; i < frames; ++i) {
+    uint16_t block = get16(&data[i * 4]);
+    uint16_t frame = get16(&data[i * 4 + 2]);
+    if (frame == 0) {
+      if ((int32_t)block <= prev_block) { r.blocks_valid = false; }
+      prev_block = block;
+      ++r.saved_blocks;
+    } else if (block != prev_block || frame != get16(&data[(i - 1) * 4 + 2]) + 1) {
+      r.blocks_valid = false;
+    }
+  }
+  return r;
+}
+
+}
+
+int main(void)
+{
+  const uint32_t audio_bytes_per_sec = sample_rate * audio_recorder_t::bytes_per_frame;
+
+  { // 録音の4倍の速度で書き込めるストレージ
+    throttled_storage_t storage { audio_bytes_per_sec * 4 };
+    auto r = run(storage);
+    printf("fast storage    : overrun %u, underrun %u, max fill %zu bytes, saved %u / %u blocks\n",
+           r.overrun, r.underrun, r.max_fill, r.saved_blocks, block_count);
+    TEST_CHECK(r.state == audio_recorder_t::rec_idle);
+    TEST_CHECK(r.overrun == 0);
+    TEST_CHECK(r.underrun == 0);
+    TEST_CHECK(r.wav_valid && r.blocks_valid);
+    TEST_CHECK(r.saved_blocks == block_count);
+  }
+
+  { // 録音の半分の速度でしか書き込めないストレージ
+    throttled_storage_t storage { audio_bytes_per_sec / 2 };
+    auto r = run(storage);
+    printf("slow storage    : overrun %u, underrun %u, max fill %zu bytes, saved %u / %u blocks\n",
+           r.overrun, r.underrun, r.max_fill, r.saved_blocks, block_count);
+    TEST_CHECK(r.state == audio_recorder_t::rec_idle);
+    TEST_CHECK(r.overrun > 0);
+    TEST_CHECK(r.underrun > 0);
+    TEST_CHECK(r.wav_valid && r.blocks_valid);
+    TEST_CHECK(r.saved_blocks + r.overrun == block_count);
+  }
+
+  { // 途中でチャンクの一部だけ書き込んで失敗するストレージ
+    throttled_storage_t storage { 0, audio_recorder_t::wav_header_bytes + chunk_bytes * 3 + 1000 };
+    auto r = run(storage);
+    printf("failing storage : overrun %u, underrun %u, saved %u / %u blocks, %zu bytes in file\n",
+           r.overrun, r.underrun, r.saved_blocks, block_count, storage.file.size());
+    TEST_CHECK(r.state == audio_recorder_t::rec_error);
+    TEST_CHECK(r.wav_valid && r.blocks_valid);
+  }
+
+  return test_result();
+}
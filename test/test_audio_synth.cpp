@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// audio_synth_t のボイスの割当て・処理時間の予算によるボイス数の上限・上限を超えたボイスの停止を確かめる
+//  - 割当ては 同じノートの再発音 > 空きボイス > リリース中で最も小さいもの > 最も古いもの の順となること
+//  - サスティンペダルで保持したノートはペダルを離した時点でリリースされること
+//  - 処理時間を通知すると、1ボイスあたりの処理時間と予算からボイス数の上限が決まり、下限を下回らないこと
+//  - 上限を超えたボイスはクリックを生じないよう短いリリースで減衰して止まり、新しいノートは上限内のボイスを使うこと
+
+#include "test_util.hpp"
+#include "audio_synth.hpp"
+
+#include <string.h>
+
+using namespace kanplay_ns;
+
+namespace {
+
+static constexpr const uint32_t sample_rate = 48000;
+static constexpr const int32_t env_full = 1 << 30;
+
+// ボイスの状態を参照するため protected のメンバを公開する
+class synth_probe_t : public audio_synth_t {
+public:
+  bool isOff(size_t i) const { return _voice[i].stage == stage_off; }
+  bool isReleasing(size_t i) const { return _voice[i].stage == stage_release; }
+  uint8_t getNote(size_t i) const { return _voice[i].note; }
+  int32_t getEnv(size_t i) const { return _voice[i].env; }
+  // 発音中のボイスから ch, note に一致するものの番号を返す (無ければ -1)
+  int findVoice(uint8_t ch, uint8_t note) const {
+    for (size_t i = 0; i < voice_max; ++i) {
+      if (_voice[i].stage != stage_off && _voice[i].channel == ch && _voice[i].note == note) { return (int)i; }
+    }
+    return -1;
+  }
+};
+
+void renderBlocks(synth_probe_t& synth, size_t blocks, size_t frames = audio_synth_t::frames_max)
+{
+  int32_t buf[audio_synth_t::frames_max * 2];
+  for (size_t b = 0; b < blocks; ++b) {
+    memset(buf, 0, sizeof(buf));
+    synth.render(buf, frames);
+  }
+}
+
+void testAllocation(void)
+{
+  static synth_probe_t synth;
+  synth.setup(sample_rate);
+
+  // 全ボイスを順に発音させる (Piano はサスティンが無く、長い減衰の間は発音中となる)
+  for (uint8_t i = 0; i < audio_synth_t::voice_max; ++i) {
+    synth.message(0x90, 40 + i, 100);
+    renderBlocks(synth, 1);
+  }
+  TEST_CHECK(synth.getActiveVoices() == audio_synth_t::voice_max);
+  for (size_t i = 0; i < audio_synth_t::voice_max; ++i) {
+    TEST_CHECK(synth.getNote(i) == 40 + i);
+  }
+
+  // 同じノートの再発音は同じボイスを使い、エンベロープを引き継ぐ
+  int32_t env = synth.getEnv(0);
+  synth.message(0x90, 40, 90);
+  TEST_CHECK(synth.findVoice(0, 40) == 0);
+  TEST_CHECK(synth.getEnv(0) == env && env > 0);
+  TEST_CHECK(synth.getActiveVoices() == audio_synth_t::voice_max);
+
+  // リリース中のボイスがあれば、最も古いボイスより優先して使う
+  synth.message(0x80, 50, 0);
+  TEST_CHECK(synth.isReleasing(10));
+  synth.message(0x90, 70, 100);
+  TEST_CHECK(synth.findVoice(0, 70) == 10);
+
+  // リリース中のボイスが無ければ最も古いボイスを使う (再発音したボイス 0 は新しくなっている)
+  synth.message(0x90, 71, 100);
+  TEST_CHECK(synth.findVoice(0, 71) == 1);
+  TEST_CHECK(synth.findVoice(0, 41) < 0);
+
+  // 別のチャンネルの同じノートは別のボイスとする
+  synth.message(0x91, 70, 100);
+  TEST_CHECK(synth.findVoice(1, 70) >= 0 && synth.findVoice(1, 70) != 10);
+
+  // サスティンペダルを踏んでいる間のノートオフは保持し、ペダルを離すとリリースする
+  synth.message(0xB0, 64, 127);
+  synth.message(0x80, 45, 0);
+  TEST_CHECK(!synth.isReleasing(5) && !synth.isOff(5));
+  synth.message(0xB0, 64, 0);
+  TEST_CHECK(synth.isReleasing(5));
+
+  // ドラムはノートオフを無視して自然に減衰させる
+  synth.reset();
+  synth.message(0x90 | audio_synth_t::drum_channel, 38, 100);
+  int drum = synth.findVoice(audio_synth_t::drum_channel, 38);
+  TEST_CHECK(drum >= 0);
+  synth.message(0x80 | audio_synth_t::drum_channel, 38, 0);
+  TEST_CHECK(drum >= 0 && !synth.isReleasing(drum));
+  // スネアの減衰 (250msec) を過ぎれば止まる
+  renderBlocks(synth, sample_rate / 2 / audio_synth_t::frames_max);
+  TEST_CHECK(synth.getActiveVoices() == 0);
+}
+
+void testBudget(void)
+{
+  static synth_probe_t synth;
+  synth.setup(sample_rate);
+
+  // Organ はサスティンが最大で、鳴らし続けられる
+  synth.message(0xC0, 16, 0);
+  for (uint8_t i = 0; i < 8; ++i) { synth.message(0x90, 60 + i, 100); }
+  renderBlocks(synth, 40);
+  TEST_CHECK(synth.getActiveVoices() == 8);
+  TEST_CHECK(synth.getVoiceLimit() == audio_synth_t::voice_max);
+
+  // 8ボイス × 96フレームの描画に 80usec かかった (1ボイスあたり 10usec) 場合、予算 60usec では 6ボイスまでとなる
+  for (int i = 0; i < 40; ++i) { synth.reportElapsed(80, 60); }
+  printf("voice cost %u nsec, voice limit %zu\n", synth.getVoiceCostNsec(), synth.getVoiceLimit());
+  TEST_CHECK(synth.getVoiceCostNsec() >= 9900 && synth.getVoiceCostNsec() <= 10000);
+  TEST_CHECK(synth.getVoiceLimit() == 6);
+  for (size_t i = 0; i < 6; ++i) { TEST_CHECK(!synth.isOff(i) && !synth.isReleasing(i)); }
+  TEST_CHECK(synth.isReleasing(6) && synth.isReleasing(7));
+
+  // 上限を超えたボイスは 1サンプル毎に一定の比率で減衰し (段差を生じない)、約10msec で止まる
+  int32_t prev = synth.getEnv(6);
+  TEST_CHECK(prev == env_full);
+  double min_ratio = 1.0;
+  size_t off_samples = 0;
+  for (size_t n = 1; n <= sample_rate / 20 && off_samples == 0; ++n) {
+    renderBlocks(synth, 1, 1);
+    if (synth.isOff(6)) {
+      off_samples = n;
+      break;
+    }
+    double ratio = (double)synth.getEnv(6) / prev;
+    if (min_ratio > ratio) { min_ratio = ratio; }
+    prev = synth.getEnv(6);
+  }
+  printf("stolen voice: %zu samples to stop, min ratio per sample %.4f\n", off_samples, min_ratio);
+  TEST_CHECK(min_ratio > 0.98);
+  TEST_CHECK(off_samples >= sample_rate * 10 / 1000 && off_samples <= sample_rate * 13 / 1000);
+  TEST_CHECK(synth.isOff(7));
+  TEST_CHECK(synth.getActiveVoices() == 6);
+
+  // 上限に達している間、新しいノートは上限内で最も古いボイスを使う
+  synth.message(0x90, 80, 100);
+  TEST_CHECK(synth.findVoice(0, 80) == 0);
+  TEST_CHECK(synth.isOff(6) && synth.isOff(7));
+
+  // 処理時間が予算を大きく超えても下限のボイス数は残す
+  renderBlocks(synth, 1);
+  for (int i = 0; i < 40; ++i) { synth.reportElapsed(10000, 60); }
+  TEST_CHECK(synth.getVoiceLimit() == 4);
+  TEST_CHECK(synth.getActiveVoices() <= 6);
+  renderBlocks(synth, sample_rate / 50 / audio_synth_t::frames_max);
+  TEST_CHECK(synth.getActiveVoices() == 4);
+
+  // 処理時間が短くなれば、ゆっくりと上限を戻す (一時的に短くなっただけでは戻さない)
+  for (int i = 0; i < 10; ++i) { synth.reportElapsed(8, 60); }
+  TEST_CHECK(synth.getVoiceLimit() == 4);
+  for (int i = 0; i < 400; ++i) { synth.reportElapsed(8, 60); }
+  TEST_CHECK(synth.getVoiceLimit() == audio_synth_t::voice_max);
+}
+
+}
+
+int main(void)
+{
+  testAllocation();
+  testBudget();
+  return test_result();
+}
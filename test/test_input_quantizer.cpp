@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// 人の手による入力のずれ方を模した入力列を input_quantizer_t へ流し、寄せた入力が分割位置に揃うこと、
+// 長い演奏でも分割位置の基準がずれていかないこと、付加した遅延と取り除いた誤差を確認する
+
+#include "test_util.hpp"
+#include "input_quantizer.hpp"
+
+#include <stdlib.h>
+#include <random>
+#include <vector>
+
+using namespace kanplay_ns;
+
+namespace {
+
+static constexpr const int32_t cycle_usec = 500000;   // 120 BPM
+static constexpr const int32_t step_per_beat = 2;
+static constexpr const int32_t grid_usec = cycle_usec / step_per_beat;
+
+struct press_t {
+  uint32_t usec;
+  uint32_t ideal_usec;  // 本来の分割位置
+};
+
+// 演奏者のずれ方 : 平均 bias_usec 、標準偏差 sigma_usec の正規分布。
+// 一部は8分音符で入力し、phrase_beats 毎に2拍休んで弾き直す (弾き直しの最初の入力は分割位置どおりとする)
+struct player_t {
+  const char* name;
+  int32_t bias_usec;
+  int32_t sigma_usec;
+};
+
+std::vector<press_t> makeTrace(const player_t& player, uint32_t seed, int beats, int phrase_beats)
+{
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> dist(player.bias_usec, player.sigma_usec);
+  std::vector<press_t> trace;
+  uint32_t start = 0xFFFFFFFFu - 60000000u;   // 途中で32bitの時刻が一周する
+  int32_t pos = 0;
+  for (int b = 0; b < beats; ++b) {
+    if (b % phrase_beats == 0) {
+      pos += 2 * step_per_beat;
+      uint32_t ideal = start + pos * grid_usec;
+      trace.push_back({ ideal, ideal });
+      pos += (rng() % 3 == 0) ? 1 : step_per_beat;
+      continue;
+    }
+    uint32_t ideal = start + pos * grid_usec;
+    int32_t err = (int32_t)dist(rng);
+    if (err > grid_usec / 2 - 1000) { err = grid_usec / 2 - 1000; }
+    if (err < -grid_usec / 2 + 1000) { err = -grid_usec / 2 + 1000; }
+    trace.push_back({ ideal + err, ideal });
+    pos += (rng() % 3 == 0) ? 1 : step_per_beat;
+  }
+  return trace;
+}
+
+struct result_t {
+  int presses = 0;
+  int corrected = 0;
+  int should_correct = 0;
+  int off_grid = 0;         // 寄せたのに分割位置に揃わなかった
+  int wrong_error = 0;      // 基準のずれにより、入力の誤差を正しく求められなかった
+  int negative_delay = 0;
+  double error_before = 0;  // 入力の誤差の絶対値の平均 (usec)
+  double error_after = 0;   // 発音の誤差の絶対値の平均 (先読み分を除く)
+  double latency = 0;       // 付加した遅延の平均
+};
+
+result_t replay(const std::vector<press_t>& trace, int32_t window_usec, int32_t lookahead_usec)
+{
+  input_quantizer_t q;
+  q.setConfig(window_usec, lookahead_usec);
+  result_t r;
+  uint32_t prev_ideal = 0;
+  for (auto& p : trace) {
+    auto res = q.process(p.usec, cycle_usec, step_per_beat);
+    int32_t err = p.usec - p.ideal_usec;
+    bool restart = (r.presses == 0) || (p.ideal_usec - prev_ideal > (uint32_t)cycle_usec * 2);
+    prev_ideal = p.ideal_usec;
+    ++r.presses;
+    if (res.delay_usec < 0 || (int32_t)(res.play_usec - p.usec) != res.delay_usec) { ++r.negative_delay; }
+    r.error_before += abs(err);
+    r.error_after += abs((int32_t)(res.play_usec - lookahead_usec - p.ideal_usec));
+    r.latency += res.delay_usec;
+    if (restart) { continue; }
+    if (res.error_usec != err) { ++r.wrong_error; }
+    if (abs(err) <= window_usec && err <= lookahead_usec) { ++r.should_correct; }
+    if (res.corrected) {
+      ++r.corrected;
+      if (res.play_usec != p.ideal_usec + lookahead_usec) { ++r.off_grid; }
+    }
+  }
+  r.error_before /= r.presses;
+  r.error_after /= r.presses;
+  r.latency /= r.presses;
+  return r;
+}
+
+}
+
+int main(void)
+{
+  static constexpr const player_t players[] = {
+    { "tight",   0,     6000 },
+    { "loose",   0,    18000 },
+    { "late",    12000, 8000 },
+    { "rushing", -9000, 8000 },
+  };
+
+  for (auto& player : players) {
+    auto trace = makeTrace(player, 1, 4000, 64);
+
+    // 先読みなし : ビートより遅い入力は寄せられない
+    auto r0 = replay(trace, 30000, 0);
+    // 先読みあり
+    auto r1 = replay(trace, 30000, 20000);
+    printf("%-8s lookahead  0ms: error %5.1f -> %5.1f msec, latency %4.1f msec, corrected %d/%d\n",
+           player.name, r0.error_before / 1000, r0.error_after / 1000, r0.latency / 1000, r0.corrected, r0.presses);
+    printf("%-8s lookahead 20ms: error %5.1f -> %5.1f msec, latency %4.1f msec, corrected %d/%d\n",
+           player.name, r1.error_before / 1000, r1.error_after / 1000, r1.latency / 1000, r1.corrected, r1.presses);
+
+    for (auto& r : { r0, r1 }) {
+      // 長い演奏でも基準が入力に引きずられず、誤差は本来の分割位置に対して求められる
+      TEST_CHECK(r.wrong_error == 0);
+      // 寄せるべき入力はすべて寄せ、寄せた入力は分割位置に揃う
+      TEST_CHECK(r.corrected == r.should_correct);
+      TEST_CHECK(r.off_grid == 0);
+      TEST_CHECK(r.negative_delay == 0);
+      TEST_CHECK(r.error_after <= r.error_before);
+    }
+    // 先読みにより遅れた入力も寄せられる
+    TEST_CHECK(r1.corrected >= r0.corrected);
+    TEST_CHECK(r1.error_after <= r0.error_after);
+    if (player.bias_usec > 0) {
+      TEST_CHECK(r1.corrected > r0.corrected * 2);
+      TEST_CHECK(r1.error_after * 3 < r1.error_before);
+    }
+    // 付加する遅延は先読みと許容幅の和を超えない
+    TEST_CHECK(r0.latency <= 30000 && r1.latency <= 20000 + 30000);
+  }
+
+  { // 誤差の平均は寄せた入力のみで求める
+    input_quantizer_t q;
+    q.setConfig(30000, 20000);
+    uint32_t t = 1000000;
+    q.process(t, cycle_usec, 1);
+    for (int i = 0; i < 32; ++i) {
+      t += cycle_usec;
+      auto res = q.process(t - 5000, cycle_usec, 1);
+      TEST_CHECK(res.corrected && res.delay_usec == 25000);
+    }
+    int32_t correction = q.getCorrectionAvg();
+    TEST_CHECK(abs(correction - 5000) < 500);
+    for (int i = 0; i < 16; ++i) {
+      t += cycle_usec;
+      // 先読みより遅い入力は寄せずに先読み分だけ遅らせて発音する
+      auto res = q.process(t + 25000, cycle_usec, 1);
+      TEST_CHECK(!res.corrected && res.error_usec == 25000 && res.delay_usec == 20000);
+    }
+    TEST_CHECK(q.getCorrectionAvg() == correction);
+    TEST_CHECK(abs(q.getLatencyAvg() - 20000) < 2000);
+
+    // オンビートが鳴るまでの間のオフビートは同じだけ遅らせ、その後は先読み分だけ遅らせる
+    t += cycle_usec;
+    auto res = q.process(t - 10000, cycle_usec, 1);
+    TEST_CHECK(res.delay_usec == 30000);
+    TEST_CHECK(q.getFollowDelay(t - 5000) == 30000);
+    TEST_CHECK(q.getFollowDelay(t + 25000) == 20000);
+  }
+
+  { // 無効時は入力時刻のまま発音し、遅延を付加しない
+    input_quantizer_t q;
+    q.setConfig(0, 20000);
+    auto res = q.process(12345, cycle_usec, 1);
+    TEST_CHECK(res.play_usec == 12345 && res.delay_usec == 0 && q.getFollowDelay(12345) == 0);
+  }
+
+  return test_result();
+}
@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// looper_t で録音・再生・重ね録りを行い、midi_out_control へ出力されたノートの時刻を確認する。
+// テンポが変わった後もオンビートに合わせて再生されること、再生音どうしのスティールによる
+// ノートオフが重ね録りに入らないことを確認する
+
+#include "test_util.hpp"
+#include "looper.hpp"
+#include "voice_manager.hpp"
+
+#include <M5Unified.h>
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+using namespace kanplay_ns;
+
+mock_m5_t M5;
+
+namespace {
+
+struct played_t {
+  uint32_t usec;
+  uint8_t status;
+  uint8_t data1;
+  uint8_t data2;
+};
+
+// 演奏タスクの代わりに、オンビートの通知と looper_t::process の呼出しを時刻順に行う
+struct sim_t {
+  reg_midi_out_control_t midi_out;
+  voice_manager_t vm;
+  looper_t looper;
+  registry_t::history_code_t code = 0;
+  uint32_t now = 1000000;
+  int32_t beat_usec = 500000;
+  uint32_t next_beat = 1000000;
+  int32_t beat_jitter_usec = 0;
+  std::vector<played_t> played;
+  std::vector<uint32_t> beat_log;
+
+  sim_t(void) {
+    midi_out.init();
+    vm.setOutput(&midi_out);
+    looper.init(1024, &vm, &midi_out);
+    code = midi_out.getHistoryCode();
+  }
+
+  void drain(void) {
+    const registry_base_t::history_t* history;
+    while (nullptr != (history = midi_out.getHistory(code))) {
+      played.push_back({ now, (uint8_t)history->index, (uint8_t)(history->value & 0xFF), (uint8_t)(history->value >> 8) });
+    }
+  }
+
+  // end の直前まで進める (end の時刻の処理は次の呼出しで行う)
+  void runUntil(uint32_t end) {
+    for (;;) {
+      if (now == next_beat) {
+        looper.onBeat(now, beat_usec);
+        beat_log.push_back(now);
+        next_beat += beat_usec + (beat_jitter_usec ? (int32_t)(rand() % (beat_jitter_usec * 2 + 1)) - beat_jitter_usec : 0);
+      }
+      uint32_t wait = looper.process(now);
+      drain();
+      if (wait == 0) { wait = 1; }
+      if (wait > 1000000) { wait = 1000000; }
+      uint32_t t = now + wait;
+      if ((int32_t)(next_beat - t) < 0) { t = next_beat; }
+      if ((int32_t)(t - end) >= 0) { break; }
+      now = t;
+    }
+    now = end;
+  }
+
+  // 手動演奏のノート (演奏タスクと同じく出力直後に capture を呼ぶ)
+  void play(uint8_t note, uint8_t velocity) {
+    vm.noteOn(0, 0, note, velocity);
+    looper.capture(now);
+    drain();
+  }
+
+  void control(def::command::looper_control_t ctrl) {
+    looper.control(ctrl, now);
+    drain();
+  }
+
+  // [from, to) の間に出力されたノートオン
+  std::vector<played_t> noteOns(uint32_t from, uint32_t to) const {
+    std::vector<played_t> res;
+    for (auto& p : played) {
+      if ((p.status & 0xF0) == 0x90 && p.data2 && (int32_t)(p.usec - from) >= 0 && (int32_t)(p.usec - to) < 0) {
+        res.push_back(p);
+      }
+    }
+    return res;
+  }
+};
+
+// 1小節 (4拍) の各拍にノートを録音し、録音終了後の1周目の終わりまで進める。ノートの長さは note_beats 拍
+void recordBar(sim_t& sim, double note_beats)
+{
+  struct input_t { uint32_t usec; uint8_t note; uint8_t velocity; };
+  std::vector<input_t> input;
+  uint32_t start = sim.next_beat;
+  for (int i = 0; i < 4; ++i) {
+    uint32_t on = start + i * sim.beat_usec;
+    input.push_back({ on, (uint8_t)(60 + i), 100 });
+    input.push_back({ on + (uint32_t)(sim.beat_usec * note_beats), (uint8_t)(60 + i), 0 });
+  }
+  std::sort(input.begin(), input.end(), [](const input_t& a, const input_t& b) { return a.usec < b.usec; });
+
+  sim.control(def::command::looper_control_t::lc_record);
+  // 4拍目の後、少し早めに再生を指示してもループ長は4拍に丸められる
+  const uint32_t play_usec = start + 4 * sim.beat_usec - 20000;
+  bool play = false;
+  for (auto& in : input) {
+    if (!play && in.usec >= play_usec) {
+      sim.runUntil(play_usec);
+      sim.control(def::command::looper_control_t::lc_play);
+      play = true;
+    }
+    sim.runUntil(in.usec);
+    sim.play(in.note, in.velocity);
+  }
+  if (!play) {
+    sim.runUntil(play_usec);
+    sim.control(def::command::looper_control_t::lc_play);
+  }
+  sim.runUntil(start + 8 * sim.beat_usec);
+}
+
+// 1周分の再生音が各拍に揃っていることを確認し、最大の誤差を返す
+int32_t checkCycle(const sim_t& sim, uint32_t cycle_start, const uint32_t (&beat_usec)[4], int expect_count = 4)
+{
+  uint32_t cycle_end = beat_usec[3] + (beat_usec[3] - beat_usec[2]);
+  auto ons = sim.noteOns(cycle_start - 1000, cycle_end - 1000);
+  TEST_CHECK((int)ons.size() == expect_count);
+  int32_t worst = 0;
+  for (auto& on : ons) {
+    if (on.data1 < 60 || on.data1 > 63) { continue; }
+    int32_t err = on.usec - beat_usec[on.data1 - 60];
+    if (abs(err) > abs(worst)) { worst = err; }
+  }
+  return worst;
+}
+
+}
+
+int main(void)
+{
+  { // 録音・再生・テンポ変更・重ね録り
+    sim_t sim;
+    recordBar(sim, 0.25);
+    TEST_CHECK(sim.looper.getState() == looper_t::looper_playing);
+    TEST_CHECK(sim.looper.getEventCount() == 8);
+    TEST_CHECK(sim.looper.getLoopLengthUsec() == 2000000);
+
+    // 同じテンポで2周
+    for (int cycle = 0; cycle < 2; ++cycle) {
+      uint32_t start = sim.now;
+      uint32_t beats[4];
+      for (int i = 0; i < 4; ++i) { beats[i] = start + i * sim.beat_usec; }
+      sim.runUntil(start + 4 * sim.beat_usec);
+      int32_t worst = checkCycle(sim, start, beats);
+      TEST_CHECK(abs(worst) <= 1);
+    }
+
+    // テンポを 120BPM から 100BPM に変更する。以降の再生は新しいビートに揃う
+    sim.beat_usec = 600000;
+    sim.next_beat = sim.now;
+    for (int cycle = 0; cycle < 3; ++cycle) {
+      uint32_t start = sim.now;
+      uint32_t beats[4];
+      for (int i = 0; i < 4; ++i) { beats[i] = start + i * sim.beat_usec; }
+      sim.runUntil(start + 4 * sim.beat_usec);
+      int32_t worst = checkCycle(sim, start, beats);
+      printf("100 BPM cycle %d: worst error %d usec\n", cycle, worst);
+      TEST_CHECK(abs(worst) <= 1);
+    }
+    TEST_CHECK(sim.looper.getLoopLengthUsec() == 2400000);
+
+    // オンビートが揺れる場合 (手動演奏) も再生はオンビートに追従し、ずれが積み重ならない
+    // (遅れたオンビートは予測した時刻に先に鳴るため、誤差は揺れの幅に収まる)
+    sim.beat_jitter_usec = 15000;
+    srand(1);
+    int32_t jitter_worst = 0;
+    for (int cycle = 0; cycle < 8; ++cycle) {
+      size_t k = sim.beat_log.size();
+      for (int i = 0; i < 4; ++i) {
+        sim.runUntil(sim.next_beat + 1);
+      }
+      uint32_t beats[4];
+      for (int i = 0; i < 4; ++i) { beats[i] = sim.beat_log[k + i]; }
+      int32_t worst = checkCycle(sim, beats[0] - sim.beat_jitter_usec, beats);
+      if (abs(worst) > abs(jitter_worst)) { jitter_worst = worst; }
+    }
+    printf("jittered beats: worst error %d usec\n", jitter_worst);
+    TEST_CHECK(abs(jitter_worst) <= sim.beat_jitter_usec + 1);
+    sim.beat_jitter_usec = 0;
+    sim.runUntil(sim.next_beat);
+
+    // 重ね録り : 3拍目の半拍後に新しいノートを加える
+    uint32_t start = sim.now;
+    sim.control(def::command::looper_control_t::lc_overdub);
+    TEST_CHECK(sim.looper.getState() == looper_t::looper_overdub);
+    sim.runUntil(start + 2 * sim.beat_usec + sim.beat_usec / 2);
+    sim.play(72, 90);
+    sim.runUntil(start + 3 * sim.beat_usec);
+    sim.play(72, 0);
+    sim.runUntil(start + 4 * sim.beat_usec + sim.beat_usec / 2);
+    sim.control(def::command::looper_control_t::lc_play);
+    TEST_CHECK(sim.looper.getState() == looper_t::looper_playing);
+    sim.runUntil(start + 8 * sim.beat_usec);
+    TEST_CHECK(sim.looper.getEventCount() == 10);
+    auto ons = sim.noteOns(start + 4 * sim.beat_usec, start + 8 * sim.beat_usec);
+    TEST_CHECK(ons.size() == 5);
+    bool found = false;
+    for (auto& on : ons) {
+      if (on.data1 == 72) {
+        found = true;
+        TEST_CHECK(abs((int32_t)(on.usec - (start + 6 * sim.beat_usec + sim.beat_usec / 2))) <= 1);
+      }
+    }
+    TEST_CHECK(found);
+
+    // 停止すると発音中の再生音を止める
+    sim.control(def::command::looper_control_t::lc_stop);
+    TEST_CHECK(sim.looper.getState() == looper_t::looper_stopped);
+    TEST_CHECK(sim.vm.getActiveCount() == 0);
+  }
+
+  { // 再生音どうしのスティールで生じたノートオフは重ね録りしない
+    sim_t sim;
+    recordBar(sim, 1.5);
+    TEST_CHECK(sim.looper.getEventCount() == 8);
+    sim.vm.setLimit(1, 0);
+    uint32_t steal_count = sim.vm.getStealCount();
+    for (int cycle = 0; cycle < 3; ++cycle) {
+      if (cycle == 0) { sim.control(def::command::looper_control_t::lc_overdub); }
+      uint32_t start = sim.now;
+      uint32_t beats[4];
+      for (int i = 0; i < 4; ++i) { beats[i] = start + i * sim.beat_usec; }
+      sim.runUntil(start + 4 * sim.beat_usec);
+      TEST_CHECK(abs(checkCycle(sim, start, beats)) <= 1);
+    }
+    printf("looper steals: %u\n", (unsigned)(sim.vm.getStealCount() - steal_count));
+    TEST_CHECK(sim.vm.getStealCount() > steal_count);
+    TEST_CHECK(sim.looper.getState() == looper_t::looper_overdub);
+    TEST_CHECK(sim.looper.getEventCount() == 8);
+    TEST_CHECK(sim.looper.getOverflowCount() == 0);
+  }
+
+  return test_result();
+}
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// MIDI_BLE_Packetizer が組み立てたパケットを受信側の手順で復元し、
+// メッセージとタイムスタンプが欠けずに届くこと、パケット長と送出までの保留時間が制限内であることを確認する
+
+#include "test_util.hpp"
+#include "midi_ble_packetizer.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace midi_driver;
+
+struct packet_t {
+  std::vector<uint8_t> data;
+  uint32_t hold_usec;
+};
+
+struct message_t {
+  std::vector<uint8_t> data;
+  uint16_t timestamp;
+  bool operator==(const message_t& rhs) const { return data == rhs.data && timestamp == rhs.timestamp; }
+};
+
+static std::vector<packet_t> sent_packets;
+static uint32_t now_usec;
+static uint32_t pending_usec;  // 送出待ちのパケットにデータを積み始めた時刻
+
+static void sender(void*, const uint8_t* data, size_t length)
+{
+  sent_packets.push_back({ std::vector<uint8_t>(data, data + length), now_usec - pending_usec });
+}
+
+// BLE-MIDI の受信側の手順でパケットをメッセージ列へ復元する
+struct decoder_t {
+  std::vector<message_t> messages;
+  message_t sysex;
+  bool in_sysex = false;
+  bool error = false;
+
+  void decode(const std::vector<uint8_t>& p)
+  {
+    if (p.size() < 2 || (p[0] & 0xC0) != 0x80) { error = true; return; }
+    uint16_t high = p[0] & 0x3F;
+    int last_low = -1;
+    uint16_t ts = 0;
+    uint8_t running = 0;
+    size_t i = 1;
+    while (i < p.size()) {
+      if (in_sysex) {
+        if (p[i] & 0x80) {
+          // 終端のF7はタイムスタンプの後に置かれる
+          if (i + 1 >= p.size() || p[i + 1] != 0xF7) { error = true; return; }
+          sysex.data.push_back(0xF7);
+          messages.push_back(sysex);
+          in_sysex = false;
+          i += 2;
+        } else {
+          sysex.data.push_back(p[i++]);
+        }
+        continue;
+      }
+      if (p[i] & 0x80) {
+        int low = p[i] & 0x7F;
+        if (last_low >= 0 && low < last_low) { high = (high + 1) & 0x3F; }
+        last_low = low;
+        ts = (high << 7) | low;
+        if (++i >= p.size()) { error = true; return; }
+        if (p[i] & 0x80) {
+          running = p[i++];
+          if (running == 0xF0) {
+            sysex = { { 0xF0 }, ts };
+            in_sysex = true;
+            running = 0;
+            continue;
+          }
+        }
+      }
+      if (running == 0) { error = true; return; }
+      size_t length = (running >= 0xC0 && running < 0xE0) ? 1 : 2;
+      if (i + length > p.size()) { error = true; return; }
+      message_t m { { running }, ts };
+      m.data.insert(m.data.end(), p.begin() + i, p.begin() + i + length);
+      messages.push_back(m);
+      i += length;
+    }
+  }
+};
+
+int main(void)
+{
+  for (uint32_t interval : { 7500u, 15000u, 30000u }) {
+    for (uint16_t mtu : { 23, 185 }) {
+      sent_packets.clear();
+      MIDI_BLE_Packetizer packetizer;
+      packetizer.setSender(sender, nullptr);
+      packetizer.setMTU(mtu);
+      packetizer.setConnectionInterval(interval);
+
+      // 10秒分: 125msec毎に4音の和音 (ノートオン/オフ)、1秒おきに5msec毎のピッチベンド、2秒毎のSysEx
+      struct event_t { uint32_t usec; message_t message; };
+      std::vector<event_t> events;
+      for (uint32_t t = 0; t < 10000000; t += 125000) {
+        for (int k = 0; k < 4; ++k) {
+          events.push_back({ t, { { 0x90, (uint8_t)(60 + k), 100 }, 0 } });
+          events.push_back({ t + 100000, { { 0x80, (uint8_t)(60 + k), 0 }, 0 } });
+        }
+      }
+      for (uint32_t t = 0; t < 10000000; t += 5000) {
+        if ((t / 1000000) & 1) { events.push_back({ t + 1234, { { 0xE0, (uint8_t)(t & 0x7F), 64 }, 0 } }); }
+      }
+      for (uint32_t t = 500000; t < 10000000; t += 2000000) {
+        message_t m { { 0xF0 }, 0 };
+        for (int k = 0; k < 60; ++k) { m.data.push_back(k); }
+        m.data.push_back(0xF7);
+        events.push_back({ t, m });
+      }
+      std::stable_sort(events.begin(), events.end(), [](const event_t& a, const event_t& b) { return a.usec < b.usec; });
+      for (auto& e : events) { e.message.timestamp = (e.usec / 1000) & 0x1FFF; }
+
+      // 1msec周期のタスクから積み、送出期限を確認する
+      size_t index = 0;
+      for (now_usec = 0; now_usec < 10100000; now_usec += 1000) {
+        while (index < events.size() && events[index].usec <= now_usec) {
+          auto& e = events[index++];
+          bool was_empty = packetizer.empty();
+          size_t count = sent_packets.size();
+          packetizer.add(e.message.data.data(), e.message.data.size(), e.usec / 1000, now_usec);
+          if (was_empty || count != sent_packets.size()) { pending_usec = now_usec; }
+        }
+        packetizer.process(now_usec);
+      }
+      packetizer.flush();
+
+      decoder_t decoder;
+      size_t size_max = 0;
+      uint32_t hold_max = 0;
+      for (auto& p : sent_packets) {
+        decoder.decode(p.data);
+        size_max = std::max(size_max, p.data.size());
+        hold_max = std::max(hold_max, p.hold_usec);
+      }
+      bool same = decoder.messages.size() == events.size();
+      for (size_t i = 0; same && i < events.size(); ++i) { same = decoder.messages[i] == events[i].message; }
+      printf("interval %5u usec mtu %3u: %zu packets, %zu messages, max packet %zu bytes, max hold %u usec\n",
+             interval, mtu, sent_packets.size(), decoder.messages.size(), size_max, hold_max);
+      TEST_CHECK(!decoder.error && !decoder.in_sysex);
+      TEST_CHECK(same);
+      TEST_CHECK(size_max <= packetizer.getPayloadSize());
+      // 保留時間は接続間隔の半分を、送出を確認する周期 (1msec) 以上超えないこと
+      TEST_CHECK(hold_max <= packetizer.getHoldUsec() + 1000);
+    }
+  }
+
+  return test_result();
+}
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// MIDI_BroadcastRing の配信、追い越された読み手の読み飛ばしと失われた数の報告を確認する
+
+#include "test_util.hpp"
+#include "midi_broadcast.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace midi_driver;
+
+int main(void)
+{
+  // 読み手毎に独立したカーソルで全メッセージを受け取る
+  {
+    static MIDI_BroadcastRing ring;
+    MIDI_BroadcastRing::cursor_t a = ring.getWriteCursor();
+    ring.push(0x90, 60, 100, 0x01);
+    ring.push(0xC3, 5, 0);
+    ring.push(0x40, 0, 0);  // ステータスバイトでないものは配信しない
+    ring.push(0x80, 60, 0, MIDI_BroadcastRing::all_port, 123456);  // 予定時刻も読み手へ渡る
+    MIDI_BroadcastRing::cursor_t b = ring.getWriteCursor();
+    MIDI_BroadcastRing::slot_t slot;
+    TEST_CHECK(ring.pop(a, &slot) && slot.length == 3 && slot.data[0] == 0x90 && slot.data[1] == 60 && slot.port_mask == 0x01);
+    TEST_CHECK(ring.pop(a, &slot) && slot.length == 2 && slot.data[0] == 0xC3 && slot.port_mask == MIDI_BroadcastRing::all_port);
+    TEST_CHECK(ring.pop(a, &slot) && slot.length == 3 && slot.data[0] == 0x80 && slot.event_usec == 123456);
+    TEST_CHECK(!ring.pop(a, &slot));
+    TEST_CHECK(!ring.pop(b, &slot));
+    TEST_CHECK(ring.getOverrunCount() == 0);
+  }
+
+  // 追い越された読み手は読めるところまで読み飛ばし、失われた数を報告する
+  {
+    static MIDI_BroadcastRing ring;
+    MIDI_BroadcastRing::cursor_t cursor = ring.getWriteCursor();
+    static constexpr const uint32_t pushed = MIDI_BroadcastRing::slot_count * 3;
+    for (uint32_t i = 0; i < pushed; ++i) { ring.push(0xB0, i & 0x7F, (i >> 7) & 0x7F); }
+    MIDI_BroadcastRing::slot_t slot;
+    uint32_t lost = 0;
+    uint32_t received = 0;
+    uint32_t first = UINT32_MAX;
+    while (ring.pop(cursor, &slot, &lost)) {
+      if (first == UINT32_MAX) { first = slot.data[1] | (slot.data[2] << 7); }
+      ++received;
+    }
+    TEST_CHECK(lost > 0 && lost + received == pushed);
+    TEST_CHECK(first == lost);
+    TEST_CHECK(ring.getOverrunCount() == 1);
+  }
+
+  // 書き手と複数の読み手を別スレッドで動かす。受け取ったメッセージは壊れておらず、
+  // 受け取った数と失われた数の合計が書き込んだ数と一致すること
+  {
+    static MIDI_BroadcastRing ring;
+    static constexpr const uint32_t total = 1000000;
+    static constexpr const int reader_count = 3;
+    std::atomic<bool> start { false };
+    std::atomic<bool> done { false };
+    struct stat_t { uint32_t received = 0, lost = 0, broken = 0, disorder = 0; };
+    std::vector<stat_t> stat(reader_count);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < reader_count; ++r) {
+      threads.emplace_back([r, &stat, &start, &done] {
+        MIDI_BroadcastRing::cursor_t cursor = 0;
+        MIDI_BroadcastRing::slot_t slot;
+        uint32_t expect = 0;
+        while (!start.load()) { std::this_thread::yield(); }
+        for (;;) {
+          uint32_t lost = stat[r].lost;
+          if (!ring.pop(cursor, &slot, &stat[r].lost)) {
+            if (done.load() && cursor == ring.getWriteCursor()) { break; }
+            std::this_thread::yield();
+            continue;
+          }
+          // data1/data2 に通し番号の下位14bitを、ステータスのチャンネルに検査用の値を入れている
+          uint32_t seq = slot.data[1] | (slot.data[2] << 7);
+          if (slot.length != 3 || (slot.data[0] & 0xF0) != 0xB0 || (slot.data[0] & 0x0F) != ((seq * 5) & 0x0F)) { ++stat[r].broken; }
+          // 失われた分を除き、通し番号が連続していること
+          expect += stat[r].lost - lost;
+          if (seq != (expect & 0x3FFF)) { ++stat[r].disorder; }
+          expect = seq + 1;
+          ++stat[r].received;
+          if (r == 2 && (stat[r].received % 1000) == 0) { std::this_thread::sleep_for(std::chrono::microseconds(500)); }
+        }
+      });
+    }
+    start = true;
+    for (uint32_t i = 0; i < total; ++i) {
+      uint32_t seq = i & 0x3FFF;
+      ring.push(0xB0 | ((seq * 5) & 0x0F), seq & 0x7F, seq >> 7);
+      if ((i & 63) == 0) { std::this_thread::yield(); }
+    }
+    done = true;
+    for (auto& t : threads) { t.join(); }
+    for (int r = 0; r < reader_count; ++r) {
+      printf("reader %d: received %u lost %u\n", r, stat[r].received, stat[r].lost);
+      TEST_CHECK(stat[r].broken == 0 && stat[r].disorder == 0);
+      TEST_CHECK(stat[r].received + stat[r].lost == total);
+    }
+  }
+
+  return test_result();
+}
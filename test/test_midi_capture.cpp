@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// 受信データを読み出した単位のまま記録したキャプチャを MIDI_CaptureReplayer で再生し、
+// トランスポートへ渡るデータが完全なメッセージ単位 (ランニングステータスを補い、
+// リアルタイムメッセージは単独) になっていることを確認する
+
+#include "test_util.hpp"
+#include "midi_capture.hpp"
+
+#include <stdio.h>
+#include <vector>
+
+using namespace midi_driver;
+
+namespace {
+
+using bytes_t = std::vector<uint8_t>;
+
+// addMessage の呼出し毎に受け取ったデータを記録する
+class message_log_transport_t : public MIDI_Transport {
+public:
+  bool begin(void) override { _connected = true; return true; }
+  void end(void) override { _connected = false; }
+  size_t read(uint8_t*, size_t) override { return 0; }
+  void addMessage(const uint8_t* data, size_t length) override { messages.push_back(bytes_t(data, data + length)); }
+  bool sendFlush(void) override { ++flush_count; return true; }
+  std::vector<bytes_t> messages;
+  uint32_t flush_count = 0;
+};
+
+}
+
+int main(void)
+{
+  const char* path = "test_midi_capture.kpmc";
+
+  // 読み出しの区切りがメッセージの区切りと一致しない受信データ
+  const std::vector<bytes_t> rx_chunks = {
+    { 0x90, 60 },                     // ノートオンの途中で区切られる
+    { 100, 62, 90, 0xB0 },            // ランニングステータスの続き、次のステータスで区切られる
+    { 1, 0xF8, 64, 11, 20 },          // コントロールチェンジの途中にクロック
+    { 0xF0, 0x7D, 0x01 },             // システムエクスクルーシブが複数の読み出しにまたがる
+    { 0x02, 0xFE, 0x03, 0xF7, 0xC1 }, // 途中にアクティブセンシング
+    { 5, 0x33, 0xF0, 0x7D, 0x90 },    // ステータスの無いデータは破棄。F7 の無いシステムエクスクルーシブ
+    { 64, 0 },
+  };
+  const std::vector<bytes_t> expect = {
+    { 0x90, 60, 100 },
+    { 0x90, 62, 90 },
+    { 0xF8 },
+    { 0xB0, 1, 64 },
+    { 0xB0, 11, 20 },
+    { 0xFE },
+    { 0xF0, 0x7D, 0x01, 0x02, 0x03, 0xF7 },
+    { 0xC1, 5 },
+    { 0xC1, 0x33 },
+    { 0xF0, 0x7D, 0xF7 },
+    { 0x90, 64, 0 },
+  };
+  // 送信データは送信したメッセージ単位で記録される
+  const bytes_t tx_message = { 0xB2, 7, 100 };
+
+  {
+    MIDI_CaptureWriter writer;
+    TEST_CHECK(writer.open(path));
+    for (auto& chunk : rx_chunks) {
+      writer.record(1, MIDI_Direction::rx, chunk.data(), chunk.size());
+      writer.record(1, MIDI_Direction::tx, tx_message.data(), tx_message.size());
+    }
+    // 別ポートの受信データはランニングステータスを引き継がない
+    const bytes_t other = { 10, 20 };
+    writer.record(2, MIDI_Direction::rx, other.data(), other.size());
+    TEST_CHECK(writer.getRecordCount() == rx_chunks.size() * 2 + 1);
+  }
+
+  { // 受信データのみ再生する
+    message_log_transport_t target;
+    MIDI_CaptureReplayer replayer;
+    MIDI_CaptureReplayer::config_t config;
+    config.speed = 0.0f;
+    replayer.setConfig(config);
+    MIDI_CaptureReplayer::report_t report;
+    TEST_CHECK(replayer.replay(path, &target, nullptr, &report));
+    TEST_CHECK(report.records == rx_chunks.size() + 1);
+    TEST_CHECK(target.messages == expect);
+    for (auto& m : target.messages) {
+      // どのメッセージもステータスから始まり、長さが揃っている
+      TEST_CHECK(!m.empty() && (m[0] & 0x80));
+      if (m[0] != 0xF0) { TEST_CHECK((int)m.size() == getDataByteLength(m[0]) + 1); }
+    }
+  }
+
+  { // 送信データのみ再生する
+    message_log_transport_t target;
+    MIDI_CaptureReplayer replayer;
+    MIDI_CaptureReplayer::config_t config;
+    config.speed = 0.0f;
+    config.use_rx = false;
+    config.use_tx = true;
+    replayer.setConfig(config);
+    TEST_CHECK(replayer.replay(path, &target));
+    TEST_CHECK(target.messages.size() == rx_chunks.size());
+    for (auto& m : target.messages) { TEST_CHECK(m == tx_message); }
+  }
+
+  remove(path);
+  return test_result();
+}
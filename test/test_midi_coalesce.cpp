@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// 31250bps の UART を模したトランスポートへ、連続的なコントローラの洪水とノートを MIDI_CoalesceQueue 経由で送り、
+// 間引きの有無でノートが回線へ出るまでの遅れを比べる。ノートの順序、スイッチ類の欠落なし、
+// コントローラの最終値が届くことも確認する
+
+#include "test_util.hpp"
+#include "midi_coalesce.hpp"
+#include "midi_tx_backlog.hpp"
+
+#include <stdlib.h>
+#include <vector>
+
+using namespace midi_driver;
+
+namespace {
+
+static constexpr const size_t queue_size = 64;
+static constexpr const uint32_t threshold_usec = 10000;
+static constexpr const uint32_t tick_usec = 1000;        // 送信タスクの処理周期
+static constexpr const uint32_t play_usec = 2000000;     // 演奏する時間
+static constexpr const uint32_t note_interval_usec = 50000;
+
+// 送信待ちを MIDI_TxBacklog で見積もる UART。各メッセージが回線へ出終わる時刻を記録する
+class uart_sim_transport_t : public MIDI_Transport {
+public:
+  struct sent_t {
+    uint8_t data[3];
+    uint8_t length;
+    uint32_t done_usec;
+    uint32_t event_usec;  // setEventTime で伝えられた予定時刻
+  };
+  uart_sim_transport_t(void) { _backlog.setBaudRate(31250); }
+  bool begin(void) override { _connected = true; _use_tx = true; return true; }
+  void end(void) override { _connected = false; }
+  size_t read(uint8_t*, size_t) override { return 0; }
+  void addMessage(const uint8_t* data, size_t length) override {
+    _backlog.add(length, now);
+    sent_t s = {};
+    for (size_t i = 0; i < length && i < 3; ++i) { s.data[i] = data[i]; }
+    s.length = length;
+    s.done_usec = now + _backlog.getDrainUsec(now);
+    s.event_usec = _event_usec;
+    sent.push_back(s);
+  }
+  void setEventTime(uint32_t usec) override { _event_usec = usec; }
+  bool sendFlush(void) override { return true; }
+  size_t getTxPendingBytes(void) const override { return _backlog.getPendingBytes(now); }
+  uint32_t getTxDrainUsec(uint32_t usec) const override { return _backlog.getDrainUsec(usec); }
+
+  uint32_t now = 0;
+  std::vector<sent_t> sent;
+private:
+  MIDI_TxBacklog _backlog;
+  uint32_t _event_usec = 0;
+};
+
+struct result_t {
+  uint32_t note_worst_usec = 0;   // ノートの生成から回線へ出終わるまでの最大値
+  uint32_t note_count = 0;
+  uint32_t order_error = 0;
+  uint32_t event_time_error = 0;  // 遅れて送信したノートに本来の予定時刻が伝わらなかった
+  uint32_t pedal_count = 0;
+  uint32_t final_value_error = 0;
+  uint32_t coalesce_count = 0;
+  uint32_t bytes = 0;
+};
+
+MIDI_BroadcastRing::slot_t makeMessage(uint8_t status, uint8_t data1, uint8_t data2, uint32_t event_usec)
+{
+  MIDI_BroadcastRing::slot_t m;
+  m.event_usec = event_usec;
+  m.length = getDataByteLength(status) + 1;
+  m.data[0] = status;
+  m.data[1] = data1;
+  m.data[2] = data2;
+  m.port_mask = MIDI_BroadcastRing::all_port;
+  return m;
+}
+
+result_t run(bool coalesce)
+{
+  uart_sim_transport_t transport;
+  MIDIDriver midi { &transport };
+  midi.begin();
+  MIDI_CoalesceQueue<queue_size> queue;
+  // 間引きなし : 送信待ちの量に関わらず常に直接送る
+  queue.setThreshold(coalesce ? threshold_usec : UINT32_MAX, coalesce ? 32 : SIZE_MAX);
+
+  struct note_t { uint8_t note; uint32_t event_usec; };
+  std::vector<note_t> notes;
+  uint8_t last_value[4][3] = {};   // チャンネル毎の CC1, CC11, ピッチベンド(MSB) の最新値
+  uint32_t pedal_sent = 0;
+
+  uint32_t t = 0;
+  for (; t < play_usec; t += tick_usec) {
+    transport.now = t;
+    // 4チャンネルでモジュレーション・エクスプレッション・ピッチベンドを毎周期送る (回線の約10倍の量)
+    for (uint8_t ch = 0; ch < 4; ++ch) {
+      uint8_t v = (t / tick_usec + ch * 17) & 0x7F;
+      queue.send(midi, makeMessage(0xB0 | ch, 1, v, t), t);
+      queue.send(midi, makeMessage(0xB0 | ch, 11, 127 - v, t), t);
+      queue.send(midi, makeMessage(0xE0 | ch, 0, v, t), t);
+      last_value[ch][0] = v;
+      last_value[ch][1] = 127 - v;
+      last_value[ch][2] = v;
+    }
+    if (t % note_interval_usec == 0) {
+      uint8_t note = 36 + (notes.size() % 48);
+      queue.send(midi, makeMessage(0x90, note, 100, t), t);
+      queue.send(midi, makeMessage(0xB0, 64, (notes.size() & 1) ? 0 : 127, t), t);
+      ++pedal_sent;
+      notes.push_back({ note, t });
+    }
+    queue.process(midi, t);
+  }
+  // 演奏を止めた後、待ち行列が空になるまで送る
+  while (!queue.empty()) {
+    transport.now = t;
+    queue.process(midi, t);
+    uint32_t wait = queue.getDrainWaitUsec(midi, t);
+    t += wait ? wait : 1;
+  }
+
+  result_t r;
+  r.coalesce_count = queue.getCoalesceCount();
+  uint8_t final_value[4][3] = {};
+  for (auto& s : transport.sent) {
+    r.bytes += s.length;
+    uint8_t ch = s.data[0] & 0x0F;
+    switch (s.data[0] & 0xF0) {
+    case 0x90:
+      if (r.note_count >= notes.size() || notes[r.note_count].note != s.data[1]) {
+        ++r.order_error;
+      } else {
+        uint32_t latency = s.done_usec - notes[r.note_count].event_usec;
+        if (r.note_worst_usec < latency) { r.note_worst_usec = latency; }
+        if (s.event_usec != notes[r.note_count].event_usec) { ++r.event_time_error; }
+      }
+      ++r.note_count;
+      break;
+    case 0xB0:
+      if (s.data[1] == 64) { ++r.pedal_count; }
+      if (s.data[1] == 1) { final_value[ch][0] = s.data[2]; }
+      if (s.data[1] == 11) { final_value[ch][1] = s.data[2]; }
+      break;
+    case 0xE0:
+      final_value[ch][2] = s.data[2];
+      break;
+    default:
+      break;
+    }
+  }
+  for (int ch = 0; ch < 4; ++ch) {
+    for (int i = 0; i < 3; ++i) {
+      if (final_value[ch][i] != last_value[ch][i]) { ++r.final_value_error; }
+    }
+  }
+  TEST_CHECK(r.pedal_count == pedal_sent);
+  TEST_CHECK(r.note_count == notes.size());
+  return r;
+}
+
+}
+
+int main(void)
+{
+  auto direct = run(false);
+  auto coalesced = run(true);
+  printf("without coalescing: note latency worst %6.1f msec, %u bytes\n", direct.note_worst_usec / 1000.0, direct.bytes);
+  printf("with coalescing   : note latency worst %6.1f msec, %u bytes, %u messages coalesced\n",
+         coalesced.note_worst_usec / 1000.0, coalesced.bytes, coalesced.coalesce_count);
+
+  for (auto& r : { direct, coalesced }) {
+    TEST_CHECK(r.order_error == 0);
+    TEST_CHECK(r.event_time_error == 0);
+    TEST_CHECK(r.final_value_error == 0);
+  }
+  // 間引きなしでは送信待ちが積み上がり、ノートは演奏時間の大半だけ遅れる
+  TEST_CHECK(direct.coalesce_count == 0);
+  TEST_CHECK(direct.note_worst_usec > play_usec / 2);
+  // 間引きありでは、閾値分の送信待ちに、待ち行列に残り得るコントローラ(4ch x 3種)とノート・ペダルの送出時間を加えた範囲に収まる
+  const uint32_t bound = threshold_usec + (4 * 3 + 2) * 3 * 320 + tick_usec * 2;
+  TEST_CHECK(coalesced.coalesce_count > 0);
+  TEST_CHECK(coalesced.note_worst_usec <= bound);
+
+  return test_result();
+}
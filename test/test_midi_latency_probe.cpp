@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// ループバック接続した2つのトランスポートの一方で MIDI_LatencyProbe を動かし、もう一方を
+// 一定時間後に受信データを送り返す機器として、測定した往復時間が与えた遅延と一致することを確認する。
+// 応答の欠落・待ち時間を過ぎた応答・プローブ以外のメッセージの混在も確認する
+
+#include "test_util.hpp"
+#include "midi_driver.hpp"
+#include "midi_transport_loopback.hpp"
+#include "midi_latency_probe.hpp"
+
+#include <random>
+#include <vector>
+
+using namespace midi_driver;
+
+namespace {
+
+static constexpr const uint8_t probe_count = 8;
+static constexpr const uint32_t timeout_usec = 500000;
+
+// 折り返し側の機器の振る舞い
+struct echo_config_t {
+  uint32_t delay_usec;       // 受信から送り返すまでの時間 (片道分の遅延の2倍に相当)
+  uint32_t jitter_usec;      // delay_usec に加える 0~jitter_usec の揺れ
+  int drop_index;            // この番号の応答を送り返さない (-1 は欠落なし)
+  int late_index;            // この番号の応答を待ち時間より後に送り返す (-1 はなし)
+  bool extra_traffic;        // プローブ以外のメッセージを混ぜる
+};
+
+struct measure_t {
+  MIDI_LatencyProbe::result_t result;
+  std::vector<uint32_t> expect_rtt;   // 折り返し側で与えた往復時間 (応答が間に合ったもの)
+  int other_messages = 0;             // プローブ以外として受け取ったメッセージ
+};
+
+measure_t measure(const echo_config_t& config)
+{
+  MIDI_Transport_Loopback host_transport;
+  MIDI_Transport_Loopback device_transport;
+  MIDI_Transport_Loopback::connect(&host_transport, &device_transport);
+  MIDIDriver host { &host_transport };
+  MIDIDriver device { &device_transport };
+  host.begin();
+  device.begin();
+  host.setUseTxRx(true, true);
+  device.setUseTxRx(true, true);
+
+  MIDI_LatencyProbe probe;
+  probe.setup(probe_count, timeout_usec);
+  probe.start();
+
+  struct echo_t { uint32_t due; uint8_t status; uint8_t data1; uint8_t data2; };
+  std::vector<echo_t> echo;
+  std::mt19937 rng(7);
+  measure_t res;
+  int probe_index = 0;
+  uint32_t now = 0xFFFFFFFFu - 1000000u;   // 途中で32bitの時刻が一周する
+
+  for (int step = 0; step < 100000; ++step) {
+    // 折り返し側 : 受信したメッセージを遅延させて送り返す
+    MIDI_Message message;
+    while (device.receiveMessage(&message)) {
+      int index = probe_index - 1;
+      if (index == config.drop_index) { continue; }
+      uint32_t delay = config.delay_usec + (config.jitter_usec ? rng() % (config.jitter_usec + 1) : 0);
+      if (index == config.late_index) {
+        delay = timeout_usec + 100000;
+      } else {
+        res.expect_rtt.push_back(delay);
+      }
+      echo.push_back({ now + delay, message.status, message.data[0], message.data[1] });
+      if (config.extra_traffic) {
+        echo.push_back({ now + delay / 2, 0x90, 60, 100 });
+      }
+    }
+    for (size_t i = 0; i < echo.size();) {
+      if ((int32_t)(echo[i].due - now) <= 0) {
+        device.sendMessage(echo[i].status, echo[i].data1, echo[i].data2);
+        echo.erase(echo.begin() + i);
+      } else {
+        ++i;
+      }
+    }
+    device.sendFlush();
+
+    // 測定側 : 受信時刻で応答を照合し、次のプローブを送る
+    while (host.receiveMessage(&message)) {
+      if (!probe.checkMessage(message.status, message.data.size(), message.data.data(), now)) {
+        ++res.other_messages;
+      }
+    }
+    auto ev = probe.process(now);
+    if (ev == MIDI_LatencyProbe::ev_done) { break; }
+    if (ev == MIDI_LatencyProbe::ev_send) {
+      host.sendMessage(MIDI_LatencyProbe::probe_status, probe.getSeq(), MIDI_LatencyProbe::probe_marker);
+      host.sendFlush();
+      ++probe_index;
+      continue;   // 送信したデータを折り返し側が同じ時刻に受け取る
+    }
+
+    // 次の処理時刻まで進める
+    uint32_t wait = probe.getWaitUsec(now);
+    for (auto& e : echo) {
+      uint32_t d = e.due - now;
+      if (wait > d) { wait = d; }
+    }
+    now += wait;
+  }
+  res.result = probe.getResult();
+  return res;
+}
+
+}
+
+int main(void)
+{
+  { // 一定の遅延
+    auto m = measure({ 6000, 0, -1, -1, false });
+    auto& r = m.result;
+    printf("fixed: rtt min %u avg %u max %u usec (%d/%d)\n", r.rtt_min, r.rtt_avg, r.rtt_max, r.received, r.sent);
+    TEST_CHECK(r.sent == probe_count && r.received == probe_count);
+    TEST_CHECK(r.rtt_min == 6000 && r.rtt_avg == 6000 && r.rtt_max == 6000);
+    TEST_CHECK(!m.other_messages);
+  }
+
+  { // 揺れのある遅延とプローブ以外のメッセージ
+    auto m = measure({ 4000, 4000, -1, -1, true });
+    auto& r = m.result;
+    uint32_t sum = 0, min = UINT32_MAX, max = 0;
+    for (auto rtt : m.expect_rtt) {
+      sum += rtt;
+      if (min > rtt) { min = rtt; }
+      if (max < rtt) { max = rtt; }
+    }
+    printf("jitter: rtt min %u avg %u max %u usec (%d/%d)\n", r.rtt_min, r.rtt_avg, r.rtt_max, r.received, r.sent);
+    TEST_CHECK(r.received == probe_count);
+    TEST_CHECK(r.rtt_min == min && r.rtt_max == max && r.rtt_avg == sum / probe_count);
+    TEST_CHECK(m.other_messages == probe_count);
+  }
+
+  { // 応答の欠落と、待ち時間を過ぎてから届いた応答は数えない
+    auto m = measure({ 3000, 0, 2, 5, false });
+    auto& r = m.result;
+    printf("lost: rtt min %u avg %u max %u usec (%d/%d)\n", r.rtt_min, r.rtt_avg, r.rtt_max, r.received, r.sent);
+    TEST_CHECK(r.sent == probe_count && r.received == probe_count - 2);
+    TEST_CHECK(r.rtt_min == 3000 && r.rtt_max == 3000);
+    TEST_CHECK(!m.other_messages);
+  }
+
+  { // 測定中でなくてもプローブは入力として扱わない。プローブ以外は通す
+    MIDI_LatencyProbe probe;
+    const uint8_t probe_data[2] = { 1, MIDI_LatencyProbe::probe_marker };
+    const uint8_t other_data[2] = { 1, 0x10 };
+    TEST_CHECK(probe.checkMessage(MIDI_LatencyProbe::probe_status, 2, probe_data, 0));
+    TEST_CHECK(!probe.checkMessage(MIDI_LatencyProbe::probe_status, 2, other_data, 0));
+    TEST_CHECK(!probe.checkMessage(0xA0, 2, probe_data, 0));
+    TEST_CHECK(probe.process(0) == MIDI_LatencyProbe::ev_none);
+    TEST_CHECK(probe.getWaitUsec(0) == UINT32_MAX);
+  }
+
+  return test_result();
+}
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// MIDI_ByteRing の折り返し・溢れの扱いと、書込み側/読出し側を別スレッドで動かした場合の整合を確認する
+
+#include "test_util.hpp"
+#include "midi_driver.hpp"
+
+#include <thread>
+
+using namespace midi_driver;
+
+int main(void)
+{
+  // 溢れ: 全量を書き込めない場合は何も書き込まない
+  {
+    static MIDI_ByteRing<16> ring;
+    uint8_t data[16];
+    for (int i = 0; i < 16; ++i) { data[i] = i; }
+    TEST_CHECK(ring.push(data, 10));
+    TEST_CHECK(!ring.push(data, 7));
+    TEST_CHECK(ring.getOverflowCount() == 1 && ring.getFreeSize() == 6);
+    TEST_CHECK(ring.getHighWater() == 10);
+    uint8_t buf[16];
+    TEST_CHECK(ring.pop(buf, 4) == 4 && buf[0] == 0 && buf[3] == 3);
+    // 折り返しを跨いで書き込む
+    TEST_CHECK(ring.reserve(10));
+    ring.write(data, 3);
+    ring.write(data + 3, 7);
+    TEST_CHECK(ring.pop(buf, 16) == 6);  // commit 前の分は読めない
+    ring.commit();
+    TEST_CHECK(ring.pop(buf, 16) == 10 && buf[0] == 0 && buf[9] == 9);
+    TEST_CHECK(!ring.reserve(17) && ring.getOverflowCount() == 2);
+    TEST_CHECK(ring.push(data, 3));
+    ring.clear();
+    TEST_CHECK(ring.pop(buf, 16) == 0 && ring.getFreeSize() == 16);
+    // 未読データ量の最大値
+    TEST_CHECK(ring.getHighWater() == 10);
+    ring.resetHighWater();
+    TEST_CHECK(ring.push(data, 3) && ring.push(data, 2));
+    TEST_CHECK(ring.getHighWater() == 5);
+  }
+
+  // 書込み側/読出し側を別スレッドで動かし、バイト列が欠けずに順に届くこと
+  {
+    static MIDI_ByteRing<1024> ring;
+    static constexpr const uint32_t total = 1000000;
+    std::thread producer([] {
+      uint8_t seq = 0;
+      uint32_t sent = 0;
+      while (sent < total) {
+        uint8_t data[7];
+        size_t length = 1 + (sent % 7);
+        if (length > total - sent) { length = total - sent; }
+        for (size_t i = 0; i < length; ++i) { data[i] = seq + i; }
+        if (!ring.reserve(length)) { std::this_thread::yield(); continue; }
+        ring.write(data, length / 2);
+        ring.write(data + length / 2, length - length / 2);
+        ring.commit();
+        seq += length;
+        sent += length;
+      }
+    });
+    uint8_t expect = 0;
+    uint32_t received = 0;
+    uint32_t mismatch = 0;
+    uint8_t buf[64];
+    while (received < total) {
+      size_t length = ring.pop(buf, sizeof(buf));
+      for (size_t i = 0; i < length; ++i) {
+        if (buf[i] != expect) { ++mismatch; }
+        ++expect;
+      }
+      received += length;
+    }
+    producer.join();
+    printf("received %u bytes, %u retries on full\n", received, ring.getOverflowCount());
+    TEST_CHECK(mismatch == 0);
+  }
+
+  return test_result();
+}
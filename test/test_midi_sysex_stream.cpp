@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// 4MB のシステムエクスクルーシブを各トランスポートの受信経路 (ループバック、UART、USB-MIDI、BLE-MIDI) で
+// MIDIDriver へ通し、以下を確認する
+//  - 上限を外したハンドラへ全バイトが欠けずに順に届き、使用メモリはメッセージの長さに依らない
+//  - ハンドラ未登録 (上限 sysex_limit_default) では破棄して数え、後続のメッセージは失われない
+// USB と BLE は送信側のパケット化 (MIDI_USB_Packet / MIDI_BLE_Packetizer) と受信側の取り出しを実際のコードで行う
+
+#include "test_util.hpp"
+#include "midi_transport_loopback.hpp"
+#include "midi_usb_packet.hpp"
+#include "midi_ble_packetizer.hpp"
+
+#include <atomic>
+#include <new>
+#include <random>
+#include <vector>
+
+#include <stdlib.h>
+
+using namespace midi_driver;
+
+// 確保中のヒープ量を数える
+static std::atomic<size_t> heap_live { 0 };
+static std::atomic<size_t> heap_peak { 0 };
+
+void* operator new(size_t size)
+{
+  auto p = (size_t*)malloc(size + sizeof(max_align_t));
+  if (p == nullptr) { throw std::bad_alloc(); }
+  *p = size;
+  size_t live = heap_live.fetch_add(size) + size;
+  size_t peak = heap_peak.load();
+  while (live > peak && !heap_peak.compare_exchange_weak(peak, live)) {}
+  return (uint8_t*)p + sizeof(max_align_t);
+}
+void operator delete(void* ptr) noexcept
+{
+  if (ptr == nullptr) { return; }
+  auto p = (size_t*)((uint8_t*)ptr - sizeof(max_align_t));
+  heap_live.fetch_sub(*p);
+  free(p);
+}
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+
+namespace {
+
+static constexpr const size_t dump_size = 4 << 20;
+
+// 受信バッファ (実機の各トランスポートと同じ1024バイト) を持つトランスポート
+// 送信側は空きが無い間、受信側の MIDIDriver に読み出させてから書き込む (フロー制御)
+class link_transport_t : public MIDI_Transport {
+public:
+  bool begin(void) override { _connected = true; _use_rx = true; return true; }
+  void end(void) override { _connected = false; }
+  void addMessage(const uint8_t*, size_t) override {}
+  bool sendFlush(void) override { return true; }
+  size_t read(uint8_t* data, size_t length) override {
+    if (!usb) { return ring.pop(data, length); }
+    size_t result = 0;
+    uint8_t packet[MIDI_USB_Packet::packet_size];
+    while (result + 3 <= length && ring.pop(packet, sizeof(packet)) == sizeof(packet)) {
+      result += MIDI_USB_Packet::decode(packet, &data[result]);
+    }
+    return result;
+  }
+  void waitSpace(size_t length) {
+    while (ring.getFreeSize() < length) { receiver->receive(); }
+  }
+
+  MIDI_ByteRing<1024> ring;
+  MIDIDriver* receiver = nullptr;
+  bool usb = false;
+};
+
+// ハンドラが受け取った内容
+struct sink_t {
+  uint64_t bytes = 0;
+  uint32_t hash = 0;
+  uint32_t starts = 0;
+  uint32_t ends = 0;
+  uint32_t aborts = 0;
+  uint32_t calls = 0;
+  size_t max_chunk = 0;
+  static void handler(void* context, const uint8_t* data, size_t length, uint8_t flags) {
+    auto me = (sink_t*)context;
+    ++me->calls;
+    if (flags & sysex_start) { ++me->starts; }
+    if (flags & sysex_end) { ++me->ends; }
+    if (flags & sysex_abort) { ++me->aborts; }
+    if (me->max_chunk < length) { me->max_chunk = length; }
+    for (size_t i = 0; i < length; ++i) { me->hash = me->hash * 31 + data[i]; }
+    me->bytes += length;
+  }
+};
+
+enum class kind_t { loopback, uart, usb, ble };
+const char* kind_name[] = { "loopback", "uart", "usb", "ble" };
+
+struct result_t {
+  sink_t sink;
+  uint32_t drop_count = 0;
+  bool note_received = false;
+  size_t heap_growth = 0;
+};
+
+// dump を送り、続けてノートオンを送る
+result_t run(kind_t kind, const std::vector<uint8_t>& dump, bool use_handler)
+{
+  static const uint8_t note_on[] = { 0x90, 60, 100 };
+  result_t res;
+
+  link_transport_t link;
+  MIDI_Transport_Loopback loop_tx, loop_rx;
+  MIDI_Transport* rx_transport = &link;
+  if (kind == kind_t::loopback) {
+    MIDI_Transport_Loopback::connect(&loop_tx, &loop_rx);
+    loop_tx.setUseTxRx(true, false);
+    loop_rx.setUseTxRx(false, true);
+    rx_transport = &loop_rx;
+  }
+  MIDIDriver receiver { rx_transport };
+  receiver.begin();
+  link.begin();
+  link.receiver = &receiver;
+  link.usb = (kind == kind_t::usb);
+  if (use_handler) {
+    receiver.setSysExHandler(sink_t::handler, &res.sink);
+    receiver.setSysExLimit(0);
+  }
+
+  size_t heap_base = heap_live.load();
+  heap_peak.store(heap_base);
+
+  std::mt19937 rng(kind == kind_t::uart ? 7 : 11);
+  switch (kind) {
+  case kind_t::loopback:
+    // 送信側が受信側のリングへ直接書き込むため、受信側が読み出せる量ずつ送る
+    for (size_t pos = 0; pos < dump.size();) {
+      size_t n = dump.size() - pos;
+      if (n > 1000) { n = 1000; }
+      loop_tx.addMessage(&dump[pos], n);
+      loop_tx.sendFlush();
+      receiver.receive();
+      pos += n;
+    }
+    loop_tx.addMessage(note_on, sizeof(note_on));
+    loop_tx.sendFlush();
+    TEST_CHECK(loop_rx.getRxOverflowCount() == 0);
+    break;
+
+  case kind_t::uart:
+    // UART はバイト列がそのまま届く。読み出し単位は不揃い
+    for (size_t pos = 0; pos < dump.size();) {
+      size_t n = 1 + rng() % 120;
+      if (n > dump.size() - pos) { n = dump.size() - pos; }
+      link.waitSpace(n);
+      link.ring.push(&dump[pos], n);
+      pos += n;
+    }
+    link.waitSpace(sizeof(note_on));
+    link.ring.push(note_on, sizeof(note_on));
+    break;
+
+  case kind_t::usb:
+    {
+      auto emit = [&](const uint8_t* packet) {
+        link.waitSpace(MIDI_USB_Packet::packet_size);
+        link.ring.push(packet, MIDI_USB_Packet::packet_size);
+      };
+      MIDI_USB_Packet::encode(dump.data(), dump.size(), emit);
+      MIDI_USB_Packet::encode(note_on, sizeof(note_on), emit);
+    }
+    break;
+
+  case kind_t::ble:
+    {
+      MIDI_BLE_Packetizer packetizer;
+      packetizer.setMTU(247);
+      packetizer.setSender([](void* context, const uint8_t* data, size_t length) {
+        auto l = (link_transport_t*)context;
+        l->waitSpace(length);
+        TEST_CHECK(MIDI_BLE_Packetizer::unpack(data, length, l->ring));
+      }, &link);
+      packetizer.add(dump.data(), dump.size(), 1000, 0);
+      packetizer.add(note_on, sizeof(note_on), 1001, 0);
+      packetizer.flush();
+    }
+    break;
+  }
+
+  MIDI_Message message;
+  while (receiver.receiveMessage(&message)) {
+    if (message.status == 0x90 && message.data.size() == 2 && message.data[0] == 60 && message.data[1] == 100) {
+      res.note_received = true;
+    }
+  }
+  res.heap_growth = heap_peak.load() - heap_base;
+  res.drop_count = receiver.getSysExDropCount();
+  TEST_CHECK(link.ring.getOverflowCount() == 0);
+  return res;
+}
+
+}
+
+int main(void)
+{
+  std::vector<uint8_t> dump(dump_size);
+  std::mt19937 rng(1);
+  for (auto& d : dump) { d = rng() & 0x7F; }
+  dump.front() = 0xF0;
+  dump.back() = 0xF7;
+  uint32_t expect_hash = 0;
+  for (size_t i = 1; i + 1 < dump.size(); ++i) { expect_hash = expect_hash * 31 + dump[i]; }
+  const size_t body_size = dump.size() - 2;
+
+  for (auto kind : { kind_t::loopback, kind_t::uart, kind_t::usb, kind_t::ble }) {
+    auto streamed = run(kind, dump, true);
+    auto dropped = run(kind, dump, false);
+    printf("%-8s: handler %llu bytes in %u chunks, heap +%zu bytes / no handler %u dropped, heap +%zu bytes\n",
+           kind_name[(int)kind], (unsigned long long)streamed.sink.bytes, streamed.sink.calls, streamed.heap_growth,
+           dropped.drop_count, dropped.heap_growth);
+
+    // 上限を外したハンドラへは全量が1つのメッセージとして届く
+    TEST_CHECK(streamed.sink.bytes == body_size);
+    TEST_CHECK(streamed.sink.hash == expect_hash);
+    TEST_CHECK(streamed.sink.starts == 1 && streamed.sink.ends == 1 && streamed.sink.aborts == 0);
+    TEST_CHECK(streamed.sink.max_chunk <= 64);
+    TEST_CHECK(streamed.drop_count == 0);
+    TEST_CHECK(streamed.note_received);
+
+    // ハンドラ未登録では上限を超えた時点で破棄する
+    TEST_CHECK(dropped.drop_count == 1);
+    TEST_CHECK(dropped.note_received);
+
+    // どちらも使用メモリはメッセージの長さに比例しない (送受信の作業領域のみ)
+    TEST_CHECK(streamed.heap_growth < 16 * 1024);
+    TEST_CHECK(dropped.heap_growth < 16 * 1024);
+  }
+
+  return test_result();
+}
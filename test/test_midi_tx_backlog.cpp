@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// 通信速度の限られた UART (ドライバの送信リングバッファ + ハードウェアFIFO、1バイトずつ一定速度で送出) を
+// バイト単位で模し、MIDI_TxBacklog の送信待ちの見積もりと比べる
+//  - 演奏 (密なストラムと散発的なメッセージ) を書き込み、バッファが満杯の間は書込みが待たされる
+//  - 任意の時刻で、残りバイト数は1バイト以内、送出し終わるまでの時間は1バイトの送出時間以内で一致すること
+//  - 時刻の周回 (usec x256 が約16秒で一周) を跨いでも見積もりが崩れないこと
+
+#include "test_util.hpp"
+#include "midi_tx_backlog.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <random>
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+using namespace midi_driver;
+
+namespace {
+
+// バイト単位の UART。時刻は double の usec で扱い、丸めを含まない
+class uart_sim_t {
+public:
+  uart_sim_t(uint32_t baud_rate, size_t capacity)
+  : _byte_usec { 10.0 * 1000000.0 / baud_rate }
+  , _capacity { capacity }
+  {}
+
+  // bytes バイトを書き込む。空きが無い間は待たされ、全量を書き込み終えた時刻を返す (uart_write_bytes 相当)
+  double write(size_t bytes, double now) {
+    for (size_t i = 0; i < bytes; ++i) {
+      update(now);
+      if (_done.size() >= _capacity) {
+        // 先頭のバイトが送出し終わり、空きができるまで待つ
+        now = _done.front();
+        update(now);
+      }
+      double start = _done.empty() ? now : std::max(now, _done.back());
+      _done.push_back(start + _byte_usec);
+    }
+    return now;
+  }
+
+  // 送出し終わっていないバイト数
+  size_t getPendingBytes(double now) {
+    update(now);
+    return _done.size();
+  }
+
+  // 全て送出し終わるまでの時間
+  double getDrainUsec(double now) {
+    update(now);
+    return _done.empty() ? 0.0 : _done.back() - now;
+  }
+
+private:
+  void update(double now) {
+    while (!_done.empty() && _done.front() <= now) { _done.pop_front(); }
+  }
+
+  double _byte_usec;
+  size_t _capacity;
+  std::deque<double> _done;   // 各バイトの送出が終わる時刻
+};
+
+struct result_t {
+  uint32_t queries = 0;
+  uint32_t blocked_writes = 0;
+  size_t max_pending = 0;
+  int max_byte_error = 0;
+  double max_usec_error = 0;
+};
+
+// start_usec から duration_usec の間、演奏を書き込みながら見積もりを確かめる
+result_t run(uint32_t baud_rate, uint32_t start_usec, uint32_t duration_usec)
+{
+  static constexpr const size_t capacity = 144 + 128;   // 送信リングバッファ + ハードウェアFIFO
+  uart_sim_t sim { baud_rate, capacity };
+  MIDI_TxBacklog backlog;
+  backlog.setBaudRate(baud_rate);
+  backlog.clear(start_usec);
+
+  std::mt19937 rng(baud_rate);
+  result_t r;
+  // 時刻はシミュレーション上 start_usec から単調に増える。MIDI_TxBacklog へは uint32_t に丸めて渡す
+  double now = start_usec;
+  double end = (double)start_usec + duration_usec;
+  auto check = [&](double t) {
+    uint32_t t32 = (uint32_t)(uint64_t)t;
+    double truth_usec = sim.getDrainUsec(t);
+    size_t truth_bytes = sim.getPendingBytes(t);
+    // 見積もりは整数 usec の時刻で行うため、比べる側も同じ時刻まで切り下げた分を考慮する
+    double est_usec = backlog.getDrainUsec(t32) - (t - floor(t));
+    int byte_error = abs((int)backlog.getPendingBytes(t32) - (int)truth_bytes);
+    double usec_error = fabs(est_usec - truth_usec);
+    if (r.max_byte_error < byte_error) { r.max_byte_error = byte_error; }
+    if (r.max_usec_error < usec_error) { r.max_usec_error = usec_error; }
+    if (r.max_pending < truth_bytes) { r.max_pending = truth_bytes; }
+    ++r.queries;
+  };
+
+  while (now < end) {
+    if (rng() % 4 == 0) {
+      // ストラム : 6弦分のノートオン (ランニングステータスで 1 + 2 x 6 バイト) を連続で、数回まとめて書き込む
+      int count = 1 + rng() % 24;
+      for (int i = 0; i < count; ++i) {
+        size_t bytes = 13;
+        double ret = sim.write(bytes, now);
+        if (ret > now) { ++r.blocked_writes; }
+        // 書込みが待たされた場合は戻った時点の時刻で積む (MIDI_Transport_UART::sendFlush と同じ)
+        now = ret;
+        backlog.add(bytes, (uint32_t)(uint64_t)now);
+        check(now);
+      }
+    } else {
+      // コントローラ等の散発的なメッセージ
+      size_t bytes = 2 + rng() % 2;
+      now = sim.write(bytes, now);
+      backlog.add(bytes, (uint32_t)(uint64_t)now);
+      check(now);
+    }
+    // 次の書込みまでの間にも何度か問い合わせる
+    double gap = (double)(rng() % 20000) + (rng() % 1000) / 1000.0;
+    for (int i = 1; i <= 4; ++i) { check(now + gap * i / 5); }
+    now += gap;
+  }
+  return r;
+}
+
+}
+
+int main(void)
+{
+  struct param_t { uint32_t baud_rate; uint32_t start_usec; };
+  // 31250bps (MIDI) と内部接続の高速な設定。それぞれ時刻の周回を跨ぐよう、周回の直前から始める場合も確かめる
+  const param_t params[] = {
+    { 31250, 0 },
+    { 31250, (UINT32_MAX >> 8) - 2000000 },
+    { 115200, 0 },
+    { 115200, (UINT32_MAX >> 8) - 2000000 },
+  };
+  for (auto& p : params) {
+    auto r = run(p.baud_rate, p.start_usec, 10000000);
+    double byte_usec = 10.0 * 1000000.0 / p.baud_rate;
+    printf("%6u bps, start %10u usec: %u queries, %u blocked writes, max pending %zu bytes, error max %d bytes / %.2f usec\n",
+           p.baud_rate, p.start_usec, r.queries, r.blocked_writes, r.max_pending, r.max_byte_error, r.max_usec_error);
+    // ストラムが続くとバッファが満杯になり、書込みが待たされる状況も含むこと
+    TEST_CHECK(r.blocked_writes > 0);
+    TEST_CHECK(r.max_byte_error <= 1);
+    TEST_CHECK(r.max_usec_error <= byte_usec);
+  }
+
+  return test_result();
+}
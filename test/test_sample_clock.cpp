@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// sample_clock_t をホストの時計とずれた仮想DMAクロックで進め、得られる時刻がCPUタイマではなく
+// DMAクロックに追従すること (ブロック間の補間を含めて1ブロック以内)、単調増加であること、
+// サンプリングレートの切替えや32bitの時刻の一周で途切れないことを確認する
+
+#include "test_util.hpp"
+#include "sample_clock.hpp"
+
+#include <stdlib.h>
+#include <atomic>
+#include <random>
+#include <thread>
+
+using namespace kanplay_ns;
+
+int main(void)
+{
+  { // DMAクロックへの追従
+    static constexpr const double drift_ppm = 300;
+    static constexpr const uint32_t frames = 48;
+    static constexpr const uint32_t jitter_max_usec = 200;  // ブロックの完了から publish までの遅れ
+    static constexpr const uint32_t host_start = 0xFFFFFFFFu - 30000000u;  // 途中で32bitの時刻が一周する
+    static constexpr const uint32_t query_usec[] = { 0, 300, 800 };
+
+    static sample_clock_t clock;
+    std::mt19937 rng(1);
+    uint32_t rate = def::audio::sample_rate_reference;
+    double host_pos_usec = 0;   // ホストの時計での経過時間
+    uint64_t sample_count = 0;
+    uint32_t prev_usec = 0;
+    bool first = true;
+    int32_t worst_error = 0;
+    uint32_t now = 0;
+    uint32_t usec = 0;
+    for (uint32_t block = 0; block < 90000; ++block) {
+      if (block == 45000) {
+        // 切替えの前後で時刻が連続すること
+        uint32_t before = clock.getUsec(now);
+        rate = 44100;
+        clock.setSampleRate(rate);
+        TEST_CHECK(clock.getSampleRate() == rate);
+        TEST_CHECK(clock.getUsec(now) - before <= 1);
+      }
+      double dma_hz = rate * (1.0 + drift_ppm * 1e-6);
+      host_pos_usec += frames * 1e6 / dma_hz;
+      sample_count += frames;
+      uint32_t publish_usec = host_start + (uint32_t)host_pos_usec + rng() % jitter_max_usec;
+      clock.publish(frames, publish_usec);
+      TEST_CHECK(clock.getSampleCount() == sample_count);
+
+      for (auto q : query_usec) {
+        now = publish_usec + q;
+        usec = clock.getUsec(now);
+        if (!first) { TEST_CHECK((int32_t)(usec - prev_usec) >= 0); }
+        first = false;
+        prev_usec = usec;
+        // ホストの時計に対して drift_ppm だけ速く進む DMAクロックでの経過時間
+        double expect = ((double)(uint32_t)(now - host_start)) * (1.0 + drift_ppm * 1e-6);
+        int32_t error = (int32_t)(usec - (uint32_t)expect);
+        if (abs(error) > abs(worst_error)) { worst_error = error; }
+
+        // サンプル位置への変換は補間した分を含めて戻せること
+        uint64_t expect_sample = sample_count + (uint64_t)q * rate / 1000000;
+        int64_t sample_diff = (int64_t)(clock.usecToSample(usec) - expect_sample);
+        TEST_CHECK(sample_diff >= -2 && sample_diff <= 2);
+      }
+    }
+    uint32_t block_usec = frames * 1000000u / rate;
+    printf("sample clock: worst error %d usec (block %u usec)\n", worst_error, block_usec);
+    TEST_CHECK((uint32_t)abs(worst_error) <= block_usec + jitter_max_usec + 2);
+
+    // 90秒後、CPUタイマとの差は drift_ppm 分 (約27msec) となり、CPUタイマには追従していない
+    int32_t from_host = (int32_t)(usec - (uint32_t)(now - host_start));
+    printf("sample clock: %d usec ahead of host after %u sec\n", from_host, (uint32_t)(host_pos_usec / 1e6));
+    TEST_CHECK(abs(from_host - (int32_t)(host_pos_usec * drift_ppm * 1e-6)) <= (int32_t)(block_usec + jitter_max_usec + 2));
+
+    // 最新ブロックから一定時間以上経過したら停止とみなす
+    TEST_CHECK(clock.isRunning(now + 5000));
+    TEST_CHECK(!clock.isRunning(now + 50000));
+  }
+
+  { // 書込み中の読み出しでも、スナップショット内の値の組合せが崩れない
+    static sample_clock_t clock;
+    static constexpr const uint32_t total = 200000;
+    std::atomic<bool> done { false };
+    std::atomic<uint32_t> torn { 0 };
+    std::thread reader([&] {
+      while (!done.load()) {
+        auto snap = clock.getSnapshot();
+        if (snap.block_usec != (uint32_t)(snap.sample_count / 48) * 7) { ++torn; }
+      }
+    });
+    for (uint32_t i = 1; i <= total; ++i) {
+      clock.publish(48, i * 7);
+    }
+    done = true;
+    reader.join();
+    TEST_CHECK(torn.load() == 0);
+    TEST_CHECK(clock.getSampleCount() == (uint64_t)total * 48);
+  }
+
+  return test_result();
+}
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// Si5351 のPLL/分周比の計算と、サンプルレート切替え時の Si5351 / ES8388 のレジスタ書込みの順序を確認する
+// (M5Unified の代わりに I2C の書込みを記録するスタブを使う)
+
+#include "test_util.hpp"
+
+#include <M5Unified.h>
+#include "in_i2c/internal_si5351.hpp"
+#include "in_i2c/internal_es8388.hpp"
+#include "common_define.hpp"
+
+#include <math.h>
+
+mock_m5_t M5;
+const char* kanplay_ns::localize_text_t::get(void) const { return ""; }
+
+using namespace kanplay_ns;
+
+// レジスタ8バイトから a + b / c を復元する
+static double decode(const uint8_t* d)
+{
+  uint32_t p3 = ((d[5] & 0xF0) << 12) | (d[0] << 8) | d[1];
+  uint32_t p1 = ((d[2] & 3) << 16) | (d[3] << 8) | d[4];
+  uint32_t p2 = ((d[5] & 0x0F) << 16) | (d[6] << 8) | d[7];
+  return (p1 + 512 + (double)p2 / p3) / 128.0;
+}
+
+int main(void)
+{
+  // 従来の init のPLL設定 (48kHz用) が 6.144MHz となることを、復元の確認に使う
+  {
+    const uint8_t legacy_pll[] = { 0xFF, 0xFD, 0x00, 0x09, 0x26, 0xF7, 0x4F, 0x72 };
+    const uint8_t legacy_ms[] = { 0x00, 0x01, 0x00, 0x2F, 0x00, 0x00, 0x00, 0x00 };
+    double mclk = 27e6 * decode(legacy_pll) / decode(legacy_ms);
+    TEST_CHECK(fabs(mclk - 6144000) < 1);
+  }
+
+  // 全サンプルレートで VCO が範囲内、分周比が偶数の整数、MCLK の誤差が 1ppm 未満であること
+  for (int i = 0; i < def::audio::sr_max; ++i) {
+    uint32_t rate = def::audio::sample_rate_hz[i];
+    internal_si5351_t::ratio_t pll, ms;
+    TEST_CHECK(internal_si5351_t::calcClock(rate * 128, 27000000, pll, ms));
+    uint8_t p[8], m[8];
+    internal_si5351_t::encodeRatio(pll, p);
+    internal_si5351_t::encodeRatio(ms, m);
+    double vco = 27e6 * decode(p);
+    double mclk = vco / decode(m);
+    double ppm = (mclk / (rate * 128.0) - 1) * 1e6;
+    printf("rate %6u: pll %u+%u/%u ms %u vco %.3f MHz err %.3g ppm\n", rate, pll.a, pll.b, pll.c, ms.a, vco / 1e6, ppm);
+    TEST_CHECK(vco >= 600e6 && vco <= 900e6);
+    TEST_CHECK((ms.a & 1) == 0 && ms.b == 0);
+    TEST_CHECK(fabs(ppm) < 1);
+  }
+
+  // サンプルレート切替えのレジスタ書込みの順序
+  internal_si5351_t si5351;
+  internal_es8388_t es8388;
+  si5351.init(10, 27000000);
+  auto& log = M5.In_I2C.log;
+  log.clear();
+  // CLK0/CLK2 が停止している状態とし、切替え後もその状態を保つことを確認する
+  M5.In_I2C.read_value = 0x05;
+  es8388.beginClockChange();
+  M5.delay(def::audio::rate_switch_ramp_msec);
+  TEST_CHECK(si5351.setSampleRate(44100));
+  es8388.setSampleRate(44100);
+  M5.delay(def::audio::rate_switch_settle_msec);
+  es8388.endClockChange();
+  M5.In_I2C.read_value = 0;
+  for (auto& op : log) {
+    if (op.addr == 0xFF) { printf("  delay %u msec\n", op.data[0]); continue; }
+    printf("  %s reg %3u:", op.addr == 0x60 ? "si5351" : "es8388", op.reg);
+    for (auto b : op.data) { printf(" %02X", b); }
+    printf("\n");
+  }
+  // ES DACミュート → ADCミュート → 待ち → Si CLK1停止 → PLL → MS → PLLリセット → 出力再開 → ESリセット → 比率 → 解除 → 待ち → ミュート解除
+  static constexpr const uint8_t expect[][2] = {
+    { 0x10, 25 }, { 0x10, 15 }, { 0xFF, 0 }, { 0x60, 3 }, { 0x60, 26 }, { 0x60, 50 }, { 0x60, 177 }, { 0x60, 3 },
+    { 0x10, 2 }, { 0x10, 13 }, { 0x10, 24 }, { 0x10, 2 }, { 0xFF, 0 }, { 0x10, 15 }, { 0x10, 25 } };
+  TEST_CHECK(log.size() == sizeof(expect) / sizeof(expect[0]));
+  if (log.size() == sizeof(expect) / sizeof(expect[0])) {
+    for (size_t i = 0; i < log.size(); ++i) {
+      TEST_CHECK(log[i].addr == expect[i][0] && log[i].reg == expect[i][1]);
+    }
+    TEST_CHECK(log[3].data[0] == 0x07 && log[7].data[0] == 0x05);
+    TEST_CHECK(log[6].data[0] == 0x20);
+    TEST_CHECK(log[0].data[0] == 0x36 && log[14].data[0] == 0x32);
+  }
+
+  // I2C の書込みに失敗した場合は false を返し、元のレート (44.1kHz) の設定を書き戻す
+  log.clear();
+  M5.In_I2C.read_value = 0x05;
+  M5.In_I2C.fail_reg = 50;
+  M5.In_I2C.fail_count = 16;
+  TEST_CHECK(!si5351.setSampleRate(96000));
+  M5.In_I2C.read_value = 0;
+  TEST_CHECK(M5.In_I2C.fail_count == 0);
+  {
+    const uint8_t* pll = nullptr;
+    const uint8_t* ms = nullptr;
+    int pll_reset = 0;
+    for (auto& op : log) {
+      if (op.addr != 0x60) { continue; }
+      if (op.reg == 26) { pll = op.data.data(); }
+      if (op.reg == 50) { ms = op.data.data(); }
+      // MULTISYNTH1 を書き込めないまま PLL をリセットしない
+      if (op.reg == 177) { ++pll_reset; TEST_CHECK(ms != nullptr); }
+    }
+    TEST_CHECK(pll_reset == 1);
+    TEST_CHECK(pll != nullptr && ms != nullptr);
+    if (pll && ms) {
+      double mclk = 27e6 * decode(pll) / decode(ms);
+      TEST_CHECK(fabs(mclk - 44100 * 128) < 1);
+    }
+    TEST_CHECK(log.back().reg == 3 && log.back().data[0] == 0x05);
+  }
+  // 書き戻した後は新しいレートへ切り替えられる
+  TEST_CHECK(si5351.setSampleRate(48000));
+
+  // 96kHz は DAC も double speed とする
+  log.clear();
+  es8388.setSampleRate(96000);
+  TEST_CHECK(log.size() > 2 && log[2].reg == 24 && log[2].data[0] == 0x20);
+  log.clear();
+  es8388.setSampleRate(48000);
+  TEST_CHECK(log.size() > 2 && log[2].data[0] == 0x00);
+
+  return test_result();
+}
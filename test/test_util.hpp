@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+#ifndef KANPLAY_TEST_UTIL_HPP
+#define KANPLAY_TEST_UTIL_HPP
+
+// ホスト用単体テストの共通マクロ。失敗は数えて継続し、main の戻り値で ctest へ伝える
+
+#include <stdio.h>
+
+static int test_fail_count = 0;
+
+#define TEST_CHECK(cond) \
+  do { if (!(cond)) { ++test_fail_count; printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); } } while (0)
+
+static inline int test_result(void)
+{
+  printf(test_fail_count ? "FAIL (%d)\n" : "PASS\n", test_fail_count);
+  return test_fail_count ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 InstaChord Corp.
+
+// 複数パートの速いストロークを voice_manager_t へ流し、midi_out_control へ出力されたメッセージを
+// 音源の発音状態として再生して、同時発音数の上限・スティールの選び方・ノートオフの整合を確認する
+
+#include "test_util.hpp"
+#include "voice_manager.hpp"
+
+#include <M5Unified.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace kanplay_ns;
+
+mock_m5_t M5;
+
+namespace {
+
+struct trace_event_t {
+  uint32_t usec;
+  uint8_t part;
+  uint8_t midi_ch;
+  uint8_t note;
+  uint8_t velocity;   // 0 はノートオフ
+};
+
+// 6弦のストローク (5msec間隔) を各パートで繰り返す。一部の音は次のストロークより長く伸ばす
+std::vector<trace_event_t> makeStrumTrace(uint32_t seed, int strums)
+{
+  static constexpr const uint8_t chord[4][6] = {
+    { 40, 47, 52, 55, 59, 64 }, { 45, 52, 57, 61, 64, 69 },
+    { 38, 45, 50, 54, 57, 62 }, { 43, 47, 50, 55, 59, 67 } };
+  std::mt19937 rng(seed);
+  std::vector<trace_event_t> trace;
+  for (int s = 0; s < strums; ++s) {
+    for (uint8_t part = 0; part < 3; ++part) {
+      uint32_t start = s * 60000 + part * 1500;
+      auto& c = chord[(s + part) & 3];
+      for (int i = 0; i < 6; ++i) {
+        uint8_t note = c[i] + part * 12;
+        uint8_t velocity = 20 + rng() % 100;
+        uint32_t on = start + i * 5000;
+        uint32_t length = (rng() & 3) ? 55000 : 150000 + rng() % 100000;
+        trace.push_back({ on, part, part, note, velocity });
+        trace.push_back({ on + length, part, part, note, 0 });
+      }
+    }
+    // ドラムのボタン
+    trace.push_back({ s * 60000u + 700u, voice_manager_t::part_direct, 9, (uint8_t)(36 + (s & 1) * 2), 100 });
+    trace.push_back({ s * 60000u + 30000u, voice_manager_t::part_direct, 9, (uint8_t)(36 + (s & 1) * 2), 0 });
+  }
+  // 同時刻はノートオフを先にする
+  std::stable_sort(trace.begin(), trace.end(), [](const trace_event_t& a, const trace_event_t& b) {
+    return a.usec != b.usec ? a.usec < b.usec : (a.velocity == 0) > (b.velocity == 0);
+  });
+  return trace;
+}
+
+// midi_out_control の履歴を読み取る音源のモデル
+struct synth_model_t {
+  struct voice_t { uint8_t part; uint8_t velocity; uint32_t order; };
+  voice_t voice[16][128] = {};
+  bool sounding[16][128] = {};
+  uint32_t order = 0;
+  int active = 0;
+  int part_active[voice_manager_t::max_part] = {};
+  int orphan_note_off = 0;
+
+  struct message_t { uint8_t status, data1, data2; };
+  std::vector<message_t> drain(reg_midi_out_control_t& midi_out, registry_t::history_code_t& code) {
+    std::vector<message_t> res;
+    const registry_base_t::history_t* history;
+    while (nullptr != (history = midi_out.getHistory(code))) {
+      res.push_back({ (uint8_t)history->index, (uint8_t)(history->value & 0xFF), (uint8_t)(history->value >> 8) });
+    }
+    return res;
+  }
+  void noteOn(uint8_t ch, uint8_t note, uint8_t part, uint8_t velocity) {
+    if (sounding[ch][note]) {
+      --part_active[voice[ch][note].part];
+    } else {
+      sounding[ch][note] = true;
+      ++active;
+    }
+    ++part_active[part];
+    voice[ch][note] = { part, velocity, ++order };
+  }
+  void noteOff(uint8_t ch, uint8_t note) {
+    if (!sounding[ch][note]) { ++orphan_note_off; return; }
+    sounding[ch][note] = false;
+    --active;
+    --part_active[voice[ch][note].part];
+  }
+};
+
+struct result_t {
+  int max_active = 0;
+  int max_part_active = 0;
+  int steals = 0;
+  int wrong_victim = 0;
+  int orphan_note_off = 0;
+  int count_mismatch = 0;
+  int left_active = 0;
+  uint32_t steal_count = 0;
+};
+
+result_t replay(const std::vector<trace_event_t>& trace, uint8_t global_limit, uint8_t part_limit, def::play::voice_steal_policy_t policy)
+{
+  static reg_midi_out_control_t midi_out;
+  static bool initialized = false;
+  if (!initialized) { initialized = true; midi_out.init(); }
+
+  voice_manager_t vm;
+  vm.setOutput(&midi_out);
+  vm.setLimit(global_limit, part_limit);
+  vm.setPolicy(policy);
+  auto code = midi_out.getHistoryCode();
+  synth_model_t model;
+  result_t result;
+
+  for (auto& ev : trace) {
+    // 要求どおりのノートオフ以外 (スティール) の正しさを確認するため、処理前の状態を控える
+    auto before = model;
+    if (ev.velocity) {
+      vm.noteOn(ev.part, ev.midi_ch, ev.note, ev.velocity);
+    } else {
+      vm.noteOff(ev.midi_ch, ev.note);
+    }
+    for (auto& m : model.drain(midi_out, code)) {
+      uint8_t ch = m.status & 0x0F;
+      bool on = (m.status & 0xF0) == 0x90 && m.data2;
+      if (on) {
+        model.noteOn(ch, m.data1, ev.part, m.data2);
+        continue;
+      }
+      bool requested = (ev.velocity == 0 && ch == ev.midi_ch && m.data1 == ev.note);
+      if (!requested && model.sounding[ch][m.data1]) {
+        ++result.steals;
+        if (part_limit == 0) {
+          // 全パートの発音中の音から、ポリシーに従って選ばれていること
+          auto& victim = model.voice[ch][m.data1];
+          for (int c = 0; c < 16; ++c) {
+            for (int n = 0; n < 128; ++n) {
+              if (!before.sounding[c][n] || (c == ch && n == m.data1)) { continue; }
+              auto& v = before.voice[c][n];
+              bool better = false;
+              switch (policy) {
+              default:
+              case def::play::voice_steal_policy_t::steal_oldest:
+                better = v.order < victim.order;
+                break;
+              case def::play::voice_steal_policy_t::steal_quietest:
+                better = v.velocity < victim.velocity || (v.velocity == victim.velocity && v.order < victim.order);
+                break;
+              case def::play::voice_steal_policy_t::steal_same_pitch:
+                {
+                  bool v_same = (n == ev.note);
+                  bool r_same = (m.data1 == ev.note);
+                  better = (v_same != r_same) ? v_same : (v.order < victim.order);
+                }
+                break;
+              }
+              if (better) { ++result.wrong_victim; }
+            }
+          }
+        }
+      }
+      model.noteOff(ch, m.data1);
+    }
+    result.max_active = std::max(result.max_active, model.active);
+    for (auto p : model.part_active) { result.max_part_active = std::max(result.max_part_active, p); }
+    if (model.active != vm.getActiveCount()) { ++result.count_mismatch; }
+  }
+  result.orphan_note_off = model.orphan_note_off;
+  result.left_active = model.active;
+  result.steal_count = vm.getStealCount();
+  return result;
+}
+
+}
+
+int main(void)
+{
+  auto trace = makeStrumTrace(1, 200);
+
+  { // 上限なし (十分大きい) の場合はスティールしない
+    auto r = replay(trace, voice_manager_t::max_voice, 0, def::play::voice_steal_policy_t::steal_oldest);
+    TEST_CHECK(r.steals == 0 && r.steal_count == 0);
+    TEST_CHECK(r.orphan_note_off == 0 && r.count_mismatch == 0 && r.left_active == 0);
+    printf("no limit: max %d voices\n", r.max_active);
+  }
+
+  // 全体の上限のみ。ポリシー毎に選ばれたボイスを確認する
+  static constexpr const def::play::voice_steal_policy_t policies[] = {
+    def::play::voice_steal_policy_t::steal_oldest,
+    def::play::voice_steal_policy_t::steal_quietest,
+    def::play::voice_steal_policy_t::steal_same_pitch,
+  };
+  for (auto policy : policies) {
+    auto r = replay(trace, 8, 0, policy);
+    printf("global 8, policy %d: steals %d\n", policy, r.steals);
+    TEST_CHECK(r.max_active <= 8);
+    TEST_CHECK(r.steals > 0 && (uint32_t)r.steals == r.steal_count);
+    TEST_CHECK(r.wrong_victim == 0);
+    TEST_CHECK(r.orphan_note_off == 0 && r.count_mismatch == 0 && r.left_active == 0);
+  }
+
+  { // パート毎の上限と全体の上限の併用
+    auto r = replay(trace, 12, 4, def::play::voice_steal_policy_t::steal_oldest);
+    printf("global 12 / part 4: steals %d, max part %d\n", r.steals, r.max_part_active);
+    TEST_CHECK(r.max_active <= 12 && r.max_part_active <= 4);
+    TEST_CHECK(r.steals > 0 && (uint32_t)r.steals == r.steal_count);
+    TEST_CHECK(r.orphan_note_off == 0 && r.count_mismatch == 0 && r.left_active == 0);
+  }
+
+  { // 発音していない音へのノートオフは出力しない
+    static reg_midi_out_control_t midi_out;
+    midi_out.init();
+    voice_manager_t vm;
+    vm.setOutput(&midi_out);
+    auto code = midi_out.getHistoryCode();
+    vm.noteOff(0, 60);
+    TEST_CHECK(midi_out.getHistory(code) == nullptr);
+    // 同じ音の再発音はボイス数を増やさない
+    vm.noteOn(0, 0, 60, 100);
+    vm.noteOn(0, 0, 60, 90);
+    TEST_CHECK(vm.getActiveCount() == 1);
+    vm.resetChannel(0);
+    TEST_CHECK(vm.getActiveCount() == 0);
+  }
+
+  return test_result();
+}